@@ -10,7 +10,7 @@
 #include <stdio.h>
 
 
-char * usage = "%s numthreads numops\n";
+char * usage = "%s numthreads numops [hot]\n";
 
 stasis_log_t * l;
 
@@ -26,7 +26,7 @@ static void* worker(void* arg) {
 }
 
 int main(int argc, char * argv[]) {
-  if(argc != 3) { printf(usage, argv[0]); abort(); }
+  if(argc != 3 && argc != 4) { printf(usage, argv[0]); abort(); }
   char * endptr;
   unsigned long numthreads = strtoul(argv[1], &endptr, 10);
   if(*endptr != 0) { printf(usage, argv[0]); abort(); }
@@ -37,6 +37,11 @@ int main(int argc, char * argv[]) {
 
   Tinit();
 
+  if(argc == 4 && !strcmp(argv[3], "hot")) {
+    int err = setPageHot(0, 1);
+    if(err) { printf("setPageHot failed: %d\n", err); }
+  }
+
   for(int i = 0; i < numthreads; i++) {
     pthread_create(&workers[i], 0, worker, &numops);
   }
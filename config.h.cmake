@@ -9,6 +9,8 @@
 #cmakedefine HAVE_O_DIRECT
 #cmakedefine HAVE_O_DSYNC
 #cmakedefine HAVE_GCC_ATOMICS
+#cmakedefine HAVE_IO_URING
+#cmakedefine HAVE_MBIND
 #cmakedefine HAVE_PTHREAD_STACK_MIN
 #cmakedefine HAVE_ALLOCA_H
 #cmakedefine HAVE_TDESTROY
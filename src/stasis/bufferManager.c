@@ -165,6 +165,21 @@ Page * loadPageOfType(int xid, pageid_t pageid, pagetype_t type) {
   Page *p = bm->loadPageImpl(bm, 0, xid, pageid, type);
   return p;
 }
+void loadPages(int xid, const pageid_t * pageids, int count, Page ** pages) {
+  if(globalLockManager.readLockPage) {
+    for(int i = 0; i < count; i++) {
+      globalLockManager.readLockPage(xid, pageids[i]);
+    }
+  }
+  stasis_buffer_manager_t * bm = (stasis_buffer_manager_t *)stasis_runtime_buffer_manager();
+  if(bm->loadPagesImpl) {
+    bm->loadPagesImpl(bm, 0, xid, pageids, count, pages);
+  } else {
+    for(int i = 0; i < count; i++) {
+      pages[i] = bm->loadPageImpl(bm, 0, xid, pageids[i], UNKNOWN_TYPE_PAGE);
+    }
+  }
+}
 Page * loadUninitializedPage(int xid, pageid_t pageid) {
   // This lock is released at Tcommit()
   if(globalLockManager.readLockPage) { globalLockManager.readLockPage(xid, pageid); }
@@ -231,3 +246,14 @@ void releasePage(Page * p) {
   stasis_buffer_manager_t * bm = (stasis_buffer_manager_t *)stasis_runtime_buffer_manager();
   bm->releasePageImpl(bm, p);
 }
+void releasePages(Page ** pages, int count) {
+  stasis_buffer_manager_t * bm = (stasis_buffer_manager_t *)stasis_runtime_buffer_manager();
+  for(int i = 0; i < count; i++) {
+    bm->releasePageImpl(bm, pages[i]);
+  }
+}
+int setPageHot(pageid_t pageid, int hot) {
+  stasis_buffer_manager_t * bm = (stasis_buffer_manager_t *)stasis_runtime_buffer_manager();
+  if(!bm->setPageHotImpl) { return ENOTSUP; }
+  return bm->setPageHotImpl(bm, pageid, hot);
+}
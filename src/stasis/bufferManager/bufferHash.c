@@ -124,14 +124,18 @@ inline static Page * getFreePage(stasis_buffer_manager_t *bm) {
     stasis_buffer_pool_free_page(bh->buffer_pool, ret,-1);
     ret->pending = 0;
     ret->next = ret->prev = NULL;
-    ret->pinCount = 1; // to match what happens after the next block calls lru->remove()
+    ret->pinCount = 1; // to match what happens after the next block calls lru->getStaleAndRemove()
     bh->pageCount++;
   } else {
-    while((ret = bh->lru->getStale(bh->lru))) {
+    // Evict with getStaleAndRemove(), so that policies that keep history
+    // (such as 2Q) can tell an eviction from a pin.
+    while((ret = bh->lru->getStaleAndRemove(bh->lru))) {
       // Make sure we have an exclusive lock on victim.
-      assert(!ret->pinCount);
+      assert(1 == ret->pinCount);
       assert(!ret->pending);
       if(ret->dirty) {
+        // Cancel the eviction; the page stays in cache until it is written back.
+        bh->lru->insert(bh->lru, ret);
         pthread_mutex_unlock(&bh->mut);
         DEBUG("Blocking app thread");
         // We don't really care if this flush happens, so long as *something* is being written back, so ignore the EAGAIN it could return.
@@ -143,12 +147,11 @@ inline static Page * getFreePage(stasis_buffer_manager_t *bm) {
       }
     }
 
-    bh->lru->remove(bh->lru, ret);
     Page * check = (Page*)LH_ENTRY(remove)(bh->cachedPages, &ret->id, sizeof(ret->id));
     assert(check == ret);
   }
   assert(!ret->pending);
-  assert(ret->next == NULL);
+  // Don't check ret->next; clock uses it to mark the victim.
   assert(1 == ret->pinCount); // was zero before this call...
   assert(!ret->dirty);
   return ret;
@@ -299,8 +302,7 @@ static Page * bhLoadPageImpl_helper(stasis_buffer_manager_t* bm, stasis_buffer_m
   ret->pending = 0;
 
   // Would remove from lru, but getFreePage() guarantees that it isn't
-  // there.
-  assert(ret->next == 0);
+  // there.  (ret->next is not NULL under clock; see getFreePage().)
 
 #ifdef LATCH_SANITY_CHECKING
   int locked = tryreadlock(ret->loadlatch, 0);
@@ -513,12 +515,16 @@ stasis_buffer_manager_t* stasis_buffer_manager_hash_open(stasis_page_handle_t *
   bm->closeHandleImpl = bhCloseHandleImpl;
   bm->loadPageImpl = bhLoadPageImpl;
   bm->loadUninitPageImpl = bhLoadUninitPageImpl;
+  bm->loadPagesImpl = NULL;
   bm->prefetchPages = bhPrefetchPagesImpl;
   bm->preallocatePages = bhPreallocatePages;
   bm->getCachedPageImpl = bhGetCachedPage;
   bm->releasePageImpl = bhReleasePage;
   bm->writeBackPage = bhWriteBackPage;
   bm->tryToWriteBackPage = bhTryToWriteBackPage;
+  bm->tryToWriteBackPages = NULL;
+  bm->restoreHotSet = NULL;
+  bm->setPageHotImpl = NULL;
   bm->forcePages = bhForcePages;
   bm->asyncForcePages = bhAsyncForcePages;
   bm->forcePageRange = bhForcePageRange;
@@ -542,6 +548,8 @@ stasis_buffer_manager_t* stasis_buffer_manager_hash_open(stasis_page_handle_t *
   if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU ||
      stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU) {
     bh->lru = lruFastInit();
+  } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CONCURRENT_2Q) {
+    bh->lru = stasis_replacement_policy_2q_init(stasis_buffer_manager_size);
   } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CLOCK) {
     bh->lru = replacementPolicyClockInit(stasis_buffer_pool_get_underlying_array(bh->buffer_pool), stasis_buffer_manager_size);
   }
@@ -0,0 +1,271 @@
+/*
+ * compressedTier.c
+ *
+ * A pool of compressed, clean pages that sits between the buffer pool and
+ * the page file.  Entries are kept in a chained hash table, keyed on page
+ * id, and on a FIFO list.  Since pages leave the tier when they are read
+ * back, insertion order is eviction order, and dropping the head of the
+ * FIFO approximates LRU.
+ *
+ * All of the bookkeeping happens under a single mutex; compression and
+ * decompression happen outside of it.
+ *
+ * The compressed format is a sequence of (literals, match) pairs, much
+ * like LZ4's.  Each sequence starts with a token byte.  Its high nibble is
+ * the number of literals, and its low nibble is the match length minus
+ * LZ_MIN_MATCH.  Nibbles of 15 are followed by extra length bytes, which
+ * are summed until one of them is not 255.  The literals come next, then
+ * a two byte little endian offset back to the start of the match, and
+ * then the match length's extra bytes.  The last sequence ends after its
+ * literals.
+ */
+#include <stasis/common.h>
+#include <stasis/constants.h>
+#include <stasis/bufferManager/compressedTier.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+typedef struct stasis_compressed_tier_entry_t {
+  pageid_t pageid;
+  struct stasis_compressed_tier_entry_t *hash_next;
+  struct stasis_compressed_tier_entry_t *prev;
+  struct stasis_compressed_tier_entry_t *next;
+  size_t len;
+  byte data[];
+} stasis_compressed_tier_entry_t;
+
+struct stasis_compressed_tier_t {
+  pthread_mutex_t mut;
+  stasis_compressed_tier_entry_t **buckets;
+  uint64_t bucket_mask;
+  /** Oldest entry; the next one to be evicted. */
+  stasis_compressed_tier_entry_t *head;
+  stasis_compressed_tier_entry_t *tail;
+  stasis_compressed_tier_stats_t stats;
+};
+
+static inline uint32_t lzRead32(const byte *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+static inline uint32_t lzHash(uint32_t v) {
+  return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+static byte * lzPutLength(byte *op, byte *oend, size_t len) {
+  while(len >= 255) {
+    if(op >= oend) { return NULL; }
+    *op++ = 255;
+    len -= 255;
+  }
+  if(op >= oend) { return NULL; }
+  *op++ = (byte)len;
+  return op;
+}
+/** Append a sequence to op.  match_len is zero for the last sequence. */
+static byte * lzPutSequence(byte *op, byte *oend, const byte *lit, size_t lit_len, size_t offset, size_t match_len) {
+  if(op >= oend) { return NULL; }
+  byte *token = op++;
+  size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+  *token = (byte)(((lit_len >= 15 ? 15 : lit_len) << 4) | (ml >= 15 ? 15 : ml));
+  if(lit_len >= 15 && !(op = lzPutLength(op, oend, lit_len - 15))) { return NULL; }
+  if((size_t)(oend - op) < lit_len) { return NULL; }
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+  if(match_len) {
+    if(oend - op < 2) { return NULL; }
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    if(ml >= 15 && !(op = lzPutLength(op, oend, ml - 15))) { return NULL; }
+  }
+  return op;
+}
+static int lzGetLength(const byte **ip, const byte *iend, size_t *len) {
+  byte b;
+  do {
+    if(*ip >= iend) { return -1; }
+    b = *(*ip)++;
+    *len += b;
+  } while(b == 255);
+  return 0;
+}
+
+size_t stasis_compressed_tier_compress(const byte * in, size_t len, byte * out, size_t out_len) {
+  // Positions plus one, so that zero means "empty".
+  uint32_t table[1 << LZ_HASH_BITS];
+  memset(table, 0, sizeof(table));
+  byte *op = out;
+  byte *oend = out + out_len;
+  size_t ip = 0;
+  size_t anchor = 0;
+  while(ip + LZ_MIN_MATCH <= len) {
+    uint32_t seq = lzRead32(in + ip);
+    uint32_t h = lzHash(seq);
+    size_t ref = table[h];
+    table[h] = (uint32_t)(ip + 1);
+    if(ref && ip - (ref - 1) <= LZ_MAX_OFFSET && lzRead32(in + ref - 1) == seq) {
+      ref--;
+      size_t ml = LZ_MIN_MATCH;
+      while(ip + ml < len && in[ref + ml] == in[ip + ml]) { ml++; }
+      if(!(op = lzPutSequence(op, oend, in + anchor, ip - anchor, ip - ref, ml))) { return 0; }
+      ip += ml;
+      anchor = ip;
+    } else {
+      // Skip through incompressible data faster the longer it goes on.
+      ip += 1 + ((ip - anchor) >> 6);
+    }
+  }
+  if(!(op = lzPutSequence(op, oend, in + anchor, len - anchor, 0, 0))) { return 0; }
+  return op - out;
+}
+
+int stasis_compressed_tier_decompress(const byte * in, size_t len, byte * out, size_t out_len) {
+  const byte *ip = in;
+  const byte *iend = in + len;
+  byte *op = out;
+  byte *oend = out + out_len;
+  while(1) {
+    if(ip >= iend) { return -1; }
+    byte token = *ip++;
+    size_t lit = token >> 4;
+    if(lit == 15 && lzGetLength(&ip, iend, &lit)) { return -1; }
+    if((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) { return -1; }
+    memcpy(op, ip, lit);
+    op += lit;
+    ip += lit;
+    if(ip == iend) { return op == oend ? 0 : -1; }
+    if(iend - ip < 2) { return -1; }
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    size_t ml = token & 15;
+    if(ml == 15 && lzGetLength(&ip, iend, &ml)) { return -1; }
+    ml += LZ_MIN_MATCH;
+    if(!offset || offset > (size_t)(op - out) || (size_t)(oend - op) < ml) { return -1; }
+    const byte *ref = op - offset;
+    if(offset >= ml) {
+      memcpy(op, ref, ml);
+      op += ml;
+    } else {
+      // Overlapping match; this is how runs are encoded.
+      for(size_t i = 0; i < ml; i++) { *op++ = ref[i]; }
+    }
+  }
+}
+
+static inline uint64_t ctBucket(stasis_compressed_tier_t *t, pageid_t pageid) {
+  return ((uint64_t)pageid * 0x9E3779B97F4A7C15ULL >> 32) & t->bucket_mask;
+}
+/** Unlink pageid's entry, and return it.  The caller must hold t->mut. */
+static stasis_compressed_tier_entry_t * ctRemove(stasis_compressed_tier_t *t, pageid_t pageid) {
+  stasis_compressed_tier_entry_t **pp = &t->buckets[ctBucket(t, pageid)];
+  while(*pp && (*pp)->pageid != pageid) { pp = &(*pp)->hash_next; }
+  stasis_compressed_tier_entry_t *e = *pp;
+  if(!e) { return NULL; }
+  *pp = e->hash_next;
+  if(e->prev) { e->prev->next = e->next; } else { t->head = e->next; }
+  if(e->next) { e->next->prev = e->prev; } else { t->tail = e->prev; }
+  t->stats.pages--;
+  t->stats.bytes -= sizeof(*e) + e->len;
+  return e;
+}
+
+stasis_compressed_tier_t * stasis_compressed_tier_open(uint64_t capacity) {
+  stasis_compressed_tier_t *t = stasis_alloc(stasis_compressed_tier_t);
+  pthread_mutex_init(&t->mut, 0);
+  // Well compressed slotted pages take about a quarter of a page.
+  uint64_t buckets = 64;
+  while(buckets < capacity / (PAGE_SIZE / 4)) { buckets *= 2; }
+  t->buckets = stasis_calloc(buckets, stasis_compressed_tier_entry_t*);
+  t->bucket_mask = buckets - 1;
+  t->head = NULL;
+  t->tail = NULL;
+  memset(&t->stats, 0, sizeof(t->stats));
+  t->stats.capacity = capacity;
+  return t;
+}
+void stasis_compressed_tier_close(stasis_compressed_tier_t * t) {
+  stasis_compressed_tier_entry_t *e = t->head;
+  while(e) {
+    stasis_compressed_tier_entry_t *next = e->next;
+    free(e);
+    e = next;
+  }
+  free(t->buckets);
+  pthread_mutex_destroy(&t->mut);
+  free(t);
+}
+int stasis_compressed_tier_put(stasis_compressed_tier_t * t, pageid_t pageid, const byte * buf) {
+  byte scratch[PAGE_SIZE];
+  size_t len = stasis_compressed_tier_compress(buf, PAGE_SIZE, scratch, PAGE_SIZE * 3 / 4);
+  if(!len || sizeof(stasis_compressed_tier_entry_t) + len > t->stats.capacity) {
+    // The tier may have an older copy of the page, which is now stale.
+    pthread_mutex_lock(&t->mut);
+    stasis_compressed_tier_entry_t *old = ctRemove(t, pageid);
+    t->stats.rejections++;
+    pthread_mutex_unlock(&t->mut);
+    free(old);
+    return 0;
+  }
+  stasis_compressed_tier_entry_t *e = stasis_malloc_trailing_array(stasis_compressed_tier_entry_t, len);
+  e->pageid = pageid;
+  e->len = len;
+  memcpy(e->data, scratch, len);
+
+  pthread_mutex_lock(&t->mut);
+  stasis_compressed_tier_entry_t *victims = ctRemove(t, pageid);
+  if(victims) { victims->next = NULL; }
+  uint64_t bucket = ctBucket(t, pageid);
+  e->hash_next = t->buckets[bucket];
+  t->buckets[bucket] = e;
+  e->prev = t->tail;
+  e->next = NULL;
+  if(t->tail) { t->tail->next = e; } else { t->head = e; }
+  t->tail = e;
+  t->stats.pages++;
+  t->stats.bytes += sizeof(*e) + len;
+  t->stats.insertions++;
+  while(t->stats.bytes > t->stats.capacity) {
+    stasis_compressed_tier_entry_t *v = ctRemove(t, t->head->pageid);
+    assert(v != e);
+    v->next = victims;
+    victims = v;
+    t->stats.evictions++;
+  }
+  pthread_mutex_unlock(&t->mut);
+
+  while(victims) {
+    stasis_compressed_tier_entry_t *next = victims->next;
+    free(victims);
+    victims = next;
+  }
+  return 1;
+}
+int stasis_compressed_tier_get(stasis_compressed_tier_t * t, pageid_t pageid, byte * buf) {
+  pthread_mutex_lock(&t->mut);
+  stasis_compressed_tier_entry_t *e = ctRemove(t, pageid);
+  if(e) { t->stats.hits++; } else { t->stats.misses++; }
+  pthread_mutex_unlock(&t->mut);
+  if(!e) { return 0; }
+  if(stasis_compressed_tier_decompress(e->data, e->len, buf, PAGE_SIZE)) {
+    fprintf(stderr, "compressedTier: Compressed copy of page %lld is corrupt\n", (long long)pageid);
+    abort();
+  }
+  free(e);
+  return 1;
+}
+void stasis_compressed_tier_invalidate(stasis_compressed_tier_t * t, pageid_t pageid) {
+  pthread_mutex_lock(&t->mut);
+  stasis_compressed_tier_entry_t *e = ctRemove(t, pageid);
+  pthread_mutex_unlock(&t->mut);
+  free(e);
+}
+void stasis_compressed_tier_stats(stasis_compressed_tier_t * t, stasis_compressed_tier_stats_t * stats) {
+  pthread_mutex_lock(&t->mut);
+  *stats = t->stats;
+  pthread_mutex_unlock(&t->mut);
+}
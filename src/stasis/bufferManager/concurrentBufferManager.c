@@ -5,25 +5,131 @@
  *      Author: sears
  */
 #include <stasis/util/concurrentHash.h>
+#include <stasis/util/crc32.h>
 #include <stasis/replacementPolicy.h>
 #include <stasis/bufferPool.h>
 #include <stasis/pageHandle.h>
 #include <stasis/flags.h>
 #include <stasis/bufferManager/concurrentBufferManager.h>
+#include <stasis/bufferManager/compressedTier.h>
 
 //#define STRESS_TEST_WRITEBACK 1 // if defined, writeback as much as possible, as fast as possible.
 
+/** Number of pages that can be flagged hot at once. */
+#define HOT_PAGE_SLOTS 16
+/** Number of pin counters per hot page.  Threads are assigned counters round robin. */
+#define HOT_PAGE_SHARDS 32
+/** Number of streams of page loads that each thread tracks for read-ahead. */
+#define READAHEAD_STREAMS 4
+
+/** The access pattern of a stream of page loads. */
+typedef struct {
+  /** The page after the last page loaded by the stream. */
+  pageid_t next_pageid;
+  /** Number of sequential loads since the last non-sequential load. */
+  int run_length;
+  /** Read-ahead has been requested for pages before this one. */
+  pageid_t readahead_end;
+} stasis_buffer_concurrent_hash_stream_t;
+
 typedef struct {
   Page *p;
   stasis_buffer_manager_t *bm;
+  /**
+   * Loads that do not go through a buffer manager handle are split into
+   * streams by page id, so that a scan that also loads other pages (such
+   * as a region's boundary tags) is still recognized.
+   */
+  stasis_buffer_concurrent_hash_stream_t streams[READAHEAD_STREAMS];
+  /** When each stream was last used, in loads by this thread. */
+  uint64_t stream_used[READAHEAD_STREAMS];
+  uint64_t stream_loads;
+  /** Which of each hot page's pin counters this thread uses. */
+  int hot_shard;
+  /**
+   * Number of pins this thread holds on each hot page slot.  Approximate,
+   * since pages can be released by a different thread than pinned them.
+   */
+  int hot_pins[HOT_PAGE_SLOTS];
 } stasis_buffer_concurrent_hash_tls_t;
 
+typedef struct {
+  stasis_buffer_manager_t *bm;
+  pthread_t thread;
+  int partition;
+} stasis_buffer_concurrent_hash_writeback_t;
+
+/** A page range that a read-ahead thread should bring into cache. */
+typedef struct {
+  pageid_t pageid;
+  pageid_t count;
+} stasis_buffer_concurrent_hash_readahead_t;
+
+#define READAHEAD_QUEUE_LENGTH 16
+/** Read-ahead threads load (and then unpin) at most this many pages at a time... */
+#define READAHEAD_BATCH 64
+/** ...and, between them, pin at most 1/READAHEAD_POOL_FRACTION of the buffer pool. */
+#define READAHEAD_POOL_FRACTION 16
+/** Number of consecutive page loads that mark a handle as sequential. */
+#define READAHEAD_TRIGGER 2
+
+enum {
+  HOT_FREE = 0,
+  /** The page is being flagged hot.  Pins use loadlatch. */
+  HOT_ARMING,
+  /** Pins use the sharded counters. */
+  HOT_ACTIVE,
+  /**
+   * A thread holds loadlatch, and is waiting for the sharded counters to
+   * drain.  New pins block on loadlatch, unless the pinning thread already
+   * holds a pin.
+   */
+  HOT_DRAINING
+};
+
+/** A pin counter on its own cache line. */
+typedef struct {
+  int64_t count;
+  char pad[64 - sizeof(int64_t)];
+} stasis_buffer_concurrent_hash_hot_shard_t;
+
+/**
+ * A page that was flagged hot with setPageHot().  Pinning a hot page
+ * increments one of its shards instead of read latching loadlatch, so
+ * threads that pin the same page do not write to the same cache line.
+ * While the page is hot, the buffer manager holds a reference to it in
+ * the replacement policy, so it is never evicted.
+ *
+ * state only changes while loadlatch is write latched, so it is stable
+ * for threads that pinned the page through loadlatch.  Threads that need
+ * the page to be unpinned (writeback, setPageHot(p, 0)) write latch
+ * loadlatch, set the state to HOT_DRAINING, and then check that the
+ * shards sum to zero.
+ */
+typedef struct {
+  pageid_t pageid;
+  Page *p;
+  int state;
+  stasis_buffer_concurrent_hash_hot_shard_t shards[HOT_PAGE_SHARDS];
+} stasis_buffer_concurrent_hash_hot_t;
+
+typedef struct {
+  stasis_page_handle_t *ph;
+  int is_sequential;
+  stasis_buffer_concurrent_hash_stream_t stream;
+} stasis_buffer_concurrent_hash_handle_t;
+
 typedef struct {
   hashtable_t *ht;
-  pthread_t worker;
+  stasis_buffer_concurrent_hash_writeback_t *workers;
+  int worker_count;
   pageid_t pageCount;
   replacementPolicy *lru;
   stasis_buffer_pool_t *buffer_pool;
+  /** Number of NUMA partitions in buffer_pool, and in lru. */
+  int numa_node_count;
+  /** Ids for frames that are handed back to the pool unused.  Always negative. */
+  pageid_t next_free_id;
   stasis_page_handle_t *page_handle;
   stasis_dirty_page_table_t *dpt;
   stasis_log_t *log;
@@ -31,12 +137,47 @@ typedef struct {
   stasis_buffer_concurrent_hash_tls_t * tls;
   pthread_key_t key;
   pthread_cond_t needFree;
+  /** Held by writeback workers while they wait for needFree, so that shutdown cannot slip between their check of running and the wait. */
+  pthread_mutex_t needFreeMut;
+  pthread_t *readahead_workers;
+  int readahead_worker_count;
+  /** Read-ahead threads are started the first time there is something to read. */
+  int readahead_started;
+  /** Number of pages each read-ahead or hot set thread pins at a time. */
+  int readahead_batch;
+  int readahead_running;
+  pthread_mutex_t readahead_mut;
+  pthread_cond_t readahead_waiting;
+  stasis_buffer_concurrent_hash_readahead_t readahead_queue[READAHEAD_QUEUE_LENGTH];
+  uint64_t readahead_head;
+  uint64_t readahead_tail;
+  /** Page ids that are being reloaded from the hot set file, sorted. */
+  pageid_t *hotset;
+  pthread_t *hotset_workers;
+  int hotset_worker_count;
+  /** Pages flagged with setPageHot().  Free slots have pageid INVALID_PAGE. */
+  stasis_buffer_concurrent_hash_hot_t *hot;
+  int hot_count;
+  int hot_next_shard;
+  /** Serializes calls to setPageHot(). */
+  pthread_mutex_t hot_mut;
+  /** Compressed copies of evicted clean pages, or NULL. */
+  stasis_compressed_tier_t *compressed;
 } stasis_buffer_concurrent_hash_t;
 
+/** The part of the hot set that one hot set worker reloads. */
+typedef struct {
+  stasis_buffer_manager_t *bm;
+  const pageid_t *pageids;
+  pageid_t count;
+} stasis_buffer_concurrent_hash_hotset_t;
+
 static inline int needFlush(stasis_buffer_manager_t * bm) {
   stasis_buffer_concurrent_hash_t *bh = (stasis_buffer_concurrent_hash_t *)bm->impl;
   pageid_t count = stasis_dirty_page_table_dirty_count(bh->dpt);
-  pageid_t needed = stasis_dirty_page_count_soft_limit;
+  stasis_dirty_page_table_limits_t limits;
+  stasis_dirty_page_table_get_limits(bh->dpt, &limits);
+  pageid_t needed = limits.soft_limit;
   if(count > needed) {
     DEBUG("Need flush?  Dirty: %lld Total: %lld ret = %d\n", count, needed, count > needed);
   }
@@ -47,7 +188,54 @@ static inline int needFlush(stasis_buffer_manager_t * bm) {
 #endif
 }
 
-static int chWriteBackPage_helper(stasis_buffer_manager_t* bm, pageid_t pageid, int is_hint) {
+static inline int belowLowWaterMark(stasis_buffer_concurrent_hash_t *ch) {
+  stasis_dirty_page_table_limits_t limits;
+  stasis_dirty_page_table_get_limits(ch->dpt, &limits);
+  return stasis_dirty_page_table_dirty_count(ch->dpt) < limits.low_water_mark;
+}
+
+static inline stasis_buffer_concurrent_hash_hot_t * chHotFind(stasis_buffer_concurrent_hash_t *ch, pageid_t pageid) {
+  if(!__atomic_load_n(&ch->hot_count, __ATOMIC_ACQUIRE)) { return NULL; }
+  for(int i = 0; i < HOT_PAGE_SLOTS; i++) {
+    if(__atomic_load_n(&ch->hot[i].pageid, __ATOMIC_ACQUIRE) == pageid) { return &ch->hot[i]; }
+  }
+  return NULL;
+}
+/**
+ * Block new pins of p, if it is hot.  The caller must hold p->loadlatch's
+ * write latch, and must call chHotUndrain() before releasing it.
+ *
+ * @param wait If true, wait for threads that have p pinned to unpin it.
+ *             Otherwise, give up if p is pinned.
+ * @return 0 if p is not hot, or if no thread has it pinned.  EBUSY if
+ *         p is pinned, and wait is false; in that case, p is left as it was.
+ */
+static int chHotDrain(stasis_buffer_concurrent_hash_t *ch, Page *p, int wait) {
+  stasis_buffer_concurrent_hash_hot_t *e = chHotFind(ch, p->id);
+  // HOT_ARMING pages are pinned through loadlatch, which the caller holds.
+  if(!e || e->p != p || e->state != HOT_ACTIVE) { return 0; }
+  __atomic_store_n(&e->state, HOT_DRAINING, __ATOMIC_SEQ_CST);
+  while(1) {
+    int64_t pins = 0;
+    for(int i = 0; i < HOT_PAGE_SHARDS; i++) {
+      pins += __atomic_load_n(&e->shards[i].count, __ATOMIC_SEQ_CST);
+    }
+    if(!pins) { return 0; }
+    if(!wait) { break; }
+    // Stay in HOT_DRAINING, so that a stream of new pins cannot starve us.
+    sched_yield();
+  }
+  __atomic_store_n(&e->state, HOT_ACTIVE, __ATOMIC_SEQ_CST);
+  return EBUSY;
+}
+static void chHotUndrain(stasis_buffer_concurrent_hash_t *ch, Page *p) {
+  stasis_buffer_concurrent_hash_hot_t *e = chHotFind(ch, p->id);
+  if(e && e->p == p && e->state == HOT_DRAINING) {
+    __atomic_store_n(&e->state, HOT_ACTIVE, __ATOMIC_SEQ_CST);
+  }
+}
+
+static int chWriteBackPage_latch(stasis_buffer_manager_t* bm, pageid_t pageid, int is_hint) {
   stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
   Page * p = (Page*)hashtable_lookup(ch->ht, pageid/*, &h*/);
   int ret = 0;
@@ -78,7 +266,14 @@ static int chWriteBackPage_helper(stasis_buffer_manager_t* bm, pageid_t pageid,
       // Instead, we release the hashtable lock, get the write latch, then double check the pageid.
       // This is safe, since we know that page pointers are never freed, only reused.  However, it causes writeback
       // to block waiting for application threads to unpin their pages.
-      writelock(p->loadlatch,0);
+
+      // Our caller reserved an I/O slot.  Don't hold it while we wait; the threads we are waiting for may need it.
+      while(!trywritelock(p->loadlatch,0)) {
+        stasis_handle_qos_release(0);
+        writelock(p->loadlatch,0);
+        unlock(p->loadlatch);
+        stasis_handle_qos_reserve(PAGE_SIZE);
+      }
       if(p->id != pageid) {
         // someone else wrote it back.  woohoo.
         unlock(p->loadlatch);
@@ -88,6 +283,13 @@ static int chWriteBackPage_helper(stasis_buffer_manager_t* bm, pageid_t pageid,
   }
   if(ret) { return ret; }
 
+  // Hot pages can be pinned without loadlatch; wait for those pins too.
+  if(chHotDrain(ch, p, !is_hint)) {
+    p->needsFlush = 1;
+    unlock(p->loadlatch);
+    return EBUSY;
+  }
+
   // When we optimize for sequential writes, we try to make sure that
   // write back only happens in a single thread.  Therefore, there is
   // no reason to put dirty pages in the LRU, and lruFast will ignore
@@ -110,9 +312,17 @@ static int chWriteBackPage_helper(stasis_buffer_manager_t* bm, pageid_t pageid,
     ch->lru->insert(ch->lru, p);
 
   p->needsFlush = 0;
+  chHotUndrain(ch, p);
   unlock(p->loadlatch);
   return 0;
 }
+static int chWriteBackPage_helper(stasis_buffer_manager_t* bm, pageid_t pageid, int is_hint) {
+  // Wait for the I/O scheduler before we latch the page, not after.
+  stasis_handle_qos_reserve(PAGE_SIZE);
+  int ret = chWriteBackPage_latch(bm, pageid, is_hint);
+  stasis_handle_qos_release(ret ? 0 : PAGE_SIZE);
+  return ret;
+}
 static int chWriteBackPage(stasis_buffer_manager_t* bm, pageid_t pageid) {
   DEBUG("chWriteBackPage called");
   return chWriteBackPage_helper(bm,pageid,0); // not hint; for correctness.  Block (deadlock?) on contention.
@@ -121,34 +331,104 @@ static int chTryToWriteBackPage(stasis_buffer_manager_t* bm, pageid_t pageid) {
   DEBUG("chTryToWriteBackPage called");
   return chWriteBackPage_helper(bm,pageid,1); // just a hint.  Return EBUSY on contention.
 }
-static void * writeBackWorker(void * bmp) {
-  stasis_buffer_manager_t* bm = (stasis_buffer_manager_t *)bmp;
+static void chWriteBackBatch(stasis_buffer_concurrent_hash_t *ch, Page **batch, int n) {
+  // See chWriteBackPage_helper for an explanation of the LRU calls.
+  if(stasis_buffer_manager_hint_writes_are_sequential) {
+    for(int i = 0; i < n; i++) { ch->lru->remove(ch->lru, batch[i]); }
+  }
+  ch->page_handle->write_pages(ch->page_handle, batch, n);
+  for(int i = 0; i < n; i++) {
+    if(stasis_buffer_manager_hint_writes_are_sequential) {
+      ch->lru->insert(ch->lru, batch[i]);
+    }
+    batch[i]->needsFlush = 0;
+    chHotUndrain(ch, batch[i]);
+    unlock(batch[i]->loadlatch);
+  }
+}
+/**
+ * Like chTryToWriteBackPage, but latches up to
+ * stasis_buffer_manager_write_coalesce_pages pages at a time, and passes
+ * them to the page handle together, so that adjacent pages are written
+ * with one request.
+ */
+static int chTryToWriteBackPages(stasis_buffer_manager_t* bm, const pageid_t * pageids, int count) {
+  DEBUG("chTryToWriteBackPages called");
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  if(count <= 0) { return 0; }
+  int max_batch = stasis_buffer_manager_write_coalesce_pages > 1 ? (int)stasis_buffer_manager_write_coalesce_pages : 1;
+  if(max_batch > count) { max_batch = count; }
+  Page ** batch = stasis_alloca(max_batch, Page*);
+  int busy = 0;
+  int i = 0;
+  while(i < count) {
+    // Wait for the I/O scheduler before we latch the batch, not after.
+    stasis_handle_qos_reserve((lsn_t)(count - i < max_batch ? count - i : max_batch) * PAGE_SIZE);
+    int n = 0;
+    for(; i < count && n < max_batch; i++) {
+      Page * p = (Page*)hashtable_lookup(ch->ht, pageids[i]);
+      if(!p) { continue; }
+      if(!trywritelock(p->loadlatch,0)) {
+        p->needsFlush = 1; // Not atomic.  Oh well.
+        busy++;
+        continue;
+      }
+      if(p->id != pageids[i]) {
+        // it must have been written back...
+        unlock(p->loadlatch);
+        continue;
+      }
+      if(chHotDrain(ch, p, 0)) {
+        unlock(p->loadlatch);
+        p->needsFlush = 1;
+        busy++;
+        continue;
+      }
+      batch[n++] = p;
+    }
+    if(n) { chWriteBackBatch(ch, batch, n); }
+    stasis_handle_qos_release((lsn_t)n * PAGE_SIZE);
+  }
+  return busy;
+}
+static void * writeBackWorker(void * wbp) {
+  stasis_buffer_concurrent_hash_writeback_t * wb = (stasis_buffer_concurrent_hash_writeback_t *)wbp;
+  stasis_buffer_manager_t* bm = wb->bm;
   stasis_buffer_concurrent_hash_t * ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
-  pthread_mutex_t mut;
-  pthread_mutex_init(&mut,0);
+  stasis_handle_qos_set_class(STASIS_IO_CLASS_WRITEBACK);
   while(1) {
-    while(ch->running && stasis_dirty_page_table_dirty_count(ch->dpt) < stasis_dirty_page_low_water_mark) {
+    while(ch->running && belowLowWaterMark(ch)) {
       if(!needFlush(bm)) {
         printf("Sleeping in write back worker (count = %lld)\n", stasis_dirty_page_table_dirty_count(ch->dpt));
-        pthread_mutex_lock(&mut);
-        pthread_cond_wait(&ch->needFree, &mut); // XXX Make sure it's OK to have many different mutexes waiting on the same cond.
-        pthread_mutex_unlock(&mut);
+        // With several workers, shutdown's broadcast could land between one worker's check of
+        // ch->running and its wait, and Tdeinit() would hang joining it.  Recheck under needFreeMut,
+        // which shutdown holds while it clears ch->running.  Other wakeups are hints; a missed one
+        // only delays writeback until the next.
+        pthread_mutex_lock(&ch->needFreeMut);
+        if(ch->running) { pthread_cond_wait(&ch->needFree, &ch->needFreeMut); }
+        pthread_mutex_unlock(&ch->needFreeMut);
         printf("Woke write back worker (count = %lld)\n", stasis_dirty_page_table_dirty_count(ch->dpt));
       }
     }
     if(!ch->running) { break; }
     DEBUG("Calling flush\n");
     // ignore ret val; this flush is for performance, not correctness.
-    stasis_dirty_page_table_flush(ch->dpt);
+    // Each worker sweeps its own stripes of the page file; with one worker this is a normal flush.
+    stasis_dirty_page_table_flush_partition(ch->dpt, wb->partition, ch->worker_count,
+                                            stasis_buffer_manager_concurrent_hash_writeback_stripe_size);
   }
-  pthread_mutex_destroy(&mut);
   return 0;
 
 }
+static Page * chHotPin(stasis_buffer_manager_t *bm, pageid_t pageid);
+static Page * chHotConvert(stasis_buffer_manager_t *bm, Page *p);
+
 static Page * chGetCachedPage(stasis_buffer_manager_t* bm, int xid, const pageid_t pageid) {
   stasis_buffer_concurrent_hash_t * ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  Page * p = chHotPin(bm, pageid);
+  if(p) { return p; }
   hashtable_bucket_handle_t h;
-  Page * p = (Page*)hashtable_lookup_lock(ch->ht, pageid, &h);
+  p = (Page*)hashtable_lookup_lock(ch->ht, pageid, &h);
   if(p) {
     int succ = tryreadlock(p->loadlatch, 0);
     if(!succ) {
@@ -160,29 +440,44 @@ static Page * chGetCachedPage(stasis_buffer_manager_t* bm, int xid, const pageid
     }
   }
   hashtable_unlock(&h);
-  return p;
+  return p ? chHotConvert(bm, p) : NULL;
+}
+/**
+ * Put a frame from TLS back into the pool of free frames.  Free frames are
+ * not in the hashtable, but still need distinct ids for the replacement
+ * policy.
+ */
+static void chReturnFrame(stasis_buffer_concurrent_hash_t *ch, Page *p) {
+  p->id = __sync_fetch_and_sub(&ch->next_free_id, 1);
+  ch->lru->insert(ch->lru, p); // TODO: put it into the LRU end instead of the MRU end, so the memory is treated as stale.
 }
 static void deinitTLS(void *tlsp) {
   stasis_buffer_concurrent_hash_tls_t * tls = (stasis_buffer_concurrent_hash_tls_t *)tlsp;
   stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)tls->bm->impl;
 
-  Page * p = tls->p;
-  p->id = -2;
-  while(hashtable_test_and_set(ch->ht,p->id, p)) {
-    p->id --;
-  }
-  ch->lru->insert(ch->lru, tls->p); // TODO: put it into the LRU end instead of the MRU end, so the memory is treated as stale.
+  if(tls->p) { chReturnFrame(ch, tls->p); }
   free(tls);
 }
-static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_manager_t* bm) {
+/** Get this thread's TLS, without making sure that it holds a free frame. */
+static inline stasis_buffer_concurrent_hash_tls_t * chGetTLS(stasis_buffer_manager_t* bm) {
   stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
   stasis_buffer_concurrent_hash_tls_t *tls = (stasis_buffer_concurrent_hash_tls_t *)pthread_getspecific(ch->key);
   if(tls == NULL) {
-    tls = stasis_alloc(stasis_buffer_concurrent_hash_tls_t);
+    tls = stasis_calloc(1, stasis_buffer_concurrent_hash_tls_t);
     tls->p = NULL;
     tls->bm = bm;
+    tls->hot_shard = __sync_fetch_and_add(&ch->hot_next_shard, 1) % HOT_PAGE_SHARDS;
+    for(int i = 0; i < READAHEAD_STREAMS; i++) {
+      tls->streams[i].next_pageid = INVALID_PAGE;
+      tls->streams[i].readahead_end = INVALID_PAGE;
+    }
     pthread_setspecific(ch->key, tls);
   }
+  return tls;
+}
+static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_manager_t* bm) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  stasis_buffer_concurrent_hash_tls_t *tls = chGetTLS(bm);
   int count = 0;
   while(tls->p == NULL) {
     Page * tmp;
@@ -195,7 +490,7 @@ static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_ma
         // or if the flag is set to true.
 
         // wake writeback thread
-        pthread_cond_signal(&ch->needFree);
+        pthread_cond_broadcast(&ch->needFree);
 
         // sleep
         struct timespec ts = { 0, (1024 * 1024) << (spin_count > 3 ? 3 : spin_count) };
@@ -209,6 +504,13 @@ static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_ma
         }
       }
     }
+    if(tmp->id < INVALID_PAGE) {
+      // A free frame.  It is not in the hashtable, so nobody else can reach it.
+      assert(!tmp->dirty);
+      tls->p = tmp;
+      tls->p->id = INVALID_PAGE;
+      break;
+    }
     hashtable_bucket_handle_t h;
     tls->p = (Page*)hashtable_remove_begin(ch->ht, tmp->id, &h);
     if(tls->p) {
@@ -217,7 +519,7 @@ static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_ma
       int succ =
       trywritelock(tls->p->loadlatch,0);  // if this blocks, it is because someone else has pinned the page (it can't be due to eviction because the lru is atomic)
 
-      if(tls->p->dirty) pthread_cond_signal(&ch->needFree);
+      if(tls->p->dirty) pthread_cond_broadcast(&ch->needFree);
 
       if(succ && (
           // Work-stealing heuristic: If we don't know that writes are sequential, then write back the page we just encountered.
@@ -239,6 +541,17 @@ static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_ma
           DEBUG("App thread stole work from write back.\n");
           // Page is not in LRU, so we don't have to worry about the case where we
           // are in sequential mode, and have to remove/add the page from/to the LRU.
+          if(ch->compressed) {
+            // A dirty page's old compressed copy (if any) is about to be stale.
+            if(tls->p->dirty) {
+              stasis_compressed_tier_invalidate(ch->compressed, tls->p->id);
+            } else {
+              stasis_compressed_tier_put(ch->compressed, tls->p->id, tls->p->memAddr);
+            }
+          }
+          if(!tls->p->dirty && ch->page_handle->evict) {
+            ch->page_handle->evict(ch->page_handle, tls->p);
+          }
           ch->page_handle->write(ch->page_handle, tls->p);
         }
         hashtable_remove_finish(ch->ht, &h);  // need to hold bucket lock until page is flushed.  Otherwise, another thread could read stale data from the filehandle.
@@ -279,15 +592,121 @@ static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_ma
   return tls;
 }
 
+/**
+ * With STASIS_NUMA_PLACEMENT_HASH, swap the free frame in TLS for one from
+ * the partition that pageid hashes to, unless pageid is already cached.
+ */
+static inline stasis_buffer_concurrent_hash_tls_t * chPlaceFrame(stasis_buffer_manager_t* bm, stasis_buffer_concurrent_hash_tls_t *tls, pageid_t pageid) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  if(ch->numa_node_count > 1 && stasis_buffer_manager_numa_placement == STASIS_NUMA_PLACEMENT_HASH) {
+    // Hash, rather than taking pageid modulo the node count, so that strided
+    // access patterns are still spread over the nodes.
+    int node = (int)(stasis_crc32(&pageid, sizeof(pageid), (unsigned int)-1) % ch->numa_node_count);
+    if(stasis_buffer_pool_page_node(ch->buffer_pool, tls->p) != node && !hashtable_lookup(ch->ht, pageid)) {
+      chReturnFrame(ch, tls->p);
+      tls->p = NULL;
+      stasis_replacement_policy_numa_prefer_node(ch->lru, node);
+      tls = populateTLS(bm);
+      stasis_replacement_policy_numa_prefer_node(ch->lru, -1);
+    }
+  }
+  return tls;
+}
+
+/** Pin a hot page without touching loadlatch.  @return NULL if pageid is not hot. */
+static Page * chHotPin(stasis_buffer_manager_t *bm, pageid_t pageid) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  stasis_buffer_concurrent_hash_hot_t *e = chHotFind(ch, pageid);
+  if(!e) { return NULL; }
+  stasis_buffer_concurrent_hash_tls_t *tls = populateTLS(bm);
+  int *held = &tls->hot_pins[e - ch->hot];
+  int64_t *count = &e->shards[tls->hot_shard].count;
+  int state = __atomic_load_n(&e->state, __ATOMIC_SEQ_CST);
+  // While the page drains, new pins go through loadlatch, which the drainer
+  // holds.  If we already have it pinned, the drain is waiting for us, so
+  // blocking would deadlock; our pin keeps our counter nonzero, so we can
+  // safely take another.
+  if(state != HOT_ACTIVE && !(state == HOT_DRAINING && *held > 0)) { return NULL; }
+  __atomic_fetch_add(count, 1, __ATOMIC_SEQ_CST);
+  // If a drain started, it may not have seen our increment.  Back off.
+  state = __atomic_load_n(&e->state, __ATOMIC_SEQ_CST);
+  if((state == HOT_ACTIVE || (state == HOT_DRAINING && *held > 0)) && e->pageid == pageid) {
+    (*held)++;
+    return e->p;
+  }
+  __atomic_fetch_sub(count, 1, __ATOMIC_SEQ_CST);
+  return NULL;
+}
+/**
+ * p was pinned through loadlatch.  If it became hot while we were
+ * waiting for loadlatch, trade that pin for a hot pin, so that
+ * chHotUnpin() will recognize it.
+ */
+static Page * chHotConvert(stasis_buffer_manager_t *bm, Page *p) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  stasis_buffer_concurrent_hash_hot_t *e = chHotFind(ch, p->id);
+  if(e && e->p == p && __atomic_load_n(&e->state, __ATOMIC_SEQ_CST) == HOT_ACTIVE) {
+    stasis_buffer_concurrent_hash_tls_t *tls = populateTLS(bm);
+    __atomic_fetch_add(&e->shards[tls->hot_shard].count, 1, __ATOMIC_SEQ_CST);
+    tls->hot_pins[e - ch->hot]++;
+    ch->lru->insert(ch->lru, p);
+    unlock(p->loadlatch);
+  }
+  return p;
+}
+/** @return 1 if p was pinned by chHotPin(), and has now been unpinned. */
+static int chHotUnpin(stasis_buffer_manager_t *bm, Page *p) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  stasis_buffer_concurrent_hash_hot_t *e = chHotFind(ch, p->id);
+  if(!e || e->p != p) { return 0; }
+  int state = __atomic_load_n(&e->state, __ATOMIC_SEQ_CST);
+  if(state != HOT_ACTIVE && state != HOT_DRAINING) { return 0; }
+  // The pin may have come from another thread's shard; only the sum matters.
+  stasis_buffer_concurrent_hash_tls_t *tls = populateTLS(bm);
+  __atomic_fetch_sub(&e->shards[tls->hot_shard].count, 1, __ATOMIC_SEQ_CST);
+  tls->hot_pins[e - ch->hot]--;
+  return 1;
+}
+
 static void chReleasePage(stasis_buffer_manager_t * bm, Page * p);
 
+/** Read p from the compressed tier if it is there, and from ph otherwise. */
+static void chReadPage(stasis_buffer_concurrent_hash_t *ch, stasis_page_handle_t *ph, Page *p, pagetype_t type) {
+  if(ch->compressed && stasis_compressed_tier_get(ch->compressed, p->id, p->memAddr)) {
+    assert(!p->dirty);
+    stasis_page_loaded(p, type);
+  } else {
+    ph->read(ph, p, type);
+  }
+}
+/** Like chReadPage(), but pages that miss the compressed tier are read with one call to read_pages(). */
+static void chReadPages(stasis_buffer_concurrent_hash_t *ch, stasis_page_handle_t *ph, Page **pages, int count, pagetype_t type) {
+  if(!ch->compressed) {
+    ph->read_pages(ph, pages, count, type);
+    return;
+  }
+  Page **misses = stasis_malloc(count, Page*);
+  int miss_count = 0;
+  for(int i = 0; i < count; i++) {
+    if(stasis_compressed_tier_get(ch->compressed, pages[i]->id, pages[i]->memAddr)) {
+      assert(!pages[i]->dirty);
+      stasis_page_loaded(pages[i], type);
+    } else {
+      misses[miss_count++] = pages[i];
+    }
+  }
+  ph->read_pages(ph, misses, miss_count, type);
+  free(misses);
+}
+
 static Page * chLoadPageImpl_helper(stasis_buffer_manager_t* bm, int xid, stasis_page_handle_t *ph, const pageid_t pageid, int uninitialized, pagetype_t type) {
   if(uninitialized) assert(!bm->in_redo);
 
   stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
-  stasis_buffer_concurrent_hash_tls_t *tls = populateTLS(bm);
+  Page * p = chHotPin(bm, pageid);
+  if(p) { return p; }
+  stasis_buffer_concurrent_hash_tls_t *tls = chPlaceFrame(bm, populateTLS(bm), pageid);
   hashtable_bucket_handle_t h;
-  Page * p = 0;
 
   ph = ph ? ph : ch->page_handle;
 
@@ -323,14 +742,15 @@ static Page * chLoadPageImpl_helper(stasis_buffer_manager_t* bm, int xid, stasis
       if(uninitialized) {
         type = UNINITIALIZED_PAGE;
         assert(!p->dirty);
+        if(ch->compressed) { stasis_compressed_tier_invalidate(ch->compressed, pageid); }
         stasis_uninitialized_page_loaded(xid, p);
       } else {
-        ph->read(ph, p, type);
+        chReadPage(ch, ph, p, type);
       }
       unlock(p->loadlatch);
 
       tls = populateTLS(bm);
-      if(needFlush(bm)) { pthread_cond_signal(&ch->needFree); }
+      if(needFlush(bm)) { pthread_cond_broadcast(&ch->needFree); }
     }
     ch->lru->remove(ch->lru, p);  // this can happen before or after the the hashable unlock, since the invariant is that in lru -> in hashtable, and it's in the hash
     hashtable_unlock(&h);
@@ -340,10 +760,290 @@ static Page * chLoadPageImpl_helper(stasis_buffer_manager_t* bm, int xid, stasis
     readlock(p->loadlatch, 0);
     // Now, we know that populateTLS won't evict the page, since it gets a writelock before doing so.
   } while(p->id != pageid); // On the off chance that the page got evicted, we'll need to try again.
-  return p;
+  return chHotConvert(bm, p);
+}
+typedef struct {
+  pageid_t pageid;
+  int slot;
+} stasis_buffer_concurrent_hash_miss_t;
+
+static int chMissCmp(const void *ap, const void *bp) {
+  const stasis_buffer_concurrent_hash_miss_t *a = (const stasis_buffer_concurrent_hash_miss_t*)ap;
+  const stasis_buffer_concurrent_hash_miss_t *b = (const stasis_buffer_concurrent_hash_miss_t*)bp;
+  return a->pageid < b->pageid ? -1 : (a->pageid > b->pageid ? 1 : 0);
+}
+/**
+ * Pin a batch of pages.  Cached pages are pinned without blocking.  Then,
+ * frames are claimed for each page that is not in cache, and the misses
+ * are read with a single call to read_pages(), which merges reads of
+ * adjacent pages.  Anything left over (duplicate ids, and pages that were
+ * loaded in race with us) goes through the normal loadPage path.
+ */
+static void chLoadPagesImpl(stasis_buffer_manager_t *bm, stasis_buffer_manager_handle_t *bh, int xid, const pageid_t * pageids, int count, Page ** pages) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  stasis_page_handle_t *ph = bh ? ((stasis_buffer_concurrent_hash_handle_t*)bh)->ph : ch->page_handle;
+  stasis_buffer_concurrent_hash_miss_t *misses = stasis_malloc(count, stasis_buffer_concurrent_hash_miss_t);
+  int miss_count = 0;
+
+  for(int i = 0; i < count; i++) {
+    pages[i] = chGetCachedPage(bm, xid, pageids[i]);
+    if(!pages[i]) {
+      misses[miss_count].pageid = pageids[i];
+      misses[miss_count].slot = i;
+      miss_count++;
+    }
+  }
+  qsort(misses, miss_count, sizeof(misses[0]), chMissCmp);
+
+  Page **batch = stasis_malloc(miss_count, Page*);
+  int batch_count = 0;
+  for(int i = 0; i < miss_count; i++) {
+    if(i && misses[i].pageid == misses[i-1].pageid) { continue; }
+    stasis_buffer_concurrent_hash_tls_t *tls = chPlaceFrame(bm, populateTLS(bm), misses[i].pageid);
+    hashtable_bucket_handle_t h;
+    if(NULL == hashtable_test_and_set_lock(ch->ht, misses[i].pageid, tls->p, &h)) {
+      // Same as chLoadPageImpl_helper, except that we keep the page pinned
+      // (by not putting it into the LRU) until it is read.
+      Page *p = tls->p;
+      tls->p = NULL;
+      writelock(p->loadlatch, 0);
+      p->id = misses[i].pageid;
+      batch[batch_count++] = p;
+      pages[misses[i].slot] = p;
+    }
+    hashtable_unlock(&h);
+  }
+  chReadPages(ch, ph, batch, batch_count, UNKNOWN_TYPE_PAGE);
+  for(int i = 0; i < batch_count; i++) {
+    // The page is not in LRU, so it cannot be evicted between these calls.
+    unlock(batch[i]->loadlatch);
+    readlock(batch[i]->loadlatch, 0);
+    chHotConvert(bm, batch[i]);
+  }
+  if(batch_count) {
+    // deinitTLS expects a free frame to be in TLS.
+    populateTLS(bm);
+    if(needFlush(bm)) { pthread_cond_broadcast(&ch->needFree); }
+  }
+
+  for(int i = 0; i < miss_count; i++) {
+    if(!pages[misses[i].slot]) {
+      pages[misses[i].slot] = chLoadPageImpl_helper(bm, xid, ph, misses[i].pageid, 0, UNKNOWN_TYPE_PAGE);
+    }
+  }
+  free(batch);
+  free(misses);
+}
+static void* readAheadWorker(void * arg);
+/**
+ * Queue a page range for the read-ahead threads.  This is a hint, so it is
+ * dropped if the threads are too far behind.
+ */
+static void chPrefetchPages(stasis_buffer_manager_t *bm, pageid_t pageid, pageid_t count) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  if(!ch->readahead_worker_count || count <= 0) { return; }
+  pthread_mutex_lock(&ch->readahead_mut);
+  if(ch->readahead_running && !ch->readahead_started) {
+    for(; ch->readahead_started < ch->readahead_worker_count; ch->readahead_started++) {
+      pthread_create(&ch->readahead_workers[ch->readahead_started], 0, readAheadWorker, bm);
+    }
+  }
+  if(ch->readahead_tail - ch->readahead_head < READAHEAD_QUEUE_LENGTH) {
+    stasis_buffer_concurrent_hash_readahead_t *r = &ch->readahead_queue[ch->readahead_tail % READAHEAD_QUEUE_LENGTH];
+    r->pageid = pageid;
+    r->count = count;
+    ch->readahead_tail++;
+    pthread_cond_signal(&ch->readahead_waiting);
+  }
+  pthread_mutex_unlock(&ch->readahead_mut);
+}
+static void* readAheadWorker(void * arg) {
+  stasis_buffer_manager_t *bm = (stasis_buffer_manager_t *)arg;
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  pageid_t pageids[READAHEAD_BATCH];
+  Page *pages[READAHEAD_BATCH];
+  stasis_handle_qos_set_class(STASIS_IO_CLASS_PREFETCH);
+
+  pthread_mutex_lock(&ch->readahead_mut);
+  while(1) {
+    while(ch->readahead_running && ch->readahead_head == ch->readahead_tail) {
+      pthread_cond_wait(&ch->readahead_waiting, &ch->readahead_mut);
+    }
+    if(!ch->readahead_running) { break; }
+    stasis_buffer_concurrent_hash_readahead_t r = ch->readahead_queue[ch->readahead_head % READAHEAD_QUEUE_LENGTH];
+    ch->readahead_head++;
+    pthread_mutex_unlock(&ch->readahead_mut);
+
+    // Don't read past the end of the page file; those pages are all zeros.
+    pageid_t end = ch->page_handle->page_count(ch->page_handle);
+    if(r.pageid + r.count > end) { r.count = end > r.pageid ? end - r.pageid : 0; }
+    for(pageid_t off = 0; off < r.count; off += ch->readahead_batch) {
+      int n = (r.count - off) < ch->readahead_batch ? (int)(r.count - off) : ch->readahead_batch;
+      for(int i = 0; i < n; i++) {
+        pageids[i] = r.pageid + off + i;
+      }
+      chLoadPagesImpl(bm, 0, -1, pageids, n, pages);
+      for(int i = 0; i < n; i++) {
+        chReleasePage(bm, pages[i]);
+      }
+    }
+    pthread_mutex_lock(&ch->readahead_mut);
+  }
+  pthread_mutex_unlock(&ch->readahead_mut);
+  return 0;
+}
+static void* hotSetWorker(void * arg) {
+  stasis_buffer_concurrent_hash_hotset_t *hs = (stasis_buffer_concurrent_hash_hotset_t *)arg;
+  stasis_buffer_manager_t *bm = hs->bm;
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  Page *pages[READAHEAD_BATCH];
+  stasis_handle_qos_set_class(STASIS_IO_CLASS_PREFETCH);
+
+  for(pageid_t off = 0; off < hs->count && ch->readahead_running; off += ch->readahead_batch) {
+    int n = (hs->count - off) < ch->readahead_batch ? (int)(hs->count - off) : ch->readahead_batch;
+    chLoadPagesImpl(bm, 0, -1, hs->pageids + off, n, pages);
+    for(int i = 0; i < n; i++) {
+      chReleasePage(bm, pages[i]);
+    }
+  }
+  free(hs);
+  return 0;
+}
+/**
+ * Write the ids of the pages in cache to stasis_buffer_manager_hot_set_file_name,
+ * in reverse eviction order, so that the pages the replacement policy would
+ * have kept longest come first.  With LRU, this is most recently used first;
+ * CLOCK only approximates that.  We find the order by draining the policy;
+ * this must only be called once the buffer manager is quiescent, and all of
+ * its pages are clean.
+ */
+static void chSaveHotSet(stasis_buffer_concurrent_hash_t *ch) {
+  if(!stasis_buffer_manager_hot_set_file_name) { return; }
+  pageid_t *ids = stasis_malloc(stasis_buffer_manager_size, pageid_t);
+  pageid_t count = 0;
+  Page *p;
+  while(count < stasis_buffer_manager_size && (p = ch->lru->getStaleAndRemove(ch->lru))) {
+    if(p->id >= 0 && hashtable_lookup(ch->ht, p->id) == p) {
+      ids[count] = p->id;
+      count++;
+    }
+  }
+  // getStaleAndRemove returns the next page the policy would evict first.
+  for(pageid_t i = 0; i < count / 2; i++) {
+    pageid_t tmp = ids[i];
+    ids[i] = ids[count - 1 - i];
+    ids[count - 1 - i] = tmp;
+  }
+  size_t len = strlen(stasis_buffer_manager_hot_set_file_name);
+  char *tmpname = stasis_malloc(len + 2, char);
+  snprintf(tmpname, len + 2, "%s~", stasis_buffer_manager_hot_set_file_name);
+  FILE *f = fopen(tmpname, "w");
+  if(!f) {
+    perror("Could not save buffer manager hot set");
+  } else {
+    int ok = (fwrite(&count, sizeof(count), 1, f) == 1)
+          && (fwrite(ids, sizeof(pageid_t), count, f) == (size_t)count);
+    ok = !fclose(f) && ok;
+    if(!ok || rename(tmpname, stasis_buffer_manager_hot_set_file_name)) {
+      perror("Could not save buffer manager hot set");
+      remove(tmpname);
+    }
+  }
+  free(tmpname);
+  free(ids);
+}
+static int chPageIdCmp(const void *a, const void *b) {
+  pageid_t x = *(const pageid_t*)a;
+  pageid_t y = *(const pageid_t*)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+/**
+ * Reload the pages that chSaveHotSet() saved at shutdown.  As many of the
+ * pages from the front of the list as fit in half of the buffer pool are read
+ * in page id order, by a few background threads.
+ */
+static void chRestoreHotSet(stasis_buffer_manager_t *bm) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  if(!stasis_buffer_manager_hot_set_file_name || ch->hotset) { return; }
+  FILE *f = fopen(stasis_buffer_manager_hot_set_file_name, "r");
+  if(!f) { return; }
+  pageid_t count;
+  if(fread(&count, sizeof(count), 1, f) != 1 || count <= 0) { fclose(f); return; }
+  // Leave some room for the pages that the application is loading.
+  if(count > stasis_buffer_manager_size / 2) { count = stasis_buffer_manager_size / 2; }
+  ch->hotset = stasis_malloc(count, pageid_t);
+  count = fread(ch->hotset, sizeof(pageid_t), count, f);
+  fclose(f);
+  qsort(ch->hotset, count, sizeof(pageid_t), chPageIdCmp);
+
+  ch->hotset_worker_count = ch->readahead_worker_count > 0 ? ch->readahead_worker_count : 1;
+  if(ch->hotset_worker_count > count) { ch->hotset_worker_count = count ? count : 1; }
+  ch->hotset_workers = stasis_malloc(ch->hotset_worker_count, pthread_t);
+  pageid_t per_worker = (count + ch->hotset_worker_count - 1) / ch->hotset_worker_count;
+  for(int i = 0; i < ch->hotset_worker_count; i++) {
+    stasis_buffer_concurrent_hash_hotset_t *hs = stasis_alloc(stasis_buffer_concurrent_hash_hotset_t);
+    pageid_t start = i * per_worker;
+    hs->bm = bm;
+    hs->pageids = ch->hotset + start;
+    hs->count = start >= count ? 0 : (count - start < per_worker ? count - start : per_worker);
+    pthread_create(&ch->hotset_workers[i], 0, hotSetWorker, hs);
+  }
+}
+/**
+ * Track the access pattern of a stream, and keep a window of
+ * stasis_buffer_manager_concurrent_hash_readahead_pages pages in front of
+ * sequential scans.  New requests are issued once the scan has consumed
+ * half of the window.
+ */
+static void chReadAhead(stasis_buffer_manager_t *bm, stasis_buffer_concurrent_hash_stream_t *h, int is_sequential, pageid_t pageid) {
+  if(pageid + 1 == h->next_pageid) {
+    // Loading the same page again neither continues nor breaks the scan.
+    return;
+  }
+  if(pageid == h->next_pageid) {
+    h->run_length++;
+  } else {
+    h->run_length = 0;
+    h->readahead_end = pageid + 1;
+  }
+  h->next_pageid = pageid + 1;
+
+  pageid_t window = stasis_buffer_manager_concurrent_hash_readahead_pages;
+  if(window <= 0) { return; }
+  if(!is_sequential && h->run_length < READAHEAD_TRIGGER) { return; }
+  if(h->readahead_end - pageid > window / 2) { return; }
+
+  pageid_t start = h->readahead_end > pageid + 1 ? h->readahead_end : pageid + 1;
+  pageid_t end = pageid + 1 + window;
+  chPrefetchPages(bm, start, end - start);
+  h->readahead_end = end;
+}
+/**
+ * Read ahead for a load that did not go through a handle.  The load
+ * continues the thread's stream that ends just before it, or replaces the
+ * stream that was used least recently.
+ */
+static void chReadAheadThread(stasis_buffer_manager_t *bm, pageid_t pageid) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  if(!ch->readahead_worker_count || stasis_buffer_manager_concurrent_hash_readahead_pages <= 0) { return; }
+  stasis_buffer_concurrent_hash_tls_t *tls = chGetTLS(bm);
+  int s = 0;
+  for(int i = 0; i < READAHEAD_STREAMS; i++) {
+    pageid_t next = tls->streams[i].next_pageid;
+    if(next == pageid || next == pageid + 1) { s = i; break; }
+    if(tls->stream_used[i] < tls->stream_used[s]) { s = i; }
+  }
+  tls->stream_used[s] = ++tls->stream_loads;
+  chReadAhead(bm, &tls->streams[s], 0, pageid);
 }
 static Page * chLoadPageImpl(stasis_buffer_manager_t *bm, stasis_buffer_manager_handle_t *h, int xid, const pageid_t pageid, pagetype_t type) {
-  return chLoadPageImpl_helper(bm, xid, (stasis_page_handle_t*)h, pageid, 0, type);
+  stasis_buffer_concurrent_hash_handle_t *ch_h = (stasis_buffer_concurrent_hash_handle_t*)h;
+  if(!ch_h) {
+    chReadAheadThread(bm, pageid);
+    return chLoadPageImpl_helper(bm, xid, NULL, pageid, 0, type);
+  }
+  chReadAhead(bm, &ch_h->stream, ch_h->is_sequential, pageid);
+  return chLoadPageImpl_helper(bm, xid, ch_h->ph, pageid, 0, type);
 }
 static Page * chLoadUninitPageImpl(stasis_buffer_manager_t *bm, int xid, const pageid_t pageid) {
   assert(!bm->in_redo);
@@ -351,6 +1051,7 @@ static Page * chLoadUninitPageImpl(stasis_buffer_manager_t *bm, int xid, const p
 }
 static void chReleasePage(stasis_buffer_manager_t * bm, Page * p) {
   stasis_buffer_concurrent_hash_t * ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  if(chHotUnpin(bm, p)) { return; }
   ch->lru->insert(ch->lru, p);
   int doFlush = p->needsFlush;
   pageid_t pid = p->id;
@@ -360,6 +1061,47 @@ static void chReleasePage(stasis_buffer_manager_t * bm, Page * p) {
     bm->tryToWriteBackPage(bm, pid);
   }
 }
+static int chSetPageHot(stasis_buffer_manager_t *bm, pageid_t pageid, int hot) {
+  stasis_buffer_concurrent_hash_t * ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  int ret = 0;
+  pthread_mutex_lock(&ch->hot_mut);
+  stasis_buffer_concurrent_hash_hot_t *e = chHotFind(ch, pageid);
+  if(hot && !e) {
+    for(int i = 0; i < HOT_PAGE_SLOTS; i++) {
+      if(ch->hot[i].pageid == INVALID_PAGE) { e = &ch->hot[i]; break; }
+    }
+    if(!e) {
+      ret = ENOSPC;
+    } else {
+      Page *p = chLoadPageImpl_helper(bm, -1, NULL, pageid, 0, UNKNOWN_TYPE_PAGE);
+      // This reference keeps the page out of the replacement policy until it is no longer hot.
+      ch->lru->remove(ch->lru, p);
+      e->p = p;
+      __atomic_store_n(&e->state, HOT_ARMING, __ATOMIC_SEQ_CST);
+      __atomic_store_n(&e->pageid, pageid, __ATOMIC_RELEASE);
+      __atomic_fetch_add(&ch->hot_count, 1, __ATOMIC_SEQ_CST);
+      chReleasePage(bm, p);
+      // Wait for pins that were taken through loadlatch.  Any that arrive
+      // after we release the latch will see HOT_ACTIVE, and convert themselves.
+      writelock(p->loadlatch, 0);
+      assert(p->id == pageid);
+      __atomic_store_n(&e->state, HOT_ACTIVE, __ATOMIC_SEQ_CST);
+      unlock(p->loadlatch);
+    }
+  } else if(!hot && e) {
+    Page *p = e->p;
+    writelock(p->loadlatch, 0);
+    chHotDrain(ch, p, 1);
+    __atomic_store_n(&e->state, HOT_FREE, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&e->pageid, INVALID_PAGE, __ATOMIC_RELEASE);
+    e->p = NULL;
+    __atomic_fetch_sub(&ch->hot_count, 1, __ATOMIC_SEQ_CST);
+    unlock(p->loadlatch);
+    ch->lru->insert(ch->lru, p);
+  }
+  pthread_mutex_unlock(&ch->hot_mut);
+  return ret;
+}
 static void chForcePages(stasis_buffer_manager_t* bm, stasis_buffer_manager_handle_t *h) {
   stasis_buffer_concurrent_hash_t * ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
   ch->page_handle->force_file(ch->page_handle);
@@ -378,19 +1120,54 @@ static int chPreallocatePages(stasis_buffer_manager_t * bm, pageid_t start, page
 }
 static void chBufDeinitHelper(stasis_buffer_manager_t * bm, int crash) {
   stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  // Stop read-ahead first; it may need the writeback threads to free frames.
+  pthread_mutex_lock(&ch->readahead_mut);
+  ch->readahead_running = 0;
+  pthread_cond_broadcast(&ch->readahead_waiting);
+  pthread_mutex_unlock(&ch->readahead_mut);
+  for(int i = 0; i < ch->readahead_started; i++) {
+    pthread_join(ch->readahead_workers[i], NULL);
+  }
+  free(ch->readahead_workers);
+  for(int i = 0; i < ch->hotset_worker_count; i++) {
+    pthread_join(ch->hotset_workers[i], NULL);
+  }
+  free(ch->hotset_workers);
+  free(ch->hotset);
+  pthread_mutex_destroy(&ch->readahead_mut);
+  pthread_cond_destroy(&ch->readahead_waiting);
+
+  // See writeBackWorker().
+  pthread_mutex_lock(&ch->needFreeMut);
   ch->running = 0;
+  pthread_cond_broadcast(&ch->needFree);
+  pthread_mutex_unlock(&ch->needFreeMut);
   pthread_key_delete(ch->key);
-  pthread_cond_signal(&ch->needFree);
-  pthread_join(ch->worker, NULL);
+  for(int i = 0; i < ch->worker_count; i++) {
+    pthread_join(ch->workers[i].thread, NULL);
+  }
+  free(ch->workers);
   pthread_cond_destroy(&ch->needFree);
+  pthread_mutex_destroy(&ch->needFreeMut);
+  // Nothing is pinned now, so hot pages can be handed back to the replacement policy without draining them.
+  for(int i = 0; i < HOT_PAGE_SLOTS; i++) {
+    if(ch->hot[i].pageid != INVALID_PAGE) {
+      ch->lru->insert(ch->lru, ch->hot[i].p);
+    }
+  }
+  ch->hot_count = 0;
   if(!crash) {
     stasis_dirty_page_table_flush(ch->dpt);
     ch->page_handle->force_file(ch->page_handle);
+    chSaveHotSet(ch);
   }
   hashtable_deinit(ch->ht);
   ch->lru->deinit(ch->lru);
   stasis_buffer_pool_deinit(ch->buffer_pool);
   ch->page_handle->close(ch->page_handle);
+  if(ch->compressed) { stasis_compressed_tier_close(ch->compressed); }
+  pthread_mutex_destroy(&ch->hot_mut);
+  free(ch->hot);
   free(ch);
   free(bm);
 }
@@ -402,31 +1179,89 @@ static void chBufDeinit(stasis_buffer_manager_t * bm) {
 }
 static stasis_buffer_manager_handle_t * chOpenHandle(stasis_buffer_manager_t *bm, int is_sequential) {
   stasis_buffer_concurrent_hash_t * bh = (stasis_buffer_concurrent_hash_t *)bm->impl;
-  return (stasis_buffer_manager_handle_t*)bh->page_handle->dup(bh->page_handle, is_sequential);
+  stasis_page_handle_t * ph = bh->page_handle->dup(bh->page_handle, is_sequential);
+  if(!ph) { return NULL; }
+  stasis_buffer_concurrent_hash_handle_t * ret = stasis_alloc(stasis_buffer_concurrent_hash_handle_t);
+  ret->ph = ph;
+  ret->is_sequential = is_sequential;
+  ret->stream.next_pageid = INVALID_PAGE;
+  ret->stream.run_length = 0;
+  ret->stream.readahead_end = INVALID_PAGE;
+  return (stasis_buffer_manager_handle_t*)ret;
 }
 static int chCloseHandle(stasis_buffer_manager_t *bm, stasis_buffer_manager_handle_t* h) {
-  ((stasis_page_handle_t*)h)->close((stasis_page_handle_t*)h);
+  stasis_buffer_concurrent_hash_handle_t * ch_h = (stasis_buffer_concurrent_hash_handle_t*)h;
+  ch_h->ph->close(ch_h->ph);
+  free(ch_h);
   return 0;
 }
 
+/** Create a replacement policy for frames [frames, frames+count). */
+static replacementPolicy * chReplacementPolicyInit(Page * frames, pageid_t count) {
+  replacementPolicy * ret = NULL;
+  if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU) {
+
+    replacementPolicy ** lrus = stasis_malloc(37, replacementPolicy*);
+    for(int i = 0; i < 37; i++) {
+      lrus[i] = lruFastInit();
+    }
+    ret = replacementPolicyConcurrentWrapperInit(lrus, 37);
+    free(lrus);
+  } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CONCURRENT_2Q) {
+    replacementPolicy ** lrus = stasis_malloc(37, replacementPolicy*);
+    for(int i = 0; i < 37; i++) {
+      lrus[i] = stasis_replacement_policy_2q_init(count / 37);
+    }
+    ret = replacementPolicyConcurrentWrapperInit(lrus, 37);
+    free(lrus);
+  } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU) {
+    ret = replacementPolicyThreadsafeWrapperInit(lruFastInit());
+  } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CLOCK) {
+    ret = replacementPolicyClockInit(frames, count);
+  }
+  return ret;
+}
+
+int stasis_buffer_manager_concurrent_hash_numa_stats(stasis_buffer_manager_t *bm, int node, stasis_replacement_policy_numa_stats_t *stats) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  if(ch->numa_node_count <= 1) { return 0; }
+  return stasis_replacement_policy_numa_stats(ch->lru, node, stats);
+}
+
+int stasis_buffer_manager_concurrent_hash_compressed_tier_stats(stasis_buffer_manager_t *bm, stasis_compressed_tier_stats_t *stats) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  if(!ch->compressed) { return 0; }
+  stasis_compressed_tier_stats(ch->compressed, stats);
+  return 1;
+}
+
+int stasis_buffer_manager_concurrent_hash_huge_pages(stasis_buffer_manager_t *bm) {
+  stasis_buffer_concurrent_hash_t *ch = (stasis_buffer_concurrent_hash_t *)bm->impl;
+  return stasis_buffer_pool_huge_pages_mode(ch->buffer_pool);
+}
+
 stasis_buffer_manager_t* stasis_buffer_manager_concurrent_hash_open(stasis_page_handle_t * h, stasis_log_t * log, stasis_dirty_page_table_t * dpt) {
   stasis_buffer_manager_t *bm = stasis_alloc(stasis_buffer_manager_t);
   stasis_buffer_concurrent_hash_t *ch = stasis_alloc(stasis_buffer_concurrent_hash_t);
   bm->openHandleImpl = chOpenHandle;
   bm->closeHandleImpl = chCloseHandle;
   bm->loadPageImpl = chLoadPageImpl;
+  bm->loadPagesImpl = chLoadPagesImpl;
   bm->loadUninitPageImpl = chLoadUninitPageImpl;
-  bm->prefetchPages = NULL;
+  bm->prefetchPages = chPrefetchPages;
   bm->preallocatePages = chPreallocatePages;
   bm->getCachedPageImpl = chGetCachedPage;
   bm->releasePageImpl = chReleasePage;
   bm->writeBackPage = chWriteBackPage;
   bm->tryToWriteBackPage = chTryToWriteBackPage;
+  bm->tryToWriteBackPages = chTryToWriteBackPages;
   bm->forcePages = chForcePages;
   bm->asyncForcePages = chAsyncForcePages;
   bm->forcePageRange = chForcePageRange;
   bm->stasis_buffer_manager_close = chBufDeinit;
   bm->stasis_buffer_manager_simulate_crash = chSimulateBufferManagerCrash;
+  bm->restoreHotSet = chRestoreHotSet;
+  bm->setPageHotImpl = chSetPageHot;
 
   bm->impl = ch;
 
@@ -440,20 +1275,24 @@ stasis_buffer_manager_t* stasis_buffer_manager_concurrent_hash_open(stasis_page_
 #endif
   ch->buffer_pool = stasis_buffer_pool_init();
 
-  if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU) {
-
-    replacementPolicy ** lrus = stasis_malloc(37, replacementPolicy*);
-    for(int i = 0; i < 37; i++) {
-      lrus[i] = lruFastInit();
+  Page * frames = stasis_buffer_pool_get_underlying_array(ch->buffer_pool);
+  ch->numa_node_count = stasis_buffer_pool_node_count(ch->buffer_pool);
+  if(ch->numa_node_count > 1) {
+    pageid_t per_node = stasis_buffer_pool_frames_per_node(ch->buffer_pool);
+    replacementPolicy ** nodes = stasis_malloc(ch->numa_node_count, replacementPolicy*);
+    for(int i = 0; i < ch->numa_node_count; i++) {
+      pageid_t start = i * per_node;
+      pageid_t count = start + per_node > stasis_buffer_manager_size ? stasis_buffer_manager_size - start : per_node;
+      nodes[i] = chReplacementPolicyInit(frames + start, count);
     }
-    ch->lru = replacementPolicyConcurrentWrapperInit(lrus, 37);
-    free(lrus);
-  } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU) {
-    ch->lru = replacementPolicyThreadsafeWrapperInit(lruFastInit());
-  } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CLOCK) {
-    ch->lru = replacementPolicyClockInit(stasis_buffer_pool_get_underlying_array(ch->buffer_pool), stasis_buffer_manager_size);
+    ch->lru = stasis_replacement_policy_numa_init(nodes, ch->numa_node_count, frames, per_node, stasis_buffer_manager_size);
+    free(nodes);
+  } else {
+    ch->lru = chReplacementPolicyInit(frames, stasis_buffer_manager_size);
   }
-  ch->ht = hashtable_init(stasis_buffer_manager_size * 4);
+  ch->next_free_id = -stasis_buffer_manager_size - 2;
+  // Only cached pages are hashed, and the hashtable grows with them.
+  ch->ht = hashtable_init(1);
 
   for(pageid_t i = 0; i < stasis_buffer_manager_size; i++) {
     Page *p = stasis_buffer_pool_malloc_page(ch->buffer_pool);
@@ -461,16 +1300,50 @@ stasis_buffer_manager_t* stasis_buffer_manager_concurrent_hash_open(stasis_page_
     p->prev = p->next = NULL;
     p->pinCount = 1;
     ch->lru->insert(ch->lru, p);  // decrements pin count ptr (setting it to zero)
-    hashtable_insert(ch->ht, p->id, p);
   }
 
   ch->pageCount = 0;
 
+  ch->hot = stasis_calloc(HOT_PAGE_SLOTS, stasis_buffer_concurrent_hash_hot_t);
+  for(int i = 0; i < HOT_PAGE_SLOTS; i++) {
+    ch->hot[i].pageid = INVALID_PAGE;
+  }
+  ch->hot_count = 0;
+  ch->hot_next_shard = 0;
+  pthread_mutex_init(&ch->hot_mut, 0);
+
+  ch->compressed = stasis_buffer_manager_compressed_tier_size > 0
+                 ? stasis_compressed_tier_open(stasis_buffer_manager_compressed_tier_size * PAGE_SIZE) : NULL;
+
   ch->running = 1;
 
   pthread_key_create(&ch->key, deinitTLS);
   pthread_cond_init(&ch->needFree, 0);
-  pthread_create(&ch->worker, 0, writeBackWorker, bm);
+  pthread_mutex_init(&ch->needFreeMut, 0);
+  ch->worker_count = stasis_buffer_manager_concurrent_hash_writeback_count > 0
+                   ? stasis_buffer_manager_concurrent_hash_writeback_count : 1;
+  ch->workers = stasis_malloc(ch->worker_count, stasis_buffer_concurrent_hash_writeback_t);
+  for(int i = 0; i < ch->worker_count; i++) {
+    ch->workers[i].bm = bm;
+    ch->workers[i].partition = i;
+    pthread_create(&ch->workers[i].thread, 0, writeBackWorker, &ch->workers[i]);
+  }
+
+  pthread_mutex_init(&ch->readahead_mut, 0);
+  pthread_cond_init(&ch->readahead_waiting, 0);
+  ch->readahead_head = 0;
+  ch->readahead_tail = 0;
+  ch->readahead_running = 1;
+  ch->readahead_worker_count = stasis_buffer_manager_concurrent_hash_readahead_count > 0
+                             ? stasis_buffer_manager_concurrent_hash_readahead_count : 0;
+  ch->readahead_workers = stasis_malloc(ch->readahead_worker_count, pthread_t);
+  ch->readahead_started = 0;
+  pageid_t batch = stasis_buffer_manager_size / READAHEAD_POOL_FRACTION
+                 / (ch->readahead_worker_count ? ch->readahead_worker_count : 1);
+  ch->readahead_batch = batch < 1 ? 1 : (batch > READAHEAD_BATCH ? READAHEAD_BATCH : (int)batch);
+  ch->hotset = NULL;
+  ch->hotset_workers = NULL;
+  ch->hotset_worker_count = 0;
 
   return bm;
 }
@@ -61,10 +61,14 @@ stasis_buffer_manager_t* stasis_buffer_manager_deprecated_open(stasis_page_handl
   bm->closeHandleImpl = bufManCloseHandle;
   bm->loadPageImpl = bufManLoadPage;
   bm->loadUninitPageImpl = bufManLoadUninitPage;
+  bm->loadPagesImpl = NULL;
   bm->prefetchPages = NULL;
   bm->preallocatePages = NULL;
   bm->getCachedPageImpl = bufManGetCachedPage;
   bm->writeBackPage = pageWrite_legacyWrapper;
+  bm->tryToWriteBackPages = NULL;
+  bm->restoreHotSet = NULL;
+  bm->setPageHotImpl = NULL;
   bm->forcePages = forcePageFile_legacyWrapper;
   bm->forcePageRange = forceRangePageFile_legacyWrapper;
   bm->stasis_buffer_manager_close = bufManBufDeinit;
@@ -69,6 +69,10 @@ static void pfPageRead(stasis_page_handle_t * h, Page *ret, pagetype_t type) {
       printf("pageFile.c readfile: read_size = %d, errno = %d\n", read_size, errno);
       abort();
     }
+  } else if(stasis_page_checksum_check(ret->memAddr, ret->id, type)) {
+    printf("pageFile.c: page %lld failed its checksum\n", (long long)ret->id);
+    fflush(NULL);
+    abort();
   }
   assert(ret->dirty == 0);
   stasis_page_loaded(ret, type);
@@ -89,6 +93,7 @@ static void pfPageWrite(stasis_page_handle_t * h, Page * ret) {
   pageid_t offset ;
 
   stasis_page_flushed(ret);
+  stasis_page_checksum_update(ret);
 
   // If necessary, force the log to disk so that ret's LSN will be stable.
 
@@ -138,9 +143,11 @@ stasis_page_handle_t*  openPageFile(stasis_log_t * log, stasis_dirty_page_table_
   ret->write = pfPageWrite;
   ret->force_file = pfForcePageFile;
   ret->force_range = pfForceRangePageFile;
+  ret->evict = NULL;
   ret->close = pfClosePageFile;
   ret->log = log;
   ret->dirtyPages = dpt;
+  ret->scrubber = NULL;
   DEBUG("Opening storefile.\n");
 
 #ifdef PAGE_FILE_O_DIRECT
@@ -0,0 +1,219 @@
+/*
+ * mmapReadOnly.c
+ *
+ * A buffer manager for page files that never change.  The page file is
+ * mapped into memory with mmap(), and loadPage() returns Page structs whose
+ * memAddr points directly at the mapping, so pages are never copied, and
+ * the kernel's page cache is the only cache.  Page structs are created the
+ * first time a page is requested, and live until the buffer manager is
+ * closed, so pinning and unpinning pages are no-ops.
+ *
+ * The page file is opened read only.  Pages are mapped copy-on-write, so
+ * that a stray write to a page does not fault, but the page is then dirty,
+ * and releasing it or writing it back aborts.  Attempts to load
+ * uninitialized pages abort too.
+ *
+ * By default, the mapping is marked MADV_RANDOM.  Handles opened with
+ * is_sequential set issue MADV_WILLNEED hints ahead of the pages they load.
+ */
+#include <stasis/transactional.h>
+#include <stasis/util/latches.h>
+#include <stasis/bufferManager/mmapReadOnly.h>
+#include <stasis/page.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <stdio.h>
+
+/** How far ahead of sequential handles we ask the kernel to read. */
+#define MMAP_READAHEAD_PAGES 64
+
+typedef struct {
+  int fd;
+  byte * map;
+  pageid_t pageCount;
+  /** One entry per page in the file.  Entries are set (once) with CAS. */
+  Page ** pageMap;
+} stasis_buffer_manager_mmap_t;
+
+typedef struct {
+  int is_sequential;
+  /** MADV_WILLNEED has been issued for pages before this one. */
+  pageid_t willneed_end;
+} stasis_buffer_manager_mmap_handle_t;
+
+static void mmAdvise(stasis_buffer_manager_mmap_t *mm, pageid_t pageid, pageid_t count, int advice) {
+  if(pageid >= mm->pageCount || count <= 0) { return; }
+  if(pageid + count > mm->pageCount) { count = mm->pageCount - pageid; }
+  if(madvise(mm->map + pageid * PAGE_SIZE, count * PAGE_SIZE, advice)) {
+    perror("madvise() failed");
+  }
+}
+static Page * mmGetPage(stasis_buffer_manager_mmap_t *mm, pageid_t pageid, pagetype_t type) {
+  if(pageid < 0 || pageid >= mm->pageCount) {
+    return NULL;
+  }
+  Page * ret = mm->pageMap[pageid];
+  if(ret) {
+    if(type != UNKNOWN_TYPE_PAGE) { assert(type == ret->pageType); }
+    return ret;
+  }
+  Page * p = stasis_alloc(Page);
+  p->id = pageid;
+  p->dirty = 0;
+  p->needsFlush = 0;
+  p->next = 0;
+  p->prev = 0;
+  p->pinCount = 0;
+  p->pending = 0;
+  p->inCache = 1;
+  p->rwlatch = initlock();
+  p->version = 0;
+  p->loadlatch = initlock();
+  p->memAddr = mm->map + pageid * PAGE_SIZE;
+  stasis_page_loaded(p, type);
+  if(__sync_bool_compare_and_swap(&mm->pageMap[pageid], NULL, p)) {
+    return p;
+  }
+  // Another thread beat us to it.
+  deletelock(p->rwlatch);
+  deletelock(p->loadlatch);
+  free(p);
+  return mm->pageMap[pageid];
+}
+static Page * mmLoadPage(stasis_buffer_manager_t *bm, stasis_buffer_manager_handle_t * h, int xid, pageid_t pageid, pagetype_t type) {
+  stasis_buffer_manager_mmap_t *mm = (stasis_buffer_manager_mmap_t *)bm->impl;
+  stasis_buffer_manager_mmap_handle_t *mh = (stasis_buffer_manager_mmap_handle_t *)h;
+  if(mh && mh->is_sequential && pageid + MMAP_READAHEAD_PAGES / 2 >= mh->willneed_end) {
+    pageid_t start = mh->willneed_end > pageid ? mh->willneed_end : pageid;
+    mmAdvise(mm, start, pageid + MMAP_READAHEAD_PAGES - start, MADV_WILLNEED);
+    mh->willneed_end = pageid + MMAP_READAHEAD_PAGES;
+  }
+  Page * ret = mmGetPage(mm, pageid, type);
+  if(!ret) {
+    fprintf(stderr, "mmapReadOnly: Attempt to load page %lld, which is past the end of the (read only) page file\n", (long long)pageid);
+    abort();
+  }
+  return ret;
+}
+static Page * mmLoadUninitPage(stasis_buffer_manager_t *bm, int xid, pageid_t pageid) {
+  fprintf(stderr, "mmapReadOnly: Attempt to initialize page %lld in a read only page file\n", (long long)pageid);
+  abort();
+}
+static Page * mmGetCachedPage(stasis_buffer_manager_t *bm, int xid, pageid_t pageid) {
+  stasis_buffer_manager_mmap_t *mm = (stasis_buffer_manager_mmap_t *)bm->impl;
+  return mmGetPage(mm, pageid, UNKNOWN_TYPE_PAGE);
+}
+static void mmRefuseDirtyPage(Page * p) {
+  if(p && p->dirty) {
+    fprintf(stderr, "mmapReadOnly: Page %lld was modified, but the page file is read only\n", (long long)p->id);
+    abort();
+  }
+}
+static void mmReleasePage(stasis_buffer_manager_t *bm, Page * p) {
+  mmRefuseDirtyPage(p);
+}
+static void mmPrefetchPages(stasis_buffer_manager_t *bm, pageid_t pageid, pageid_t count) {
+  stasis_buffer_manager_mmap_t *mm = (stasis_buffer_manager_mmap_t *)bm->impl;
+  mmAdvise(mm, pageid, count, MADV_WILLNEED);
+}
+static int mmWriteBackPage(stasis_buffer_manager_t *bm, pageid_t pageid) {
+  stasis_buffer_manager_mmap_t *mm = (stasis_buffer_manager_mmap_t *)bm->impl;
+  if(pageid >= 0 && pageid < mm->pageCount) { mmRefuseDirtyPage(mm->pageMap[pageid]); }
+  return 0;
+}
+static void mmForcePages(stasis_buffer_manager_t * bm, stasis_buffer_manager_handle_t *h) { /* no-op */ }
+static void mmAsyncForcePages(stasis_buffer_manager_t * bm, stasis_buffer_manager_handle_t *h) { /* no-op */ }
+static void mmForcePageRange(stasis_buffer_manager_t *bm, stasis_buffer_manager_handle_t *h, pageid_t start, pageid_t stop) { /* no-op */ }
+
+static void mmBufDeinit(stasis_buffer_manager_t * bm) {
+  stasis_buffer_manager_mmap_t *mm = (stasis_buffer_manager_mmap_t *)bm->impl;
+
+  for(pageid_t i = 0; i < mm->pageCount; i++) {
+    if(mm->pageMap[i]) {
+      deletelock(mm->pageMap[i]->rwlatch);
+      deletelock(mm->pageMap[i]->loadlatch);
+      free(mm->pageMap[i]);
+    }
+  }
+  if(mm->pageCount) {
+    munmap(mm->map, mm->pageCount * PAGE_SIZE);
+  }
+  close(mm->fd);
+  free(mm->pageMap);
+  free(mm);
+  free(bm);
+}
+
+static stasis_buffer_manager_handle_t * mmOpenHandle(stasis_buffer_manager_t *bm, int is_sequential) {
+  stasis_buffer_manager_mmap_handle_t * h = stasis_alloc(stasis_buffer_manager_mmap_handle_t);
+  h->is_sequential = is_sequential;
+  h->willneed_end = 0;
+  return (stasis_buffer_manager_handle_t*)h;
+}
+static int mmCloseHandle(stasis_buffer_manager_t *bm, stasis_buffer_manager_handle_t* h) {
+  free(h);
+  return 0; // no error.
+}
+
+stasis_buffer_manager_t * stasis_buffer_manager_mmap_read_only_open(const char * filename) {
+  int fd = open(filename, O_RDONLY);
+  if(fd == -1) {
+    perror("mmapReadOnly: Could not open page file");
+    return NULL;
+  }
+  struct stat st;
+  if(fstat(fd, &st)) {
+    perror("mmapReadOnly: Could not stat page file");
+    close(fd);
+    return NULL;
+  }
+
+  stasis_buffer_manager_t * bm = stasis_alloc(stasis_buffer_manager_t);
+  stasis_buffer_manager_mmap_t * mm = stasis_alloc(stasis_buffer_manager_mmap_t);
+
+  mm->fd = fd;
+  mm->pageCount = st.st_size / PAGE_SIZE;
+  mm->map = NULL;
+  if(mm->pageCount) {
+    mm->map = mmap(NULL, mm->pageCount * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if(mm->map == MAP_FAILED) {
+      perror("mmapReadOnly: Could not map page file");
+      close(fd);
+      free(mm);
+      free(bm);
+      return NULL;
+    }
+    if(madvise(mm->map, mm->pageCount * PAGE_SIZE, MADV_RANDOM)) {
+      perror("madvise() failed");
+    }
+  }
+  mm->pageMap = stasis_calloc(mm->pageCount ? mm->pageCount : 1, Page*);
+
+  bm->releasePageImpl = mmReleasePage;
+  bm->openHandleImpl = mmOpenHandle;
+  bm->closeHandleImpl = mmCloseHandle;
+  bm->loadPageImpl = mmLoadPage;
+  bm->loadUninitPageImpl = mmLoadUninitPage;
+  bm->loadPagesImpl = NULL;
+  bm->prefetchPages = mmPrefetchPages;
+  bm->preallocatePages = NULL;
+  bm->getCachedPageImpl = mmGetCachedPage;
+  bm->writeBackPage = mmWriteBackPage;
+  bm->tryToWriteBackPage = mmWriteBackPage;
+  bm->tryToWriteBackPages = NULL;
+  bm->restoreHotSet = NULL;
+  bm->setPageHotImpl = NULL;
+  bm->forcePages = mmForcePages;
+  bm->asyncForcePages = mmAsyncForcePages;
+  bm->forcePageRange = mmForcePageRange;
+  bm->stasis_buffer_manager_close = mmBufDeinit;
+  bm->stasis_buffer_manager_simulate_crash = mmBufDeinit;
+  bm->impl = mm;
+  return bm;
+}
+stasis_buffer_manager_t* stasis_buffer_manager_mmap_read_only_factory(stasis_log_t * log, stasis_dirty_page_table_t *dpt) {
+  return stasis_buffer_manager_mmap_read_only_open(stasis_store_file_name);
+}
@@ -33,6 +33,7 @@ static Page * paLoadPage(stasis_buffer_manager_t *bm, stasis_buffer_manager_hand
     pa->pageMap[pageid]->pinCount = 0;
     pa->pageMap[pageid]->inCache = 1;
     pa->pageMap[pageid]->rwlatch = initlock();
+    pa->pageMap[pageid]->version = 0;
     pa->pageMap[pageid]->loadlatch = initlock();
     pa->pageMap[pageid]->memAddr= stasis_calloc(PAGE_SIZE, byte);
   } else{
@@ -90,11 +91,15 @@ stasis_buffer_manager_t * stasis_buffer_manager_mem_array_open (void) {
   bm->closeHandleImpl = paCloseHandle;
   bm->loadPageImpl = paLoadPage;
   bm->loadUninitPageImpl = paLoadUninitPage;
+  bm->loadPagesImpl = NULL;
   bm->prefetchPages = NULL;
   bm->preallocatePages = NULL;
   bm->getCachedPageImpl = paGetCachedPage;
   bm->writeBackPage = paWriteBackPage;
   bm->tryToWriteBackPage = paWriteBackPage;
+  bm->tryToWriteBackPages = NULL;
+  bm->restoreHotSet = NULL;
+  bm->setPageHotImpl = NULL;
   bm->forcePages = paForcePages;
   bm->asyncForcePages = paAsyncForcePages;
   bm->forcePageRange = paForcePageRange;
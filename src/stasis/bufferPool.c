@@ -48,20 +48,170 @@ terms specified in this license.
  * $Id: bufferPool.c 1542 2011-08-23 18:25:26Z sears.russell@gmail.com $
  *
  */
+#include <config.h>
 #include <stasis/common.h>
 #include <stasis/flags.h>
 
 #include <stasis/bufferPool.h>
 #include <stasis/page.h>
 #include <assert.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+#ifdef HAVE_MBIND
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 struct stasis_buffer_pool_t {
 	pageid_t nextPage;
 	Page* pool;
 	pthread_mutex_t mut;
 	void * addr_to_free;
+	/** Length of the mapping at addr_to_free, or zero if it came from stasis_buffer_pool_alloc_aligned(). */
+	size_t map_len;
+	/** The STASIS_BUFFER_POOL_HUGE_PAGES_* mode that the frames were allocated with. */
+	int huge_pages;
+	/** The pool is split into node_count runs of frames_per_node frames. */
+	int node_count;
+	pageid_t frames_per_node;
 };
 
+void * stasis_buffer_pool_alloc_aligned(size_t len) {
+#ifdef HAVE_POSIX_MEMALIGN
+  void * ret;
+  if(posix_memalign(&ret, PAGE_SIZE, len)) { return NULL; }
+  return ret;
+#else
+  // Keep the unaligned pointer in front of the buffer, so that
+  // stasis_buffer_pool_free_aligned() can find it.
+  byte * raw = stasis_malloc(len + PAGE_SIZE + sizeof(void*), byte);
+  if(!raw) { return NULL; }
+  byte * ret = raw + sizeof(void*);
+  ret += PAGE_SIZE - (((intptr_t)ret) % PAGE_SIZE);
+  ((void**)ret)[-1] = raw;
+  return ret;
+#endif
+}
+
+void stasis_buffer_pool_free_aligned(void * buf) {
+#ifdef HAVE_POSIX_MEMALIGN
+  free(buf);
+#else
+  if(buf) { free(((void**)buf)[-1]); }
+#endif
+}
+
+/**
+ * @return the number of NUMA nodes in the system, according to sysfs, or 1
+ * if that cannot be determined.
+ */
+static int stasis_buffer_pool_online_nodes(void) {
+  int first, last = 0;
+  FILE * f = fopen("/sys/devices/system/node/online", "r");
+  if(!f) { return 1; }
+  // The file holds a list of ranges, such as "0" or "0-1" or "0,2-3".
+  int ret = 1;
+  while(1 <= fscanf(f, "%d", &first)) {
+    last = first;
+    int c = fgetc(f);
+    if(c == '-') {
+      if(1 != fscanf(f, "%d", &last)) { break; }
+      c = fgetc(f);
+    }
+    if(last + 1 > ret) { ret = last + 1; }
+    if(c != ',') { break; }
+  }
+  fclose(f);
+  return ret;
+}
+
+/**
+ * Ask the kernel to back frames [start, start+count) with memory from node.
+ * This is a hint; if it fails, the frames end up wherever the threads that
+ * first touch them run.
+ */
+static void stasis_buffer_pool_bind(byte * start, pageid_t count, int node) {
+#ifdef HAVE_MBIND
+  unsigned long mask = 1UL << node;
+  if(syscall(__NR_mbind, start, count * PAGE_SIZE, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0)) {
+    perror("Could not bind buffer pool frames to NUMA node");
+  }
+#endif
+}
+
+/**
+ * Read a size in bytes from the first line of path that starts with
+ * prefix (and, if kb is set, ends in "kB").
+ *
+ * @return the size, or def if it could not be read.
+ */
+static size_t stasis_buffer_pool_read_size(const char * path, const char * prefix, int kb, size_t def) {
+  FILE * f = fopen(path, "r");
+  if(!f) { return def; }
+  char line[128];
+  size_t ret = def;
+  size_t prefix_len = strlen(prefix);
+  while(fgets(line, sizeof(line), f)) {
+    unsigned long long val;
+    if(!strncmp(line, prefix, prefix_len) && 1 == sscanf(line + prefix_len, "%llu", &val) && val) {
+      ret = kb ? val * 1024 : val;
+      break;
+    }
+  }
+  fclose(f);
+  return ret;
+}
+
+/**
+ * Allocate len bytes of PAGE_SIZE aligned memory for the frames, backed
+ * by huge pages if stasis_buffer_pool_huge_pages asks for them.  Explicit
+ * huge pages fall back on transparent huge pages, which fall back on
+ * ordinary pages.  ret->huge_pages is set to the mode that was used.
+ */
+static byte * stasis_buffer_pool_alloc_frames(stasis_buffer_pool_t * ret, size_t len) {
+  ret->huge_pages = STASIS_BUFFER_POOL_HUGE_PAGES_DISABLED;
+  ret->map_len = 0;
+#ifdef MAP_HUGETLB
+  if(stasis_buffer_pool_huge_pages == STASIS_BUFFER_POOL_HUGE_PAGES_EXPLICIT) {
+    size_t huge = stasis_buffer_pool_read_size("/proc/meminfo", "Hugepagesize:", 1, 2 * 1024 * 1024);
+    size_t map_len = ((len + huge - 1) / huge) * huge;
+    void * buf = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(buf != MAP_FAILED) {
+      ret->huge_pages = STASIS_BUFFER_POOL_HUGE_PAGES_EXPLICIT;
+      ret->addr_to_free = buf;
+      ret->map_len = map_len;
+      return buf;
+    }
+    perror("Could not allocate buffer pool from explicit huge pages (is vm.nr_hugepages large enough?); trying transparent huge pages");
+  }
+#endif
+#ifdef MADV_HUGEPAGE
+  if(stasis_buffer_pool_huge_pages != STASIS_BUFFER_POOL_HUGE_PAGES_DISABLED) {
+    size_t huge = stasis_buffer_pool_read_size("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "", 0, 2 * 1024 * 1024);
+    // Over-allocate, so that the frames can start on a huge page boundary.
+    size_t map_len = len + huge;
+    byte * buf = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(buf != MAP_FAILED) {
+      byte * frames = (byte*)((((intptr_t)buf) + huge - 1) & ~((intptr_t)huge - 1));
+      ret->addr_to_free = buf;
+      ret->map_len = map_len;
+      if(madvise(frames, len, MADV_HUGEPAGE)) {
+        perror("Could not enable transparent huge pages for buffer pool; using ordinary pages");
+      } else {
+        ret->huge_pages = STASIS_BUFFER_POOL_HUGE_PAGES_TRANSPARENT;
+      }
+      return frames;
+    }
+    perror("Could not map buffer pool; using ordinary pages");
+  }
+#endif
+  byte * buf = stasis_buffer_pool_alloc_aligned(len);
+  ret->addr_to_free = buf;
+  return buf;
+}
+
 stasis_buffer_pool_t* stasis_buffer_pool_init(void) {
 
   stasis_buffer_pool_t * ret = stasis_alloc(stasis_buffer_pool_t);
@@ -70,17 +220,35 @@ stasis_buffer_pool_t* stasis_buffer_pool_init(void) {
 
   pthread_mutex_init(&(ret->mut), NULL);
 
+  int online_nodes = stasis_buffer_pool_online_nodes();
+  ret->node_count = stasis_buffer_pool_numa_nodes > 0 ? stasis_buffer_pool_numa_nodes : online_nodes;
+  ret->frames_per_node = (stasis_buffer_manager_size + ret->node_count) / ret->node_count;
+  // Each partition needs at least one frame that is not the dummy page.
+  while(ret->node_count > 1 && (ret->node_count - 1) * ret->frames_per_node >= stasis_buffer_manager_size) {
+    ret->node_count--;
+    ret->frames_per_node = (stasis_buffer_manager_size + ret->node_count) / ret->node_count;
+  }
+
 #ifndef VALGRIND_MODE
 
-  byte * bufferSpace = stasis_malloc((stasis_buffer_manager_size + 2) * PAGE_SIZE, byte);
+  // Frames are PAGE_SIZE aligned, so that they can be passed directly to
+  // file handles that were opened with O_DIRECT.
+  byte * bufferSpace = stasis_buffer_pool_alloc_frames(ret, (stasis_buffer_manager_size + 1) * PAGE_SIZE);
   assert(bufferSpace);
-  ret->addr_to_free = bufferSpace;
-
-  bufferSpace = (byte*)(((long)bufferSpace) +
-			PAGE_SIZE -
-			(((long)bufferSpace) % PAGE_SIZE));
+  // mbind() needs hugetlb ranges to be aligned to the huge page size, so
+  // explicit huge pages are left wherever the kernel puts them.
+  if(ret->node_count > 1 && ret->huge_pages != STASIS_BUFFER_POOL_HUGE_PAGES_EXPLICIT) {
+    // The memory has not been touched yet, so this decides where it lives.
+    for(int i = 0; i < ret->node_count && i < online_nodes && i < (int)(sizeof(long) * 8); i++) {
+      pageid_t start = i * ret->frames_per_node;
+      pageid_t count = ret->frames_per_node;
+      if(start + count > stasis_buffer_manager_size + 1) { count = stasis_buffer_manager_size + 1 - start; }
+      stasis_buffer_pool_bind(&bufferSpace[start * PAGE_SIZE], count, i);
+    }
+  }
 #else
   fprintf(stderr, "WARNING: VALGRIND_MODE #defined; Using memory allocation strategy designed to catch bugs under valgrind\n");
+  ret->huge_pages = STASIS_BUFFER_POOL_HUGE_PAGES_DISABLED;
 #endif // VALGRIND_MODE
 
   // We need one dummy page for locking purposes,
@@ -89,11 +257,12 @@ stasis_buffer_pool_t* stasis_buffer_pool_init(void) {
 
   for(pageid_t i = 0; i < stasis_buffer_manager_size+1; i++) {
     ret->pool[i].rwlatch = initlock();
+    ret->pool[i].version = 0;
     ret->pool[i].loadlatch = initlock();
 #ifndef VALGRIND_MODE
     ret->pool[i].memAddr = &(bufferSpace[i*PAGE_SIZE]);
 #else
-    ret->pool[i].memAddr = stasis_malloc(PAGE_SIZE, byte);
+    ret->pool[i].memAddr = stasis_buffer_pool_alloc_aligned(PAGE_SIZE);
 #endif
     ret->pool[i].dirty = 0;
     ret->pool[i].needsFlush = 0;
@@ -106,11 +275,15 @@ void stasis_buffer_pool_deinit(stasis_buffer_pool_t * ret) {
     deletelock(ret->pool[i].rwlatch);
     deletelock(ret->pool[i].loadlatch);
 #ifdef VALGRIND_MODE
-    free(ret->pool[i].memAddr);
+    stasis_buffer_pool_free_aligned(ret->pool[i].memAddr);
 #endif
   }
 #ifndef VALGRIND_MODE
-  free(ret->addr_to_free); // breaks efence
+  if(ret->map_len) {
+    munmap(ret->addr_to_free, ret->map_len);
+  } else {
+    stasis_buffer_pool_free_aligned(ret->addr_to_free); // breaks efence
+  }
 #endif
   free(ret->pool);
   pthread_mutex_destroy(&ret->mut);
@@ -147,3 +320,19 @@ void stasis_buffer_pool_free_page(stasis_buffer_pool_t * ret, Page *p, pageid_t
 Page * stasis_buffer_pool_get_underlying_array(stasis_buffer_pool_t *ret) {
   return ret->pool;
 }
+
+int stasis_buffer_pool_node_count(stasis_buffer_pool_t *ret) {
+  return ret->node_count;
+}
+
+pageid_t stasis_buffer_pool_frames_per_node(stasis_buffer_pool_t *ret) {
+  return ret->frames_per_node;
+}
+
+int stasis_buffer_pool_page_node(stasis_buffer_pool_t *ret, Page *p) {
+  return (int)((p - ret->pool) / ret->frames_per_node);
+}
+
+int stasis_buffer_pool_huge_pages_mode(stasis_buffer_pool_t *ret) {
+  return ret->huge_pages;
+}
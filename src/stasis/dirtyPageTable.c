@@ -33,65 +33,122 @@ static int dpt_cmp_lsn_and_page(const void *ap, const void * bp, const void * ig
   return (a->lsn < b->lsn) ? -1 : ((a->lsn == b->lsn) ? dpt_cmp_page(ap, bp, 0) : 1);
 }
 
-struct stasis_dirty_page_table_t {
+/**
+ * One shard of the dirty page table.  Pages are assigned to shards in
+ * stripes of stasis_dirty_page_table_shard_stripe_size pages, so each
+ * shard holds a disjoint set of page id ranges.
+ */
+typedef struct {
+  pthread_mutex_t mutex;
   struct rbtree * tableByPage;
   struct rbtree * tableByLsnAndPage;
+  /** The smallest recLSN in this shard, or LSN_T_MAX.  Updated under mutex, read without it. */
+  lsn_t minRecLSN;
+} dpt_shard;
+
+struct stasis_dirty_page_table_t {
+  dpt_shard * shards;
+  int shardCount;
+  pageid_t stripeSize;
   stasis_buffer_manager_t * bufferManager;
   uint32_t count; // NOTE: this is 32 bit so that it is cheap to atomically manipulate it on 32 bit intels.
+  /** Protects flushing and outstanding_flush_lsns; never held while acquiring a shard mutex. */
   pthread_mutex_t mutex;
   pthread_cond_t flushDone;
   int flushing;
   stasis_util_multiset_t * outstanding_flush_lsns;
+  /** The most recent LSN targeted flush; protected by mutex. */
+  stasis_dirty_page_table_flush_progress_t progress;
+  /** The number of threads waiting on writebackCond; set_clean() only takes mutex if this is non-zero. */
+  int waiters;
   pthread_cond_t writebackCond;
+  /** Serializes updates to the adaptive limits below, and protects the sample. */
+  pthread_mutex_t limitsMutex;
+  /** Moving average of writeback bandwidth, in pages per second.  Zero until writeback is first measured. */
+  double bandwidth;
+  /** Number of flushes that are writing back pages right now. */
+  int activeFlushes;
+  /** When activeFlushes last became non-zero. */
+  double busySince;
+  /** Time that some flush was running, and pages they wrote, since the last sample. */
+  double sampleSeconds;
+  pageid_t samplePages;
+  /** Adaptive limits; these are published with atomic stores so that needFlush() does not need limitsMutex. */
+  pageid_t writeBandwidth;
+  pageid_t softLimit;
+  pageid_t lowWaterMark;
+  pageid_t flushQuantum;
 };
 
+/** The weight of the newest bandwidth sample in the moving average. */
+#define DPT_BANDWIDTH_WEIGHT 0.25
+/** Flushes are aggregated into bandwidth samples that cover at least this much busy time. */
+#define DPT_SAMPLE_SECONDS 0.1
+/** Adaptive limits never shrink the flush quantum below this many pages... */
+#define DPT_MIN_FLUSH_QUANTUM 16
+/** ...or the soft limit below this fraction of stasis_dirty_page_count_soft_limit. */
+#define DPT_MIN_SOFT_LIMIT_DIVISOR 8
+
+static inline dpt_shard * dpt_shard_for(stasis_dirty_page_table_t * dirtyPages, pageid_t p) {
+  return &dirtyPages->shards[((uint64_t)p / dirtyPages->stripeSize) % dirtyPages->shardCount];
+}
+static inline struct rbtree * dpt_tree(dpt_shard * shard, int byLsn) {
+  return byLsn ? shard->tableByLsnAndPage : shard->tableByPage;
+}
+
 void stasis_dirty_page_table_set_dirty(stasis_dirty_page_table_t * dirtyPages, Page * p) {
+  dpt_shard * shard = dpt_shard_for(dirtyPages, p->id);
   if(!p->dirty) {
     while(stasis_dirty_page_table_dirty_count(dirtyPages)
           > stasis_dirty_page_count_hard_limit) {
       struct timespec ts = stasis_double_to_timespec(0.01);
       nanosleep(&ts,0);
     }
-    pthread_mutex_lock(&dirtyPages->mutex);
+    pthread_mutex_lock(&shard->mutex);
     if(!p->dirty) {
       p->dirty = 1;
       dpt_entry * e = stasis_alloc(dpt_entry);
       e->p = p->id;
       e->lsn = p->LSN;
-      const void * ret = rbsearch(e, dirtyPages->tableByPage);
+      const void * ret = rbsearch(e, shard->tableByPage);
       assert(ret == e); // otherwise, the entry was already in the table.
 
       e = stasis_alloc(dpt_entry);
       e->p = p->id;
       e->lsn = p->LSN;
-      ret = rbsearch(e, dirtyPages->tableByLsnAndPage);
+      ret = rbsearch(e, shard->tableByLsnAndPage);
       assert(ret == e); // otherwise, the entry was already in the table.
+      if(e->lsn < shard->minRecLSN) {
+        __atomic_store_n(&shard->minRecLSN, e->lsn, __ATOMIC_SEQ_CST);
+      }
       FETCH_AND_ADD(&dirtyPages->count,1);
     }
-    pthread_mutex_unlock(&dirtyPages->mutex);
+    pthread_mutex_unlock(&shard->mutex);
 #ifdef SANITY_CHECKS
   } else {
-    pthread_mutex_lock(&dirtyPages->mutex);
+    pthread_mutex_lock(&shard->mutex);
     dpt_entry e = { p->id, 0};
-    assert(rbfind(&e, dirtyPages->tableByPage));
-    pthread_mutex_unlock(&dirtyPages->mutex);
+    assert(rbfind(&e, shard->tableByPage));
+    pthread_mutex_unlock(&shard->mutex);
 #endif //SANITY_CHECKS
   }
 }
 
 void stasis_dirty_page_table_set_clean(stasis_dirty_page_table_t * dirtyPages, Page * p) {
   if(p->dirty) {
-    pthread_mutex_lock(&dirtyPages->mutex);
+    dpt_shard * shard = dpt_shard_for(dirtyPages, p->id);
+    int cleaned = 0;
+    pthread_mutex_lock(&shard->mutex);
     if(p->dirty) {
       dpt_entry dummy = {p->id, 0};
 
-      const dpt_entry * e = (const dpt_entry *)rbdelete(&dummy, dirtyPages->tableByPage);
+      const dpt_entry * e = (const dpt_entry *)rbdelete(&dummy, shard->tableByPage);
       assert(e);
       assert(e->p == p->id);
       dummy.lsn = e->lsn;
       free((void*)e);
 
-      e = (const dpt_entry *)rbdelete(&dummy, dirtyPages->tableByLsnAndPage);
+      e = (const dpt_entry *)rbdelete(&dummy, shard->tableByLsnAndPage);
       assert(e);
       assert(e->p == p->id);
       assert(e->lsn == dummy.lsn);
@@ -99,17 +156,27 @@ void stasis_dirty_page_table_set_clean(stasis_dirty_page_table_t * dirtyPages, P
       assert(p->dirty);
       p->dirty = 0;
 
-      lsn_t min_waiting = stasis_util_multiset_min(dirtyPages->outstanding_flush_lsns);
-      e = (const dpt_entry *)rbmin(dirtyPages->tableByLsnAndPage);
-      if(dummy.lsn >= min_waiting &&
-         (!e || e->lsn >= min_waiting)) {
-        pthread_cond_broadcast( &dirtyPages->writebackCond );
+      if(dummy.lsn == shard->minRecLSN) {
+        e = (const dpt_entry *)rbmin(shard->tableByLsnAndPage);
+        __atomic_store_n(&shard->minRecLSN, e ? e->lsn : LSN_T_MAX, __ATOMIC_SEQ_CST);
       }
 
       //dirtyPages->count--;
       FETCH_AND_ADD(&dirtyPages->count, -1);
+      cleaned = 1;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+
+    // Waiters register themselves before they check minRecLSN, so either
+    // they see the update above, or we see them here.
+    if(cleaned && __atomic_load_n(&dirtyPages->waiters, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&dirtyPages->mutex);
+      lsn_t min_waiting = stasis_util_multiset_min(dirtyPages->outstanding_flush_lsns);
+      if(stasis_dirty_page_table_minRecLSN(dirtyPages) >= min_waiting) {
+        pthread_cond_broadcast( &dirtyPages->writebackCond );
+      }
+      pthread_mutex_unlock(&dirtyPages->mutex);
     }
-    pthread_mutex_unlock(&dirtyPages->mutex);
   }
 }
 
@@ -118,33 +185,372 @@ int stasis_dirty_page_table_is_dirty(stasis_dirty_page_table_t * dirtyPages, Pag
 
   ret = p->dirty;
 #ifdef SANITY_CHECKS
-  pthread_mutex_lock(&dirtyPages->mutex);
+  dpt_shard * shard = dpt_shard_for(dirtyPages, p->id);
+  pthread_mutex_lock(&shard->mutex);
   dpt_entry e = { p->id, 0};
-  const void* found = rbfind(&e, dirtyPages->tableByPage);
+  const void* found = rbfind(&e, shard->tableByPage);
   assert((found && ret) || !(found||ret));
-  pthread_mutex_unlock(&dirtyPages->mutex);
+  pthread_mutex_unlock(&shard->mutex);
 #endif
   return ret;
 }
 
-lsn_t stasis_dirty_page_table_minRecLSN(stasis_dirty_page_table_t * dirtyPages) {
+void stasis_dirty_page_table_flush_progress(stasis_dirty_page_table_t * dirtyPages, stasis_dirty_page_table_flush_progress_t * progress) {
   pthread_mutex_lock(&dirtyPages->mutex);
-  const dpt_entry * e = (const dpt_entry *)rbmin(dirtyPages->tableByLsnAndPage);
-  lsn_t lsn =  e ? e->lsn : LSN_T_MAX;
+  *progress = dirtyPages->progress;
   pthread_mutex_unlock(&dirtyPages->mutex);
+  progress->min_rec_lsn = stasis_dirty_page_table_minRecLSN(dirtyPages);
+}
+
+lsn_t stasis_dirty_page_table_minRecLSN(stasis_dirty_page_table_t * dirtyPages) {
+  // Each shard publishes its own minimum, so this does not take any locks.
+  // Pages that are dirtied while we scan have LSNs that are newer than the
+  // caller's first_pending_lsn(), so (as before sharding) missing them is
+  // harmless.
+  lsn_t lsn = LSN_T_MAX;
+  for(int i = 0; i < dirtyPages->shardCount; i++) {
+    lsn_t shardLsn = __atomic_load_n(&dirtyPages->shards[i].minRecLSN, __ATOMIC_SEQ_CST);
+    if(shardLsn < lsn) { lsn = shardLsn; }
+  }
   return lsn;
 }
 
+pageid_t stasis_dirty_page_table_snapshot(stasis_dirty_page_table_t * dirtyPages, pageid_t ** pages, lsn_t ** recLSNs) {
+  pageid_t count = 0;
+  pageid_t size = stasis_dirty_page_table_dirty_count(dirtyPages) + 1;
+  *pages = stasis_malloc(size, pageid_t);
+  *recLSNs = stasis_malloc(size, lsn_t);
+  for(int i = 0; i < dirtyPages->shardCount; i++) {
+    dpt_shard * shard = &dirtyPages->shards[i];
+    pthread_mutex_lock(&shard->mutex);
+    dpt_entry dummy = {0, 0};
+    for(const dpt_entry * e = (const dpt_entry *)rblookup(RB_LUGTEQ, &dummy, shard->tableByPage);
+           e;
+           e = (const dpt_entry *)rblookup(RB_LUGREAT, e, shard->tableByPage)) {
+      if(count == size) {
+        size *= 2;
+        *pages = stasis_realloc(*pages, size, pageid_t);
+        *recLSNs = stasis_realloc(*recLSNs, size, lsn_t);
+      }
+      (*pages)[count] = e->p;
+      (*recLSNs)[count] = e->lsn;
+      count++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+  }
+  return count;
+}
+
+/**
+ * A merged, in-order iterator over one of the per-shard trees.  It keeps
+ * a copy of each shard's next entry, and repeatedly drains the shard with
+ * the smallest one until that shard's entries overtake the runner up.
+ * Shard mutexes are only held while an individual shard is being read, so
+ * (as with the unsharded table) pages that are dirtied behind the cursor
+ * are missed, and cleaned pages are skipped.
+ */
+typedef struct {
+  stasis_dirty_page_table_t * dpt;
+  int byLsn;
+  lsn_t targetLsn;
+  pageid_t stop;
+  dpt_entry * heads;
+  int * valid;
+} dpt_cursor;
+
+static inline int dpt_cursor_cmp(dpt_cursor * c, const dpt_entry * a, const dpt_entry * b) {
+  return c->byLsn ? dpt_cmp_lsn_and_page(a, b, 0) : dpt_cmp_page(a, b, 0);
+}
+static inline int dpt_cursor_in_range(dpt_cursor * c, const dpt_entry * e) {
+  return e->lsn < c->targetLsn && (c->stop == 0 || e->p < c->stop);
+}
+/** Advance shard i's head to its first entry at or after the current head. */
+static void dpt_cursor_refresh(dpt_cursor * c, int i) {
+  dpt_shard * shard = &c->dpt->shards[i];
+  pthread_mutex_lock(&shard->mutex);
+  const dpt_entry * e = (const dpt_entry *)rblookup(RB_LUGTEQ, &c->heads[i], dpt_tree(shard, c->byLsn));
+  if(e && dpt_cursor_in_range(c, e)) {
+    c->heads[i] = *e;
+  } else {
+    c->valid[i] = 0;
+  }
+  pthread_mutex_unlock(&shard->mutex);
+}
+static void dpt_cursor_open(dpt_cursor * c, stasis_dirty_page_table_t * dirtyPages, int byLsn,
+                            const dpt_entry * start, lsn_t targetLsn, pageid_t stop) {
+  c->dpt = dirtyPages;
+  c->byLsn = byLsn;
+  c->targetLsn = targetLsn;
+  c->stop = stop;
+  c->heads = stasis_malloc(dirtyPages->shardCount, dpt_entry);
+  c->valid = stasis_malloc(dirtyPages->shardCount, int);
+  for(int i = 0; i < dirtyPages->shardCount; i++) {
+    c->heads[i] = *start;
+    c->valid[i] = 1;
+    dpt_cursor_refresh(c, i);
+  }
+}
+static void dpt_cursor_close(dpt_cursor * c) {
+  free(c->heads);
+  free(c->valid);
+}
+/** @return the shard with the smallest head, or -1 if the cursor is exhausted. */
+static int dpt_cursor_peek(dpt_cursor * c, int * second) {
+  int best = -1;
+  *second = -1;
+  for(int i = 0; i < c->dpt->shardCount; i++) {
+    if(!c->valid[i]) { continue; }
+    if(best == -1 || dpt_cursor_cmp(c, &c->heads[i], &c->heads[best]) < 0) {
+      *second = best;
+      best = i;
+    } else if(*second == -1 || dpt_cursor_cmp(c, &c->heads[i], &c->heads[*second]) < 0) {
+      *second = i;
+    }
+  }
+  return best;
+}
+/** Skip all shards ahead to the first entry at or after to. */
+static void dpt_cursor_seek(dpt_cursor * c, const dpt_entry * to) {
+  for(int i = 0; i < c->dpt->shardCount; i++) {
+    if(c->valid[i] && dpt_cursor_cmp(c, &c->heads[i], to) < 0) {
+      c->heads[i] = *to;
+      dpt_cursor_refresh(c, i);
+    }
+  }
+}
+/**
+ * Copy the ids of up to max pages into vals, in cursor order.  If limit
+ * is non-zero (which only makes sense for page order), stop before the
+ * first page at or after it, and leave the cursor there so that a later
+ * call (or a seek) can pick up from it.
+ *
+ * @return the number of page ids copied; zero if there are none left.
+ */
+static int dpt_cursor_next(dpt_cursor * c, pageid_t * vals, int max, pageid_t limit) {
+  int off = 0;
+  while(off < max) {
+    int second;
+    int best = dpt_cursor_peek(c, &second);
+    if(best == -1 || (limit && c->heads[best].p >= limit)) { break; }
+    dpt_shard * shard = &c->dpt->shards[best];
+    struct rbtree * tree = dpt_tree(shard, c->byLsn);
+    pthread_mutex_lock(&shard->mutex);
+    const dpt_entry * e = (const dpt_entry *)rblookup(RB_LUGTEQ, &c->heads[best], tree);
+    while(e && dpt_cursor_in_range(c, e) && off < max
+          && (limit == 0 || e->p < limit)
+          && (second == -1 || dpt_cursor_cmp(c, e, &c->heads[second]) < 0)) {
+      vals[off] = e->p;
+      off++;
+      e = (const dpt_entry *)rblookup(RB_LUGREAT, e, tree);
+    }
+    if(e && dpt_cursor_in_range(c, e)) {
+      c->heads[best] = *e;
+    } else {
+      c->valid[best] = 0;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+  }
+  return off;
+}
+
 pageid_t stasis_dirty_page_table_dirty_count(stasis_dirty_page_table_t * dirtyPages) {
   return ATOMIC_READ_32(&dirtyPages->mutex, &dirtyPages->count);
 }
 
+static inline pageid_t dpt_clamp(pageid_t val, pageid_t lo, pageid_t hi) {
+  if(lo > hi) { lo = hi; }
+  return val < lo ? lo : (val > hi ? hi : val);
+}
+static inline double dpt_now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return stasis_timeval_to_double(tv);
+}
+
+void stasis_dirty_page_table_observe_writeback(stasis_dirty_page_table_t * dirtyPages, pageid_t pages, double seconds) {
+  if(!stasis_dirty_page_table_adaptive_limits || pages <= 0 || seconds <= 0.0) { return; }
+  pthread_mutex_lock(&dirtyPages->limitsMutex);
+  double sample = (double)pages / seconds;
+  dirtyPages->bandwidth = dirtyPages->bandwidth == 0.0 ? sample
+      : DPT_BANDWIDTH_WEIGHT * sample + (1.0 - DPT_BANDWIDTH_WEIGHT) * dirtyPages->bandwidth;
+
+  // Start writeback once the backlog would take more than
+  // stasis_dirty_page_table_adaptive_backlog_ms to write, and keep the
+  // configured ratio between the low water mark and the soft limit.
+  const pageid_t configuredSoft = stasis_dirty_page_count_soft_limit;
+  pageid_t soft = dpt_clamp((pageid_t)(dirtyPages->bandwidth * stasis_dirty_page_table_adaptive_backlog_ms / 1000.0),
+                            configuredSoft / DPT_MIN_SOFT_LIMIT_DIVISOR, configuredSoft);
+  pageid_t low = configuredSoft ? (soft * stasis_dirty_page_low_water_mark) / configuredSoft
+                                : stasis_dirty_page_low_water_mark;
+  // Bound the time that each quantum holds up asyncForcePages() and the
+  // latches that writeback holds.
+  pageid_t quantum = dpt_clamp((pageid_t)(dirtyPages->bandwidth * stasis_dirty_page_table_adaptive_quantum_ms / 1000.0),
+                               DPT_MIN_FLUSH_QUANTUM, stasis_dirty_page_table_flush_quantum);
+
+  __atomic_store_n(&dirtyPages->softLimit, soft, __ATOMIC_RELAXED);
+  __atomic_store_n(&dirtyPages->lowWaterMark, low, __ATOMIC_RELAXED);
+  __atomic_store_n(&dirtyPages->flushQuantum, quantum, __ATOMIC_RELAXED);
+  pageid_t bw = (pageid_t)dirtyPages->bandwidth;
+  __atomic_store_n(&dirtyPages->writeBandwidth, bw ? bw : 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&dirtyPages->limitsMutex);
+}
+
+/**
+ * Writeback bandwidth is measured across all concurrent flushes, since
+ * writeback threads that each timed their own pages would see only their
+ * share of the device.  Time is only counted while at least one flush is
+ * running, so idle periods do not look like a slow device.
+ *
+ * @return non-zero if the flush should report its progress to dpt_flush_progress().
+ */
+static int dpt_flush_begin(stasis_dirty_page_table_t * dirtyPages) {
+  if(!stasis_dirty_page_table_adaptive_limits) { return 0; }
+  pthread_mutex_lock(&dirtyPages->limitsMutex);
+  if(!dirtyPages->activeFlushes++) { dirtyPages->busySince = dpt_now(); }
+  pthread_mutex_unlock(&dirtyPages->limitsMutex);
+  return 1;
+}
+/**
+ * Credit pages to the current bandwidth sample.  Callers pass pages once
+ * the asyncForcePages() that follows them has returned, rather than when
+ * they are handed to the page file.
+ *
+ * @param tracked The return value of dpt_flush_begin().
+ * @param done Non-zero if this is the calling flush's last call.
+ */
+static void dpt_flush_progress(stasis_dirty_page_table_t * dirtyPages, int tracked, pageid_t pages, int done) {
+  if(!tracked) { return; }
+  pthread_mutex_lock(&dirtyPages->limitsMutex);
+  double now = dpt_now();
+  dirtyPages->samplePages += pages;
+  dirtyPages->sampleSeconds += now - dirtyPages->busySince;
+  dirtyPages->busySince = now;
+  if(done) { dirtyPages->activeFlushes--; }
+  pageid_t samplePages = 0;
+  double sampleSeconds = 0.0;
+  if(dirtyPages->sampleSeconds >= DPT_SAMPLE_SECONDS) {
+    samplePages = dirtyPages->samplePages;
+    sampleSeconds = dirtyPages->sampleSeconds;
+    dirtyPages->samplePages = 0;
+    dirtyPages->sampleSeconds = 0.0;
+  }
+  pthread_mutex_unlock(&dirtyPages->limitsMutex);
+  stasis_dirty_page_table_observe_writeback(dirtyPages, samplePages, sampleSeconds);
+}
+
+void stasis_dirty_page_table_get_limits(stasis_dirty_page_table_t * dirtyPages, stasis_dirty_page_table_limits_t * limits) {
+  pageid_t bw = stasis_dirty_page_table_adaptive_limits
+      ? __atomic_load_n(&dirtyPages->writeBandwidth, __ATOMIC_ACQUIRE) : 0;
+  limits->hard_limit = stasis_dirty_page_count_hard_limit;
+  limits->write_bandwidth = bw;
+  if(bw) {
+    limits->soft_limit = __atomic_load_n(&dirtyPages->softLimit, __ATOMIC_RELAXED);
+    limits->low_water_mark = __atomic_load_n(&dirtyPages->lowWaterMark, __ATOMIC_RELAXED);
+    limits->flush_quantum = __atomic_load_n(&dirtyPages->flushQuantum, __ATOMIC_RELAXED);
+  } else {
+    limits->soft_limit = stasis_dirty_page_count_soft_limit;
+    limits->low_water_mark = stasis_dirty_page_low_water_mark;
+    limits->flush_quantum = stasis_dirty_page_table_flush_quantum;
+  }
+}
+static inline pageid_t dpt_flush_quantum(stasis_dirty_page_table_t * dirtyPages) {
+  stasis_dirty_page_table_limits_t limits;
+  stasis_dirty_page_table_get_limits(dirtyPages, &limits);
+  return limits.flush_quantum;
+}
+
+/**
+ * Write back a batch of pages, letting the buffer manager coalesce writes
+ * to adjacent pages if it can.  The writes are scheduled in the caller's
+ * I/O class, so synchronous flushes are not throttled like background
+ * writeback.
+ *
+ * @return the number of pages that were pinned, and could not be written.
+ */
+static int dpt_write_back(stasis_dirty_page_table_t * dirtyPages, const pageid_t * vals, int count) {
+  stasis_buffer_manager_t * bm = dirtyPages->bufferManager;
+  int busy = 0;
+  if(bm->tryToWriteBackPages) {
+    busy = bm->tryToWriteBackPages(bm, vals, count);
+  } else {
+    for(int i = 0; i < count; i++) {
+      if(bm->tryToWriteBackPage(bm, vals[i]) == EBUSY) {
+        busy++;
+      }
+    }
+  }
+  return busy;
+}
+
+static int dpt_cmp_pageid(const void * ap, const void * bp) {
+  pageid_t a = *(const pageid_t*)ap;
+  pageid_t b = *(const pageid_t*)bp;
+  return (a < b) ? -1 : ((a == b) ? 0 : 1);
+}
+/**
+ * Write back the pages whose recLSN is below targetLsn.
+ *
+ * The pages are found in LSN order, but written in page order, so that the
+ * buffer manager can coalesce adjacent pages, and the device sees one
+ * elevator sweep instead of random writes.  Each flush quantum is followed
+ * by asyncForcePages(), which bounds the amount of writeback that is queued
+ * ahead of the pages that truncation is waiting for.
+ *
+ * @return 1 if every page was written, 0 if some were pinned.
+ */
+static int dpt_sweep_below_lsn(stasis_dirty_page_table_t * dirtyPages, lsn_t targetLsn, long stride) {
+  pageid_t * pages = 0;
+  pageid_t n = 0;
+  pageid_t capacity = 0;
+  dpt_entry dummy = { 0, 0 };
+  dpt_cursor cursor;
+  dpt_cursor_open(&cursor, dirtyPages, 1, &dummy, targetLsn, 0);
+  int got;
+  do {
+    if(n == capacity) {
+      capacity = capacity ? 2 * capacity : stride;
+      pages = stasis_realloc(pages, capacity, pageid_t);
+    }
+    got = dpt_cursor_next(&cursor, pages + n, capacity - n, 0);
+    n += got;
+  } while(got);
+  dpt_cursor_close(&cursor);
+
+  qsort(pages, n, sizeof(pageid_t), dpt_cmp_pageid);
+
+  pthread_mutex_lock(&dirtyPages->mutex);
+  dirtyPages->progress.passes++;
+  dirtyPages->progress.pages = n;
+  dirtyPages->progress.written = 0;
+  dirtyPages->progress.busy = 0;
+  pthread_mutex_unlock(&dirtyPages->mutex);
+
+  int all_flushed = 1;
+  int tracked = dpt_flush_begin(dirtyPages);
+  for(pageid_t i = 0; i < n; i += stride) {
+    int count = (n - i) < stride ? (int)(n - i) : (int)stride;
+    int busy = dpt_write_back(dirtyPages, pages + i, count);
+    if(busy) { all_flushed = 0; }
+    DEBUG("Forcing %d pages (target lsn %lld)\n", count - busy, targetLsn);
+    dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
+    dpt_flush_progress(dirtyPages, tracked, count - busy, 0);
+
+    pthread_mutex_lock(&dirtyPages->mutex);
+    dirtyPages->progress.written += count - busy;
+    dirtyPages->progress.busy += busy;
+    pthread_mutex_unlock(&dirtyPages->mutex);
+  }
+  dpt_flush_progress(dirtyPages, tracked, 0, 1);
+  free(pages);
+  return all_flushed;
+}
+
 int stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyPages, lsn_t targetLsn) {
   DEBUG("stasis_dirty_page_table_flush_with_target called");
-  const long stride = stasis_dirty_page_table_flush_quantum;
+  const long stride = dpt_flush_quantum(dirtyPages);
   int all_flushed;
-  pthread_mutex_lock(&dirtyPages->mutex);
   if (targetLsn == LSN_T_MAX) {
+    pthread_mutex_lock(&dirtyPages->mutex);
     if(dirtyPages->flushing) {
       pthread_cond_wait(&dirtyPages->flushDone, &dirtyPages->mutex);
       pthread_mutex_unlock(&dirtyPages->mutex);
@@ -154,6 +560,7 @@ int stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyP
       return EAGAIN;
     }
     dirtyPages->flushing = 1;
+    pthread_mutex_unlock(&dirtyPages->mutex);
   }
 
   // Normally, we will be called by a background thread that wants to maximize
@@ -162,64 +569,52 @@ int stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyP
   // Sometimes, we are called by log truncation, which wants to prioritize writeback
   // of pages that are blocking log truncation.
 
-  // If we are writing back for the buffer manager, sort writebacks by page number.
-  // Otherwise, sort them by the LSN that first dirtied the page.
-  // TODO: Re-sort LSN ordered pages before passing them to the OS?
-  struct rbtree * tree = targetLsn == LSN_T_MAX ? dirtyPages->tableByPage
-                                                : dirtyPages->tableByLsnAndPage;
+  // Either way, pages are written in page order; see dpt_sweep_below_lsn().
+  const int byLsn = targetLsn != LSN_T_MAX;
+
+  if(byLsn) {
+    pthread_mutex_lock(&dirtyPages->mutex);
+    memset(&dirtyPages->progress, 0, sizeof(dirtyPages->progress));
+    dirtyPages->progress.target_lsn = targetLsn;
+    pthread_mutex_unlock(&dirtyPages->mutex);
+  }
 
+  pageid_t * vals = stasis_alloca(stride, pageid_t);
   long buffered = 0;
   do {
-    dpt_entry dummy = { 0, 0 };
-    pageid_t * vals = stasis_alloca(stride, pageid_t);
-    int off = 0;
-    int strides = 0;
-    all_flushed = 1;
-    for(const dpt_entry * e = (const dpt_entry *)rblookup(RB_LUGTEQ, &dummy, tree);
-        e && e->lsn < targetLsn;
-        e = (const dpt_entry *)rblookup(RB_LUGREAT, &dummy, tree)) {
-      dummy = *e;
-      vals[off] = dummy.p;
-      off++;
-      if(off == stride) {
-        pthread_mutex_unlock(&dirtyPages->mutex);
-        for(pageid_t i = 0; i < off; i++) {
-          if (dirtyPages->bufferManager->tryToWriteBackPage(dirtyPages->bufferManager, vals[i]) == EBUSY) {
-            all_flushed = 0;
-          } else {
-            buffered++;
-          }
-          if(buffered == stride) {
-            DEBUG("Forcing %lld pages A\n", buffered);
-            buffered = 0;
-            dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
-          }
+    if(byLsn) {
+      all_flushed = dpt_sweep_below_lsn(dirtyPages, targetLsn, stride);
+    } else {
+      int tracked = dpt_flush_begin(dirtyPages);
+      dpt_entry dummy = { 0, 0 };
+      dpt_cursor cursor;
+      dpt_cursor_open(&cursor, dirtyPages, 0, &dummy, targetLsn, 0);
+      all_flushed = 1;
+      int off;
+      while((off = dpt_cursor_next(&cursor, vals, stride, 0))) {
+        int busy = dpt_write_back(dirtyPages, vals, off);
+        if(busy) { all_flushed = 0; }
+        buffered += off - busy;
+        if(buffered >= stride) {
+          DEBUG("Forcing %lld pages A\n", buffered);
+          dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
+          dpt_flush_progress(dirtyPages, tracked, buffered, 0);
+          buffered = 0;
         }
-        off = 0;
-        strides++;
-        pthread_mutex_lock(&dirtyPages->mutex);
-      }
-    }
-    pthread_mutex_unlock(&dirtyPages->mutex);
-    for(pageid_t i = 0; i < off; i++) {
-      if (dirtyPages->bufferManager->tryToWriteBackPage(dirtyPages->bufferManager, vals[i]) == EBUSY) {
-        all_flushed = 0;
-      } else {
-        buffered++;
       }
+      dpt_cursor_close(&cursor);
       DEBUG("Forcing %lld pages B\n", buffered);
+      dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
+      dpt_flush_progress(dirtyPages, tracked, buffered, 1);
       buffered = 0;
     }
-    dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
-    pthread_mutex_lock(&dirtyPages->mutex);
-    dpt_entry * e = ((dpt_entry*)rbmin(tree));
 
     DEBUG("Finished elevator sweep.\n");
 
     if (!all_flushed &&
         targetLsn < LSN_T_MAX &&
         ATOMIC_READ_32(0, &dirtyPages->count) > 0 &&
-        e && targetLsn > e->lsn ) {
+        targetLsn > stasis_dirty_page_table_minRecLSN(dirtyPages)) {
       struct timespec ts;
       struct timeval tv;
 
@@ -244,33 +639,36 @@ int stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyP
       ts.tv_sec = tv.tv_sec;
       ts.tv_nsec = 1000*tv.tv_usec;
 
-      dpt_entry * e = ((dpt_entry*)rbmin(tree));
+      pthread_mutex_lock(&dirtyPages->mutex);
+      stasis_util_multiset_insert(dirtyPages->outstanding_flush_lsns, targetLsn);
+      __atomic_add_fetch(&dirtyPages->waiters, 1, __ATOMIC_SEQ_CST);
 
-      if(targetLsn != LSN_T_MAX) { stasis_util_multiset_insert(dirtyPages->outstanding_flush_lsns, targetLsn); }
-
-      while( e && targetLsn > e->lsn ) {
+      while( targetLsn > stasis_dirty_page_table_minRecLSN(dirtyPages) ) {
         if (pthread_cond_timedwait(&dirtyPages->writebackCond, &dirtyPages->mutex, &ts) == ETIMEDOUT) {
           all_flushed = 0;
           break;
         }
-        e = ((dpt_entry*)rbmin(tree));
-      }
-
-      if(targetLsn != LSN_T_MAX) {
-        int found = stasis_util_multiset_remove(dirtyPages->outstanding_flush_lsns, targetLsn);
-        assert(found);
       }
 
+      __atomic_sub_fetch(&dirtyPages->waiters, 1, __ATOMIC_SEQ_CST);
+      int found = stasis_util_multiset_remove(dirtyPages->outstanding_flush_lsns, targetLsn);
+      assert(found);
+      pthread_mutex_unlock(&dirtyPages->mutex);
     }
 
   } while(targetLsn != LSN_T_MAX && !all_flushed);
+  if (byLsn) {
+    pthread_mutex_lock(&dirtyPages->mutex);
+    if(dirtyPages->progress.target_lsn == targetLsn) { dirtyPages->progress.done = 1; }
+    pthread_mutex_unlock(&dirtyPages->mutex);
+  }
   if (targetLsn == LSN_T_MAX) {
+    pthread_mutex_lock(&dirtyPages->mutex);
     pthread_cond_broadcast(&dirtyPages->flushDone);
     dirtyPages->flushing = 0;
+    pthread_mutex_unlock(&dirtyPages->mutex);
   }
 
-  pthread_mutex_unlock(&dirtyPages->mutex);
-
   return 0;
 }
 
@@ -279,27 +677,77 @@ int stasis_dirty_page_table_flush(stasis_dirty_page_table_t * dirtyPages) {
     return stasis_dirty_page_table_flush_with_target(dirtyPages, LSN_T_MAX);
 }
 
+int stasis_dirty_page_table_flush_partition(stasis_dirty_page_table_t * dirtyPages, int partition, int partition_count, pageid_t stripe_size) {
+  DEBUG("stasis_dirty_page_table_flush_partition called");
+  if(partition_count == 1) {
+    return stasis_dirty_page_table_flush(dirtyPages);
+  }
+  assert(partition >= 0 && partition < partition_count);
+  assert(stripe_size > 0);
+
+  const long stride = dpt_flush_quantum(dirtyPages);
+  pageid_t * vals = stasis_malloc(stride, pageid_t);
+  dpt_entry dummy = { stripe_size * partition, 0 };
+  dpt_cursor cursor;
+  dpt_cursor_open(&cursor, dirtyPages, 0, &dummy, LSN_T_MAX, 0);
+  long buffered = 0;
+  int done = 0;
+  int tracked = dpt_flush_begin(dirtyPages);
+
+  while(!done) {
+    int off = 0;
+    while(off < stride) {
+      int second;
+      int next = dpt_cursor_peek(&cursor, &second);
+      if(next == -1) { done = 1; break; }
+      pageid_t stripe = cursor.heads[next].p / stripe_size;
+      int owner = stripe % partition_count;
+      if(owner != partition) {
+        // Skip ahead to the first page of our next stripe.
+        dummy.p = (stripe + (partition + partition_count - owner) % partition_count) * stripe_size;
+        dpt_cursor_seek(&cursor, &dummy);
+      } else {
+        off += dpt_cursor_next(&cursor, vals + off, stride - off, (stripe + 1) * stripe_size);
+      }
+    }
+
+    buffered += off - dpt_write_back(dirtyPages, vals, off);
+    if(buffered >= stride) {
+      DEBUG("Forcing %lld pages (partition %d)\n", buffered, partition);
+      dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
+      dpt_flush_progress(dirtyPages, tracked, buffered, 0);
+      buffered = 0;
+    }
+  }
+  dpt_cursor_close(&cursor);
+  if(buffered) {
+    dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
+  }
+  dpt_flush_progress(dirtyPages, tracked, buffered, 1);
+  DEBUG("Finished elevator sweep of partition %d.\n", partition);
+  free(vals);
+  return 0;
+}
+
 int stasis_dirty_page_table_get_flush_candidates(stasis_dirty_page_table_t * dirtyPages, pageid_t start, pageid_t stop, int count, pageid_t* range_starts, pageid_t* range_ends) {
-  pthread_mutex_lock(&dirtyPages->mutex);
-  int n = 0;
+  pageid_t * vals = stasis_malloc(count, pageid_t);
+  dpt_entry dummy = { start, 0 };
+  dpt_cursor cursor;
+  dpt_cursor_open(&cursor, dirtyPages, 0, &dummy, LSN_T_MAX, stop);
+  int n = dpt_cursor_next(&cursor, vals, count, 0);
+  dpt_cursor_close(&cursor);
+
   int b = -1;
-  dpt_entry dummy;
-  dummy.lsn = -1;
-  dummy.p = start;
-
-  for(const dpt_entry *e = (const dpt_entry *)rblookup(RB_LUGTEQ, &dummy, dirtyPages->tableByPage);
-      e && (stop == 0 || e->p < stop) && n < ATOMIC_READ_32(0, &count);
-      e = (const dpt_entry *)rblookup(RB_LUGREAT, e, dirtyPages->tableByPage)) {
-    if(n == 0 || range_ends[b] != e->p) {
+  for(int i = 0; i < n; i++) {
+    if(i == 0 || range_ends[b] != vals[i]) {
       b++;
-      range_starts[b] = e->p;
-      range_ends[b] = e->p+1;
+      range_starts[b] = vals[i];
+      range_ends[b] = vals[i]+1;
     } else {
       range_ends[b]++;
     }
-    n++;
   }
-  pthread_mutex_unlock(&dirtyPages->mutex);
+  free(vals);
   return b+1;
 }
 void stasis_dirty_page_table_flush_range(stasis_dirty_page_table_t * dirtyPages, pageid_t start, pageid_t stop) {
@@ -315,26 +763,32 @@ void stasis_dirty_page_table_flush_range(stasis_dirty_page_table_t * dirtyPages,
       return;
     } // else, a call to flush returned, but that call could have been initiated before we were called...
   }
+  pthread_mutex_unlock(&dirtyPages->mutex);
 
   pageid_t * staleDirtyPages = 0;
   pageid_t n = 0;
+  pageid_t capacity = 0;
   dpt_entry dummy = { start, 0 };
-  for(const dpt_entry * e = (const dpt_entry *)rblookup(RB_LUGTEQ, &dummy, dirtyPages->tableByPage);
-         e && (stop == 0 || e->p < stop);
-         e = (const dpt_entry *)rblookup(RB_LUGREAT, e, dirtyPages->tableByPage)) {
-    n++;
-    staleDirtyPages = stasis_realloc(staleDirtyPages, n, pageid_t);
-    staleDirtyPages[n-1] = e->p;
-  }
-  pthread_mutex_unlock(&dirtyPages->mutex);
+  dpt_cursor cursor;
+  dpt_cursor_open(&cursor, dirtyPages, 0, &dummy, LSN_T_MAX, stop);
+  int got;
+  do {
+    if(n == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      staleDirtyPages = stasis_realloc(staleDirtyPages, capacity, pageid_t);
+    }
+    got = dpt_cursor_next(&cursor, staleDirtyPages + n, capacity - n, 0);
+    n += got;
+  } while(got);
+  dpt_cursor_close(&cursor);
 
-  for(pageid_t i = 0; i < n; i++) {
-    if(stop) {
+  if(stop) {
+    for(pageid_t i = 0; i < n; i++) {
       int err = dirtyPages->bufferManager->writeBackPage(dirtyPages->bufferManager, staleDirtyPages[i]);
       if(err == EBUSY) { abort(); /*api violation!*/ }
-    } else {
-      dirtyPages->bufferManager->tryToWriteBackPage(dirtyPages->bufferManager, staleDirtyPages[i]);
     }
+  } else {
+    dpt_write_back(dirtyPages, staleDirtyPages, n);
   }
   free(staleDirtyPages);
 }
@@ -347,48 +801,73 @@ stasis_dirty_page_table_t * stasis_dirty_page_table_init(void) {
   stasis_dirty_page_table_t * ret = stasis_alloc(stasis_dirty_page_table_t);
   ret->outstanding_flush_lsns = stasis_util_multiset_create();
 
-  ret->tableByPage = rbinit(dpt_cmp_page, 0);
-  ret->tableByLsnAndPage = rbinit(dpt_cmp_lsn_and_page, 0);
+  ret->shardCount = stasis_dirty_page_table_shard_count > 0 ? stasis_dirty_page_table_shard_count : 1;
+  ret->stripeSize = stasis_dirty_page_table_shard_stripe_size > 0 ? stasis_dirty_page_table_shard_stripe_size : 1;
+  ret->shards = stasis_malloc(ret->shardCount, dpt_shard);
+  for(int i = 0; i < ret->shardCount; i++) {
+    pthread_mutex_init(&ret->shards[i].mutex, 0);
+    ret->shards[i].tableByPage = rbinit(dpt_cmp_page, 0);
+    ret->shards[i].tableByLsnAndPage = rbinit(dpt_cmp_lsn_and_page, 0);
+    ret->shards[i].minRecLSN = LSN_T_MAX;
+  }
   ret->count = 0;
   pthread_mutex_init(&ret->mutex, 0);
   pthread_cond_init(&ret->flushDone, 0);
   ret->flushing = 0;
+  ret->waiters = 0;
+  memset(&ret->progress, 0, sizeof(ret->progress));
   pthread_cond_init(&ret->writebackCond, 0);
+  pthread_mutex_init(&ret->limitsMutex, 0);
+  ret->bandwidth = 0.0;
+  ret->activeFlushes = 0;
+  ret->busySince = 0.0;
+  ret->sampleSeconds = 0.0;
+  ret->samplePages = 0;
+  ret->writeBandwidth = 0;
+  ret->softLimit = stasis_dirty_page_count_soft_limit;
+  ret->lowWaterMark = stasis_dirty_page_low_water_mark;
+  ret->flushQuantum = stasis_dirty_page_table_flush_quantum;
   return ret;
 }
 
 void stasis_dirty_page_table_deinit(stasis_dirty_page_table_t * dirtyPages) {
   int areDirty = 0;
-  dpt_entry dummy = {0, 0};
-  for(const dpt_entry * e = (const dpt_entry *)rblookup(RB_LUGTEQ, &dummy, dirtyPages->tableByPage);
-         e;
-         e = (const dpt_entry *)rblookup(RB_LUGREAT, &dummy, dirtyPages->tableByPage)) {
-
-    if((!areDirty) &&
-       (!stasis_suppress_unclean_shutdown_warnings)) {
-      printf("Warning:  dirtyPagesDeinit detected dirty, unwritten pages.  "
-         "Updates lost?\n");
-      areDirty = 1;
+  for(int i = 0; i < dirtyPages->shardCount; i++) {
+    dpt_shard * shard = &dirtyPages->shards[i];
+    dpt_entry dummy = {0, 0};
+    for(const dpt_entry * e = (const dpt_entry *)rblookup(RB_LUGTEQ, &dummy, shard->tableByPage);
+           e;
+           e = (const dpt_entry *)rblookup(RB_LUGREAT, &dummy, shard->tableByPage)) {
+
+      if((!areDirty) &&
+         (!stasis_suppress_unclean_shutdown_warnings)) {
+        printf("Warning:  dirtyPagesDeinit detected dirty, unwritten pages.  "
+           "Updates lost?\n");
+        areDirty = 1;
+      }
+      dummy = *e;
+      rbdelete(e, shard->tableByPage);
+      free((void*)e);
     }
-    dummy = *e;
-    rbdelete(e, dirtyPages->tableByPage);
-    free((void*)e);
-  }
 
-  dpt_entry dummy2 = {0, 0};
-  for(const dpt_entry * e = (const dpt_entry *)rblookup(RB_LUGTEQ, &dummy2, dirtyPages->tableByLsnAndPage);
-         e;
-         e = (const dpt_entry *)rblookup(RB_LUGREAT, &dummy2, dirtyPages->tableByLsnAndPage)) {
-    dummy2 = *e;
-    rbdelete(e, dirtyPages->tableByLsnAndPage);
-    free((void*)e);
-  }
+    dpt_entry dummy2 = {0, 0};
+    for(const dpt_entry * e = (const dpt_entry *)rblookup(RB_LUGTEQ, &dummy2, shard->tableByLsnAndPage);
+           e;
+           e = (const dpt_entry *)rblookup(RB_LUGREAT, &dummy2, shard->tableByLsnAndPage)) {
+      dummy2 = *e;
+      rbdelete(e, shard->tableByLsnAndPage);
+      free((void*)e);
+    }
 
-  rbdestroy(dirtyPages->tableByPage);
-  rbdestroy(dirtyPages->tableByLsnAndPage);
+    rbdestroy(shard->tableByPage);
+    rbdestroy(shard->tableByLsnAndPage);
+    pthread_mutex_destroy(&shard->mutex);
+  }
+  free(dirtyPages->shards);
   pthread_mutex_destroy(&dirtyPages->mutex);
   stasis_util_multiset_destroy(dirtyPages->outstanding_flush_lsns);
   pthread_cond_destroy(&dirtyPages->flushDone);
   pthread_cond_destroy(&dirtyPages->writebackCond);
+  pthread_mutex_destroy(&dirtyPages->limitsMutex);
   free(dirtyPages);
 }
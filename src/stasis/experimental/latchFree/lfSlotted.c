@@ -104,7 +104,8 @@ page_impl stasis_page_slotted_latch_free_impl(void) {
     0, // page_impl_dereference_identity,
     slotted.pageLoaded,
     slotted.pageFlushed,
-    slotted.pageCleanup
+    slotted.pageCleanup,
+    0 // lfSlottedReadOptimistic
   };
   return pi;
 }
@@ -273,7 +273,7 @@ recordid TlsmCreate(int xid, int comparator,
   recordid ret = { root, 0, 0 };
 
   Page *p = loadPage(xid, ret.page);
-  writelock(p->rwlatch,0);
+  stasis_page_writelock(p);
   stasis_page_fixed_initialize_page(p, sizeof(lsmTreeNodeRecord) + keySize, 0);
   p->pageType = LSM_ROOT_PAGE;
 
@@ -304,7 +304,7 @@ recordid TlsmCreate(int xid, int comparator,
 
   free(dummy);
 
-  unlock(p->rwlatch);
+  stasis_page_writeunlock(p);
   releasePage(p);
   return ret;
 }
@@ -323,7 +323,7 @@ static recordid buildPathToLeaf(int xid, recordid root, Page *root_p,
   DEBUG("new child = %lld internal? %d\n", child, depth-1);
 
   Page *child_p = loadPage(xid, child);
-  writelock(child_p->rwlatch,0);
+  stasis_page_writelock(child_p);
   initializeNodePage(xid, child_p, key_len);
 
   recordid ret;
@@ -337,7 +337,7 @@ static recordid buildPathToLeaf(int xid, recordid root, Page *root_p,
     ret = buildPathToLeaf(xid, child_rec, child_p, depth-1, key, key_len,
 			  val_page,lastLeaf, allocator, allocator_state);
 
-    unlock(child_p->rwlatch);
+    stasis_page_writeunlock(child_p);
     releasePage(child_p);
 
   } else {
@@ -360,14 +360,14 @@ static recordid buildPathToLeaf(int xid, recordid root, Page *root_p,
 
     ret = leaf_rec;
 
-    unlock(child_p->rwlatch);
+    stasis_page_writeunlock(child_p);
     releasePage(child_p);
     if(lastLeaf != -1) {
       // install forward link in previous page
       Page *lastLeafP = loadPage(xid, lastLeaf);
-      writelock(lastLeafP->rwlatch,0);
+      stasis_page_writelock(lastLeafP);
       writeNodeRecord(xid,lastLeafP,NEXT_LEAF,dummy,key_len,child);
-      unlock(lastLeafP->rwlatch);
+      stasis_page_writeunlock(lastLeafP);
       releasePage(lastLeafP);
     }
 
@@ -419,11 +419,11 @@ static recordid appendInternalNode(int xid, Page *p,
     recordid ret;
     {
       Page *child_page = loadPage(xid, child_id);
-      writelock(child_page->rwlatch,0);
+      stasis_page_writelock(child_page);
       ret = appendInternalNode(xid, child_page, depth-1, key, key_len,
                                val_page, lastLeaf, allocator, allocator_state);
 
-      unlock(child_page->rwlatch);
+      stasis_page_writeunlock(child_page);
       releasePage(child_page);
     }
     if(ret.size == INVALID_SLOT) { // subtree is full; split
@@ -492,7 +492,7 @@ recordid TlsmAppendPage(int xid, recordid tree,
 			lsm_page_allocator_t allocator, void *allocator_state,
                         long val_page) {
   Page *p = loadPage(xid, tree.page);
-  writelock(p->rwlatch, 0);
+  stasis_page_writelock(p);
   lsmTreeState *s = p->impl;
 
   size_t keySize = getKeySize(xid,p);
@@ -512,7 +512,7 @@ recordid TlsmAppendPage(int xid, recordid tree,
 
   if(s->lastLeaf != tree.page) {
     lastLeaf= loadPage(xid, s->lastLeaf);
-    writelock(lastLeaf->rwlatch, 0);
+    stasis_page_writelock(lastLeaf);
   } else {
     lastLeaf = p;
   }
@@ -523,7 +523,7 @@ recordid TlsmAppendPage(int xid, recordid tree,
   if(ret.size == INVALID_SLOT) {
     if(lastLeaf->id != p->id) {
       assert(s->lastLeaf != tree.page);
-      unlock(lastLeaf->rwlatch);
+      stasis_page_writeunlock(lastLeaf);
       releasePage(lastLeaf); // don't need that page anymore...
       lastLeaf = 0;
     }
@@ -541,7 +541,7 @@ recordid TlsmAppendPage(int xid, recordid tree,
 
       pageid_t child = allocator(xid, allocator_state);
       Page *lc = loadPage(xid, child);
-      writelock(lc->rwlatch,0);
+      stasis_page_writelock(lc);
 
       initializeNodePage(xid, lc,keySize);
 
@@ -582,7 +582,7 @@ recordid TlsmAppendPage(int xid, recordid tree,
         writeNodeRecord(xid,lc,NEXT_LEAF,dummy,keySize,-1);
       }
 
-      unlock(lc->rwlatch);
+      stasis_page_writeunlock(lc);
       releasePage(lc);
 
 
@@ -614,12 +614,12 @@ recordid TlsmAppendPage(int xid, recordid tree,
 
     if(lastLeaf->id != p->id) {
       assert(s->lastLeaf != tree.page);
-      unlock(lastLeaf->rwlatch);
+      stasis_page_writeunlock(lastLeaf);
       releasePage(lastLeaf);
     }
   }
 
-  unlock(p->rwlatch);
+  stasis_page_writeunlock(p);
   releasePage(p);
 
   return ret;
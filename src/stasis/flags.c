@@ -40,6 +40,18 @@ int stasis_buffer_manager_io_handle_flags =
 #endif 
 #endif
 
+#ifdef STASIS_BUFFER_MANAGER_DIRECT_IO
+int stasis_buffer_manager_direct_io = STASIS_BUFFER_MANAGER_DIRECT_IO;
+#else
+int stasis_buffer_manager_direct_io = 0;
+#endif
+
+#ifdef STASIS_BUFFER_MANAGER_WRITE_COALESCE_PAGES
+pageid_t stasis_buffer_manager_write_coalesce_pages = STASIS_BUFFER_MANAGER_WRITE_COALESCE_PAGES;
+#else
+pageid_t stasis_buffer_manager_write_coalesce_pages = 64;
+#endif
+
 int stasis_buffer_manager_preallocate_mode =
 #ifdef STASIS_BUFFER_MANAGER_PREALLOCATE_MODE
   STASIS_BUFFER_MANAGER_PREALLOCATE_MODE;
@@ -86,6 +98,36 @@ pageid_t stasis_dirty_page_table_flush_quantum =
 #else
   (4 * 1024 * 1024) / PAGE_SIZE;
 #endif
+int stasis_dirty_page_table_adaptive_limits =
+#ifdef STASIS_DIRTY_PAGE_TABLE_ADAPTIVE_LIMITS
+  STASIS_DIRTY_PAGE_TABLE_ADAPTIVE_LIMITS;
+#else
+  0;
+#endif
+int stasis_dirty_page_table_adaptive_backlog_ms =
+#ifdef STASIS_DIRTY_PAGE_TABLE_ADAPTIVE_BACKLOG_MS
+  STASIS_DIRTY_PAGE_TABLE_ADAPTIVE_BACKLOG_MS;
+#else
+  1000;
+#endif
+int stasis_dirty_page_table_adaptive_quantum_ms =
+#ifdef STASIS_DIRTY_PAGE_TABLE_ADAPTIVE_QUANTUM_MS
+  STASIS_DIRTY_PAGE_TABLE_ADAPTIVE_QUANTUM_MS;
+#else
+  100;
+#endif
+int stasis_dirty_page_table_shard_count =
+#ifdef STASIS_DIRTY_PAGE_TABLE_SHARD_COUNT
+  STASIS_DIRTY_PAGE_TABLE_SHARD_COUNT;
+#else
+  16;
+#endif
+pageid_t stasis_dirty_page_table_shard_stripe_size =
+#ifdef STASIS_DIRTY_PAGE_TABLE_SHARD_STRIPE_SIZE
+  STASIS_DIRTY_PAGE_TABLE_SHARD_STRIPE_SIZE;
+#else
+  64;
+#endif
 
 stasis_page_handle_t* (*stasis_page_handle_factory)(stasis_log_t*, stasis_dirty_page_table_t*) =
 #ifdef STASIS_PAGE_HANDLE_FACTORY
@@ -122,6 +164,42 @@ uint32_t stasis_handle_raid0_stripe_size =
 
 char ** stasis_handle_raid0_filenames = 0;
 
+#ifdef STASIS_HANDLE_CACHE_FILE_NAME
+const char * stasis_handle_cache_file_name = STASIS_HANDLE_CACHE_FILE_NAME;
+#else
+const char * stasis_handle_cache_file_name = "storefile.cache";
+#endif
+lsn_t stasis_handle_cache_size =
+#ifdef STASIS_HANDLE_CACHE_SIZE
+  STASIS_HANDLE_CACHE_SIZE;
+#else
+  1024 * 1024 * 1024;
+#endif
+int stasis_handle_cache_write_back =
+#ifdef STASIS_HANDLE_CACHE_WRITE_BACK
+  STASIS_HANDLE_CACHE_WRITE_BACK;
+#else
+  0;
+#endif
+int stasis_handle_qos_queue_depth =
+#ifdef STASIS_HANDLE_QOS_QUEUE_DEPTH
+  STASIS_HANDLE_QOS_QUEUE_DEPTH;
+#else
+  8;
+#endif
+double stasis_handle_qos_writeback_rate =
+#ifdef STASIS_HANDLE_QOS_WRITEBACK_RATE
+  STASIS_HANDLE_QOS_WRITEBACK_RATE;
+#else
+  0;
+#endif
+double stasis_handle_qos_prefetch_rate =
+#ifdef STASIS_HANDLE_QOS_PREFETCH_RATE
+  STASIS_HANDLE_QOS_PREFETCH_RATE;
+#else
+  0;
+#endif
+
 #ifdef STASIS_BUFFER_MANAGER_HINT_WRITES_ARE_SEQUENTIAL
 int stasis_buffer_manager_hint_writes_are_sequential = STASIS_BUFFER_MANAGER_HINT_WRITES_ARE_SEQUENTIAL;
 #else
@@ -163,6 +241,18 @@ int stasis_truncation_automatic = STASIS_TRUNCATION_AUTOMATIC;
 int stasis_truncation_automatic = 1;
 #endif
 
+#ifdef STASIS_CHECKPOINT_INTERVAL
+int stasis_checkpoint_interval = STASIS_CHECKPOINT_INTERVAL;
+#else
+int stasis_checkpoint_interval = 30;
+#endif
+
+#ifdef STASIS_CHECKPOINT_FILE_NAME
+const char * stasis_checkpoint_file_name = STASIS_CHECKPOINT_FILE_NAME;
+#else
+const char * stasis_checkpoint_file_name = NULL;
+#endif
+
 #ifdef STASIS_LOG_TYPE
 int stasis_log_type = STASIS_LOG_TYPE;
 #else
@@ -205,6 +295,74 @@ int stasis_buffer_manager_hash_prefetch_count = STASIS_BUFFER_MANAGER_HASH_PREFE
 int stasis_buffer_manager_hash_prefetch_count = 2;
 #endif
 
+#ifdef STASIS_BUFFER_MANAGER_CONCURRENT_HASH_WRITEBACK_COUNT
+int stasis_buffer_manager_concurrent_hash_writeback_count = STASIS_BUFFER_MANAGER_CONCURRENT_HASH_WRITEBACK_COUNT;
+#else
+int stasis_buffer_manager_concurrent_hash_writeback_count = 1;
+#endif
+
+#ifdef STASIS_BUFFER_MANAGER_CONCURRENT_HASH_WRITEBACK_STRIPE_SIZE
+pageid_t stasis_buffer_manager_concurrent_hash_writeback_stripe_size = STASIS_BUFFER_MANAGER_CONCURRENT_HASH_WRITEBACK_STRIPE_SIZE;
+#else
+pageid_t stasis_buffer_manager_concurrent_hash_writeback_stripe_size = (4 * 1024 * 1024) / PAGE_SIZE;
+#endif
+
+#ifdef STASIS_BUFFER_MANAGER_CONCURRENT_HASH_READAHEAD_COUNT
+int stasis_buffer_manager_concurrent_hash_readahead_count = STASIS_BUFFER_MANAGER_CONCURRENT_HASH_READAHEAD_COUNT;
+#else
+int stasis_buffer_manager_concurrent_hash_readahead_count = 1;
+#endif
+
+#ifdef STASIS_BUFFER_MANAGER_CONCURRENT_HASH_READAHEAD_PAGES
+pageid_t stasis_buffer_manager_concurrent_hash_readahead_pages = STASIS_BUFFER_MANAGER_CONCURRENT_HASH_READAHEAD_PAGES;
+#else
+pageid_t stasis_buffer_manager_concurrent_hash_readahead_pages = 32;
+#endif
+
+#ifdef STASIS_BUFFER_MANAGER_HOT_SET_FILE_NAME
+const char * stasis_buffer_manager_hot_set_file_name = STASIS_BUFFER_MANAGER_HOT_SET_FILE_NAME;
+#else
+const char * stasis_buffer_manager_hot_set_file_name = NULL;
+#endif
+
+#ifdef STASIS_BUFFER_POOL_NUMA_NODES
+int stasis_buffer_pool_numa_nodes = STASIS_BUFFER_POOL_NUMA_NODES;
+#else
+int stasis_buffer_pool_numa_nodes = 0;
+#endif
+
+#ifdef STASIS_BUFFER_MANAGER_NUMA_PLACEMENT
+int stasis_buffer_manager_numa_placement = STASIS_BUFFER_MANAGER_NUMA_PLACEMENT;
+#else
+int stasis_buffer_manager_numa_placement = STASIS_NUMA_PLACEMENT_LOCAL;
+#endif
+
+#ifdef STASIS_BUFFER_POOL_HUGE_PAGES
+int stasis_buffer_pool_huge_pages = STASIS_BUFFER_POOL_HUGE_PAGES;
+#else
+int stasis_buffer_pool_huge_pages = STASIS_BUFFER_POOL_HUGE_PAGES_TRANSPARENT;
+#endif
+#ifdef STASIS_BUFFER_MANAGER_COMPRESSED_TIER_SIZE
+pageid_t stasis_buffer_manager_compressed_tier_size = STASIS_BUFFER_MANAGER_COMPRESSED_TIER_SIZE;
+#else
+pageid_t stasis_buffer_manager_compressed_tier_size = 0;
+#endif
+#ifdef STASIS_PAGE_OPTIMISTIC_READS
+int stasis_page_optimistic_reads = STASIS_PAGE_OPTIMISTIC_READS;
+#else
+int stasis_page_optimistic_reads = 1;
+#endif
+#ifdef STASIS_PAGE_CHECKSUMS
+int stasis_page_checksums = STASIS_PAGE_CHECKSUMS;
+#else
+int stasis_page_checksums = 0;
+#endif
+#ifdef STASIS_PAGE_SCRUBBER_PAGES_PER_SECOND
+pageid_t stasis_page_scrubber_pages_per_second = STASIS_PAGE_SCRUBBER_PAGES_PER_SECOND;
+#else
+pageid_t stasis_page_scrubber_pages_per_second = 0;
+#endif
+
 #ifdef STASIS_LOG_FILE_MODE
 int stasis_log_file_mode = STASIS_LOG_FILE_MODE;
 #else
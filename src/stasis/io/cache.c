@@ -0,0 +1,895 @@
+/*
+ * cache.c
+ *
+ * A handle that keeps copies of a slow handle's pages in a bounded cache
+ * file on a fast handle (typically, a hard disk array and an SSD).
+ *
+ * The cache file is divided into PAGE_SIZE slots.  Each slot holds one
+ * PAGE_SIZE aligned block of the slow handle.  Blocks enter the cache when
+ * they are written in their entirety, and when admit() is called on them
+ * (buffer managers do so when they drop clean pages).  Reads of cached
+ * blocks are served from the fast handle; other reads go to the slow
+ * handle, and do not populate the cache.  Slots are reclaimed with CLOCK.
+ *
+ * admit() is called on buffer manager miss paths, so it never blocks on
+ * I/O: it gives up if the cache is busy, or has no free slot, and
+ * otherwise copies the block to a queue.  A background thread writes
+ * queued blocks to their slots, and reclaims slots (which may mean writing
+ * dirty blocks back and saving the directory) when admit() runs out.
+ *
+ * In write-through mode, every write goes to the slow handle, and to the
+ * cache if the block is cached.  In write-back mode, writes to cached
+ * blocks only go to the cache; dirty blocks are written to the slow handle
+ * when their slot is reclaimed, and when the handle is closed.
+ *
+ * Layout of the cache file, in PAGE_SIZE blocks:
+ *
+ *   [superblock][directory A][directory B][slot 0][slot 1]...
+ *
+ * The directory maps slots to blocks, and records which slots are dirty.
+ * force() saves it, alternating between the two copies, so that a torn
+ * directory write leaves the other copy intact.  A slot that is listed in
+ * either copy is not reused for a different block until a newer copy that
+ * does not list it is durable, so after a crash, every slot that the
+ * newest valid copy lists holds a version of its block that is at least as
+ * new as the one that was current when the copy was saved.  That is all
+ * that the write-ahead log needs from the page file.
+ *
+ * A cache file belongs to one slow handle; nothing checks that it is
+ * reopened with the same one.
+ *
+ * The superblock records whether the cache was closed cleanly.  After a
+ * crash, dirty bits may be stale, so every recovered slot is treated as
+ * dirty, and (in write-through mode) written back to the slow handle before
+ * open returns.
+ */
+#include <config.h>
+#include <stasis/common.h>
+#include <stasis/flags.h>
+#include <stasis/io/handle.h>
+#include <stasis/bufferPool.h>
+#include <stasis/util/concurrentHash.h>
+#include <stasis/util/crc32.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+
+#define CACHE_MAGIC 0x5354415343414348LL  /* "STASCACH" */
+#define CACHE_VERSION 1
+#define CACHE_EMPTY ((pageid_t)-1)
+/** When the cache is full, reclaim this fraction of the slots at once, so that directory saves are amortized. */
+#define CACHE_RECLAIM_DIVISOR 16
+/** Blocks that admit() may queue for the background thread before it starts dropping them. */
+#define CACHE_ADMIT_QUEUE 64
+
+typedef struct {
+  int64_t magic;
+  int64_t version;
+  int64_t page_size;
+  int64_t slot_count;
+  int64_t clean;
+} cache_superblock;
+
+typedef struct {
+  int64_t magic;
+  int64_t seq;
+  int64_t slot_count;
+  lsn_t end_pos;
+  uint32_t crc;
+  uint32_t pad;
+} cache_directory_header;
+
+typedef struct {
+  int64_t block;
+  int64_t dirty;
+} cache_directory_entry;
+
+typedef struct {
+  /** The block this slot holds, or CACHE_EMPTY. */
+  pageid_t block;
+  /** The block that the newest durable directory lists for this slot. */
+  pageid_t persisted;
+  /** The block that the directory that is being saved lists for this slot. */
+  pageid_t saving;
+  /** Threads that are reading or writing the slot; pinned slots are not reclaimed. */
+  int pins;
+  /** Zero while the slot is being filled; readers treat such slots as misses. */
+  int valid;
+  /** The block was written behind the slot's back; drop the slot once it is unpinned. */
+  int stale;
+  int dirty;
+  /** CLOCK reference bit. */
+  int ref;
+} cache_slot;
+
+typedef struct cache_impl {
+  stasis_handle_t * slow;
+  stasis_handle_t * fast;
+  int write_back;
+  pageid_t slot_count;
+  /** Size of one directory copy, in bytes. */
+  lsn_t dir_len;
+  /** Offset of slot 0 in the fast handle. */
+  lsn_t slot_base;
+  cache_slot * slots;
+  /** block -> cache_slot*. */
+  hashtable_t * map;
+  pageid_t * free_slots;
+  pageid_t free_count;
+  pageid_t hand;
+  lsn_t end_pos;
+  int64_t seq;
+  /** The directory has changed since it was last saved. */
+  int changed;
+  int saving;
+  pthread_cond_t save_done;
+  /** Copies of admitted blocks, waiting for the admission thread. */
+  byte * admit_bufs;
+  pageid_t admit_slots[CACHE_ADMIT_QUEUE];
+  int admit_head;
+  int admit_count;
+  /** admit() found no free slot. */
+  int admit_starved;
+  int admit_shutdown;
+  pthread_t admitter;
+  pthread_cond_t admit_needed;
+  pthread_cond_t admit_done;
+  int refcount;
+  pthread_mutex_t mut;
+} cache_impl;
+
+static inline lsn_t cache_slot_off(cache_impl * impl, pageid_t s) {
+  return impl->slot_base + s * PAGE_SIZE;
+}
+static inline lsn_t cache_dir_off(cache_impl * impl, int64_t seq) {
+  return PAGE_SIZE + (seq & 1) * impl->dir_len;
+}
+
+static int cache_write_superblock(cache_impl * impl, int clean) {
+  byte * buf = stasis_buffer_pool_alloc_aligned(PAGE_SIZE);
+  memset(buf, 0, PAGE_SIZE);
+  cache_superblock * sb = (cache_superblock*)buf;
+  sb->magic = CACHE_MAGIC;
+  sb->version = CACHE_VERSION;
+  sb->page_size = PAGE_SIZE;
+  sb->slot_count = impl->slot_count;
+  sb->clean = clean;
+  int ret = impl->fast->write(impl->fast, 0, buf, PAGE_SIZE);
+  if(!ret) { ret = impl->fast->force(impl->fast); }
+  stasis_buffer_pool_free_aligned(buf);
+  return ret;
+}
+/** Rebuild the free list.  Called with mut held. */
+static void cache_rebuild_free_list(cache_impl * impl) {
+  impl->free_count = 0;
+  for(pageid_t s = 0; s < impl->slot_count; s++) {
+    cache_slot * slot = &impl->slots[s];
+    if(slot->block == CACHE_EMPTY && slot->persisted == CACHE_EMPTY && slot->saving == CACHE_EMPTY) {
+      impl->free_slots[impl->free_count++] = s;
+    }
+  }
+}
+/**
+ * Make everything that has been written so far durable, and save the
+ * directory.  Called with mut held; releases it while doing I/O.
+ */
+static int cache_save_directory(cache_impl * impl) {
+  while(impl->saving) {
+    pthread_cond_wait(&impl->save_done, &impl->mut);
+  }
+  impl->saving = 1;
+  impl->changed = 0;
+  int64_t seq = ++impl->seq;
+
+  byte * buf = stasis_buffer_pool_alloc_aligned(impl->dir_len);
+  memset(buf, 0, impl->dir_len);
+  cache_directory_header * hdr = (cache_directory_header*)buf;
+  cache_directory_entry * ent = (cache_directory_entry*)(hdr + 1);
+  for(pageid_t s = 0; s < impl->slot_count; s++) {
+    cache_slot * slot = &impl->slots[s];
+    slot->saving = slot->valid ? slot->block : CACHE_EMPTY;
+    ent[s].block = slot->saving;
+    ent[s].dirty = slot->valid && slot->dirty;
+  }
+  hdr->magic = CACHE_MAGIC;
+  hdr->seq = seq;
+  hdr->slot_count = impl->slot_count;
+  hdr->end_pos = impl->end_pos;
+  pthread_mutex_unlock(&impl->mut);
+
+  // The directory may only become durable after the slots it lists (and
+  // the slow handle writes that let us drop slots from it) are.
+  int ret = impl->slow->force(impl->slow);
+  if(!ret) { ret = impl->fast->force(impl->fast); }
+  if(!ret) {
+    hdr->crc = stasis_crc32(buf, impl->dir_len, (uint32_t)-1);
+    ret = impl->fast->write(impl->fast, cache_dir_off(impl, seq), buf, impl->dir_len);
+  }
+  if(!ret) { ret = impl->fast->force(impl->fast); }
+  stasis_buffer_pool_free_aligned(buf);
+
+  pthread_mutex_lock(&impl->mut);
+  // Don't let the next save overwrite the newest valid copy.
+  if(ret) { impl->seq--; }
+  for(pageid_t s = 0; s < impl->slot_count; s++) {
+    cache_slot * slot = &impl->slots[s];
+    // If the save failed, the old copy is still the newest one on disk,
+    // and the slots it lists are still off limits.
+    if(!ret) { slot->persisted = slot->saving; }
+    slot->saving = CACHE_EMPTY;
+  }
+  if(ret) { impl->changed = 1; }
+  cache_rebuild_free_list(impl);
+  impl->saving = 0;
+  pthread_cond_broadcast(&impl->save_done);
+  return ret;
+}
+/** Copy a dirty slot to the slow handle.  The caller must have pinned the slot. */
+static int cache_write_back_slot(cache_impl * impl, pageid_t s, pageid_t block) {
+  byte * buf = stasis_buffer_pool_alloc_aligned(PAGE_SIZE);
+  int ret = impl->fast->read(impl->fast, cache_slot_off(impl, s), buf, PAGE_SIZE);
+  if(!ret) { ret = impl->slow->write(impl->slow, block * PAGE_SIZE, buf, PAGE_SIZE); }
+  stasis_buffer_pool_free_aligned(buf);
+  return ret;
+}
+/** Called with mut held.  Drops slot s from the directory. */
+static void cache_drop_slot(cache_impl * impl, pageid_t s) {
+  cache_slot * slot = &impl->slots[s];
+  void * old = hashtable_remove(impl->map, slot->block);
+  assert(old == slot);
+  slot->block = CACHE_EMPTY;
+  slot->valid = 0;
+  slot->stale = 0;
+  slot->dirty = 0;
+  slot->ref = 0;
+  impl->changed = 1;
+  if(slot->persisted == CACHE_EMPTY && slot->saving == CACHE_EMPTY) {
+    impl->free_slots[impl->free_count++] = s;
+  }
+}
+/**
+ * Run CLOCK until up to count slots have been reclaimed, writing dirty
+ * victims back to the slow handle.  Called with mut held; may release it.
+ */
+static void cache_reclaim(cache_impl * impl, pageid_t count) {
+  pageid_t found = 0;
+  for(pageid_t scanned = 0; found < count && scanned < 2 * impl->slot_count; scanned++) {
+    pageid_t s = impl->hand;
+    impl->hand = (impl->hand + 1) % impl->slot_count;
+    cache_slot * slot = &impl->slots[s];
+    if(slot->block == CACHE_EMPTY || slot->pins || !slot->valid) { continue; }
+    if(slot->ref) { slot->ref = 0; continue; }
+    if(slot->dirty) {
+      pageid_t block = slot->block;
+      slot->pins++;
+      slot->dirty = 0;
+      pthread_mutex_unlock(&impl->mut);
+      int err = cache_write_back_slot(impl, s, block);
+      pthread_mutex_lock(&impl->mut);
+      slot->pins--;
+      if(err) {
+        slot->dirty = 1;
+        continue;
+      }
+      // Someone used the slot while we were writing it back.
+      if(slot->dirty || slot->pins || slot->block != block) { continue; }
+    }
+    cache_drop_slot(impl, s);
+    found++;
+  }
+}
+/**
+ * Find an empty slot, and assign it to block.  Called with mut held; may
+ * release it.  The slot is returned pinned, and invalid.
+ *
+ * @return the slot, or -1 if the cache has no slots to spare.
+ */
+static pageid_t cache_assign_slot(cache_impl * impl, pageid_t block, int dirty) {
+  for(int attempt = 0; !impl->free_count && attempt < 3; attempt++) {
+    cache_reclaim(impl, impl->slot_count / CACHE_RECLAIM_DIVISOR + 1);
+    if(!impl->free_count) {
+      // Reclaimed slots are still listed by the directory on disk.
+      cache_save_directory(impl);
+    }
+  }
+  if(hashtable_lookup(impl->map, block)) {
+    // Another thread admitted block while we were reclaiming.
+    return -1;
+  }
+  if(!impl->free_count) { return -1; }
+  pageid_t s = impl->free_slots[--impl->free_count];
+  cache_slot * slot = &impl->slots[s];
+  assert(slot->block == CACHE_EMPTY && !slot->pins);
+  slot->block = block;
+  slot->valid = 0;
+  slot->stale = 0;
+  slot->dirty = dirty;
+  slot->ref = 1;
+  slot->pins = 1;
+  hashtable_insert(impl->map, block, slot);
+  impl->changed = 1;
+  return s;
+}
+/** Called with mut held.  Validate a slot that has just been filled, and unpin it. */
+static void cache_filled_slot(cache_impl * impl, pageid_t s, int err) {
+  cache_slot * slot = &impl->slots[s];
+  slot->pins--;
+  assert(!slot->pins);  // cache_pin() ignores invalid slots.
+  if(err || slot->stale) {
+    cache_drop_slot(impl, s);
+  } else {
+    slot->valid = 1;
+  }
+}
+/** Fill a slot returned by cache_assign_slot(), and unpin it. */
+static int cache_fill_slot(cache_impl * impl, pageid_t s, const byte * dat) {
+  int ret = impl->fast->write(impl->fast, cache_slot_off(impl, s), dat, PAGE_SIZE);
+  pthread_mutex_lock(&impl->mut);
+  cache_filled_slot(impl, s, ret);
+  pthread_mutex_unlock(&impl->mut);
+  return ret;
+}
+/**
+ * Called with mut held.  The slow handle's copy of block is about to
+ * change without the cache's copy changing too.  Make sure that nobody
+ * reads the cache's copy again.
+ */
+static void cache_invalidate(cache_impl * impl, pageid_t block) {
+  cache_slot * slot = (cache_slot*)hashtable_lookup(impl->map, block);
+  if(!slot) { return; }
+  // Clean slots are up to date on the slow handle, so dropping them loses nothing.
+  assert(!slot->dirty);
+  slot->stale = 1;
+  slot->valid = 0;
+  if(!slot->pins) { cache_drop_slot(impl, slot - impl->slots); }
+}
+/** @return the slot that holds block (pinned), or -1 if block is not cached. */
+static pageid_t cache_pin(cache_impl * impl, pageid_t block) {
+  pageid_t ret = -1;
+  pthread_mutex_lock(&impl->mut);
+  cache_slot * slot = (cache_slot*)hashtable_lookup(impl->map, block);
+  if(slot && slot->valid) {
+    slot->pins++;
+    slot->ref = 1;
+    ret = slot - impl->slots;
+  }
+  pthread_mutex_unlock(&impl->mut);
+  return ret;
+}
+static void cache_unpin(cache_impl * impl, pageid_t s, int dirtied) {
+  pthread_mutex_lock(&impl->mut);
+  cache_slot * slot = &impl->slots[s];
+  if(dirtied && !slot->dirty) {
+    slot->dirty = 1;
+    impl->changed = 1;
+  }
+  slot->pins--;
+  if(!slot->pins && slot->stale) { cache_drop_slot(impl, s); }
+  pthread_mutex_unlock(&impl->mut);
+}
+/**
+ * Write queued admissions to their slots, and reclaim slots when admit()
+ * runs out of them, so that admit() never does I/O itself.
+ */
+static void * cache_admit_worker(void * arg) {
+  cache_impl * impl = (cache_impl*)arg;
+  pthread_mutex_lock(&impl->mut);
+  while(1) {
+    while(!impl->admit_count && !impl->admit_starved && !impl->admit_shutdown) {
+      pthread_cond_wait(&impl->admit_needed, &impl->mut);
+    }
+    if(impl->admit_count) {
+      int i = impl->admit_head;
+      pageid_t s = impl->admit_slots[i];
+      pthread_mutex_unlock(&impl->mut);
+      int err = impl->fast->write(impl->fast, cache_slot_off(impl, s),
+                                  impl->admit_bufs + i * PAGE_SIZE, PAGE_SIZE);
+      pthread_mutex_lock(&impl->mut);
+      cache_filled_slot(impl, s, err);
+      impl->admit_head = (impl->admit_head + 1) % CACHE_ADMIT_QUEUE;
+      impl->admit_count--;
+      pthread_cond_broadcast(&impl->admit_done);
+    } else if(impl->admit_shutdown) {
+      break;
+    } else {
+      impl->admit_starved = 0;
+      cache_reclaim(impl, impl->slot_count / CACHE_RECLAIM_DIVISOR + 1);
+      if(!impl->free_count && impl->changed) {
+        // Reclaimed slots are still listed by the directory on disk.
+        cache_save_directory(impl);
+      }
+    }
+  }
+  pthread_mutex_unlock(&impl->mut);
+  return 0;
+}
+
+static int cache_num_copies(stasis_handle_t * h) { return 0; }
+static int cache_num_copies_buffer(stasis_handle_t * h) { return 1; }
+
+static int cache_write_back_all(cache_impl * impl) {
+  int ret = 0;
+  pthread_mutex_lock(&impl->mut);
+  for(pageid_t s = 0; s < impl->slot_count; s++) {
+    cache_slot * slot = &impl->slots[s];
+    if(slot->block == CACHE_EMPTY || !slot->valid || !slot->dirty) { continue; }
+    pageid_t block = slot->block;
+    slot->pins++;
+    slot->dirty = 0;
+    impl->changed = 1;
+    pthread_mutex_unlock(&impl->mut);
+    int err = cache_write_back_slot(impl, s, block);
+    pthread_mutex_lock(&impl->mut);
+    slot->pins--;
+    if(err) { slot->dirty = 1; ret = err; }
+  }
+  pthread_mutex_unlock(&impl->mut);
+  return ret;
+}
+static int cache_close(stasis_handle_t * h) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  pthread_mutex_lock(&impl->mut);
+  impl->refcount--;
+  if(impl->refcount) {
+    pthread_mutex_unlock(&impl->mut);
+    return 0;
+  }
+  impl->admit_shutdown = 1;
+  pthread_cond_signal(&impl->admit_needed);
+  pthread_mutex_unlock(&impl->mut);
+  pthread_join(impl->admitter, 0);
+
+  // Leave the slow handle self-contained, so that it can be opened without the cache.
+  int ret = cache_write_back_all(impl);
+  pthread_mutex_lock(&impl->mut);
+  int err = cache_save_directory(impl);
+  pthread_mutex_unlock(&impl->mut);
+  if(!ret) { ret = err; }
+  if(!ret) { ret = cache_write_superblock(impl, 1); }
+
+  err = impl->slow->close(impl->slow);
+  if(!ret) { ret = err; }
+  err = impl->fast->close(impl->fast);
+  if(!ret) { ret = err; }
+
+  hashtable_deinit(impl->map);
+  stasis_buffer_pool_free_aligned(impl->admit_bufs);
+  pthread_cond_destroy(&impl->admit_needed);
+  pthread_cond_destroy(&impl->admit_done);
+  pthread_cond_destroy(&impl->save_done);
+  pthread_mutex_destroy(&impl->mut);
+  free(impl->free_slots);
+  free(impl->slots);
+  free(impl);
+  free(h);
+  return ret;
+}
+static stasis_handle_t * cache_dup(stasis_handle_t * h) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  pthread_mutex_lock(&impl->mut);
+  impl->refcount++;
+  pthread_mutex_unlock(&impl->mut);
+  return h;
+}
+static void cache_enable_sequential_optimizations(stasis_handle_t * h) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  impl->slow->enable_sequential_optimizations(impl->slow);
+}
+static lsn_t cache_end_position(stasis_handle_t * h) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  pthread_mutex_lock(&impl->mut);
+  lsn_t ret = impl->end_pos;
+  pthread_mutex_unlock(&impl->mut);
+  // In write-back mode, the cache may hold blocks past the end of the slow handle.
+  lsn_t slow_end = impl->slow->end_position(impl->slow);
+  return slow_end > ret ? slow_end : ret;
+}
+
+/**
+ * Read from the slow handle.  In write-back mode, the handle may end
+ * before blocks that only exist in the cache; the gap reads as zeros.
+ */
+static int cache_read_slow(cache_impl * impl, lsn_t off, byte * buf, lsn_t len) {
+  lsn_t slow_end = impl->slow->end_position(impl->slow);
+  lsn_t n = off >= slow_end ? 0 : (off + len > slow_end ? slow_end - off : len);
+  int ret = n ? impl->slow->read(impl->slow, off, buf, n) : 0;
+  if(!ret && n < len) { memset(buf + n, 0, len - n); }
+  return ret;
+}
+static int cache_read(stasis_handle_t * h, lsn_t off, byte * buf, lsn_t len) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  if(off < 0) { return EDOM; }
+  if(off + len > cache_end_position(h)) { return EDOM; }
+  // Misses are coalesced into a single read of the slow handle.
+  lsn_t miss_start = off;
+  lsn_t pos = off;
+  while(pos < off + len) {
+    pageid_t block = pos / PAGE_SIZE;
+    lsn_t stop = (block + 1) * PAGE_SIZE;
+    if(stop > off + len) { stop = off + len; }
+    pageid_t s = cache_pin(impl, block);
+    if(s != -1) {
+      int ret = 0;
+      if(miss_start < pos) {
+        ret = cache_read_slow(impl, miss_start, buf + (miss_start - off), pos - miss_start);
+      }
+      if(!ret) {
+        ret = impl->fast->read(impl->fast, cache_slot_off(impl, s) + (pos - block * PAGE_SIZE),
+                               buf + (pos - off), stop - pos);
+      }
+      cache_unpin(impl, s, 0);
+      if(ret) { return ret; }
+      miss_start = stop;
+    }
+    pos = stop;
+  }
+  if(miss_start < off + len) {
+    return cache_read_slow(impl, miss_start, buf + (miss_start - off), off + len - miss_start);
+  }
+  return 0;
+}
+static int cache_write(stasis_handle_t * h, lsn_t off, const byte * dat, lsn_t len) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  if(off < 0) { return EDOM; }
+  int ret = 0;
+  if(!impl->write_back) {
+    ret = impl->slow->write(impl->slow, off, dat, len);
+    if(ret) { return ret; }
+  }
+  lsn_t pos = off;
+  while(pos < off + len) {
+    pageid_t block = pos / PAGE_SIZE;
+    lsn_t stop = (block + 1) * PAGE_SIZE;
+    if(stop > off + len) { stop = off + len; }
+    const byte * src = dat + (pos - off);
+    pageid_t s = cache_pin(impl, block);
+    if(s != -1) {
+      ret = impl->fast->write(impl->fast, cache_slot_off(impl, s) + (pos - block * PAGE_SIZE), src, stop - pos);
+      if(ret) {
+        pthread_mutex_lock(&impl->mut);
+        if(impl->slots[s].dirty) {
+          // The cache holds the only up to date copy of the rest of the block.
+          impl->slots[s].pins--;
+          pthread_mutex_unlock(&impl->mut);
+          return ret;
+        }
+        // Otherwise, the slot now holds stale data; drop it, and use the slow handle.
+        impl->slots[s].stale = 1;
+        impl->slots[s].valid = 0;
+        pthread_mutex_unlock(&impl->mut);
+      }
+      cache_unpin(impl, s, impl->write_back && !ret);
+    } else if(stop - pos == PAGE_SIZE) {
+      pthread_mutex_lock(&impl->mut);
+      s = cache_assign_slot(impl, block, impl->write_back);
+      pthread_mutex_unlock(&impl->mut);
+      if(s != -1) {
+        ret = cache_fill_slot(impl, s, src);
+      }
+    }
+    if(s == -1) {
+      pthread_mutex_lock(&impl->mut);
+      cache_slot * slot = (cache_slot*)hashtable_lookup(impl->map, block);
+      if(slot && slot->dirty) {
+        // A racing write of this block is filling a slot; let it finish.
+        pthread_mutex_unlock(&impl->mut);
+        sched_yield();
+        continue;
+      }
+      // The block may have a slot that is still being filled with older data.
+      cache_invalidate(impl, block);
+      pthread_mutex_unlock(&impl->mut);
+    }
+    if(s == -1 || ret) {
+      // Not cached; in write-back mode, write it through.
+      if(impl->write_back) {
+        ret = impl->slow->write(impl->slow, pos, src, stop - pos);
+      } else {
+        ret = 0;  // The slow handle already has the data.
+      }
+    }
+    if(ret) { return ret; }
+    pos = stop;
+  }
+  pthread_mutex_lock(&impl->mut);
+  if(off + len > impl->end_pos) { impl->end_pos = off + len; }
+  pthread_mutex_unlock(&impl->mut);
+  return 0;
+}
+/**
+ * Queue blocks for the admission thread.  This is best effort: it skips
+ * blocks if another thread holds the cache's mutex, if there are no free
+ * slots, or if the queue is full, and never waits for I/O.
+ */
+static int cache_admit(stasis_handle_t * h, lsn_t off, const byte * dat, lsn_t len) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  if(off < 0) { return EDOM; }
+  if(pthread_mutex_trylock(&impl->mut)) { return EAGAIN; }
+  int ret = 0;
+  // Only whole blocks are cached.
+  lsn_t first = (off + PAGE_SIZE - 1) / PAGE_SIZE;
+  lsn_t last = (off + len) / PAGE_SIZE;
+  for(pageid_t block = first; block < last; block++) {
+    cache_slot * slot = (cache_slot*)hashtable_lookup(impl->map, block);
+    if(slot) {
+      slot->ref = 1;  // Already cached, or about to be.
+      continue;
+    }
+    if(!impl->free_count) {
+      impl->admit_starved = 1;
+      pthread_cond_signal(&impl->admit_needed);
+      ret = ENOSPC;
+      break;
+    }
+    if(impl->admit_count == CACHE_ADMIT_QUEUE) {
+      ret = EAGAIN;
+      break;
+    }
+    pageid_t s = cache_assign_slot(impl, block, 0);
+    assert(s != -1);  // There was a free slot, and we did not release mut.
+    int i = (impl->admit_head + impl->admit_count) % CACHE_ADMIT_QUEUE;
+    memcpy(impl->admit_bufs + i * PAGE_SIZE, dat + (block * PAGE_SIZE - off), PAGE_SIZE);
+    impl->admit_slots[i] = s;
+    impl->admit_count++;
+    pthread_cond_signal(&impl->admit_needed);
+  }
+  pthread_mutex_unlock(&impl->mut);
+  return ret;
+}
+static stasis_write_buffer_t * cache_write_buffer(stasis_handle_t * h, lsn_t off, lsn_t len) {
+  stasis_write_buffer_t * ret = stasis_alloc(stasis_write_buffer_t);
+  ret->h = h;
+  ret->impl = 0;
+  if(off < 0) {
+    ret->off = 0;
+    ret->buf = 0;
+    ret->len = 0;
+    ret->error = EDOM;
+  } else {
+    ret->off = off;
+    ret->buf = stasis_malloc(len, byte);
+    ret->len = len;
+    ret->error = 0;
+  }
+  return ret;
+}
+static int cache_release_write_buffer(stasis_write_buffer_t * w) {
+  int ret = w->error ? 0 : cache_write(w->h, w->off, w->buf, w->len);
+  free(w->buf);
+  free(w);
+  return ret;
+}
+static stasis_read_buffer_t * cache_read_buffer(stasis_handle_t * h, lsn_t off, lsn_t len) {
+  stasis_read_buffer_t * ret = stasis_alloc(stasis_read_buffer_t);
+  byte * buf = stasis_malloc(len, byte);
+  int error = cache_read(h, off, buf, len);
+  ret->h = h;
+  ret->impl = 0;
+  if(error) {
+    free(buf);
+    ret->buf = 0;
+    ret->off = 0;
+    ret->len = 0;
+  } else {
+    ret->buf = buf;
+    ret->off = off;
+    ret->len = len;
+  }
+  ret->error = error;
+  return ret;
+}
+static int cache_release_read_buffer(stasis_read_buffer_t * r) {
+  free((void*)r->buf);
+  free(r);
+  return 0;
+}
+static int cache_force(stasis_handle_t * h) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  int ret;
+  pthread_mutex_lock(&impl->mut);
+  // Let the directory list the blocks that have been admitted so far.
+  while(impl->admit_count) {
+    pthread_cond_wait(&impl->admit_done, &impl->mut);
+  }
+  if(impl->changed) {
+    ret = cache_save_directory(impl);
+    pthread_mutex_unlock(&impl->mut);
+  } else {
+    pthread_mutex_unlock(&impl->mut);
+    ret = impl->slow->force(impl->slow);
+    if(!ret) { ret = impl->fast->force(impl->fast); }
+  }
+  return ret;
+}
+static int cache_async_force(stasis_handle_t * h) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  int ret = impl->slow->async_force(impl->slow);
+  int err = impl->fast->async_force(impl->fast);
+  return ret ? ret : err;
+}
+static int cache_force_range(stasis_handle_t * h, lsn_t start, lsn_t stop) {
+  // In write-back mode, the range may be spread across the cache file.
+  return cache_force(h);
+}
+static int cache_fallocate(stasis_handle_t * h, lsn_t off, lsn_t len) {
+  cache_impl * impl = (cache_impl*)h->impl;
+  return impl->slow->fallocate ? impl->slow->fallocate(impl->slow, off, len) : 0;
+}
+
+static struct stasis_handle_t cache_func = {
+  /*.num_copies =*/ cache_num_copies,
+  /*.num_copies_buffer =*/ cache_num_copies_buffer,
+  /*.close =*/ cache_close,
+  /*.dup =*/ cache_dup,
+  /*.enable_sequential_optimizations =*/ cache_enable_sequential_optimizations,
+  /*.end_position =*/ cache_end_position,
+  /*.write_buffer =*/ cache_write_buffer,
+  /*.release_write_buffer =*/ cache_release_write_buffer,
+  /*.read_buffer =*/ cache_read_buffer,
+  /*.release_read_buffer =*/ cache_release_read_buffer,
+  /*.write =*/ cache_write,
+  /*.read =*/ cache_read,
+  /*.force =*/ cache_force,
+  /*.async_force =*/ cache_async_force,
+  /*.force_range =*/ cache_force_range,
+  /*.fallocate =*/ cache_fallocate,
+  /*.admit =*/ cache_admit,
+  /*.writev =*/ NULL,
+  /*.error =*/ 0,
+  /*.impl =*/ 0
+};
+
+/**
+ * Load the newest valid directory copy from the cache file.
+ *
+ * @return 1 if a directory was loaded, 0 if the cache is empty.
+ */
+static int cache_load_directory(cache_impl * impl, int clean) {
+  byte * buf = stasis_buffer_pool_alloc_aligned(impl->dir_len);
+  byte * best = stasis_buffer_pool_alloc_aligned(impl->dir_len);
+  int64_t best_seq = -1;
+  for(int copy = 0; copy < 2; copy++) {
+    if(impl->fast->read(impl->fast, cache_dir_off(impl, copy), buf, impl->dir_len)) { continue; }
+    cache_directory_header * hdr = (cache_directory_header*)buf;
+    if(hdr->magic != CACHE_MAGIC || hdr->slot_count != impl->slot_count
+       || (hdr->seq & 1) != copy || hdr->seq <= best_seq) { continue; }
+    uint32_t crc = hdr->crc;
+    hdr->crc = 0;
+    if(stasis_crc32(buf, impl->dir_len, (uint32_t)-1) != crc) { continue; }
+    best_seq = hdr->seq;
+    byte * tmp = best; best = buf; buf = tmp;
+  }
+  if(best_seq != -1) {
+    cache_directory_header * hdr = (cache_directory_header*)best;
+    cache_directory_entry * ent = (cache_directory_entry*)(hdr + 1);
+    impl->seq = best_seq;
+    if(hdr->end_pos > impl->end_pos) { impl->end_pos = hdr->end_pos; }
+    for(pageid_t s = 0; s < impl->slot_count; s++) {
+      cache_slot * slot = &impl->slots[s];
+      if(ent[s].block == CACHE_EMPTY) { continue; }
+      if(hashtable_lookup(impl->map, ent[s].block)) {
+        // Cannot happen unless the file is corrupt; keep the first copy.
+        fprintf(stderr, "cache: block %lld appears twice in the cache directory\n", (long long)ent[s].block);
+        continue;
+      }
+      slot->block = ent[s].block;
+      slot->persisted = ent[s].block;
+      slot->valid = 1;
+      // If we crashed, the slot may be newer than the slow handle, even if it was clean when the directory was saved.
+      slot->dirty = clean ? (int)ent[s].dirty : 1;
+      hashtable_insert(impl->map, slot->block, slot);
+      if(slot->dirty && (slot->block + 1) * PAGE_SIZE > impl->end_pos) {
+        impl->end_pos = (slot->block + 1) * PAGE_SIZE;
+      }
+    }
+  }
+  stasis_buffer_pool_free_aligned(buf);
+  stasis_buffer_pool_free_aligned(best);
+  return best_seq != -1;
+}
+
+stasis_handle_t * stasis_handle(open_cache)(stasis_handle_t * slow, stasis_handle_t * fast,
+                                            lsn_t cache_size, int write_back) {
+  if(slow->error || fast->error) {
+    stasis_handle_t * ret = stasis_alloc(stasis_handle_t);
+    *ret = cache_func;
+    ret->error = slow->error ? slow->error : fast->error;
+    slow->close(slow);
+    fast->close(fast);
+    return ret;
+  }
+  // Find the largest slot count such that the superblock, both directory
+  // copies, and the slots fit in cache_size.
+  pageid_t blocks = cache_size / PAGE_SIZE;
+  pageid_t slot_count = blocks - 3;
+  lsn_t dir_len = 0;
+  for(; slot_count > 0; slot_count--) {
+    lsn_t bytes = sizeof(cache_directory_header) + slot_count * sizeof(cache_directory_entry);
+    dir_len = ((bytes + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
+    if(1 + 2 * (dir_len / PAGE_SIZE) + slot_count <= blocks) { break; }
+  }
+  if(slot_count <= 0) {
+    fprintf(stderr, "cache: cache size %lld is too small\n", (long long)cache_size);
+    slot_count = 1;
+    dir_len = PAGE_SIZE;
+  }
+
+  stasis_handle_t * ret = stasis_alloc(stasis_handle_t);
+  *ret = cache_func;
+  cache_impl * impl = stasis_alloc(cache_impl);
+  ret->impl = impl;
+  impl->slow = slow;
+  impl->fast = fast;
+  impl->write_back = write_back;
+  impl->slot_count = slot_count;
+  impl->dir_len = dir_len;
+  impl->slot_base = PAGE_SIZE + 2 * dir_len;
+  impl->slots = stasis_malloc(slot_count, cache_slot);
+  for(pageid_t s = 0; s < slot_count; s++) {
+    impl->slots[s].block = CACHE_EMPTY;
+    impl->slots[s].persisted = CACHE_EMPTY;
+    impl->slots[s].saving = CACHE_EMPTY;
+    impl->slots[s].pins = 0;
+    impl->slots[s].valid = 0;
+    impl->slots[s].stale = 0;
+    impl->slots[s].dirty = 0;
+    impl->slots[s].ref = 0;
+  }
+  impl->map = hashtable_init(slot_count);
+  impl->free_slots = stasis_malloc(slot_count, pageid_t);
+  impl->free_count = 0;
+  impl->hand = 0;
+  impl->end_pos = slow->end_position(slow);
+  impl->seq = 0;
+  impl->changed = 1;
+  impl->saving = 0;
+  pthread_cond_init(&impl->save_done, 0);
+  impl->admit_bufs = stasis_buffer_pool_alloc_aligned(CACHE_ADMIT_QUEUE * PAGE_SIZE);
+  impl->admit_head = 0;
+  impl->admit_count = 0;
+  impl->admit_starved = 0;
+  impl->admit_shutdown = 0;
+  pthread_cond_init(&impl->admit_needed, 0);
+  pthread_cond_init(&impl->admit_done, 0);
+  impl->refcount = 1;
+  pthread_mutex_init(&impl->mut, 0);
+
+  byte * buf = stasis_buffer_pool_alloc_aligned(PAGE_SIZE);
+  cache_superblock * sb = (cache_superblock*)buf;
+  int loaded = 0;
+  if(!fast->read(fast, 0, buf, PAGE_SIZE) && sb->magic == CACHE_MAGIC
+     && sb->version == CACHE_VERSION && sb->page_size == PAGE_SIZE
+     && sb->slot_count == slot_count) {
+    loaded = cache_load_directory(impl, (int)sb->clean);
+    if(!sb->clean) {
+      printf("cache: recovering cache directory after unclean shutdown\n");
+    }
+  }
+  stasis_buffer_pool_free_aligned(buf);
+  cache_rebuild_free_list(impl);
+
+  int err = 0;
+  if(loaded && !write_back) {
+    // Write-through handles never have dirty slots.
+    err = cache_write_back_all(impl);
+  }
+  // Save a directory before we mark the superblock unclean, so that
+  // recovery never sees a directory from a different cache geometry.
+  pthread_mutex_lock(&impl->mut);
+  if(!err) { err = cache_save_directory(impl); }
+  pthread_mutex_unlock(&impl->mut);
+  if(!err) { err = cache_write_superblock(impl, 0); }
+  if(err) {
+    ret->error = err;
+  }
+  pthread_create(&impl->admitter, 0, cache_admit_worker, impl);
+  return ret;
+}
+
+stasis_handle_t * stasis_handle_cache_factory(void) {
+  stasis_handle_t * slow = stasis_handle_file_factory(stasis_store_file_name, stasis_handle_page_file_flags(stasis_store_file_name), FILE_PERM);
+  stasis_handle_t * fast = stasis_handle_file_factory(stasis_handle_cache_file_name, stasis_handle_page_file_flags(stasis_handle_cache_file_name), FILE_PERM);
+  return stasis_handle_open_cache(slow, fast, stasis_handle_cache_size, stasis_handle_cache_write_back);
+}
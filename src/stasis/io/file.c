@@ -245,6 +245,38 @@ static int file_write(stasis_handle_t *h, lsn_t off, const byte * dat, lsn_t len
   return error;
 }
 
+static int file_writev(stasis_handle_t *h, lsn_t off, const struct iovec * iov, int iovcnt) {
+  file_impl * impl = (file_impl*)(h->impl);
+  if(off < 0) { return EDOM; }
+  struct iovec * v = stasis_alloca(iovcnt, struct iovec);
+  memcpy(v, iov, iovcnt * sizeof(struct iovec));
+  lsn_t len = 0;
+  for(int i = 0; i < iovcnt; i++) { len += iov[i].iov_len; }
+
+  pthread_mutex_lock(&(impl->mut));
+  int error = 0;
+  if(impl->end_pos < off+len){
+    impl->end_pos = off+len;
+  }
+  while(iovcnt) {
+    ssize_t ret = pwritev(impl->fd, v, iovcnt > IOV_MAX ? IOV_MAX : iovcnt, off);
+    if(ret == -1) {
+      // See file_write_unlocked() for an explanation of EAGAIN and EINTR.
+      if(errno == EAGAIN || errno == EINTR) { continue; }
+      error = errno;
+      if(error == EBADF || error == ESPIPE) {
+        h->error = error;
+        error = EBADF;
+      }
+      break;
+    }
+    off += ret;
+    stasis_handle_iovec_consume(&v, &iovcnt, ret);
+  }
+  pthread_mutex_unlock(&(impl->mut));
+  return error;
+}
+
 static stasis_write_buffer_t * file_write_buffer(stasis_handle_t * h,
 						lsn_t off, lsn_t len) {
   // Allocate the handle
@@ -483,6 +515,8 @@ struct stasis_handle_t file_func = {
   /*.async_force =*/ file_async_force,
   /*.force_range =*/ file_force_range,
   /*.fallocate =*/ file_fallocate,
+  /*.admit =*/ NULL,
+  /*.writev =*/ file_writev,
   /*.error =*/ 0,
   /*.impl =*/ 0
 };
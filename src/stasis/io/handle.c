@@ -4,6 +4,9 @@
  *  Created on: May 7, 2009
  *      Author: sears
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for O_DIRECT
+#endif
 #include <config.h>
 
 #include <stasis/common.h>
@@ -14,10 +17,48 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
 
 #include <assert.h>
 #include <stdio.h>
 
+void stasis_handle_iovec_consume(struct iovec ** iov, int * iovcnt, size_t bytes) {
+  while(*iovcnt && bytes >= (*iov)->iov_len) {
+    bytes -= (*iov)->iov_len;
+    (*iov)++;
+    (*iovcnt)--;
+  }
+  if(bytes) {
+    assert(*iovcnt);
+    (*iov)->iov_base = (byte*)(*iov)->iov_base + bytes;
+    (*iov)->iov_len -= bytes;
+  }
+}
+
+int stasis_handle_page_file_flags(const char * filename) {
+  int flags = O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags;
+#ifdef HAVE_O_DIRECT
+  if(stasis_buffer_manager_direct_io) {
+    // Some file systems (and older versions of tmpfs) reject O_DIRECT at
+    // open time.  Check now, so that we can fall back to buffered I/O.
+    int fd = open(filename, flags | O_DIRECT, FILE_PERM);
+    if(fd != -1) {
+      close(fd);
+      flags |= O_DIRECT;
+    } else {
+      fprintf(stderr, "Could not open %s with O_DIRECT (%s); using buffered I/O\n", filename, strerror(errno));
+    }
+  }
+#else
+  if(stasis_buffer_manager_direct_io) {
+    fprintf(stderr, "This platform does not support O_DIRECT; using buffered I/O\n");
+  }
+#endif
+  return flags;
+}
+
 stasis_handle_t* stasis_handle_default_factory(void) {
-  return stasis_handle_file_factory(stasis_store_file_name, O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags, FILE_PERM);
+  return stasis_handle_file_factory(stasis_store_file_name, stasis_handle_page_file_flags(stasis_store_file_name), FILE_PERM);
 }
@@ -144,6 +144,23 @@ static int mem_write(stasis_handle_t * h, lsn_t off,
   return ret;
 }
 
+static int mem_writev(stasis_handle_t * h, lsn_t off,
+                      const struct iovec * iov, int iovcnt) {
+  lsn_t len = 0;
+  for(int i = 0; i < iovcnt; i++) { len += iov[i].iov_len; }
+  stasis_write_buffer_t * w = mem_write_buffer(h, off, len);
+  int ret = w->error;
+  if(!ret) {
+    byte * buf = w->buf;
+    for(int i = 0; i < iovcnt; i++) {
+      memcpy(buf, iov[i].iov_base, iov[i].iov_len);
+      buf += iov[i].iov_len;
+    }
+  }
+  mem_release_write_buffer(w);
+  return ret;
+}
+
 static int mem_read(stasis_handle_t * h,
 		    lsn_t off, byte * buf, lsn_t len) {
   stasis_read_buffer_t * r = mem_read_buffer(h, off, len);
@@ -181,6 +198,8 @@ struct stasis_handle_t mem_func = {
   /*.async_force =*/ mem_force,
   /*.force_range =*/ mem_force_range,
   /*.fallocate =*/ NULL,
+  /*.admit =*/ NULL,
+  /*.writev =*/ mem_writev,
   /*.error =*/ 0,
   /*.impl =*/ 0
 };
@@ -199,6 +199,36 @@ static int pfile_write(stasis_handle_t *h, lsn_t off, const byte *dat,
   return error;
 }
 
+static int pfile_writev(stasis_handle_t *h, lsn_t off,
+                        const struct iovec *iov, int iovcnt) {
+  pfile_impl *impl = (pfile_impl*)(h->impl);
+  if (off < 0) { return EDOM; }
+  // pwritev() may stop early, so work on a copy that we can advance.
+  struct iovec *v = stasis_alloca(iovcnt, struct iovec);
+  memcpy(v, iov, iovcnt * sizeof(struct iovec));
+  int error = 0;
+  TICK(write_hist);
+  while (iovcnt) {
+    ssize_t count = pwritev(impl->fd, v, iovcnt > IOV_MAX ? IOV_MAX : iovcnt, off);
+    if (count == -1) {
+      if (errno == EAGAIN || errno == EINTR) {
+        continue;
+      }
+      error = errno;
+      // As in file_writev(), a closed or unseekable fd poisons the handle.
+      if (error == EBADF || error == ESPIPE) {
+        h->error = error;
+        error = EBADF;
+      }
+      break;
+    }
+    off += count;
+    stasis_handle_iovec_consume(&v, &iovcnt, count);
+  }
+  TOCK(write_hist);
+  return error;
+}
+
 static stasis_write_buffer_t * pfile_write_buffer(stasis_handle_t *h,
                                                  lsn_t off, lsn_t len) {
   stasis_write_buffer_t *ret = stasis_alloc(stasis_write_buffer_t);
@@ -415,6 +445,8 @@ static struct stasis_handle_t pfile_func = {
   /*.async_force =*/ pfile_async_force,
   /*.force_range =*/ pfile_force_range,
   /*.fallocate =*/ pfile_fallocate,
+  /*.admit =*/ NULL,
+  /*.writev =*/ pfile_writev,
   /*.error =*/ 0,
   /*.impl =*/ 0
 };
@@ -0,0 +1,435 @@
+/*
+ * qos.c
+ *
+ * A handle that schedules another handle's requests by priority class.
+ *
+ * Every request is tagged with the I/O class of the calling thread (see
+ * stasis_handle_qos_set_class()).  Classes are only tracked per thread.
+ * The buffer manager's writeback, read-ahead and hot set threads, and
+ * the truncation thread, set their own classes; other threads run as
+ * foreground unless the application sets their class.
+ *
+ * A single scheduler is shared by all qos handles, and by the log, which
+ * reports its forces with stasis_handle_qos_begin() and
+ * stasis_handle_qos_end(), so that page file writeback can get out of
+ * their way even though the log does not use a stasis_handle_t.
+ *
+ * A request may start when:
+ *
+ *  - no request of a more urgent class is waiting,
+ *  - fewer than stasis_handle_qos_queue_depth requests are in flight,
+ *  - if it is a background request (prefetch or writeback), and a log
+ *    force or foreground request is in flight, no other background
+ *    request is, and
+ *  - its class's token bucket holds enough tokens for it.
+ *
+ * Threads that write back pages reserve their turn with
+ * stasis_handle_qos_reserve() before they latch the pages, so that they
+ * never wait here while holding latches.  Requests they issue before
+ * stasis_handle_qos_release() are charged to the reservation.
+ *
+ * Log forces are already in progress by the time they are reported, so
+ * they never wait.  Token buckets are refilled at the class's rate, and
+ * hold up to a quarter second's worth of tokens.  A request larger than
+ * the bucket may start once the bucket is full, and leaves it in debt.
+ * Classes with a rate of zero are not rate limited.
+ */
+#include <config.h>
+#include <stasis/common.h>
+#include <stasis/flags.h>
+#include <stasis/io/handle.h>
+#include <stasis/util/time.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+/** Buckets hold this many seconds of tokens. */
+#define QOS_BURST_SECONDS 0.25
+/** ...but at least this many bytes, so that slow rates can still issue a page at a time. */
+#define QOS_MIN_BURST (16 * PAGE_SIZE)
+
+typedef struct {
+  double rate;
+  double burst;
+  double tokens;
+  double last_refill;
+  int waiting;
+  int inflight;
+  stasis_handle_qos_stats_t stats;
+} qos_class;
+
+static struct {
+  int initialized;
+  /** Reservations are only made while qos handles are open. */
+  int handle_count;
+  qos_class cls[STASIS_IO_CLASS_COUNT];
+} qos;
+static pthread_mutex_t qos_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t qos_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_key_t qos_class_key;
+/** The number of bytes the thread has reserved, or zero. */
+static pthread_key_t qos_reserve_key;
+static pthread_once_t qos_class_key_once = PTHREAD_ONCE_INIT;
+
+static void qos_class_key_init(void) {
+  pthread_key_create(&qos_class_key, 0);
+  pthread_key_create(&qos_reserve_key, 0);
+}
+
+stasis_io_class_t stasis_handle_qos_get_class(void) {
+  pthread_once(&qos_class_key_once, qos_class_key_init);
+  // Zero (the initial value) is foreground.
+  return (stasis_io_class_t)((intptr_t)pthread_getspecific(qos_class_key) + STASIS_IO_CLASS_FOREGROUND);
+}
+stasis_io_class_t stasis_handle_qos_set_class(stasis_io_class_t cls) {
+  assert(cls >= 0 && cls < STASIS_IO_CLASS_COUNT);
+  stasis_io_class_t ret = stasis_handle_qos_get_class();
+  pthread_setspecific(qos_class_key, (void*)(intptr_t)(cls - STASIS_IO_CLASS_FOREGROUND));
+  return ret;
+}
+
+static double qos_now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return stasis_timeval_to_double(tv);
+}
+/** Set a class's rate.  The caller must hold qos_mut. */
+static void qos_set_rate(stasis_io_class_t cls, double bytes_per_second) {
+  qos_class * c = &qos.cls[cls];
+  c->rate = bytes_per_second > 0 ? bytes_per_second : 0;
+  c->burst = c->rate * QOS_BURST_SECONDS;
+  if(c->burst < QOS_MIN_BURST) { c->burst = QOS_MIN_BURST; }
+  c->tokens = c->burst;
+  c->last_refill = qos_now();
+}
+/** Pick up the rates in stasis/flags.h the first time the scheduler is used.  The caller must hold qos_mut. */
+static void qos_init(void) {
+  if(qos.initialized) { return; }
+  qos.initialized = 1;
+  for(int i = 0; i < STASIS_IO_CLASS_COUNT; i++) {
+    qos_set_rate((stasis_io_class_t)i, 0);
+  }
+  qos_set_rate(STASIS_IO_CLASS_PREFETCH, stasis_handle_qos_prefetch_rate);
+  qos_set_rate(STASIS_IO_CLASS_WRITEBACK, stasis_handle_qos_writeback_rate);
+}
+static inline int qos_is_background(stasis_io_class_t cls) {
+  return cls == STASIS_IO_CLASS_PREFETCH || cls == STASIS_IO_CLASS_WRITEBACK;
+}
+/**
+ * @return 0 if the request may start now, or a positive number of seconds
+ * to wait before the class's bucket has enough tokens.  -1 means wait for
+ * another request to finish.  The caller must hold qos_mut.
+ */
+static double qos_admit(stasis_io_class_t cls, lsn_t bytes) {
+  int inflight = 0;
+  int urgent = 0;
+  int background = 0;
+  for(int i = 0; i < STASIS_IO_CLASS_COUNT; i++) {
+    if(i < (int)cls && qos.cls[i].waiting) { return -1; }
+    inflight += qos.cls[i].inflight;
+    if(qos_is_background((stasis_io_class_t)i)) {
+      background += qos.cls[i].inflight;
+    } else {
+      urgent += qos.cls[i].inflight;
+    }
+  }
+  if(inflight >= stasis_handle_qos_queue_depth) { return -1; }
+  if(qos_is_background(cls) && urgent && background) { return -1; }
+
+  qos_class * c = &qos.cls[cls];
+  if(c->rate == 0) { return 0; }
+  double now = qos_now();
+  c->tokens += (now - c->last_refill) * c->rate;
+  if(c->tokens > c->burst) { c->tokens = c->burst; }
+  c->last_refill = now;
+  double need = bytes < c->burst ? bytes : c->burst;
+  if(c->tokens >= need) {
+    c->tokens -= bytes;
+    return 0;
+  }
+  return (need - c->tokens) / c->rate;
+}
+
+/** Wait for a request to be admitted.  The caller must hold qos_mut. */
+static void qos_begin_locked(stasis_io_class_t cls, lsn_t bytes) {
+  qos_init();
+  qos_class * c = &qos.cls[cls];
+  c->stats.requests++;
+  c->stats.bytes += bytes;
+  if(cls == STASIS_IO_CLASS_LOG) {
+    c->inflight++;
+    return;
+  }
+  double wait = qos_admit(cls, bytes);
+  if(wait) {
+    double start = qos_now();
+    c->waiting++;
+    c->stats.delayed++;
+    while(wait) {
+      if(wait > 0) {
+        struct timespec ts = stasis_double_to_timespec(qos_now() + wait);
+        pthread_cond_timedwait(&qos_cond, &qos_mut, &ts);
+      } else {
+        pthread_cond_wait(&qos_cond, &qos_mut);
+      }
+      // Don't count ourselves as a more urgent waiter.
+      c->waiting--;
+      wait = qos_admit(cls, bytes);
+      c->waiting++;
+    }
+    c->waiting--;
+    c->stats.wait_seconds += qos_now() - start;
+  }
+  c->inflight++;
+}
+void stasis_handle_qos_begin(stasis_io_class_t cls, lsn_t bytes) {
+  pthread_mutex_lock(&qos_mut);
+  qos_begin_locked(cls, bytes);
+  pthread_mutex_unlock(&qos_mut);
+}
+void stasis_handle_qos_end(stasis_io_class_t cls) {
+  pthread_mutex_lock(&qos_mut);
+  assert(qos.cls[cls].inflight > 0);
+  qos.cls[cls].inflight--;
+  pthread_cond_broadcast(&qos_cond);
+  pthread_mutex_unlock(&qos_mut);
+}
+void stasis_handle_qos_reserve(lsn_t bytes) {
+  pthread_once(&qos_class_key_once, qos_class_key_init);
+  assert(bytes > 0 && bytes <= INTPTR_MAX);
+  assert(!pthread_getspecific(qos_reserve_key));
+  pthread_mutex_lock(&qos_mut);
+  if(qos.handle_count) {
+    qos_begin_locked(stasis_handle_qos_get_class(), bytes);
+    pthread_setspecific(qos_reserve_key, (void*)(intptr_t)bytes);
+  }
+  pthread_mutex_unlock(&qos_mut);
+}
+void stasis_handle_qos_release(lsn_t bytes) {
+  pthread_once(&qos_class_key_once, qos_class_key_init);
+  lsn_t reserved = (intptr_t)pthread_getspecific(qos_reserve_key);
+  if(!reserved) { return; }
+  pthread_setspecific(qos_reserve_key, 0);
+  stasis_io_class_t cls = stasis_handle_qos_get_class();
+  qos_class * c = &qos.cls[cls];
+  pthread_mutex_lock(&qos_mut);
+  if(bytes < reserved) {
+    // Give back the tokens we did not use.
+    c->stats.bytes -= reserved - bytes;
+    if(c->rate) {
+      c->tokens += reserved - bytes;
+      if(c->tokens > c->burst) { c->tokens = c->burst; }
+    }
+  }
+  assert(c->inflight > 0);
+  c->inflight--;
+  pthread_cond_broadcast(&qos_cond);
+  pthread_mutex_unlock(&qos_mut);
+}
+/**
+ * Schedule a request, unless the calling thread's reservation covers it.
+ *
+ * @return non-zero if the request must be ended with qos_request_end().
+ */
+static int qos_request_begin(stasis_io_class_t cls, lsn_t bytes) {
+  pthread_once(&qos_class_key_once, qos_class_key_init);
+  if(pthread_getspecific(qos_reserve_key)) { return 0; }
+  stasis_handle_qos_begin(cls, bytes);
+  return 1;
+}
+static void qos_request_end(stasis_io_class_t cls, int scheduled) {
+  if(scheduled) { stasis_handle_qos_end(cls); }
+}
+void stasis_handle_qos_set_rate(stasis_io_class_t cls, double bytes_per_second) {
+  pthread_mutex_lock(&qos_mut);
+  qos_init();
+  qos_set_rate(cls, bytes_per_second);
+  pthread_cond_broadcast(&qos_cond);
+  pthread_mutex_unlock(&qos_mut);
+}
+void stasis_handle_qos_stats(stasis_io_class_t cls, stasis_handle_qos_stats_t * stats) {
+  pthread_mutex_lock(&qos_mut);
+  *stats = qos.cls[cls].stats;
+  pthread_mutex_unlock(&qos_mut);
+}
+
+typedef struct qos_impl {
+  stasis_handle_t * h;
+} qos_impl;
+
+static stasis_handle_t * qos_wrap(stasis_handle_t * h);
+
+static int qos_num_copies(stasis_handle_t * h) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  return hh->num_copies(hh);
+}
+static int qos_num_copies_buffer(stasis_handle_t * h) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  return hh->num_copies_buffer(hh);
+}
+static int qos_close(stasis_handle_t * h) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  int ret = hh->close(hh);
+  free(h->impl);
+  free(h);
+  pthread_mutex_lock(&qos_mut);
+  qos.handle_count--;
+  pthread_mutex_unlock(&qos_mut);
+  return ret;
+}
+static stasis_handle_t * qos_dup(stasis_handle_t * h) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  return qos_wrap(hh->dup(hh));
+}
+static void qos_enable_sequential_optimizations(stasis_handle_t * h) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  hh->enable_sequential_optimizations(hh);
+}
+static lsn_t qos_end_position(stasis_handle_t * h) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  return hh->end_position(hh);
+}
+/** Write buffers are wrapped, so that the write that release_write_buffer() issues is scheduled. */
+static stasis_write_buffer_t * qos_write_buffer(stasis_handle_t * h, lsn_t off, lsn_t len) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  stasis_write_buffer_t * w = hh->write_buffer(hh, off, len);
+  stasis_write_buffer_t * ret = stasis_alloc(stasis_write_buffer_t);
+  ret->h = h;
+  ret->off = w->off;
+  ret->buf = w->buf;
+  ret->len = w->len;
+  ret->impl = w;
+  ret->error = w->error;
+  return ret;
+}
+static int qos_release_write_buffer(stasis_write_buffer_t * w) {
+  stasis_write_buffer_t * ww = (stasis_write_buffer_t *)w->impl;
+  stasis_io_class_t cls = stasis_handle_qos_get_class();
+  int scheduled = qos_request_begin(cls, w->len);
+  int ret = ww->h->release_write_buffer(ww);
+  qos_request_end(cls, scheduled);
+  free(w);
+  return ret;
+}
+static stasis_read_buffer_t * qos_read_buffer(stasis_handle_t * h, lsn_t off, lsn_t len) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  stasis_io_class_t cls = stasis_handle_qos_get_class();
+  int scheduled = qos_request_begin(cls, len);
+  stasis_read_buffer_t * r = hh->read_buffer(hh, off, len);
+  qos_request_end(cls, scheduled);
+  stasis_read_buffer_t * ret = stasis_alloc(stasis_read_buffer_t);
+  ret->h = h;
+  ret->off = r->off;
+  ret->buf = r->buf;
+  ret->len = r->len;
+  ret->impl = r;
+  ret->error = r->error;
+  return ret;
+}
+static int qos_release_read_buffer(stasis_read_buffer_t * r) {
+  stasis_read_buffer_t * rr = (stasis_read_buffer_t *)r->impl;
+  int ret = rr->h->release_read_buffer(rr);
+  free(r);
+  return ret;
+}
+static int qos_write(stasis_handle_t * h, lsn_t off, const byte * dat, lsn_t len) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  stasis_io_class_t cls = stasis_handle_qos_get_class();
+  int scheduled = qos_request_begin(cls, len);
+  int ret = hh->write(hh, off, dat, len);
+  qos_request_end(cls, scheduled);
+  return ret;
+}
+static int qos_writev(stasis_handle_t * h, lsn_t off, const struct iovec * iov, int iovcnt) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  lsn_t len = 0;
+  for(int i = 0; i < iovcnt; i++) { len += iov[i].iov_len; }
+  stasis_io_class_t cls = stasis_handle_qos_get_class();
+  int scheduled = qos_request_begin(cls, len);
+  int ret = hh->writev(hh, off, iov, iovcnt);
+  qos_request_end(cls, scheduled);
+  return ret;
+}
+static int qos_read(stasis_handle_t * h, lsn_t off, byte * buf, lsn_t len) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  stasis_io_class_t cls = stasis_handle_qos_get_class();
+  int scheduled = qos_request_begin(cls, len);
+  int ret = hh->read(hh, off, buf, len);
+  qos_request_end(cls, scheduled);
+  return ret;
+}
+static int qos_force(stasis_handle_t * h) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  stasis_io_class_t cls = stasis_handle_qos_get_class();
+  int scheduled = qos_request_begin(cls, 0);
+  int ret = hh->force(hh);
+  qos_request_end(cls, scheduled);
+  return ret;
+}
+static int qos_async_force(stasis_handle_t * h) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  return hh->async_force(hh);
+}
+static int qos_force_range(stasis_handle_t * h, lsn_t start, lsn_t stop) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  stasis_io_class_t cls = stasis_handle_qos_get_class();
+  int scheduled = qos_request_begin(cls, 0);
+  int ret = hh->force_range(hh, start, stop);
+  qos_request_end(cls, scheduled);
+  return ret;
+}
+static int qos_fallocate(stasis_handle_t * h, lsn_t off, lsn_t len) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  return hh->fallocate(hh, off, len);
+}
+static int qos_admit_region(stasis_handle_t * h, lsn_t off, const byte * dat, lsn_t len) {
+  stasis_handle_t * hh = ((qos_impl*)h->impl)->h;
+  return hh->admit(hh, off, dat, len);
+}
+
+static struct stasis_handle_t qos_func = {
+  /*.num_copies =*/ qos_num_copies,
+  /*.num_copies_buffer =*/ qos_num_copies_buffer,
+  /*.close =*/ qos_close,
+  /*.dup =*/ qos_dup,
+  /*.enable_sequential_optimizations =*/ qos_enable_sequential_optimizations,
+  /*.end_position =*/ qos_end_position,
+  /*.write_buffer =*/ qos_write_buffer,
+  /*.release_write_buffer =*/ qos_release_write_buffer,
+  /*.read_buffer =*/ qos_read_buffer,
+  /*.release_read_buffer =*/ qos_release_read_buffer,
+  /*.write =*/ qos_write,
+  /*.read =*/ qos_read,
+  /*.force =*/ qos_force,
+  /*.async_force =*/ qos_async_force,
+  /*.force_range =*/ qos_force_range,
+  /*.fallocate =*/ qos_fallocate,
+  /*.admit =*/ qos_admit_region,
+  /*.writev =*/ qos_writev,
+  /*.error =*/ 0,
+  /*.impl =*/ 0
+};
+
+static stasis_handle_t * qos_wrap(stasis_handle_t * h) {
+  if(!h) { return NULL; }
+  stasis_handle_t * ret = stasis_alloc(stasis_handle_t);
+  *ret = qos_func;
+  // Optional methods stay optional.
+  if(!h->admit) { ret->admit = NULL; }
+  if(!h->writev) { ret->writev = NULL; }
+  ret->error = h->error;
+  qos_impl * impl = stasis_alloc(qos_impl);
+  impl->h = h;
+  ret->impl = impl;
+  pthread_mutex_lock(&qos_mut);
+  qos.handle_count++;
+  pthread_mutex_unlock(&qos_mut);
+  return ret;
+}
+stasis_handle_t * stasis_handle(open_qos)(stasis_handle_t * h) {
+  return qos_wrap(h);
+}
+stasis_handle_t * stasis_handle_qos_factory(void) {
+  return stasis_handle_open_qos(stasis_handle_file_factory(stasis_store_file_name, stasis_handle_page_file_flags(stasis_store_file_name), FILE_PERM));
+}
@@ -187,6 +187,8 @@ struct stasis_handle_t raid0_func = {
   /*.async_force =*/ raid0_async_force,
   /*.force_range =*/ raid0_force_range,
   /*.fallocate =*/ raid0_fallocate,
+  /*.admit =*/ NULL,
+  /*.writev =*/ NULL,
   /*.error =*/ 0,
   /*.impl =*/ 0
 };
@@ -208,15 +210,15 @@ stasis_handle_t * stasis_handle_open_raid0(int handle_count, stasis_handle_t** h
 stasis_handle_t * stasis_handle_raid0_factory(void) {
   if(stasis_handle_raid0_filenames == NULL) {
     stasis_handle_t * h[2];
-    h[0] = stasis_handle_file_factory(stasis_store_file_1_name, O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags, FILE_PERM);
-    h[1] = stasis_handle_file_factory(stasis_store_file_2_name, O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags, FILE_PERM);
+    h[0] = stasis_handle_file_factory(stasis_store_file_1_name, stasis_handle_page_file_flags(stasis_store_file_1_name), FILE_PERM);
+    h[1] = stasis_handle_file_factory(stasis_store_file_2_name, stasis_handle_page_file_flags(stasis_store_file_2_name), FILE_PERM);
     return stasis_handle_open_raid0(2, h, stasis_handle_raid0_stripe_size);
   } else {
     int count = 0;
     while(stasis_handle_raid0_filenames[count]) count++;
     stasis_handle_t ** h = stasis_alloca(count, stasis_handle_t*);
     for(int i = 0; i < count; i++) {
-      h[i] = stasis_handle_file_factory(stasis_handle_raid0_filenames[i], O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags, FILE_PERM);
+      h[i] = stasis_handle_file_factory(stasis_handle_raid0_filenames[i], stasis_handle_page_file_flags(stasis_handle_raid0_filenames[i]), FILE_PERM);
     }
     return stasis_handle_open_raid0(count, h, stasis_handle_raid0_stripe_size);
   }
@@ -145,6 +145,8 @@ struct stasis_handle_t raid1_func = {
   /*.async_force =*/ raid1_async_force,
   /*.force_range =*/ raid1_force_range,
   /*.fallocate =*/ raid1_fallocate,
+  /*.admit =*/ NULL,
+  /*.writev =*/ NULL,
   /*.error =*/ 0,
   /*.impl =*/ 0
 };
@@ -159,7 +161,7 @@ stasis_handle_t * stasis_handle_open_raid1(stasis_handle_t* a, stasis_handle_t*
 }
 
 stasis_handle_t * stasis_handle_raid1_factory(void) {
-  stasis_handle_t * a = stasis_handle_file_factory(stasis_store_file_1_name, O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags, FILE_PERM);
-  stasis_handle_t * b = stasis_handle_file_factory(stasis_store_file_2_name, O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags, FILE_PERM);
+  stasis_handle_t * a = stasis_handle_file_factory(stasis_store_file_1_name, stasis_handle_page_file_flags(stasis_store_file_1_name), FILE_PERM);
+  stasis_handle_t * b = stasis_handle_file_factory(stasis_store_file_2_name, stasis_handle_page_file_flags(stasis_store_file_2_name), FILE_PERM);
   return stasis_handle_open_raid1(a, b);
 }
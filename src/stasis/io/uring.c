@@ -0,0 +1,720 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for sync_file_range constants
+#endif
+#include <config.h>
+
+#include <stasis/io/handle.h>
+#include <stasis/constants.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <assert.h>
+
+/**
+   @file
+
+   Implementation of a file-backed io handle on top of Linux's io_uring
+   interface.  This talks to the kernel with the raw system calls, so it
+   does not depend on liburing.
+
+   Each handle owns one submission / completion ring pair, which is
+   shared by all of the threads that use the handle.  Threads queue their
+   requests under a mutex, and submit everything that is queued with a
+   single io_uring_enter() call, so requests from concurrent callers are
+   batched.  One waiting thread at a time blocks in the kernel for
+   completions, and hands them out to the other waiters.
+
+   Buffers handed out by write_buffer() and read_buffer() come from a
+   small pool that is registered with the kernel, and are transferred with
+   the fixed buffer opcodes.  async_force() and force_range() are issued as
+   chains of linked sync_file_range requests.
+
+   If this build does not support io_uring, or the kernel refuses to
+   create a ring, stasis_handle_open_uring() falls back to
+   stasis_handle_open_pfile().
+
+   The functions defined here implement interfaces documented in handle.h
+
+   @see handle.h
+*/
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/** Number of submission queue entries per handle. */
+#define URING_ENTRIES 64
+/** Number of registered buffers per handle. */
+#define URING_BUFFER_COUNT 16
+/** Size of each registered buffer; larger requests use malloc(). */
+#define URING_BUFFER_SIZE PAGE_SIZE
+/** Largest length we will pass in a single request. */
+#define URING_MAX_IO (1024 * 1024 * 1024)
+
+typedef struct uring_completion {
+  int res;
+  int done;
+} uring_completion;
+
+/**
+   Per-handle information for uring
+*/
+typedef struct uring_impl {
+  int fd;
+  int file_flags;
+  int file_mode;
+  char *filename;
+  int sequential;
+
+  int ring_fd;
+  unsigned entries;
+  void *sq_ptr;
+  size_t sq_len;
+  void *cq_ptr;
+  size_t cq_len;
+  struct io_uring_sqe *sqes;
+  size_t sqes_len;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  /** Protects everything below, and the producer side of the rings. */
+  pthread_mutex_t mut;
+  pthread_cond_t cond;
+  /** Requests in the submission queue that have not been submitted. */
+  unsigned queued;
+  /** Requests that have not been reaped from the completion queue. */
+  unsigned inflight;
+  /** Total number of requests that have been reaped. */
+  uint64_t completed;
+  /** True if some thread is blocked in the kernel waiting for completions. */
+  int reaping;
+
+  byte *buffers;
+  int buffer_count;
+  int *free_buffers;
+  int free_buffer_count;
+} uring_impl;
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+static int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+static int uring_register(int ring_fd, unsigned opcode, void *arg, unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+/** @return 0 on success, or an errno. */
+static int uring_ring_init(uring_impl *impl) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  impl->ring_fd = uring_setup(URING_ENTRIES, &p);
+  if(impl->ring_fd < 0) { return errno; }
+  impl->entries = p.sq_entries;
+
+  impl->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  impl->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP) {
+    if(impl->cq_len > impl->sq_len) { impl->sq_len = impl->cq_len; }
+    impl->cq_len = impl->sq_len;
+  }
+  impl->sq_ptr = mmap(0, impl->sq_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, impl->ring_fd, IORING_OFF_SQ_RING);
+  if(impl->sq_ptr == MAP_FAILED) { int err = errno; close(impl->ring_fd); return err; }
+  if(p.features & IORING_FEAT_SINGLE_MMAP) {
+    impl->cq_ptr = impl->sq_ptr;
+  } else {
+    impl->cq_ptr = mmap(0, impl->cq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, impl->ring_fd, IORING_OFF_CQ_RING);
+    if(impl->cq_ptr == MAP_FAILED) {
+      int err = errno;
+      munmap(impl->sq_ptr, impl->sq_len);
+      close(impl->ring_fd);
+      return err;
+    }
+  }
+  impl->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  impl->sqes = (struct io_uring_sqe*)mmap(0, impl->sqes_len, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, impl->ring_fd, IORING_OFF_SQES);
+  if(impl->sqes == MAP_FAILED) {
+    int err = errno;
+    if(impl->cq_ptr != impl->sq_ptr) { munmap(impl->cq_ptr, impl->cq_len); }
+    munmap(impl->sq_ptr, impl->sq_len);
+    close(impl->ring_fd);
+    return err;
+  }
+  impl->sq_tail  = (unsigned*)((byte*)impl->sq_ptr + p.sq_off.tail);
+  impl->sq_mask  = (unsigned*)((byte*)impl->sq_ptr + p.sq_off.ring_mask);
+  impl->sq_array = (unsigned*)((byte*)impl->sq_ptr + p.sq_off.array);
+  impl->cq_head  = (unsigned*)((byte*)impl->cq_ptr + p.cq_off.head);
+  impl->cq_tail  = (unsigned*)((byte*)impl->cq_ptr + p.cq_off.tail);
+  impl->cq_mask  = (unsigned*)((byte*)impl->cq_ptr + p.cq_off.ring_mask);
+  impl->cqes     = (struct io_uring_cqe*)((byte*)impl->cq_ptr + p.cq_off.cqes);
+  return 0;
+}
+static void uring_ring_deinit(uring_impl *impl) {
+  munmap(impl->sqes, impl->sqes_len);
+  if(impl->cq_ptr != impl->sq_ptr) { munmap(impl->cq_ptr, impl->cq_len); }
+  munmap(impl->sq_ptr, impl->sq_len);
+  close(impl->ring_fd);
+}
+/**
+   Register a pool of buffers with the kernel.  This is an optimization,
+   so failures (for instance, due to RLIMIT_MEMLOCK) are ignored.
+*/
+static void uring_buffers_init(uring_impl *impl) {
+  impl->buffer_count = 0;
+  impl->free_buffer_count = 0;
+  impl->buffers = NULL;
+  impl->free_buffers = NULL;
+  void *buf;
+  if(posix_memalign(&buf, PAGE_SIZE, URING_BUFFER_COUNT * URING_BUFFER_SIZE)) { return; }
+  struct iovec iov[URING_BUFFER_COUNT];
+  for(int i = 0; i < URING_BUFFER_COUNT; i++) {
+    iov[i].iov_base = (byte*)buf + i * URING_BUFFER_SIZE;
+    iov[i].iov_len = URING_BUFFER_SIZE;
+  }
+  if(uring_register(impl->ring_fd, IORING_REGISTER_BUFFERS, iov, URING_BUFFER_COUNT)) {
+    free(buf);
+    return;
+  }
+  impl->buffers = (byte*)buf;
+  impl->buffer_count = URING_BUFFER_COUNT;
+  impl->free_buffers = stasis_malloc(URING_BUFFER_COUNT, int);
+  for(int i = 0; i < URING_BUFFER_COUNT; i++) {
+    impl->free_buffers[i] = i;
+  }
+  impl->free_buffer_count = URING_BUFFER_COUNT;
+}
+/** @return the index of a free registered buffer, or -1. */
+static int uring_buffer_get(uring_impl *impl, lsn_t len) {
+  int ret = -1;
+  if(len > URING_BUFFER_SIZE) { return ret; }
+  pthread_mutex_lock(&impl->mut);
+  if(impl->free_buffer_count) {
+    ret = impl->free_buffers[--impl->free_buffer_count];
+  }
+  pthread_mutex_unlock(&impl->mut);
+  return ret;
+}
+static void uring_buffer_put(uring_impl *impl, int idx) {
+  pthread_mutex_lock(&impl->mut);
+  impl->free_buffers[impl->free_buffer_count++] = idx;
+  pthread_mutex_unlock(&impl->mut);
+}
+
+/** Pass everything that is queued to the kernel.  Caller holds mut. */
+static void uring_submit_locked(uring_impl *impl) {
+  while(impl->queued) {
+    int ret = uring_enter(impl->ring_fd, impl->queued, 0, 0);
+    if(ret < 0) {
+      if(errno == EINTR || errno == EAGAIN || errno == EBUSY) { continue; }
+      perror("io_uring_enter() failed to submit requests");
+      abort();
+    }
+    impl->queued -= ret;
+  }
+}
+/** Hand completions out to their waiters.  Caller holds mut. */
+static void uring_reap_locked(uring_impl *impl) {
+  unsigned head = *impl->cq_head;
+  unsigned tail = __atomic_load_n(impl->cq_tail, __ATOMIC_ACQUIRE);
+  while(head != tail) {
+    struct io_uring_cqe *cqe = &impl->cqes[head & *impl->cq_mask];
+    uring_completion *c = (uring_completion*)(intptr_t)cqe->user_data;
+    c->res = cqe->res;
+    c->done = 1;
+    impl->inflight--;
+    impl->completed++;
+    head++;
+  }
+  __atomic_store_n(impl->cq_head, head, __ATOMIC_RELEASE);
+}
+/**
+   Wait for c to complete, or, if c is NULL, for any request to complete.
+   Caller holds mut; it is released while this thread waits.
+*/
+static void uring_wait_locked(uring_impl *impl, uring_completion *c) {
+  uint64_t completed = impl->completed;
+  while(c ? !c->done : impl->completed == completed) {
+    if(impl->reaping) {
+      pthread_cond_wait(&impl->cond, &impl->mut);
+      continue;
+    }
+    impl->reaping = 1;
+    uring_submit_locked(impl);
+    pthread_mutex_unlock(&impl->mut);
+    int ret = uring_enter(impl->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+    int err = errno;
+    pthread_mutex_lock(&impl->mut);
+    if(ret < 0 && err != EINTR && err != EAGAIN && err != EBUSY) {
+      errno = err;
+      perror("io_uring_enter() failed to wait for completions");
+      abort();
+    }
+    uring_reap_locked(impl);
+    impl->reaping = 0;
+    pthread_cond_broadcast(&impl->cond);
+  }
+}
+/**
+   Get an empty submission queue entry.  Caller holds mut, and must call
+   uring_queue_locked() before releasing it.
+*/
+static struct io_uring_sqe * uring_get_sqe_locked(uring_impl *impl, uring_completion *c) {
+  while(impl->inflight == impl->entries) {
+    uring_wait_locked(impl, NULL);
+  }
+  unsigned idx = *impl->sq_tail & *impl->sq_mask;
+  struct io_uring_sqe *sqe = &impl->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = impl->fd;
+  sqe->user_data = (uint64_t)(intptr_t)c;
+  c->done = 0;
+  c->res = 0;
+  return sqe;
+}
+static void uring_queue_locked(uring_impl *impl) {
+  unsigned tail = *impl->sq_tail;
+  impl->sq_array[tail & *impl->sq_mask] = tail & *impl->sq_mask;
+  __atomic_store_n(impl->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  impl->queued++;
+  impl->inflight++;
+}
+
+/**
+   Synchronously read or write [off, off+len), resubmitting short
+   transfers.  buf_index is only used by the fixed buffer opcodes.
+*/
+static int uring_rw(uring_impl *impl, int opcode, int buf_index, lsn_t off,
+                    byte *buf, lsn_t len) {
+  int error = 0;
+  lsn_t done = 0;
+  pthread_mutex_lock(&impl->mut);
+  while(done < len) {
+    uring_completion c;
+    struct io_uring_sqe *sqe = uring_get_sqe_locked(impl, &c);
+    sqe->opcode = opcode;
+    sqe->off = off + done;
+    sqe->addr = (uint64_t)(intptr_t)(buf + done);
+    sqe->len = (len - done) > URING_MAX_IO ? URING_MAX_IO : (len - done);
+    sqe->buf_index = buf_index;
+    uring_queue_locked(impl);
+    uring_submit_locked(impl);
+    uring_wait_locked(impl, &c);
+    if(c.res < 0) {
+      if(c.res == -EINTR || c.res == -EAGAIN) { continue; }
+      error = -c.res;
+      break;
+    } else if(c.res == 0) {
+      // EOF (for reads).  Writes should never return zero.
+      error = (opcode == IORING_OP_READ || opcode == IORING_OP_READ_FIXED) ? EDOM : EIO;
+      break;
+    }
+    done += c.res;
+  }
+  pthread_mutex_unlock(&impl->mut);
+  return error;
+}
+/**
+   Issue a chain of sync_file_range requests over [start, stop).  Each
+   request in the chain has the same flags.  If the chain is more than one
+   request long, the requests are linked, so that they run in order.
+*/
+static int uring_sync_range(uring_impl *impl, lsn_t start, lsn_t stop, unsigned flags) {
+  int error = 0;
+  int count = 0;
+  uring_completion c[URING_ENTRIES];
+  pthread_mutex_lock(&impl->mut);
+  // A length of zero means "through the end of the file".
+  do {
+    lsn_t len = stop - start;
+    if(stop == 0 || len < 0) { len = 0; }
+    if(len > URING_MAX_IO) { len = URING_MAX_IO; }
+    struct io_uring_sqe *sqe = uring_get_sqe_locked(impl, &c[count]);
+    sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+    sqe->off = start;
+    sqe->len = len;
+    sqe->sync_range_flags = flags;
+    start += len;
+    count++;
+    if(len && start < stop && count < URING_ENTRIES / 2) {
+      sqe->flags |= IOSQE_IO_LINK;
+      uring_queue_locked(impl);
+    } else {
+      uring_queue_locked(impl);
+      break;
+    }
+  } while(1);
+  uring_submit_locked(impl);
+  for(int i = 0; i < count; i++) {
+    uring_wait_locked(impl, &c[i]);
+    if(c[i].res < 0 && !error) { error = -c[i].res; }
+  }
+  pthread_mutex_unlock(&impl->mut);
+  if(!error && start < stop) {
+    // The range was too big for one chain.
+    error = uring_sync_range(impl, start, stop, flags);
+  }
+  return error;
+}
+
+static int uring_num_copies(stasis_handle_t *h) { return 0; }
+static int uring_num_copies_buffer(stasis_handle_t *h) { return 0; }
+
+static int uring_close(stasis_handle_t *h) {
+  uring_impl *impl = (uring_impl*)h->impl;
+  int fd = impl->fd;
+  assert(!impl->inflight);
+  if(impl->buffer_count) {
+    uring_register(impl->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    free(impl->buffers);
+    free(impl->free_buffers);
+  }
+  uring_ring_deinit(impl);
+  pthread_mutex_destroy(&impl->mut);
+  pthread_cond_destroy(&impl->cond);
+  free(impl->filename);
+  free(impl);
+  free(h);
+  int ret = close(fd);
+  if (!ret) return 0;
+  else     return errno;
+}
+static stasis_handle_t * uring_dup(stasis_handle_t *h) {
+  uring_impl *impl = (uring_impl *)h->impl;
+  return stasis_handle_open_uring(impl->filename, impl->file_flags, impl->file_mode);
+}
+static void uring_enable_sequential_optimizations(stasis_handle_t *h) {
+  uring_impl *impl = (uring_impl *)h->impl;
+  impl->sequential = 1;
+#ifdef HAVE_POSIX_FADVISE
+  int err = posix_fadvise(impl->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if(err) perror("Attempt to pass POSIX_FADV_SEQUENTIAL to kernel failed");
+#endif
+}
+static lsn_t uring_end_position(stasis_handle_t *h) {
+  uring_impl *impl = (uring_impl*)h->impl;
+  return lseek(impl->fd, 0, SEEK_END);
+}
+static int uring_read(stasis_handle_t *h, lsn_t off, byte *buf, lsn_t len) {
+  if(off < 0) { return EDOM; }
+  return uring_rw((uring_impl*)h->impl, IORING_OP_READ, 0, off, buf, len);
+}
+static int uring_write(stasis_handle_t *h, lsn_t off, const byte *dat, lsn_t len) {
+  if(off < 0) { return EDOM; }
+  return uring_rw((uring_impl*)h->impl, IORING_OP_WRITE, 0, off, (byte*)dat, len);
+}
+static int uring_writev(stasis_handle_t *h, lsn_t off, const struct iovec *iov, int iovcnt) {
+  if(off < 0) { return EDOM; }
+  uring_impl *impl = (uring_impl*)h->impl;
+  // Short writes are resubmitted from where they stopped, as in uring_rw().
+  struct iovec *v = stasis_alloca(iovcnt, struct iovec);
+  memcpy(v, iov, iovcnt * sizeof(struct iovec));
+  int error = 0;
+  pthread_mutex_lock(&impl->mut);
+  while(iovcnt) {
+    uring_completion c;
+    struct io_uring_sqe *sqe = uring_get_sqe_locked(impl, &c);
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->off = off;
+    sqe->addr = (uint64_t)(intptr_t)v;
+    sqe->len = iovcnt > IOV_MAX ? IOV_MAX : iovcnt;
+    sqe->buf_index = 0;
+    uring_queue_locked(impl);
+    uring_submit_locked(impl);
+    uring_wait_locked(impl, &c);
+    if(c.res < 0) {
+      if(c.res == -EINTR || c.res == -EAGAIN) { continue; }
+      error = -c.res;
+      break;
+    } else if(c.res == 0) {
+      error = EIO;
+      break;
+    }
+    off += c.res;
+    stasis_handle_iovec_consume(&v, &iovcnt, c.res);
+  }
+  pthread_mutex_unlock(&impl->mut);
+  return error;
+}
+static stasis_write_buffer_t * uring_write_buffer(stasis_handle_t *h,
+                                                 lsn_t off, lsn_t len) {
+  uring_impl *impl = (uring_impl*)h->impl;
+  stasis_write_buffer_t *ret = stasis_alloc(stasis_write_buffer_t);
+  if (!ret) {
+    h->error = ENOMEM;
+    return NULL;
+  }
+  ret->h = h;
+  ret->off = 0;
+  ret->buf = 0;
+  ret->len = 0;
+  ret->impl = 0;
+  ret->error = 0;
+  if (off < 0) {
+    ret->error = EDOM;
+    return ret;
+  }
+  // impl is one plus the index of the registered buffer, or zero.
+  int idx = uring_buffer_get(impl, len);
+  if(idx != -1) {
+    ret->buf = impl->buffers + idx * URING_BUFFER_SIZE;
+    ret->impl = (void*)(intptr_t)(idx + 1);
+  } else {
+    ret->buf = stasis_malloc(len, byte);
+    if(!ret->buf) { ret->error = ENOMEM; return ret; }
+  }
+  ret->off = off;
+  ret->len = len;
+  return ret;
+}
+static int uring_release_write_buffer(stasis_write_buffer_t *w) {
+  uring_impl *impl = (uring_impl*)(w->h->impl);
+  int error = 0;
+  intptr_t idx = (intptr_t)w->impl;
+  if(idx) {
+    error = uring_rw(impl, IORING_OP_WRITE_FIXED, idx - 1, w->off, w->buf, w->len);
+    uring_buffer_put(impl, idx - 1);
+  } else if(w->buf) {
+    error = uring_rw(impl, IORING_OP_WRITE, 0, w->off, w->buf, w->len);
+    free(w->buf);
+  }
+  free(w);
+  return error;
+}
+static stasis_read_buffer_t *uring_read_buffer(stasis_handle_t *h,
+                                               lsn_t off, lsn_t len) {
+  uring_impl *impl = (uring_impl*)h->impl;
+  stasis_read_buffer_t *ret = stasis_alloc(stasis_read_buffer_t);
+  if (!ret) { return NULL; }
+  ret->h = h;
+  ret->buf = 0;
+  ret->off = 0;
+  ret->len = 0;
+  ret->impl = 0;
+  ret->error = 0;
+  if (off < 0) {
+    ret->error = EDOM;
+    return ret;
+  }
+  int idx = uring_buffer_get(impl, len);
+  byte *buf;
+  int error;
+  if(idx != -1) {
+    buf = impl->buffers + idx * URING_BUFFER_SIZE;
+    error = uring_rw(impl, IORING_OP_READ_FIXED, idx, off, buf, len);
+    if(error) { uring_buffer_put(impl, idx); }
+  } else {
+    buf = stasis_malloc(len, byte);
+    error = buf ? uring_rw(impl, IORING_OP_READ, 0, off, buf, len) : ENOMEM;
+    if(error) { free(buf); }
+  }
+  if(error) {
+    ret->error = error;
+  } else {
+    ret->buf = buf;
+    ret->off = off;
+    ret->len = len;
+    ret->impl = (void*)(intptr_t)(idx + 1);
+  }
+  return ret;
+}
+static int uring_release_read_buffer(stasis_read_buffer_t *r) {
+  uring_impl *impl = (uring_impl*)(r->h->impl);
+  intptr_t idx = (intptr_t)r->impl;
+  if(idx) {
+    uring_buffer_put(impl, idx - 1);
+  } else if (r->buf) {
+    free((void*)r->buf);
+  }
+  free(r);
+  return 0;
+}
+static int uring_force(stasis_handle_t *h) {
+  uring_impl *impl = (uring_impl *)h->impl;
+  int error = 0;
+  if(!(impl->file_flags & O_SYNC)) {
+    uring_completion c;
+    pthread_mutex_lock(&impl->mut);
+    struct io_uring_sqe *sqe = uring_get_sqe_locked(impl, &c);
+    sqe->opcode = IORING_OP_FSYNC;
+#ifdef HAVE_FDATASYNC
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+#endif
+    uring_queue_locked(impl);
+    uring_submit_locked(impl);
+    uring_wait_locked(impl, &c);
+    pthread_mutex_unlock(&impl->mut);
+    if(c.res < 0) { error = -c.res; }
+  } else {
+    DEBUG("File was opened with O_SYNC.  uring_force() is a no-op\n");
+  }
+  if(impl->sequential) {
+#ifdef HAVE_POSIX_FADVISE
+    int err = posix_fadvise(impl->fd, 0, 0, POSIX_FADV_DONTNEED);
+    if(err) perror("Attempt to pass POSIX_FADV_SEQUENTIAL to kernel failed");
+#endif
+  }
+  return error;
+}
+static int uring_async_force(stasis_handle_t *h) {
+  uring_impl *impl = (uring_impl *)h->impl;
+  // Wait for the last async_force to finish, then start writeback of
+  // everything else, as two linked requests.
+  uring_completion c[2];
+  pthread_mutex_lock(&impl->mut);
+  struct io_uring_sqe *sqe = uring_get_sqe_locked(impl, &c[0]);
+  sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+  sqe->sync_range_flags = SYNC_FILE_RANGE_WAIT_BEFORE;
+  sqe->flags |= IOSQE_IO_LINK;
+  uring_queue_locked(impl);
+  sqe = uring_get_sqe_locked(impl, &c[1]);
+  sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+  sqe->sync_range_flags = SYNC_FILE_RANGE_WRITE;
+  uring_queue_locked(impl);
+  uring_submit_locked(impl);
+  uring_wait_locked(impl, &c[0]);
+  uring_wait_locked(impl, &c[1]);
+  pthread_mutex_unlock(&impl->mut);
+  int ret = 0;
+  if(c[0].res < 0 || c[1].res < 0) {
+    // With the possible exceptions of ENOMEM and ENOSPACE, all of the sync
+    // errors are unrecoverable.
+    h->error = EBADF;
+    ret = c[0].res < 0 ? -c[0].res : -c[1].res;
+  }
+#ifdef HAVE_POSIX_FADVISE
+  if(impl->sequential) {
+    int err = posix_fadvise(impl->fd, 0, 0, POSIX_FADV_DONTNEED);
+    if(err) perror("Attempt to pass POSIX_FADV_SEQUENTIAL (for a range of a file) to kernel failed");
+  }
+#endif
+  return ret;
+}
+static int uring_force_range(stasis_handle_t *h, lsn_t start, lsn_t stop) {
+  uring_impl *impl = (uring_impl *)h->impl;
+  int ret = uring_sync_range(impl, start, stop,
+                             SYNC_FILE_RANGE_WAIT_BEFORE |
+                             SYNC_FILE_RANGE_WRITE |
+                             SYNC_FILE_RANGE_WAIT_AFTER);
+  if(ret) {
+    h->error = EBADF;
+  }
+#ifdef HAVE_POSIX_FADVISE
+  if(impl->sequential) {
+    int err = posix_fadvise(impl->fd, start, stop-start, POSIX_FADV_DONTNEED);
+    if(err) perror("Attempt to pass POSIX_FADV_SEQUENTIAL (for a range of a file) to kernel failed");
+  }
+#endif
+  return ret;
+}
+static int uring_fallocate(struct stasis_handle_t* h, lsn_t off, lsn_t len) {
+  uring_impl *impl = (uring_impl *)h->impl;
+  uring_completion c;
+  pthread_mutex_lock(&impl->mut);
+  struct io_uring_sqe *sqe = uring_get_sqe_locked(impl, &c);
+  sqe->opcode = IORING_OP_FALLOCATE;
+  sqe->off = off;
+  sqe->addr = len;
+  sqe->len = 0; // mode
+  uring_queue_locked(impl);
+  uring_submit_locked(impl);
+  uring_wait_locked(impl, &c);
+  pthread_mutex_unlock(&impl->mut);
+  if(c.res == -EOPNOTSUPP || c.res == -EINVAL) {
+    // Not all file systems (or kernels) support this; match pfile.
+#ifdef HAVE_POSIX_FALLOCATE
+    return posix_fallocate(impl->fd, off, len);
+#endif
+  }
+  return c.res < 0 ? -c.res : 0;
+}
+static struct stasis_handle_t uring_func = {
+  /*.num_copies =*/ uring_num_copies,
+  /*.num_copies_buffer =*/ uring_num_copies_buffer,
+  /*.close =*/ uring_close,
+  /*.dup =*/ uring_dup,
+  /*.enable_sequential_optimizations =*/ uring_enable_sequential_optimizations,
+  /*.end_position =*/ uring_end_position,
+  /*.write_buffer =*/ uring_write_buffer,
+  /*.release_write_buffer =*/ uring_release_write_buffer,
+  /*.read_buffer =*/ uring_read_buffer,
+  /*.release_read_buffer =*/ uring_release_read_buffer,
+  /*.write =*/ uring_write,
+  /*.read =*/ uring_read,
+  /*.force =*/ uring_force,
+  /*.async_force =*/ uring_async_force,
+  /*.force_range =*/ uring_force_range,
+  /*.fallocate =*/ uring_fallocate,
+  /*.admit =*/ NULL,
+  /*.writev =*/ uring_writev,
+  /*.error =*/ 0,
+  /*.impl =*/ 0
+};
+
+stasis_handle_t *stasis_handle(open_uring)(const char *filename,
+                                           int flags, int mode) {
+  stasis_handle_t *ret = stasis_alloc(stasis_handle_t);
+  if (!ret) { return NULL; }
+  *ret = uring_func;
+
+  uring_impl *impl = stasis_alloc(uring_impl);
+  if (!impl) { free(ret); return NULL; }
+
+  int err = uring_ring_init(impl);
+  if(err) {
+    static int warned = 0;
+    if(!warned) {
+      fprintf(stderr, "uring.c: Could not create io_uring (%s); falling back to pfile.\n", strerror(err));
+      warned = 1;
+    }
+    free(impl);
+    free(ret);
+    return stasis_handle_open_pfile(filename, flags, mode);
+  }
+
+  ret->impl = impl;
+  impl->fd = open(filename, flags, mode);
+  assert(sizeof(off_t) >= (64/8));
+  if (impl->fd == -1) {
+    ret->error = errno;
+  }
+  pthread_mutex_init(&impl->mut, 0);
+  pthread_cond_init(&impl->cond, 0);
+  impl->queued = 0;
+  impl->inflight = 0;
+  impl->completed = 0;
+  impl->reaping = 0;
+  uring_buffers_init(impl);
+
+  impl->filename = strdup(filename);
+  impl->file_flags = flags;
+  impl->file_mode = mode;
+  impl->sequential = 0;
+  assert(!ret->error);
+  return ret;
+}
+
+#else // HAVE_IO_URING
+
+stasis_handle_t *stasis_handle(open_uring)(const char *filename,
+                                           int flags, int mode) {
+  static int warned = 0;
+  if(!warned) {
+    fprintf(stderr, "uring.c: This build does not support io_uring; falling back to pfile.\n");
+    warned = 1;
+  }
+  return stasis_handle_open_pfile(filename, flags, mode);
+}
+
+#endif // HAVE_IO_URING
@@ -11,6 +11,7 @@
 #include <stasis/util/crc32.h>
 #include <stasis/util/latches.h>
 #include <stasis/logger/filePool.h>
+#include <stasis/io/handle.h>
 
 #include <stdio.h>
 #include <assert.h>
@@ -19,7 +20,61 @@
 #include <unistd.h>
 
 /**
-   Latch order: ringbuffer range, chunk state
+ * Threads that reserve log entries at the same time are combined into
+ * groups, which reserve ringbuffer space with a single call.  Each group
+ * is collected in a slot.  This is the number of slots.
+ */
+#define GROUP_SLOTS 4
+/** Entries larger than this are reserved on their own. */
+#define GROUP_MAX_BYTES (1024 * 1024)
+/** Maximum number of entries in a group. */
+#define GROUP_MAX_COUNT 1023
+
+/*
+ * A slot's state packs the number of bytes that have been reserved by the
+ * group (low 32 bits), the number of entries in the group (next 30 bits),
+ * and a bit that is set once the group is closed to new entries.
+ */
+#define GROUP_BYTES(s)  ((s) & 0xffffffffLL)
+#define GROUP_COUNT(s)  (((s) >> 32) & 0x3fffffffLL)
+#define GROUP_MEMBER    (1LL << 32)
+#define GROUP_CLOSED    (1LL << 62)
+
+/**
+ * The ringbuffer range reserved for a group of log entries.  Entries are
+ * packed into it in the order that they joined the group.  The range is
+ * handed back to the ringbuffer once every entry has been written (and
+ * again once every entry is done), so the ringbuffer's write tail (and
+ * first_pending_lsn) never passes an entry that is still being written.
+ */
+typedef struct {
+  /** The ringbuffer handle.  Its value is the LSN of the first entry. */
+  lsn_t handle;
+  /** Entries that have not been passed to write_entry() yet. */
+  int64_t writers;
+  /** Entries that have not been passed to write_entry_done() yet. */
+  int64_t readers;
+} stasis_log_file_pool_group_t;
+
+typedef struct {
+  int64_t state;
+  pthread_mutex_t mut;
+  pthread_cond_t published;
+  /** Set once the group's leader has reserved its space. */
+  stasis_log_file_pool_group_t * group;
+  /** Members that have not read group yet.  The last one reopens the slot. */
+  int pickups;
+} stasis_log_file_pool_slot_t;
+
+/** Per-thread state. */
+typedef struct {
+  /** The group that holds the entry that this thread is writing. */
+  stasis_log_file_pool_group_t * group;
+  int slot;
+} stasis_log_file_pool_tls_t;
+
+/**
+   Latch order: group insertion, ringbuffer range, chunk state
  */
 typedef struct {
   const char * dirname;
@@ -62,11 +117,14 @@ typedef struct {
   pthread_t write_thread2;
   pthread_t prealloc_thread;
   stasis_ringbuffer_t * ring;
-  /** Need this because the min aggregate in the ringbuffer doesn't
-   * want to malloc keys, but needs to maintain some sort of state
-   * for each log operation.
-   */
+  /** Points to each thread's stasis_log_file_pool_tls_t. */
   pthread_key_t handle_key;
+  /**
+   * Held by group leaders while they close their group and reserve its
+   * space.  Other threads join groups while leaders wait for it.
+   */
+  pthread_mutex_t insert_mut;
+  stasis_log_file_pool_slot_t slots[GROUP_SLOTS];
 
   pthread_mutex_t mut;
 
@@ -345,22 +403,15 @@ int stasis_log_file_pool_append_chunk(stasis_log_t * log, off_t new_offset) {
   return fp->live_count-1;
 }
 /**
- * Appends a new chunk to the log if necessary.  Holds mut while checking and
- * appending chunk.  (After reserving space in the ringbuffer).
+ * Appends a new chunk to the log if [off, off+len) does not fit in the
+ * current one.  Holds mut while checking and appending chunk.  (After
+ * reserving space in the ringbuffer).
  */
-LogEntry * stasis_log_file_pool_reserve_entry(stasis_log_t * log, size_t szs) {
-  uint32_t sz = szs;
+static void stasis_log_file_pool_reserve_chunk(stasis_log_t * log, lsn_t off, lsn_t len) {
   stasis_log_file_pool_state * fp = (stasis_log_file_pool_state *)log->impl;
-  lsn_t * handle = (lsn_t *)pthread_getspecific(fp->handle_key);
-  if(!handle) { handle = stasis_alloc(lsn_t); pthread_setspecific(fp->handle_key, handle); }
-
-  uint64_t framed_size = sz+sizeof(uint32_t)+sizeof(uint32_t);
-  lsn_t off  = stasis_ringbuffer_reserve_space(fp->ring, framed_size, handle);
-
   pthread_mutex_lock(&fp->mut);
-  int endchunk = get_chunk_from_offset(log, off + sz + 2*sizeof(uint32_t));
-  //if(chunk >= fp->live_count || (off + (sz+2*sizeof(uint32_t)) > fp->live_offsets[chunk] + fp->target_chunk_size)) {
-  if(endchunk == -1) { //>= fp->live_count) {
+  int endchunk = get_chunk_from_offset(log, off + len);
+  if(endchunk == -1) {
     stasis_log_file_pool_append_chunk(log, off);
     int chunk = get_chunk_from_offset(log, off);
     assert(chunk == fp->live_count-1);
@@ -371,6 +422,122 @@ LogEntry * stasis_log_file_pool_reserve_entry(stasis_log_t * log, size_t szs) {
   if(barrier < off) {
     stasis_ringbuffer_flush(fp->ring, barrier);
   }
+}
+/**
+ * Reserve space for a group of one.
+ */
+static lsn_t stasis_log_file_pool_reserve_alone(stasis_log_t * log, lsn_t len, stasis_log_file_pool_group_t ** group) {
+  stasis_log_file_pool_state * fp = (stasis_log_file_pool_state *)log->impl;
+  stasis_log_file_pool_group_t * g = stasis_alloc(stasis_log_file_pool_group_t);
+  g->writers = 1;
+  g->readers = 1;
+  lsn_t off = stasis_ringbuffer_reserve_space(fp->ring, len, &g->handle);
+  stasis_log_file_pool_reserve_chunk(log, off, len);
+  *group = g;
+  return off;
+}
+/**
+ * Close the group in slot, and reserve space for all of its entries.  The
+ * leader's entry goes first.
+ */
+static lsn_t stasis_log_file_pool_lead_group(stasis_log_t * log, stasis_log_file_pool_slot_t * slot, stasis_log_file_pool_group_t ** group) {
+  stasis_log_file_pool_state * fp = (stasis_log_file_pool_state *)log->impl;
+  // Other threads join the group while we wait for the mutex.
+  pthread_mutex_lock(&fp->insert_mut);
+  int64_t state;
+  do {
+    state = ATOMIC_READ_64(0, &slot->state);
+  } while(!CAS(0, &slot->state, state, state | GROUP_CLOSED));
+
+  stasis_log_file_pool_group_t * g = stasis_alloc(stasis_log_file_pool_group_t);
+  g->writers = GROUP_COUNT(state);
+  g->readers = GROUP_COUNT(state);
+  lsn_t off = stasis_ringbuffer_reserve_space(fp->ring, GROUP_BYTES(state), &g->handle);
+  pthread_mutex_unlock(&fp->insert_mut);
+
+  stasis_log_file_pool_reserve_chunk(log, off, GROUP_BYTES(state));
+
+  pthread_mutex_lock(&slot->mut);
+  if(GROUP_COUNT(state) == 1) {
+    ATOMIC_WRITE_64(0, &slot->state, 0);
+  } else {
+    slot->group = g;
+    slot->pickups = GROUP_COUNT(state) - 1;
+    pthread_cond_broadcast(&slot->published);
+  }
+  pthread_mutex_unlock(&slot->mut);
+  *group = g;
+  return off;
+}
+/**
+ * Wait for the leader of the group in slot to reserve space, and return
+ * the LSN of our entry, which is pos bytes into the group.
+ */
+static lsn_t stasis_log_file_pool_follow_group(stasis_log_file_pool_slot_t * slot, lsn_t pos, stasis_log_file_pool_group_t ** group) {
+  pthread_mutex_lock(&slot->mut);
+  while(!slot->group) {
+    pthread_cond_wait(&slot->published, &slot->mut);
+  }
+  stasis_log_file_pool_group_t * g = slot->group;
+  slot->pickups--;
+  if(!slot->pickups) {
+    slot->group = NULL;
+    ATOMIC_WRITE_64(0, &slot->state, 0);
+  }
+  pthread_mutex_unlock(&slot->mut);
+  *group = g;
+  return g->handle + pos;
+}
+/**
+ * Join an open group, starting with the slot that this thread used last.
+ * The first thread to join a group leads it.  If every group is closed or
+ * full, reserve the entry on its own.
+ */
+static lsn_t stasis_log_file_pool_join_group(stasis_log_t * log, stasis_log_file_pool_tls_t * tls, lsn_t len, stasis_log_file_pool_group_t ** group) {
+  stasis_log_file_pool_state * fp = (stasis_log_file_pool_state *)log->impl;
+  if(len > GROUP_MAX_BYTES) {
+    return stasis_log_file_pool_reserve_alone(log, len, group);
+  }
+  for(int i = 0; i < GROUP_SLOTS; i++) {
+    int slotnum = (tls->slot + i) % GROUP_SLOTS;
+    stasis_log_file_pool_slot_t * slot = &fp->slots[slotnum];
+    while(1) {
+      int64_t state = ATOMIC_READ_64(0, &slot->state);
+      if((state & GROUP_CLOSED)
+         || GROUP_BYTES(state) + len > GROUP_MAX_BYTES
+         || GROUP_COUNT(state) == GROUP_MAX_COUNT) {
+        break;
+      }
+      if(CAS(0, &slot->state, state, state + GROUP_MEMBER + len)) {
+        tls->slot = slotnum;
+        if(GROUP_COUNT(state) == 0) {
+          return stasis_log_file_pool_lead_group(log, slot, group);
+        } else {
+          return stasis_log_file_pool_follow_group(slot, GROUP_BYTES(state), group);
+        }
+      }
+    }
+  }
+  return stasis_log_file_pool_reserve_alone(log, len, group);
+}
+/**
+ * Joins a group of concurrent reservations (see join_group), and then
+ * fills in the entry's framing.  Threads that join the same group copy
+ * their entries into the ringbuffer in parallel.
+ */
+LogEntry * stasis_log_file_pool_reserve_entry(stasis_log_t * log, size_t szs) {
+  uint32_t sz = szs;
+  stasis_log_file_pool_state * fp = (stasis_log_file_pool_state *)log->impl;
+  stasis_log_file_pool_tls_t * tls = (stasis_log_file_pool_tls_t *)pthread_getspecific(fp->handle_key);
+  if(!tls) {
+    tls = stasis_alloc(stasis_log_file_pool_tls_t);
+    tls->group = NULL;
+    tls->slot = ((intptr_t)tls / sizeof(*tls)) % GROUP_SLOTS;
+    pthread_setspecific(fp->handle_key, tls);
+  }
+
+  uint64_t framed_size = sz+sizeof(uint32_t)+sizeof(uint32_t);
+  lsn_t off = stasis_log_file_pool_join_group(log, tls, framed_size, &tls->group);
 
   byte * buf = stasis_ringbuffer_get_wr_buf(fp->ring, off, framed_size);
 
@@ -381,14 +548,20 @@ LogEntry * stasis_log_file_pool_reserve_entry(stasis_log_t * log, size_t szs) {
   return e;
 }
 /**
- * Does no latching.  Everything is thread local, except the call to ringbuffer.
+ * Does no latching.  Everything is thread local, except the call to
+ * ringbuffer, which is made by the last entry in the group to finish.
  */
 int stasis_log_file_pool_write_entry_done(stasis_log_t * log, LogEntry * e) {
   stasis_log_file_pool_state * fp = (stasis_log_file_pool_state *)log->impl;
-  lsn_t * handle = (lsn_t *)pthread_getspecific(fp->handle_key);
-  assert(handle);
-
-  stasis_ringbuffer_reading_writer_done(fp->ring, handle);
+  stasis_log_file_pool_tls_t * tls = (stasis_log_file_pool_tls_t *)pthread_getspecific(fp->handle_key);
+  assert(tls && tls->group);
+  stasis_log_file_pool_group_t * g = tls->group;
+  tls->group = NULL;
+
+  if(FETCH_AND_ADD(&g->readers, -1) == 1) {
+    stasis_ringbuffer_reading_writer_done(fp->ring, &g->handle);
+    free(g);
+  }
   return 0;
 }
 /**
@@ -397,8 +570,8 @@ int stasis_log_file_pool_write_entry_done(stasis_log_t * log, LogEntry * e) {
  */
 int stasis_log_file_pool_write_entry(stasis_log_t * log, LogEntry * e) {
   stasis_log_file_pool_state * fp = (stasis_log_file_pool_state *)log->impl;
-  lsn_t * handle = (lsn_t *)pthread_getspecific(fp->handle_key);
-  assert(handle);
+  stasis_log_file_pool_tls_t * tls = (stasis_log_file_pool_tls_t *)pthread_getspecific(fp->handle_key);
+  assert(tls && tls->group);
 
   byte * buf = (byte*)e;
   lsn_t sz = sizeofLogEntry(log, e);
@@ -410,7 +583,10 @@ int stasis_log_file_pool_write_entry(stasis_log_t * log, LogEntry * e) {
   // have workers dequeue entries to checksum.  It's not clear it would be worth
   // the extra synchronization overhead...
   *(((uint32_t*)buf)-1) = stasis_crc32(buf, sz, (uint32_t)-1);
-  stasis_ringbuffer_write_done(fp->ring, handle);
+  // The group's readers count keeps it allocated until we are done with it.
+  if(FETCH_AND_ADD(&tls->group->writers, -1) == 1) {
+    stasis_ringbuffer_write_done(fp->ring, &tls->group->handle);
+  }
   return 0;
 }
 /**
@@ -629,6 +805,11 @@ int stasis_log_file_pool_close(stasis_log_t * log) {
   pthread_join(fp->prealloc_thread, 0);
 
   stasis_ringbuffer_free(fp->ring);
+  pthread_mutex_destroy(&fp->insert_mut);
+  for(int i = 0; i < GROUP_SLOTS; i++) {
+    pthread_mutex_destroy(&fp->slots[i].mut);
+    pthread_cond_destroy(&fp->slots[i].published);
+  }
 
   for(int i = 0; i < fp->live_count; i++) {
   close(fp->ro_fd[i]);
@@ -671,6 +852,8 @@ void * stasis_log_file_pool_writeback_worker(void * arg) {
     }
     assert(endchunk != -1);
     pthread_mutex_unlock(&fp->mut);
+    // The log is opened with O_DSYNC, so these writes are log forces.
+    stasis_handle_qos_begin(STASIS_IO_CLASS_LOG, len);
     lsn_t bytes_written = 0;
     for(int c = chunk; c <= endchunk; c++){
       lsn_t write_len;
@@ -696,6 +879,7 @@ void * stasis_log_file_pool_writeback_worker(void * arg) {
         assert(succ);
       }
     }
+    stasis_handle_qos_end(STASIS_IO_CLASS_LOG);
     free(file_offs);
     free(fds);
     stasis_ringbuffer_read_done(fp->ring, &handle);
@@ -877,6 +1061,14 @@ stasis_log_t* stasis_log_file_pool_open(const char* dirname, int filemode, int f
 
   fp->ring = stasis_ringbuffer_init(26, next_lsn); // 64mb buffer
   pthread_key_create(&fp->handle_key, key_destr);
+  pthread_mutex_init(&fp->insert_mut, 0);
+  for(int i = 0; i < GROUP_SLOTS; i++) {
+    fp->slots[i].state = 0;
+    pthread_mutex_init(&fp->slots[i].mut, 0);
+    pthread_cond_init(&fp->slots[i].published, 0);
+    fp->slots[i].group = NULL;
+    fp->slots[i].pickups = 0;
+  }
 
   fp->dead_threshold = 1;
   pthread_cond_init(&fp->prealloc_log_cond, 0);
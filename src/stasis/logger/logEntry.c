@@ -70,6 +70,23 @@ LogEntry * allocPrepareLogEntry(stasis_log_t* log, lsn_t prevLSN, int xid, lsn_t
   return ret;
 }
 
+static lsn_t sizeofCheckpointLogEntry(pageid_t page_count, int64_t xact_count) {
+  return sizeof(struct __raw_log_entry) + sizeof(CheckpointLogEntry)
+    + page_count * sizeof(CheckpointDirtyPage)
+    + xact_count * sizeof(CheckpointTransaction);
+}
+LogEntry * allocCheckpointLogEntry(stasis_log_t* log, lsn_t begin_lsn, pageid_t page_count, int64_t xact_count) {
+  LogEntry * ret = log->reserve_entry(log, sizeofCheckpointLogEntry(page_count, xact_count));
+  ret->prevLSN = INVALID_LSN;
+  ret->xid = INVALID_XID;
+  ret->type = CHECKPOINTLOG;
+  CheckpointLogEntry * cp = (CheckpointLogEntry*)getCheckpoint(ret);
+  cp->begin_lsn = begin_lsn;
+  cp->page_count = page_count;
+  cp->xact_count = xact_count;
+  return ret;
+}
+
 const void * stasis_log_entry_update_args_cptr(const LogEntry * ret) {
   assert(ret->type == UPDATELOG ||
 	 ret->type == CLRLOG);
@@ -158,6 +175,8 @@ lsn_t sizeofLogEntry(stasis_log_t * log, const LogEntry * e) {
     return log->sizeof_internal_entry(log,e);
   case XPREPARE:
     return sizeof(struct __raw_log_entry)+sizeof(lsn_t);
+  case CHECKPOINTLOG:
+    return sizeofCheckpointLogEntry(getCheckpoint(e)->page_count, getCheckpoint(e)->xact_count);
   default:
     return sizeof(struct __raw_log_entry);
   }
@@ -34,10 +34,10 @@ static void* stasis_log_reordering_handle_worker(void * a) {
         h->log->write_entry_done(h->log, e);
 
         if(p) {
-	  writelock(p->rwlatch,0);
+	  stasis_page_writelock(p);
           // XXX truncation bug; dirty page table's reclsn may have been increased past this lsn in race with the log entry allocation.
           stasis_page_lsn_write(e->xid, p, lsn);
-          unlock(p->rwlatch);
+          stasis_page_writeunlock(p);
           releasePage(p);
         } /*
 	    else it's the caller's problem; flush(), and checking the
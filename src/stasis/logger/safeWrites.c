@@ -52,6 +52,7 @@ terms specified in this license.
 #include <stasis/logger/safeWrites.h>
 #include <stasis/logger/logWriterUtils.h>
 #include <stasis/logger/logHandle.h>
+#include <stasis/io/handle.h>
 
 #include <assert.h>
 #include <stdio.h>
@@ -62,16 +63,23 @@ terms specified in this license.
  *
  * A Stasis log implementation that uses safe writes (copy tail, force, rename) to perform truncation.
  *
+ * Entries are appended to one of two in-memory tail buffers.  A flusher
+ * thread writes the other buffer with pwrite(), and forces it with
+ * fdatasync() if a caller of force_tail() needs it to.  Appenders keep
+ * filling the current buffer while the previous one is being written, and
+ * threads that force the log while a force is in progress are covered by
+ * the next one.
+ *
  * @todo The safeWrites log implementation is not optimized for reading old entries.
  *
  * @ingroup LOGGING_IMPLEMENTATIONS
  */
 
 /**
-   Latch order:  truncate_mutex, write_mutex, read_mutex
+   Latch order:  truncate_mutex, write_mutex, read_mutex, flush_mutex
 */
 typedef struct {
-  FILE * fp;
+  int  fd;
   int  ro_fd;
   const char * filename;
   const char * scratch_filename;
@@ -89,11 +97,6 @@ typedef struct {
      flushedLSN_wal.
   */
   lsn_t flushedLSN_commit;
-  /**
-     The first LSN that hasn't made it into roLogFD.  This can be greater than
-     flushedLSN_commit
-  */
-  lsn_t flushedLSN_internal;
   /**
      The LSN that will be assigned to the next log entry.
    */
@@ -138,9 +141,41 @@ typedef struct {
   */
   rwl* flushedLSN_latch;
   /**
-     In memory log buffer.  Managed by fwrite().
+     The log's tail buffers.  Appenders fill buffer[cur]; the flusher
+     writes the other one.  Each holds stasis_log_file_write_buffer_size
+     bytes.
   */
-  char * buffer;
+  byte * buffer[2];
+  int cur;
+  /** The LSN of the first byte in buffer[cur]. */
+  lsn_t buffer_lsn;
+  /** The number of bytes in buffer[cur]. */
+  lsn_t buffer_len;
+  /** Set by appenders that are waiting for the flusher to swap buffers. */
+  int buffer_full;
+  /** True while the flusher is writing a buffer. */
+  int flushing;
+  /** Bytes before this LSN have been written to fd (and are visible to ro_fd). */
+  lsn_t written_lsn;
+  /** Bytes before this LSN have been forced to disk. */
+  lsn_t synced_lsn;
+  /** Some thread is waiting for the bytes before this LSN to be written. */
+  lsn_t request_lsn;
+  /** Some thread is waiting for the bytes before this LSN to be forced. */
+  lsn_t sync_request_lsn;
+  int shutdown;
+  pthread_t flusher;
+  /**
+     Protects the buffers, and the fields above.  Appenders also hold
+     write_mutex, so only the flusher contends for it with them.
+  */
+  pthread_mutex_t flush_mutex;
+  /** Wakes the flusher. */
+  pthread_cond_t flush_needed;
+  /** Signaled when the flusher finishes writing (or forcing) a buffer. */
+  pthread_cond_t flush_done;
+  /** Signaled when the flusher swaps buffers. */
+  pthread_cond_t buffer_free;
   /**
       CRC of the log between last CRC log entry, and the current end of
       the log.  The CRC includes everything except for the CRC log entry
@@ -304,6 +339,120 @@ static inline lsn_t log_crc_next_lsn(stasis_log_t* log, lsn_t ret) {
 }
 
 
+/**
+   Copy bytes to the tail of the log, waiting for the flusher to swap
+   buffers whenever the current one fills up.  The caller must hold
+   write_mutex, so the bytes are contiguous in the log.
+*/
+static void appendLocked(stasis_log_safe_writes_state* sw, const void * dat, lsn_t len) {
+  const byte * p = (const byte*)dat;
+  pthread_mutex_lock(&sw->flush_mutex);
+  while(len) {
+    while(sw->buffer_len == stasis_log_file_write_buffer_size) {
+      sw->buffer_full = 1;
+      pthread_cond_signal(&sw->flush_needed);
+      pthread_cond_wait(&sw->buffer_free, &sw->flush_mutex);
+    }
+    lsn_t n = stasis_log_file_write_buffer_size - sw->buffer_len;
+    if(n > len) { n = len; }
+    memcpy(sw->buffer[sw->cur] + sw->buffer_len, p, n);
+    sw->buffer_len += n;
+    p += n;
+    len -= n;
+  }
+  pthread_mutex_unlock(&sw->flush_mutex);
+}
+/**
+   Wait until the bytes before lsn have been written to the log file, and,
+   if sync is true, forced to disk.
+*/
+static void waitForFlush(stasis_log_safe_writes_state* sw, lsn_t lsn, int sync) {
+  pthread_mutex_lock(&sw->flush_mutex);
+  if(sw->request_lsn < lsn) { sw->request_lsn = lsn; }
+  if(sync && sw->sync_request_lsn < lsn) { sw->sync_request_lsn = lsn; }
+  pthread_cond_signal(&sw->flush_needed);
+  while(sw->written_lsn < lsn || (sync && sw->synced_lsn < lsn)) {
+    pthread_cond_wait(&sw->flush_done, &sw->flush_mutex);
+  }
+  pthread_mutex_unlock(&sw->flush_mutex);
+}
+/**
+   Wait for the flusher to write everything that has been appended to the
+   log, and to go idle.  The caller must hold write_mutex, so that nothing
+   else can be appended.
+*/
+static void drainLocked(stasis_log_safe_writes_state* sw) {
+  pthread_mutex_lock(&sw->flush_mutex);
+  lsn_t end = sw->buffer_lsn + sw->buffer_len;
+  if(sw->request_lsn < end) { sw->request_lsn = end; }
+  pthread_cond_signal(&sw->flush_needed);
+  while(sw->flushing || sw->written_lsn < end || sw->synced_lsn < sw->sync_request_lsn) {
+    pthread_cond_wait(&sw->flush_done, &sw->flush_mutex);
+  }
+  pthread_mutex_unlock(&sw->flush_mutex);
+}
+static void * flusher_LogWriter(void * arg) {
+  stasis_log_safe_writes_state* sw = (stasis_log_safe_writes_state*)arg;
+  pthread_mutex_lock(&sw->flush_mutex);
+  while(1) {
+    while(!sw->shutdown && !sw->buffer_full
+          && sw->request_lsn <= sw->written_lsn
+          && sw->sync_request_lsn <= sw->synced_lsn) {
+      pthread_cond_wait(&sw->flush_needed, &sw->flush_mutex);
+    }
+    if(sw->shutdown) { break; }
+
+    // Swap buffers, so that appenders can continue while we write.
+    const byte * buf = sw->buffer[sw->cur];
+    lsn_t lsn = sw->buffer_lsn;
+    lsn_t len = sw->buffer_len;
+    lsn_t end = lsn + len;
+    off_t off = lsn - sw->global_offset;
+    int fd = sw->fd;
+    sw->cur = !sw->cur;
+    sw->buffer_lsn += len;
+    sw->buffer_len = 0;
+    sw->buffer_full = 0;
+    sw->flushing = 1;
+    pthread_cond_broadcast(&sw->buffer_free);
+    pthread_mutex_unlock(&sw->flush_mutex);
+
+    stasis_handle_qos_begin(STASIS_IO_CLASS_LOG, len);
+    while(len) {
+      ssize_t ret = pwrite(fd, buf, len, off);
+      if(ret == -1) {
+        if(errno == EINTR) { continue; }
+        perror("writeLog couldn't write log buffer");
+        abort();
+      }
+      buf += ret;
+      off += ret;
+      len -= ret;
+    }
+
+    // Threads that asked for a force while we were writing are covered by this one.
+    pthread_mutex_lock(&sw->flush_mutex);
+    int sync = sw->sync_request_lsn > sw->synced_lsn;
+    pthread_mutex_unlock(&sw->flush_mutex);
+    if(sync) {
+#ifdef HAVE_FDATASYNC
+      fdatasync(fd);
+#else
+      fsync(fd);
+#endif
+    }
+    stasis_handle_qos_end(STASIS_IO_CLASS_LOG);
+
+    pthread_mutex_lock(&sw->flush_mutex);
+    sw->flushing = 0;
+    sw->written_lsn = end;
+    if(sync) { sw->synced_lsn = end; }
+    pthread_cond_broadcast(&sw->flush_done);
+  }
+  pthread_mutex_unlock(&sw->flush_mutex);
+  return 0;
+}
+
 /**
     Unfortunately, this function can't just seek to the end of the
     log.  If it did, and a prior instance of Stasis crashed (and wrote
@@ -340,37 +489,8 @@ static int writeLogEntryUnlocked(stasis_log_t* log, LogEntry * e, int clearcrc)
   DEBUG("Writing Log entry type = %d lsn = %ld, size = %ld\n",
         e->type, e->LSN, size);
 
-  size_t nmemb = fwrite(&size, sizeof(lsn_t), 1, sw->fp);
-
-  if(nmemb != 1) {
-    if(feof(sw->fp))   { abort();  /* feof makes no sense here */  }
-    if(ferror(sw->fp)) {
-      fprintf(stderr, "writeLog couldn't write next log entry: %d\n",
-              ferror(sw->fp));
-      errno = ferror(sw->fp);
-      perror("error was:");
-      abort();
-    }
-    abort();
-    // XXX nextAvailableLSN not set...
-    return LLADD_IO_ERROR;
-  }
-
-  nmemb = fwrite(e, size, 1, sw->fp);
-
-  if(nmemb != 1) {
-    if(feof(sw->fp)) { abort();  /* feof makes no sense here */ }
-    if(ferror(sw->fp)) {
-      fprintf(stderr, "writeLog couldn't write next log entry: %d\n",
-              ferror(sw->fp));
-      errno = ferror(sw->fp);
-      perror("error was:");
-      abort();
-    }
-    abort();
-    // XXX nextAvailableLSN not set...
-    return LLADD_IO_ERROR;
-  }
+  appendLocked(sw, &size, sizeof(lsn_t));
+  appendLocked(sw, e, size);
 
   // XXX Works around bug in API; the unit test needs to know where the end of the log is, so it calls
   // next available LSN.  If we set this in reserve_entry (where it should be set), then this would
@@ -418,21 +538,12 @@ static lsn_t sizeofInternalLogEntry_LogWriter(stasis_log_t * log,
   return sizeof(struct __raw_log_entry);
 }
 
+/** Make everything that has been appended to the log visible to ro_fd. */
 static void syncLogInternal(stasis_log_safe_writes_state* sw) {
-  lsn_t newFlushedLSN;
-
   pthread_mutex_lock(&sw->nextAvailableLSN_mutex);
-  newFlushedLSN = sw->nextAvailableLSN;
-  if(newFlushedLSN > sw->flushedLSN_internal) {
-    pthread_mutex_unlock(&sw->nextAvailableLSN_mutex);
-    fflush(sw->fp);
-    writelock(sw->flushedLSN_latch, 0);
-  }
-  if(newFlushedLSN > sw->flushedLSN_internal) {
-    sw->flushedLSN_internal = newFlushedLSN;
-  }
-  unlock(sw->flushedLSN_latch);
-
+  lsn_t newFlushedLSN = sw->nextAvailableLSN;
+  pthread_mutex_unlock(&sw->nextAvailableLSN_mutex);
+  waitForFlush(sw, newFlushedLSN, 0);
 }
 
 static void syncLog_LogWriter(stasis_log_t * log,
@@ -442,21 +553,13 @@ static void syncLog_LogWriter(stasis_log_t * log,
 
   newFlushedLSN = log_crc_entry(log) + sizeof(lsn_t) + sizeofInternalLogEntry_LogWriter(log, 0);
 
-  fflush(sw->fp);
-
   // We can skip the fsync if we opened with O_SYNC, or if we're in softcommit mode, and not forcing for WAL.
+  int sync = (sw->softcommit && mode == LOG_FORCE_WAL)  // soft commit mode; syncing for wal
+      || !(sw->softcommit || (sw->filemode & O_SYNC)); // neither soft commit nor opened with O_SYNC
 
-  if((sw->softcommit && mode == LOG_FORCE_WAL)  // soft commit mode; syncing for wal
-      || !(sw->softcommit || (sw->filemode & O_SYNC)) // neither soft commit nor opened with O_SYNC
-  ) {
-#ifdef HAVE_FDATASYNC
-  fdatasync(fileno(sw->fp));
-#else
-  fsync(fileno(sw->fp));
-#endif
-  }
+  waitForFlush(sw, newFlushedLSN, sync);
 
-  // update flushedLSN after fflush returns.
+  // update flushedLSN after the flusher is done with our entries.
   writelock(sw->flushedLSN_latch, 0);
   if((!sw->softcommit) || mode == LOG_FORCE_WAL) {
     if(newFlushedLSN > sw->flushedLSN_wal) {
@@ -466,9 +569,6 @@ static void syncLog_LogWriter(stasis_log_t * log,
   if(newFlushedLSN > sw->flushedLSN_commit) {
     sw->flushedLSN_commit = newFlushedLSN;
   }
-  if(newFlushedLSN > sw->flushedLSN_internal) {
-    sw->flushedLSN_internal = newFlushedLSN;
-  }
 
   writeunlock(sw->flushedLSN_latch);
 }
@@ -505,10 +605,11 @@ static lsn_t firstPendingLSN_LogWriter(stasis_log_t* log) {
   return ret;
 }
 
+/** @return the first LSN that hasn't made it into ro_fd. */
 static lsn_t flushedLSNInternal(stasis_log_safe_writes_state* sw) {
-  readlock(sw->flushedLSN_latch, 0);
-  lsn_t ret = sw->flushedLSN_internal;
-  readunlock(sw->flushedLSN_latch);
+  pthread_mutex_lock(&sw->flush_mutex);
+  lsn_t ret = sw->written_lsn;
+  pthread_mutex_unlock(&sw->flush_mutex);
   return ret;
 }
 
@@ -517,7 +618,13 @@ static int close_LogWriter(stasis_log_t* log) {
   /* Get the whole thing to the disk before closing it. */
   syncLog_LogWriter(log, LOG_FORCE_WAL);
 
-  fclose(sw->fp);
+  pthread_mutex_lock(&sw->flush_mutex);
+  sw->shutdown = 1;
+  pthread_cond_signal(&sw->flush_needed);
+  pthread_mutex_unlock(&sw->flush_mutex);
+  pthread_join(sw->flusher, 0);
+
+  close(sw->fd);
   close(sw->ro_fd);
 
   /* Free locks. */
@@ -526,7 +633,12 @@ static int close_LogWriter(stasis_log_t* log) {
   pthread_mutex_destroy(&sw->write_mutex);
   pthread_mutex_destroy(&sw->nextAvailableLSN_mutex);
   pthread_mutex_destroy(&sw->truncate_mutex);
-  free(sw->buffer);
+  pthread_mutex_destroy(&sw->flush_mutex);
+  pthread_cond_destroy(&sw->flush_needed);
+  pthread_cond_destroy(&sw->flush_done);
+  pthread_cond_destroy(&sw->buffer_free);
+  free(sw->buffer[0]);
+  free(sw->buffer[1]);
 
   free((void*)sw->filename);
   free((void*)sw->scratch_filename);
@@ -549,15 +661,17 @@ static const LogEntry * readLSNEntry_LogWriter(stasis_log_t * log, const lsn_t L
   }
   pthread_mutex_unlock(&sw->nextAvailableLSN_mutex);
 
-  pthread_mutex_lock(&sw->read_mutex);
-
   /** Because we use two file descriptors to access the log, we need
-      to flush the log write buffer before concluding we're at EOF. */
+      to flush the log write buffer before concluding we're at EOF.
+      Don't hold read_mutex while waiting for the flusher; truncation
+      holds write_mutex while it waits for read_mutex. */
   if(flushedLSNInternal(sw) <= LSN) { // && LSN < nextAvailableLSN) {
     syncLogInternal(sw);
     assert(flushedLSNInternal(sw) > LSN);
   }
 
+  pthread_mutex_lock(&sw->read_mutex);
+
   if(sw->global_offset > LSN) {
     // Return NULL; the caller read before the beginning of the log.
     DEBUG(stderr, "Log entry is before beginning of log!");
@@ -656,7 +770,7 @@ static int truncateLog_LogWriter(stasis_log_t* log, lsn_t LSN) {
   */
   pthread_mutex_lock(&sw->write_mutex);
 
-  fflush(sw->fp);
+  drainLocked(sw);
 
   lh = getLSNHandle(log, LSN);
   lsn_t lengthOfCopiedLog = 0;
@@ -724,7 +838,7 @@ static int truncateLog_LogWriter(stasis_log_t* log, lsn_t LSN) {
      don't want, so we basicly re-implement closeLogWriter and
      openLogWriter here...
   */
-  fclose(sw->fp);
+  close(sw->fd);
   close(sw->ro_fd);
 
   lsn_t tmpLen = myFseek(tmpLog, 0, SEEK_END);
@@ -754,29 +868,24 @@ static int truncateLog_LogWriter(stasis_log_t* log, lsn_t LSN) {
     fflush(stdout);
   }
 
-  int logFD = open(sw->filename, sw->filemode, sw->fileperm);
+  int logFD = open(sw->filename, sw->filemode & ~O_APPEND, sw->fileperm);
 
   if(logFD == -1) {
     perror("Couldn't open log file for append.\n");
     abort();
   }
-  sw->fp = fdopen(logFD, "w+");
-
-  if (sw->fp==NULL) {
-    pthread_mutex_unlock(&sw->read_mutex);
-    pthread_mutex_unlock(&sw->write_mutex);
-    pthread_mutex_unlock(&sw->truncate_mutex);
-
-    perror("Couldn't reopen log after truncate");
-    abort();
-    return LLADD_IO_ERROR;
-  }
-
-  setbuffer(sw->fp, sw->buffer, stasis_log_file_write_buffer_size);
 
+  // The flusher is idle (drainLocked), and nothing can be appended until we release write_mutex.
+  pthread_mutex_lock(&sw->flush_mutex);
+  sw->fd = logFD;
   sw->global_offset = LSN - sizeof(lsn_t);
+  // The crc entry was appended to the scratch file, which has been forced.
+  sw->buffer_lsn = sw->nextAvailableLSN;
+  sw->written_lsn = sw->nextAvailableLSN;
+  sw->synced_lsn = sw->nextAvailableLSN;
+  pthread_mutex_unlock(&sw->flush_mutex);
 
-  lsn_t logPos = myFseek(sw->fp, 0, SEEK_END);
+  lsn_t logPos = lseek(sw->fd, 0, SEEK_END);
   if(logPos != sw->nextAvailableLSN - sw->global_offset) {
     if(logPos == -1) {
       perror("Truncation couldn't seek");
@@ -808,7 +917,7 @@ static int truncateLog_LogWriter(stasis_log_t* log, lsn_t LSN) {
 static lsn_t firstLogEntry_LogWriter(stasis_log_t* log) {
   stasis_log_safe_writes_state* sw = (stasis_log_safe_writes_state*)log->impl;
 
-  assert(sw->fp);
+  assert(sw->fd != -1);
   pthread_mutex_lock(&sw->read_mutex); // for global offset...
   lsn_t ret = sw->global_offset + sizeof(lsn_t);
   pthread_mutex_unlock(&sw->read_mutex);
@@ -858,37 +967,22 @@ stasis_log_t* stasis_log_safe_writes_open(const char * filename,
   memcpy(log,&proto, sizeof(proto));
   log->impl = sw;
 
-  sw->buffer = stasis_calloc(stasis_log_file_write_buffer_size, char);
+  sw->buffer[0] = stasis_malloc(stasis_log_file_write_buffer_size, byte);
+  sw->buffer[1] = stasis_malloc(stasis_log_file_write_buffer_size, byte);
 
-  if(!sw->buffer) { return 0; /*LLADD_NO_MEM;*/ }
+  if(!sw->buffer[0] || !sw->buffer[1]) { return 0; /*LLADD_NO_MEM;*/ }
 
-  /* The file is opened twice for a reason.  fseek() seems to call
-     fflush() under Linux, which normally would be a minor problem.
-     However, we open the log with O_SYNC, so the fflush() results in
-     synchronous disk writes.  Therefore, all read accesses (and
-     therefore all seeks) run through the second descriptor.  */
+  /* The file is opened twice for a reason.  The flusher writes to the
+     first descriptor with pwrite(), at explicit offsets.  Reads use
+     lseek() and read(), so they run through the second descriptor.
+     (O_APPEND would make pwrite() ignore its offset.) */
 
-  int logFD;
-  logFD = open(sw->filename, sw->filemode, sw->fileperm);
-  if(logFD == -1) {
+  sw->fd = open(sw->filename, sw->filemode & ~O_APPEND, sw->fileperm);
+  if(sw->fd == -1) {
     perror("Couldn't open log file for append.\n");
     abort();
   }
-  sw->fp = fdopen(logFD, "w+");
-
-  if (sw->fp==NULL) {
-    perror("Couldn't open log file");
-    abort();
-    return 0; //LLADD_IO_ERROR;
-  }
-
-  /* Increase the length of log's buffer, since it's in O_SYNC mode. */
-  setbuffer(sw->fp, sw->buffer, stasis_log_file_write_buffer_size);
 
-  /* fread() doesn't notice when another handle writes to its file,
-     even if fflush() is used to push the changes out to disk.
-     Therefore, we use a file descriptor, and read() instead of a FILE
-     and fread(). */
   sw->ro_fd = open(sw->filename, O_RDONLY, 0);
 
   if(sw->ro_fd == -1) {
@@ -902,26 +996,23 @@ stasis_log_t* stasis_log_safe_writes_open(const char * filename,
   pthread_mutex_init(&sw->write_mutex, NULL);
   pthread_mutex_init(&sw->nextAvailableLSN_mutex, NULL);
   pthread_mutex_init(&sw->truncate_mutex, NULL);
+  pthread_mutex_init(&sw->flush_mutex, NULL);
+  pthread_cond_init(&sw->flush_needed, NULL);
+  pthread_cond_init(&sw->flush_done, NULL);
+  pthread_cond_init(&sw->buffer_free, NULL);
 
   sw->flushedLSN_wal = 0;
   sw->flushedLSN_commit = 0;
-  sw->flushedLSN_internal = 0;
   sw->minPending = stasis_aggregate_min_init(0);
-  /*
-    Seek append only log to the end of the file.  This is unnecessary,
-    since the file was opened in append only mode, but it returns the
-    length of the file.
-  */
 
-  if (myFseek(sw->fp, 0, SEEK_END)==0) {
+  if (lseek(sw->fd, 0, SEEK_END)==0) {
     /*if file is empty, write an LSN at the 0th position.  LSN 0 is
       invalid, and this prevents us from using it.  Also, the LSN at
       this position is used after log truncation to store the
       global offset for the truncated log.
     */
     sw->global_offset = 0;
-    size_t nmemb = fwrite(&sw->global_offset, sizeof(lsn_t), 1, sw->fp);
-    if(nmemb != 1) {
+    if(pwrite(sw->fd, &sw->global_offset, sizeof(lsn_t), 0) != sizeof(lsn_t)) {
       perror("Couldn't start new log file!");
       return 0; //LLADD_IO_ERROR;
     }
@@ -952,23 +1043,27 @@ stasis_log_t* stasis_log_safe_writes_open(const char * filename,
   // find first lsn after last valid crc.
   sw->nextAvailableLSN = log_crc_next_lsn(log, sw->nextAvailableLSN);
 
-  if(ftruncate(fileno(sw->fp), sw->nextAvailableLSN-sw->global_offset) == -1) {
+  if(ftruncate(sw->fd, sw->nextAvailableLSN-sw->global_offset) == -1) {
     perror("Couldn't discard junk at end of log");
   }
 
-  // If there was trailing garbage at the end of the log, overwrite it.
-  if(myFseek(sw->fp, sw->nextAvailableLSN-sw->global_offset, SEEK_SET)
-     != sw->nextAvailableLSN-sw->global_offset) {
-    perror("Error repositioning log");
-    abort();
-  }
-
   // Reset log_crc to zero (nextAvailableLSN immediately follows a crc entry).
   sw->crc = 0;
 
   sw->flushedLSN_wal      = sw->nextAvailableLSN;
   sw->flushedLSN_commit   = sw->nextAvailableLSN;
-  sw->flushedLSN_internal = sw->nextAvailableLSN;
+
+  sw->cur = 0;
+  sw->buffer_lsn = sw->nextAvailableLSN;
+  sw->buffer_len = 0;
+  sw->buffer_full = 0;
+  sw->flushing = 0;
+  sw->written_lsn = sw->nextAvailableLSN;
+  sw->synced_lsn = sw->nextAvailableLSN;
+  sw->request_lsn = sw->nextAvailableLSN;
+  sw->sync_request_lsn = sw->nextAvailableLSN;
+  sw->shutdown = 0;
+  pthread_create(&sw->flusher, 0, flusher_LogWriter, sw);
 
   return log;
 }
@@ -303,7 +303,7 @@ recordid Talloc(int xid, unsigned long size) {
 
   Page * p = loadPage(xid, alloc->lastFreepage);
 
-  writelock(p->rwlatch, 0);
+  stasis_page_writelock(p);
   int rec_size = stasis_record_type_to_size(type);
   if(rec_size < 4) { rec_size = 4; }
   while(stasis_record_freespace(xid, p) < rec_size) {
@@ -314,7 +314,7 @@ recordid Talloc(int xid, unsigned long size) {
       break;
     }
 
-    unlock(p->rwlatch);
+    stasis_page_writeunlock(p);
     stasis_allocation_policy_update_freespace(alloc->allocPolicy, pageid, newFreespace);
     releasePage(p);
 
@@ -330,7 +330,7 @@ recordid Talloc(int xid, unsigned long size) {
     alloc->lastFreepage = pageid;
 
     p = loadPage(xid, alloc->lastFreepage);
-    writelock(p->rwlatch, 0);
+    stasis_page_writelock(p);
   }
 
   rid = stasis_record_alloc_begin(xid, p, type);
@@ -341,7 +341,7 @@ recordid Talloc(int xid, unsigned long size) {
   int newFreespace = stasis_record_freespace(xid, p);
   stasis_allocation_policy_alloced_from_page(alloc->allocPolicy, xid, pageid);
   stasis_allocation_policy_update_freespace(alloc->allocPolicy, pageid, newFreespace);
-  unlock(p->rwlatch);
+  stasis_page_writeunlock(p);
 
   alloc_arg a = { rid.slot, type };
 
@@ -377,14 +377,14 @@ recordid TallocFromPage(int xid, pageid_t page, unsigned long size) {
     return NULLRID;
   }
   Page * p = loadPage(xid, page);
-  writelock(p->rwlatch,0);
+  stasis_page_writelock(p);
   recordid rid = stasis_record_alloc_begin(xid, p, type);
 
 
   if(rid.size != INVALID_SLOT) {
     stasis_record_alloc_done(xid,p,rid);
     stasis_allocation_policy_alloced_from_page(alloc->allocPolicy, xid, page);
-    unlock(p->rwlatch);
+    stasis_page_writeunlock(p);
 
     alloc_arg a = { rid.slot, type };
 
@@ -395,7 +395,7 @@ recordid TallocFromPage(int xid, pageid_t page, unsigned long size) {
       stasis_blob_alloc(xid,rid);
     }
   } else {
-    unlock(p->rwlatch);
+    stasis_page_writeunlock(p);
   }
 
   releasePage(p);
@@ -167,7 +167,7 @@ int TbtreeInsert(int xid, recordid rid, void *cmp_arg, byte *key, size_t keySize
   slotid_t slot = stasis_btree_helper(xid, h, key, keySize, &found, &path, btree_comparators[h.cmp_id], cmp_arg);
   recordid slotrid = {path[h.height-1], slot, 0};
   Page *p = loadPage(xid, slotrid.page);
-  writelock(p->rwlatch,0);
+  stasis_page_writelock(p);
   if(found) {
     // delete old value
     stasis_record_free(xid, p, slotrid);
@@ -185,7 +185,7 @@ int TbtreeInsert(int xid, recordid rid, void *cmp_arg, byte *key, size_t keySize
     pageid_t rightpage = TpageAlloc(xid);
     TinitializeSlottedPage(xid, rightpage);
     Page * rightp = loadPage(xid, rightpage);
-    writelock(rightp->rwlatch,0);
+    stasis_page_writelock(rightp);
     const recordid lastrid = stasis_record_last(xid, p);
     for(slotid_t i = lastrid.slot / 2; i <= lastrid.slot; i++) {
       recordid leftrid = {p->id, i, 0};
@@ -211,7 +211,7 @@ int TbtreeInsert(int xid, recordid rid, void *cmp_arg, byte *key, size_t keySize
       slotrid.slot = p->id;
       newrid = stasis_record_alloc_begin(xid, p, sz);
     }
-    unlock(rightp->rwlatch);
+    stasis_page_writeunlock(rightp);
     releasePage(rightp);
     int next_to_split = h.height - 2;  // h.height-1 is the offset of the leaf, which we just split.
     while(next_to_split >= 0) {
@@ -229,7 +229,7 @@ int TbtreeInsert(int xid, recordid rid, void *cmp_arg, byte *key, size_t keySize
   stasis_record_splice(xid, p, slotrid.slot, newrid.slot);
   DEBUG("created new record: %lld %d -> %d %d\n", newrid.page, newrid.slot, slotrid.slot, newrid.size);
   free(path);
-  unlock(p->rwlatch);
+  stasis_page_writeunlock(p);
   releasePage(p);
   return found;
 }
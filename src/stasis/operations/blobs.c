@@ -109,7 +109,8 @@ page_impl stasis_page_blob_impl(void) {
       0, //XXX page_impl_dereference_identity,
       stasis_page_blob_loaded,
       stasis_page_blob_flushed,
-      stasis_page_blob_cleanup
+      stasis_page_blob_cleanup,
+      0 //recordReadOptimistic
   };
   return pi;
 }
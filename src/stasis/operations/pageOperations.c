@@ -218,7 +218,7 @@ static int op_init_multipage_impl(const LogEntry *e, Page *ignored) {
   for(pageid_t i = 0; i < arg->numPages; i++) {
     Page * p = loadPage(e->xid, arg->firstPage + i);
     if(stasis_operation_multi_should_apply(e, p)) {
-      writelock(p->rwlatch, 0);
+      stasis_page_writelock(p);
       if(arg->recordSize == 0) {
         stasis_page_slotted_initialize_page(p);
       } else if(arg->recordSize == BLOB_SLOT) {
@@ -229,7 +229,7 @@ static int op_init_multipage_impl(const LogEntry *e, Page *ignored) {
                                      (stasis_record_type_to_size(arg->recordSize)));
       }
       stasis_page_lsn_write(e->xid, p, e->LSN);
-      unlock(p->rwlatch);
+      stasis_page_writeunlock(p);
     }
     releasePage(p);
   }
@@ -158,9 +158,9 @@ void regionsInit(stasis_log_t *log) {
     // flush the page, since this code is deterministic, and will be
     // re-run before recovery if this update doesn't make it to disk
     // after a crash.
-    writelock(p->rwlatch,0);
+    stasis_page_writelock(p);
     alloc_boundary_tag(-1, p, &t);
-    unlock(p->rwlatch);
+    stasis_page_writeunlock(p);
   }
   holding_mutex = 0;
   releasePage(p);
@@ -70,7 +70,7 @@ static ssize_t read_write_helper(int read, int xid, lsn_t lsn, byte* buf, size_t
 
   // copy the last page (if necessary)
   if(start != stop) {
-    p = loadPage(xid, stop);
+    p = loadPageOfType(xid, stop, SEGMENT_PAGE);
     if(read) { readlock(p->rwlatch, 0); } else { writelock(p->rwlatch,0); }
     user_buf = buf + buf_phase + (n * PAGE_SIZE);
     page_buf = p->memAddr;
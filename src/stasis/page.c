@@ -71,6 +71,7 @@ terms specified in this license.
 #include <stasis/util/latches.h>
 #include <stasis/page.h>
 #include <stasis/constants.h>
+#include <stasis/flags.h>
 #include <stasis/operations/blobs.h>
 #include <stasis/lockManager.h>
 #include <stasis/page/slotted.h>
@@ -80,6 +81,7 @@ terms specified in this license.
 #include <stasis/operations/arrayList.h>
 #include <stasis/bufferPool.h>
 #include <stasis/truncation.h>
+#include <stasis/util/crc32.h>
 
 #include <assert.h>
 
@@ -160,6 +162,20 @@ int stasis_record_read(int xid, Page * p, recordid rid, byte *buf) {
 
   return 0;
 }
+int stasis_record_read_optimistic(int xid, Page * p, recordid rid, byte *buf) {
+  if(!stasis_page_optimistic_reads) { return 1; }
+  uint64_t version = stasis_page_read_begin_optimistic(p);
+  if(version & 1) { return 1; }
+  int page_type = __atomic_load_n(&p->pageType, __ATOMIC_RELAXED);
+  if(page_type <= 0 || page_type >= MAX_PAGE_TYPE
+     || !page_impls[page_type].recordReadOptimistic
+     || rid.page != p->id || rid.size < 0 || rid.size > BLOB_THRESHOLD_SIZE) {
+    return 1;
+  }
+  int ret = page_impls[page_type].recordReadOptimistic(xid, p, rid, buf);
+  if(!stasis_page_read_validate_optimistic(p, version)) { return 1; }
+  return ret;
+}
 /**
    @todo stasis_record_dereference should dispatch via page_impl...
  */
@@ -287,7 +303,7 @@ void stasis_uninitialized_page_loaded(int xid, Page * p) {
 }
 void stasis_page_loaded(Page * p, pagetype_t type){
   assert(type != UNINITIALIZED_PAGE);
-  p->pageType = (type == UNKNOWN_TYPE_PAGE) ? *stasis_page_type_ptr(p) : type;
+  p->pageType = (type == UNKNOWN_TYPE_PAGE) ? stasis_page_type_from_word(*stasis_page_type_cptr(p)) : type;
   assert(page_impls[p->pageType].page_type == p->pageType);  // XXX unsafe; what if the page has no header?
   if(page_impls[p->pageType].has_header) {
     p->LSN = *stasis_page_lsn_cptr(p);
@@ -316,6 +332,37 @@ void stasis_page_flushed(Page * p){
   }
   if(page_impls[type].pageFlushed) page_impls[type].pageFlushed(p);
 }
+static int stasis_page_has_checksum(pagetype_t type) {
+  return type >= 0 && type < MAX_PAGE_TYPE
+    && page_impls[type].page_type == type && page_impls[type].has_header;
+}
+/**
+   Checksum the page as stasis_page_flushed() left it, with only the type
+   in its type word.  The page id catches misdirected writes.
+*/
+static uint32_t stasis_page_checksum(const byte * buf, pageid_t pageid) {
+  const byte * word = (const byte*)stasis_mempage_type_cptr(buf);
+  const byte * rest = word + sizeof(int);
+  int type = stasis_page_type_from_word(*stasis_mempage_type_cptr(buf));
+  uint32_t crc = stasis_crc32c(&pageid, sizeof(pageid), (uint32_t)-1);
+  crc = stasis_crc32c(buf, word - buf, crc);
+  crc = stasis_crc32c(&type, sizeof(type), crc);
+  crc = ~stasis_crc32c(rest, buf + PAGE_SIZE - rest, crc);
+  crc &= 0xffffff;
+  return crc ? crc : 1; // zero means "no checksum"
+}
+void stasis_page_checksum_update(Page * p) {
+  if(!stasis_page_checksums || !stasis_page_has_checksum(p->pageType)) { return; }
+  assert(*stasis_page_type_cptr(p) == p->pageType);
+  uint32_t crc = stasis_page_checksum(p->memAddr, p->id);
+  *stasis_page_type_ptr(p) = (int)((uint32_t)p->pageType | (crc << 8));
+}
+int stasis_page_checksum_check(const byte * buf, pageid_t pageid, pagetype_t type) {
+  uint32_t stored = (uint32_t)*stasis_mempage_type_cptr(buf) >> 8;
+  if(!stasis_page_checksums || !stored) { return 0; }
+  if(!stasis_page_has_checksum(type == UNKNOWN_TYPE_PAGE ? stasis_page_type_from_word(*stasis_mempage_type_cptr(buf)) : type)) { return 0; }
+  return stasis_page_checksum(buf, pageid) != stored;
+}
 void stasis_page_cleanup(Page * p) {
   short type = p->pageType;
   assert(page_impls[type].page_type == type);
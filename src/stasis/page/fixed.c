@@ -40,6 +40,16 @@ static inline byte* stasis_page_fixed_write(int xid, Page *p, recordid rid) {
   return stasis_page_fixed_record_ptr(p, rid.slot);
 }
 
+static int stasis_page_fixed_read_optimistic(int xid, Page *p, recordid rid, byte *buf) {
+  int16_t size  = __atomic_load_n(stasis_page_fixed_recordsize_cptr(p), __ATOMIC_RELAXED);
+  int16_t count = __atomic_load_n(stasis_page_fixed_recordcount_cptr(p), __ATOMIC_RELAXED);
+  if(size <= 0 || size != rid.size || rid.slot < 0 || rid.slot >= count
+     || rid.slot >= stasis_page_fixed_records_per_page(size)) {
+    return 1;
+  }
+  memcpy(buf, stasis_page_fixed_record_cptr(p, rid.slot), size);
+  return 0;
+}
 
 static int stasis_page_fixed_get_length_record(int xid, Page *p, recordid rid) {
   assert(p->pageType);
@@ -142,7 +152,8 @@ page_impl stasis_page_fixed_impl(void) {
     0, // XXX dereference
     stasis_page_fixed_loaded,
     stasis_page_fixed_flushed,
-    stasis_page_fixed_cleanup
+    stasis_page_fixed_cleanup,
+    stasis_page_fixed_read_optimistic
   };
   return pi;
 }
@@ -153,6 +164,7 @@ page_impl stasis_page_fixed_impl(void) {
 page_impl stasis_page_array_list_impl(void) {
   page_impl pi = stasis_page_fixed_impl();
   pi.page_type = ARRAY_LIST_PAGE;
+  pi.recordReadOptimistic = 0; // records must be dereferenced first
   return pi;
 }
 
@@ -37,6 +37,7 @@ static page_impl pi =  {
     0,
     0,
     0,
+    0,
     0
   };
   return pi;
@@ -46,6 +46,21 @@ static const byte* slottedRead (int xid, Page *p, recordid rid) {
 static byte* slottedWrite(int xid, Page *p, recordid rid) {
   return stasis_page_slotted_record_ptr(p, rid.slot);
 }
+static int slottedReadOptimistic(int xid, Page *p, recordid rid, byte *buf) {
+  int16_t numslots = __atomic_load_n(stasis_page_slotted_numslots_cptr(p), __ATOMIC_RELAXED);
+  if(rid.slot < 0 || rid.slot >= numslots
+     || numslots * SLOTTED_PAGE_OVERHEAD_PER_RECORD >= USABLE_SIZE_OF_PAGE) {
+    return 1;
+  }
+  int16_t offset = __atomic_load_n(stasis_page_slotted_slot_cptr(p, rid.slot), __ATOMIC_RELAXED);
+  int16_t length = __atomic_load_n(stasis_page_slotted_slot_length_cptr(p, rid.slot), __ATOMIC_RELAXED);
+  // Negative offsets are free slots; negative lengths are special slot types, such as blobs.
+  if(offset < 0 || length < 0 || length != rid.size || (size_t)(offset + length) > USABLE_SIZE_OF_PAGE) {
+    return 1;
+  }
+  memcpy(buf, p->memAddr + offset, length);
+  return 0;
+}
 static int slottedGetType(int xid, Page *p, recordid rid) {
   return stasis_page_slotted_get_type(p, rid.slot);
 }
@@ -180,7 +195,8 @@ static page_impl pi =  {
     0, //XXX page_impl_dereference_identity,
     slottedLoaded,
     slottedFlushed,
-    slottedCleanup
+    slottedCleanup,
+    slottedReadOptimistic
   };
   return pi;
 }
@@ -49,7 +49,8 @@ page_impl stasis_page_uninitialized_impl(void) {
     0, // XXX dereference
     uninitializedLoaded, // loaded
     uninitializedFlushed, // flushed
-    uninitializedCleanup
+    uninitializedCleanup,
+    0 // readOptimistic
   };
   return pi;
 }
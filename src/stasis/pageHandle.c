@@ -1,9 +1,14 @@
 #include <stasis/flags.h>
 #include <stasis/pageHandle.h>
+#include <stasis/bufferPool.h>
+#include <stasis/util/time.h>
 
 #include <assert.h>
 #include <errno.h>
 #include <stdio.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 /**
     @todo Make sure this doesn't need to be atomic.  (It isn't!) Can
     we get in trouble by setting the page clean after it's written
@@ -16,6 +21,7 @@ static void phWrite(stasis_page_handle_t * ph, Page * ret) {
   // no further latching is necessary.
   if(!ret->dirty) { return; }
   stasis_page_flushed(ret);
+  stasis_page_checksum_update(ret);
   if(ph->log) { stasis_log_force(ph->log, ret->LSN, LOG_FORCE_WAL); }
   int err = impl->write(impl, PAGE_SIZE * ret->id, ret->memAddr, PAGE_SIZE);
   if(err) {
@@ -25,6 +31,69 @@ static void phWrite(stasis_page_handle_t * ph, Page * ret) {
   }
   stasis_dirty_page_table_set_clean(ph->dirtyPages, ret);
 }
+static void phWritePages(stasis_page_handle_t * ph, Page ** pages, int count) {
+  stasis_handle_t* impl = (stasis_handle_t*) (ph->impl);
+  pageid_t max_run = stasis_buffer_manager_write_coalesce_pages;
+  if(max_run < 1) { max_run = 1; }
+  byte * buf = NULL;
+  struct iovec * iov = NULL;
+  int i = 0;
+  while(i < count) {
+    if(!pages[i]->dirty) { i++; continue; }
+    int run = 1;
+    while(i + run < count && run < max_run && pages[i+run]->dirty
+          && pages[i+run]->id == pages[i]->id + run) { run++; }
+    if(run == 1) {
+      phWrite(ph, pages[i]);
+    } else {
+      lsn_t max_lsn = 0;
+      for(int j = 0; j < run; j++) {
+        stasis_page_flushed(pages[i+j]);
+        stasis_page_checksum_update(pages[i+j]);
+        if(pages[i+j]->LSN > max_lsn) { max_lsn = pages[i+j]->LSN; }
+      }
+      if(ph->log) { stasis_log_force(ph->log, max_lsn, LOG_FORCE_WAL); }
+      int err;
+      if(impl->writev) {
+        // Gather the frames directly; they are PAGE_SIZE aligned, so this
+        // works with O_DIRECT too.
+        if(!iov) { iov = stasis_malloc(max_run, struct iovec); }
+        for(int j = 0; j < run; j++) {
+          iov[j].iov_base = pages[i+j]->memAddr;
+          iov[j].iov_len = PAGE_SIZE;
+        }
+        err = impl->writev(impl, PAGE_SIZE * pages[i]->id, iov, run);
+      } else {
+        if(!buf) {
+          buf = stasis_buffer_pool_alloc_aligned(max_run * PAGE_SIZE);
+          assert(buf);
+        }
+        for(int j = 0; j < run; j++) {
+          memcpy(buf + j * PAGE_SIZE, pages[i+j]->memAddr, PAGE_SIZE);
+        }
+        err = impl->write(impl, PAGE_SIZE * pages[i]->id, buf, run * PAGE_SIZE);
+      }
+      if(err) {
+        printf("Couldn't write to page file: %s\n", strerror(err));
+        fflush(stdout);
+        abort();
+      }
+      for(int j = 0; j < run; j++) {
+        stasis_dirty_page_table_set_clean(ph->dirtyPages, pages[i+j]);
+      }
+    }
+    i += run;
+  }
+  stasis_buffer_pool_free_aligned(buf);
+  free(iov);
+}
+static void phCheckPage(Page * p, pagetype_t type) {
+  if(stasis_page_checksum_check(p->memAddr, p->id, type)) {
+    printf("Page %lld failed its checksum\n", (long long)p->id);
+    fflush(stdout);
+    abort();
+  }
+}
 static void phRead(stasis_page_handle_t * ph, Page * ret, pagetype_t type) {
   stasis_handle_t* impl = (stasis_handle_t*) (ph->impl);
   // The caller guarantees that we have exclusive access to the page, so
@@ -39,21 +108,74 @@ static void phRead(stasis_page_handle_t * ph, Page * ret, pagetype_t type) {
       fflush(stdout);
       abort();
     }
+  } else {
+    phCheckPage(ret, type);
   }
   assert(!ret->dirty);
   stasis_page_loaded(ret, type);
 }
+static void phReadPages(stasis_page_handle_t * ph, Page ** pages, int count, pagetype_t type) {
+  stasis_handle_t* impl = (stasis_handle_t*) (ph->impl);
+  byte * buf = NULL;
+  int buf_count = 0;
+  int i = 0;
+  while(i < count) {
+    int run = 1;
+    while(i + run < count && pages[i+run]->id == pages[i]->id + run) { run++; }
+    // Runs that extend past the end of the file are read one page at a
+    // time; phRead zero fills the missing pages.
+    if(run == 1 || (pages[i]->id + run) * PAGE_SIZE > impl->end_position(impl)) {
+      for(int j = 0; j < run; j++) {
+        phRead(ph, pages[i+j], type);
+      }
+    } else {
+      if(run > buf_count) {
+        // The handle may have been opened with O_DIRECT.
+        stasis_buffer_pool_free_aligned(buf);
+        buf = stasis_buffer_pool_alloc_aligned(run * PAGE_SIZE);
+        assert(buf);
+        buf_count = run;
+      }
+      int err = impl->read(impl, PAGE_SIZE * pages[i]->id, buf, run * PAGE_SIZE);
+      if(err) {
+        printf("Couldn't read from page file: %s\n", strerror(err));
+        fflush(stdout);
+        abort();
+      }
+      for(int j = 0; j < run; j++) {
+        memcpy(pages[i+j]->memAddr, buf + j * PAGE_SIZE, PAGE_SIZE);
+        phCheckPage(pages[i+j], type);
+        assert(!pages[i+j]->dirty);
+        stasis_page_loaded(pages[i+j], type);
+      }
+    }
+    i += run;
+  }
+  stasis_buffer_pool_free_aligned(buf);
+}
 static void phPrefetchRange(stasis_page_handle_t *ph, pageid_t pageid, pageid_t count) {
   stasis_handle_t* impl = (stasis_handle_t*) (ph->impl);
   // TODO RTFM and see if Linux provides a decent API for prefetch hints.
   lsn_t off = pageid * PAGE_SIZE;
   lsn_t len = count * PAGE_SIZE;
 
-  byte * buf = stasis_malloc(len, byte);
+  byte * buf = stasis_buffer_pool_alloc_aligned(len);
 
   impl->read(impl, off, buf, len);
 
-  free(buf);
+  stasis_buffer_pool_free_aligned(buf);
+}
+static pageid_t phPageCount(stasis_page_handle_t *ph) {
+  stasis_handle_t* impl = (stasis_handle_t*) (ph->impl);
+  return impl->end_position(impl) / PAGE_SIZE;
+}
+static void phEvict(stasis_page_handle_t *ph, Page * p) {
+  stasis_handle_t* impl = (stasis_handle_t*) (ph->impl);
+  assert(!p->dirty);
+  if(impl->admit) {
+    // Failing to admit the page is harmless; it will be read from the page file.
+    impl->admit(impl, PAGE_SIZE * p->id, p->memAddr, PAGE_SIZE);
+  }
 }
 static int phPreallocateRange(stasis_page_handle_t * ph, pageid_t pageid, pageid_t count) {
   stasis_handle_t* impl = (stasis_handle_t*) (ph->impl);
@@ -79,6 +201,7 @@ static void phForceRange(stasis_page_handle_t * ph, lsn_t start, lsn_t stop) {
 }
 static void phClose(stasis_page_handle_t * ph) {
   stasis_handle_t* impl = (stasis_handle_t*) (ph->impl);
+  if(ph->scrubber) { stasis_page_scrubber_close(ph->scrubber); }
   int err = impl->close(impl);
   DEBUG("Closing pageHandle\n");
   if(err) {
@@ -92,6 +215,7 @@ static stasis_page_handle_t * phDup(stasis_page_handle_t * ph, int is_sequential
   stasis_page_handle_t * ret = stasis_alloc(stasis_page_handle_t);
   stasis_handle_t* impl = (stasis_handle_t*) (ph->impl);
   memcpy(ret, ph, sizeof(*ret));
+  ret->scrubber = NULL;
   ret->impl = impl->dup(impl);
   stasis_handle_t* retimpl = (stasis_handle_t*)ret->impl;
   if(retimpl->error != 0) {
@@ -109,8 +233,12 @@ stasis_page_handle_t * stasis_page_handle_open(stasis_handle_t * handle,
   DEBUG("Using pageHandle implementation\n");
   stasis_page_handle_t * ret = stasis_alloc(stasis_page_handle_t);
   ret->write = phWrite;
+  ret->write_pages = phWritePages;
   ret->read  = phRead;
+  ret->read_pages = phReadPages;
   ret->prefetch_range = phPrefetchRange;
+  ret->page_count = phPageCount;
+  ret->evict = phEvict;
   ret->preallocate_range = phPreallocateRange;
   ret->force_file = phForce;
   ret->async_force_file = phAsyncForce;
@@ -119,9 +247,125 @@ stasis_page_handle_t * stasis_page_handle_open(stasis_handle_t * handle,
   ret->dup = phDup;
   ret->log = log;
   ret->dirtyPages = dpt;
+  ret->scrubber = NULL;
   ret->impl = handle;
+  if(stasis_page_checksums && stasis_page_scrubber_pages_per_second > 0) {
+    stasis_handle_t * h = handle->dup(handle);
+    if(h->error) {
+      fprintf(stderr, "Could not dup file handle for page scrubber: %s\n", strerror(h->error));
+      h->close(h);
+    } else {
+      ret->scrubber = stasis_page_scrubber_open(h, stasis_page_scrubber_pages_per_second);
+    }
+  }
   return ret;
 }
 stasis_page_handle_t* stasis_page_handle_default_factory(stasis_log_t *log, stasis_dirty_page_table_t *dpt) {
   return stasis_page_handle_open(stasis_handle_factory(), log, dpt);
 }
+
+/** Pages read by each of the scrubber's requests. */
+#define SCRUB_BATCH 32
+
+struct stasis_page_scrubber_t {
+  stasis_handle_t * h;
+  pageid_t pages_per_second;
+  pthread_t thread;
+  pthread_mutex_t mut;
+  pthread_cond_t cond;
+  int running;
+  stasis_page_scrubber_stats_t stats;
+};
+
+/**
+   A page failed verification, but it may have been read while it was
+   being written.  Read it a few more times before giving up on it.
+
+   @return 1 if the page is corrupt.
+*/
+static int scrubRecheck(stasis_page_scrubber_t * s, byte * buf, pageid_t pageid) {
+  for(int i = 0; i < 3; i++) {
+    struct timespec ts = { 0, 1000000 };
+    nanosleep(&ts, 0);
+    if(s->h->read(s->h, pageid * PAGE_SIZE, buf, PAGE_SIZE)) { return 0; }
+    if(!stasis_page_checksum_check(buf, pageid, UNKNOWN_TYPE_PAGE)) { return 0; }
+  }
+  return 1;
+}
+static void * scrubWorker(void * arg) {
+  stasis_page_scrubber_t * s = (stasis_page_scrubber_t*)arg;
+#ifdef SYS_gettid
+  // Linux applies nice values to individual threads.
+  setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#endif
+  byte * buf = stasis_buffer_pool_alloc_aligned(SCRUB_BATCH * PAGE_SIZE);
+  pageid_t next = 0;
+  pthread_mutex_lock(&s->mut);
+  while(s->running) {
+    pthread_mutex_unlock(&s->mut);
+    pageid_t end = s->h->end_position(s->h) / PAGE_SIZE;
+    pageid_t count = end - next < SCRUB_BATCH ? end - next : SCRUB_BATCH;
+    pageid_t checked = 0;
+    pageid_t corrupt = 0;
+    pageid_t last = INVALID_PAGE;
+    if(count > 0 && !s->h->read(s->h, next * PAGE_SIZE, buf, count * PAGE_SIZE)) {
+      for(pageid_t i = 0; i < count; i++) {
+        if(stasis_page_checksum_check(buf + i * PAGE_SIZE, next + i, UNKNOWN_TYPE_PAGE)
+           && scrubRecheck(s, buf + i * PAGE_SIZE, next + i)) {
+          fprintf(stderr, "Page scrubber: page %lld failed its checksum\n", (long long)(next + i));
+          corrupt++;
+          last = next + i;
+        }
+      }
+      checked = count;
+    }
+    if(count > 0) { next += count; }
+
+    pthread_mutex_lock(&s->mut);
+    s->stats.checked += checked;
+    s->stats.corrupt += corrupt;
+    if(corrupt) { s->stats.last_corrupt = last; }
+    if(next >= end) {
+      next = 0;
+      s->stats.passes++;
+    }
+    if(s->running) {
+      double delay = (count > 0 ? count : SCRUB_BATCH) / (double)s->pages_per_second;
+      struct timeval now;
+      gettimeofday(&now, 0);
+      struct timespec deadline = stasis_double_to_timespec(stasis_timeval_to_double(now) + delay);
+      pthread_cond_timedwait(&s->cond, &s->mut, &deadline);
+    }
+  }
+  pthread_mutex_unlock(&s->mut);
+  stasis_buffer_pool_free_aligned(buf);
+  return 0;
+}
+stasis_page_scrubber_t * stasis_page_scrubber_open(stasis_handle_t * handle, pageid_t pages_per_second) {
+  stasis_page_scrubber_t * s = stasis_alloc(stasis_page_scrubber_t);
+  s->h = handle;
+  s->pages_per_second = pages_per_second > 0 ? pages_per_second : 1;
+  pthread_mutex_init(&s->mut, 0);
+  pthread_cond_init(&s->cond, 0);
+  s->running = 1;
+  memset(&s->stats, 0, sizeof(s->stats));
+  s->stats.last_corrupt = INVALID_PAGE;
+  pthread_create(&s->thread, 0, scrubWorker, s);
+  return s;
+}
+void stasis_page_scrubber_stats(stasis_page_scrubber_t * s, stasis_page_scrubber_stats_t * stats) {
+  pthread_mutex_lock(&s->mut);
+  *stats = s->stats;
+  pthread_mutex_unlock(&s->mut);
+}
+void stasis_page_scrubber_close(stasis_page_scrubber_t * s) {
+  pthread_mutex_lock(&s->mut);
+  s->running = 0;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->mut);
+  pthread_join(s->thread, 0);
+  s->h->close(s->h);
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->mut);
+  free(s);
+}
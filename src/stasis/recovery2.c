@@ -21,6 +21,8 @@
 /** @todo Get rid of linkedlist */
 #include <stasis/util/linkedlist.h>
 #include <stasis/page.h> // Needed for pageReadLSN.
+#include <stasis/flags.h>
+#include <stasis/truncation.h>
 
 #include <stdio.h>
 #include <assert.h>
@@ -33,6 +35,92 @@ static LinkedList * rollbackLSNs = NULL;
     from concurrent modifications. */
 static pthread_mutex_t rollback_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/**
+   What recovery learned from the most recent checkpoint.  If there is
+   no usable checkpoint, start_lsn is the truncation point, and
+   begin_lsn is zero, so that everything is redone.
+*/
+typedef struct {
+  /** Analysis and redo start here. */
+  lsn_t start_lsn;
+  /** Entries before this LSN are reflected in pages. */
+  lsn_t begin_lsn;
+  /** The pages that were dirty at begin_lsn, sorted by page id. */
+  CheckpointDirtyPage * pages;
+  pageid_t page_count;
+} stasis_recovery_checkpoint_t;
+
+static stasis_recovery_checkpoint_t checkpoint;
+
+static int stasis_recovery_cmp_dirty_page(const void * ap, const void * bp) {
+  const CheckpointDirtyPage * a = (const CheckpointDirtyPage *)ap;
+  const CheckpointDirtyPage * b = (const CheckpointDirtyPage *)bp;
+  return a->page < b->page ? -1 : (a->page > b->page ? 1 : 0);
+}
+/**
+   Find the most recent checkpoint, and work out where recovery should
+   start.  The checkpoint is ignored if it has been truncated away, or
+   if its LSN does not point to a checkpoint entry.
+
+   Analysis needs to see every entry of the transactions that were
+   active at begin_lsn, and redo needs to see every update that may not
+   have reached disk, so recovery starts at the oldest recLSN in either
+   table.  That is usually far later than the truncation point.
+*/
+static void stasis_recovery_load_checkpoint(stasis_log_t* log) {
+  lsn_t truncation_point = log->truncation_point(log);
+  checkpoint.start_lsn = truncation_point;
+  checkpoint.begin_lsn = 0;
+  checkpoint.pages = NULL;
+  checkpoint.page_count = 0;
+
+  char * name = stasis_truncation_checkpoint_file_name();
+  if(!name) { return; }
+  FILE * f = fopen(name, "r");
+  free(name);
+  if(!f) { return; }
+  lsn_t lsn;
+  int ok = (fread(&lsn, sizeof(lsn), 1, f) == 1);
+  fclose(f);
+  if(!ok || lsn < truncation_point || lsn >= log->next_available_lsn(log)) { return; }
+
+  const LogEntry * e = log->read_entry(log, lsn);
+  if(!e) { return; }
+  if(e->LSN == lsn && e->type == CHECKPOINTLOG) {
+    const CheckpointLogEntry * cp = getCheckpoint(e);
+    lsn_t start = cp->begin_lsn;
+
+    checkpoint.begin_lsn = cp->begin_lsn;
+    checkpoint.page_count = cp->page_count;
+    checkpoint.pages = stasis_malloc(cp->page_count + 1, CheckpointDirtyPage);
+    memcpy(checkpoint.pages, getCheckpointDirtyPages(e), cp->page_count * sizeof(CheckpointDirtyPage));
+    qsort(checkpoint.pages, checkpoint.page_count, sizeof(CheckpointDirtyPage), stasis_recovery_cmp_dirty_page);
+    for(pageid_t i = 0; i < checkpoint.page_count; i++) {
+      if(checkpoint.pages[i].rec_lsn < start) { start = checkpoint.pages[i].rec_lsn; }
+    }
+    const CheckpointTransaction * xacts = getCheckpointTransactions(e);
+    for(int64_t i = 0; i < cp->xact_count; i++) {
+      if(xacts[i].rec_lsn != INVALID_LSN && xacts[i].rec_lsn < start) { start = xacts[i].rec_lsn; }
+    }
+    // Anything older than the truncation point was already written back.
+    checkpoint.start_lsn = start > truncation_point ? start : truncation_point;
+    DEBUG("Recovery: Checkpoint at %lld; starting at %lld instead of %lld\n",
+          (long long)lsn, (long long)checkpoint.start_lsn, (long long)truncation_point);
+  }
+  log->read_entry_done(log, e);
+}
+/**
+   @return 0 if the checkpoint shows that the page already reflects the
+   entry at lsn, 1 if the entry must be redone.
+*/
+static int stasis_recovery_needs_redo(pageid_t page, lsn_t lsn) {
+  if(lsn >= checkpoint.begin_lsn) { return 1; }
+  CheckpointDirtyPage key = { page, 0 };
+  const CheckpointDirtyPage * dirty = (const CheckpointDirtyPage *)bsearch(&key,
+      checkpoint.pages, checkpoint.page_count, sizeof(CheckpointDirtyPage), stasis_recovery_cmp_dirty_page);
+  return dirty && lsn >= dirty->rec_lsn;
+}
+
 /**
     Determines which transactions committed, and which need to be redone.
 
@@ -55,7 +143,7 @@ static void stasis_recovery_analysis(stasis_log_t* log, stasis_transaction_table
 
   const LogEntry * e;
 
-  LogHandle* lh = getLogHandle(log);
+  LogHandle* lh = getLSNHandle(log, checkpoint.start_lsn);
 
   while((e = nextInLog(lh))) {
 
@@ -126,6 +214,7 @@ static void stasis_recovery_analysis(stasis_log_t* log, stasis_transaction_table
       addSortedVal(&rollbackLSNs, e->LSN);
       break; // XXX check to see if the xact exists?
     case INTERNALLOG:
+    case CHECKPOINTLOG:
       // Created by the logger, just ignore it
       // Make sure the log entry doesn't interfere with real xacts.
       assert(e->xid == INVALID_XID);
@@ -155,13 +244,13 @@ static void stasis_recovery_analysis(stasis_log_t* log, stasis_transaction_table
  */
 
 static void stasis_recovery_redo(stasis_log_t* log, stasis_transaction_table_t * tbl) {
-  LogHandle* lh = getLogHandle(log);
+  LogHandle* lh = getLSNHandle(log, checkpoint.start_lsn);
   const LogEntry  * e;
 
   DEBUG("Recovery: Redo\n");
 
   while((e = nextInLog(lh))) {
-    if(e->type != INTERNALLOG) {
+    if(e->type != INTERNALLOG && e->type != CHECKPOINTLOG) {
       stasis_transaction_table_roll_forward(tbl, e->xid, e->LSN, e->prevLSN);
     }
     // Check to see if this entry's action needs to be redone
@@ -171,12 +260,14 @@ static void stasis_recovery_redo(stasis_log_t* log, stasis_transaction_table_t *
         // this entry specifies a logical undo operation; ignore it.
       } else if(e->update.page == SEGMENT_PAGEID || e->update.page == MULTI_PAGEID) {
         stasis_operation_redo(e,0);
+      } else if(!stasis_recovery_needs_redo(e->update.page, e->LSN)) {
+        // The page was written back after this update; don't bother reading it.
       } else {
         Page * p = loadPageForOperation(e->xid, e->update.page, e->update.funcID);
-        if(p) writelock(p->rwlatch,0);
+        if(p) stasis_page_writelock(p);
         stasis_operation_redo(e,p);
         if(p) {
-          unlock(p->rwlatch);
+          stasis_page_writeunlock(p);
           releasePage(p);
         }
       }
@@ -189,15 +280,18 @@ static void stasis_recovery_redo(stasis_log_t* log, stasis_transaction_table_t *
       if(-1 != ce->LSN) {
         if(ce->update.page == INVALID_PAGE) {
           // logical redo of end of NTA; no-op
+        } else if(ce->update.page != SEGMENT_PAGEID && ce->update.page != MULTI_PAGEID
+                  && !stasis_recovery_needs_redo(ce->update.page, e->LSN)) {
+          // already written back
         } else {
           // need to grab latch page here so that Tabort() can be atomic
           // below...
 
           Page * p = loadPageForOperation(e->xid, ce->update.page, ce->update.funcID);
-          if(p) writelock(p->rwlatch,0);
+          if(p) stasis_page_writelock(p);
           stasis_operation_undo(ce, e->LSN, p);
           if(p) {
-            unlock(p->rwlatch);
+            stasis_page_writeunlock(p);
             releasePage(p);
           }
         }
@@ -225,6 +319,8 @@ static void stasis_recovery_redo(stasis_log_t* log, stasis_transaction_table_t *
     } break;
     case INTERNALLOG: {
     } break;
+    case CHECKPOINTLOG: {
+    } break;
     case XPREPARE: {
     } break;
     default: {
@@ -275,7 +371,7 @@ static void stasis_recovery_undo(stasis_log_t* log, stasis_transaction_table_t *
             // otherwise, there's a race where the page's LSN is
             // updated before we undo.
             Page* p = loadPageForOperation(e->xid, e->update.page, e->update.funcID);
-            if(p) writelock(p->rwlatch,0);
+            if(p) stasis_page_writelock(p);
 
             // Log a CLR for this entry
             lsn_t clr_lsn = stasis_log_write_clr(log, e);
@@ -285,7 +381,7 @@ static void stasis_recovery_undo(stasis_log_t* log, stasis_transaction_table_t *
             stasis_operation_undo(e, clr_lsn, p);
 
             if(p) {
-              unlock(p->rwlatch);
+              stasis_page_writeunlock(p);
               releasePage(p);
             }
 
@@ -344,6 +440,7 @@ static void stasis_recovery_undo(stasis_log_t* log, stasis_transaction_table_t *
 void stasis_recovery_initiate(stasis_log_t* log, stasis_transaction_table_t * tbl, stasis_alloc_t * alloc) {
   stasis_buffer_manager_set_redo_mode(1);
   transactionLSN = lhcreate(64);
+  stasis_recovery_load_checkpoint(log);
   DEBUG("Analysis started\n");
   stasis_recovery_analysis(log, tbl);
   DEBUG("Redo started\n");
@@ -366,6 +463,9 @@ void stasis_recovery_initiate(stasis_log_t* log, stasis_transaction_table_t * tb
 
   destroyList(&rollbackLSNs);
   assert(rollbackLSNs==0);
+
+  free(checkpoint.pages);
+  checkpoint.pages = NULL;
 }
 
 
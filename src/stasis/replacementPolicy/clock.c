@@ -14,7 +14,9 @@
  * not evict pages that have been pinned by the calling thread.
  *
  * This module does not use mutexes, and instead uses atomic instructions
- * such as test and set.
+ * such as test and set.  Hits and inserts only store to the page that
+ * was touched, so there is no shared state on the page pinning path; the
+ * clock hand is only advanced by threads that are looking for a victim.
  *
  * States (Stored in p->queue):
  *
@@ -29,10 +31,16 @@
 #include <stasis/util/latches.h>
 #include <stasis/replacementPolicy.h>
 #include <stasis/page.h>
+#define CLOCK_CACHE_LINE_SIZE 64
+
 typedef struct {
-  uint64_t ptr;
   Page * pages;
   uint64_t page_count;
+  /* Every evicting thread increments ptr.  Keep it off of the cache line
+     that holds pages and page_count, which are read on every probe. */
+  char pad[CLOCK_CACHE_LINE_SIZE - sizeof(Page*) - sizeof(uint64_t)];
+  uint64_t ptr;
+  char pad2[CLOCK_CACHE_LINE_SIZE - sizeof(uint64_t)];
 } stasis_replacement_policy_clock_t;
 
 static void  clockDeinit  (struct replacementPolicy* impl) {
@@ -41,7 +49,11 @@ static void  clockDeinit  (struct replacementPolicy* impl) {
   free(impl);
 }
 static void  clockHit     (struct replacementPolicy* impl, Page* page) {
-  page->next = (Page*)1;
+  // Hot pages are hit over and over; don't dirty their cache line if the
+  // bit is already set.
+  if(page->next != (Page*)1) {
+    page->next = (Page*)1;
+  }
 }
 static Page* clockGetStale(struct replacementPolicy* impl) {
   stasis_replacement_policy_clock_t * clock = (stasis_replacement_policy_clock_t *)impl->impl;
@@ -87,8 +99,9 @@ static Page* clockGetStaleAndRemove  (struct replacementPolicy* impl) {
       // evict this page, but not if it is pinned (this protects the caller
       // from evicting pages that it has pinned, not pages that were pinned
       // in race by other threads.)
-      if(clock->pages[ptr].pinCount == 0) {
-        clock->pages[ptr].pinCount++;
+      // remove() increments pinCount without holding any latches, so this
+      // has to be atomic too.
+      if(__sync_bool_compare_and_swap(&clock->pages[ptr].pinCount, 0, 1)) {
         return &clock->pages[ptr];
       } else {
         // Reset the queue flag to 0, unless someone has changed it to 0
@@ -111,7 +124,6 @@ static Page* clockGetStaleAndRemove  (struct replacementPolicy* impl) {
 static void  clockInsert  (struct replacementPolicy* impl, Page* page) {
   __sync_fetch_and_sub(&page->pinCount,1);  // don't care about ordering of this line and next.  pinCount is just a "message to ourselves"
   page->next = (Page*)1;
-  __sync_synchronize();
 }
 
 replacementPolicy* replacementPolicyClockInit(Page * pageArray, int page_count) {
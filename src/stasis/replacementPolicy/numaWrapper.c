@@ -0,0 +1,136 @@
+/*
+ * numaWrapper.c
+ *
+ * Splits the buffer pool into one replacement policy per NUMA node.
+ * Frames belong to nodes according to their position in the frame array
+ * (see stasis_buffer_pool_frames_per_node()), so a page always goes back
+ * to the policy of the frame that holds it, whatever its current id is.
+ *
+ * getStaleAndRemove() looks for a victim in the calling thread's
+ * preferred node first, and only takes frames from other nodes when the
+ * preferred node has nothing to evict.  Threads prefer the node they are
+ * running on, unless they call stasis_replacement_policy_numa_prefer_node().
+ *
+ * The per-node policies must be threadsafe; this wrapper adds no locking.
+ */
+#include <config.h>
+#include <stasis/common.h>
+#include <stasis/replacementPolicy.h>
+#include <stasis/page.h>
+
+#ifdef HAVE_MBIND
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+  replacementPolicy ** impl;
+  int node_count;
+  Page * frames;
+  pageid_t frames_per_node;
+  /** The node that this thread asked for, plus one.  Zero means "the node we're running on". */
+  pthread_key_t preferred_node;
+  stasis_replacement_policy_numa_stats_t * stats;
+} stasis_replacement_policy_numa_t;
+
+static inline int numaNode(stasis_replacement_policy_numa_t *rp, Page *p) {
+  return (int)((p - rp->frames) / rp->frames_per_node);
+}
+static int numaPreferredNode(stasis_replacement_policy_numa_t *rp) {
+  intptr_t node = (intptr_t)pthread_getspecific(rp->preferred_node);
+  if(node) { return (int)(node - 1); }
+#ifdef HAVE_MBIND
+  unsigned int cpu, cur;
+  if(!syscall(__NR_getcpu, &cpu, &cur, NULL)) {
+    return (int)(cur % rp->node_count);
+  }
+#endif
+  return 0;
+}
+
+static void  numaDeinit  (struct replacementPolicy* impl) {
+  stasis_replacement_policy_numa_t * rp = (stasis_replacement_policy_numa_t *)impl->impl;
+  for(int i = 0; i < rp->node_count; i++) {
+    rp->impl[i]->deinit(rp->impl[i]);
+  }
+  pthread_key_delete(rp->preferred_node);
+  free(rp->impl);
+  free(rp->stats);
+  free(rp);
+  free(impl);
+}
+static void  numaHit     (struct replacementPolicy* impl, Page* page) {
+  stasis_replacement_policy_numa_t * rp = (stasis_replacement_policy_numa_t *)impl->impl;
+  replacementPolicy * node = rp->impl[numaNode(rp, page)];
+  node->hit(node, page);
+}
+static Page* numaGetStaleHelper(struct replacementPolicy* impl, int remove) {
+  stasis_replacement_policy_numa_t * rp = (stasis_replacement_policy_numa_t *)impl->impl;
+  int preferred = numaPreferredNode(rp);
+  for(int i = 0; i < rp->node_count; i++) {
+    int n = (preferred + i) % rp->node_count;
+    replacementPolicy * node = rp->impl[n];
+    Page * ret = remove ? node->getStaleAndRemove(node) : node->getStale(node);
+    if(ret) {
+      if(remove) {
+        __sync_fetch_and_add(i ? &rp->stats[n].remote_evictions : &rp->stats[n].local_evictions, 1);
+      }
+      return ret;
+    }
+  }
+  return 0;
+}
+static Page* numaGetStale(struct replacementPolicy* impl) {
+  return numaGetStaleHelper(impl, 0);
+}
+static Page* numaGetStaleAndRemove(struct replacementPolicy* impl) {
+  return numaGetStaleHelper(impl, 1);
+}
+static Page* numaRemove  (struct replacementPolicy* impl, Page* page) {
+  stasis_replacement_policy_numa_t * rp = (stasis_replacement_policy_numa_t *)impl->impl;
+  replacementPolicy * node = rp->impl[numaNode(rp, page)];
+  return node->remove(node, page);
+}
+static void  numaInsert  (struct replacementPolicy* impl, Page* page) {
+  stasis_replacement_policy_numa_t * rp = (stasis_replacement_policy_numa_t *)impl->impl;
+  replacementPolicy * node = rp->impl[numaNode(rp, page)];
+  node->insert(node, page);
+}
+
+void stasis_replacement_policy_numa_prefer_node(replacementPolicy* impl, int node) {
+  stasis_replacement_policy_numa_t * rp = (stasis_replacement_policy_numa_t *)impl->impl;
+  pthread_setspecific(rp->preferred_node, (void*)(intptr_t)(node < 0 ? 0 : (node % rp->node_count) + 1));
+}
+
+int stasis_replacement_policy_numa_stats(replacementPolicy* impl, int node, stasis_replacement_policy_numa_stats_t *stats) {
+  stasis_replacement_policy_numa_t * rp = (stasis_replacement_policy_numa_t *)impl->impl;
+  if(node < 0 || node >= rp->node_count) { return rp->node_count; }
+  *stats = rp->stats[node];
+  return rp->node_count;
+}
+
+replacementPolicy* stasis_replacement_policy_numa_init(replacementPolicy** rp, int node_count, Page * frames, pageid_t frames_per_node, pageid_t frame_count) {
+  replacementPolicy *ret = stasis_alloc(replacementPolicy);
+  stasis_replacement_policy_numa_t * rpn = stasis_alloc(stasis_replacement_policy_numa_t);
+  rpn->impl = stasis_malloc(node_count, replacementPolicy*);
+  rpn->stats = stasis_calloc(node_count, stasis_replacement_policy_numa_stats_t);
+  for(int i = 0; i < node_count; i++) {
+    rpn->impl[i] = rp[i];
+    pageid_t start = i * frames_per_node;
+    pageid_t stop = start + frames_per_node > frame_count ? frame_count : start + frames_per_node;
+    rpn->stats[i].frames = stop > start ? stop - start : 0;
+  }
+  rpn->node_count = node_count;
+  rpn->frames = frames;
+  rpn->frames_per_node = frames_per_node;
+  pthread_key_create(&rpn->preferred_node, 0);
+  ret->init = NULL;
+  ret->deinit = numaDeinit;
+  ret->hit = numaHit;
+  ret->getStale = numaGetStale;
+  ret->getStaleAndRemove = numaGetStaleAndRemove;
+  ret->remove = numaRemove;
+  ret->insert = numaInsert;
+  ret->impl = rpn;
+  return ret;
+}
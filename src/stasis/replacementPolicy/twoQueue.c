@@ -0,0 +1,300 @@
+/*
+ * twoQueue.c
+ *
+ * Scan resistant "2Q" replacement, as described in Johnson and Shasha,
+ * "2Q: A Low Overhead High Performance Buffer Management Replacement
+ * Algorithm".
+ *
+ * Pages that are loaded for the first time enter a FIFO (A1in).  When
+ * a page is evicted from A1in, its id is remembered in a bounded ghost
+ * queue (A1out).  Only pages that are re-read while their id is in
+ * A1out are admitted to the main LRU queue (Am).  A one-pass scan
+ * therefore cycles through A1in, and leaves the hot set in Am alone.
+ *
+ * Evictions can be cancelled; the buffer manager hands the victim back
+ * with insert() without changing its id.  Such pages go back to the
+ * queue they were evicted from, and their ids are taken back out of
+ * A1out, so that they are not mistaken for re-references.
+ *
+ * All of the per-page state is keyed by page id, not by frame.  The
+ * concurrent wrapper picks a sub-policy by page id, so a frame that is
+ * evicted and reused for another page moves between sub-policies;
+ * anything keyed by the frame would be left behind in the old one.
+ *
+ * This policy is not threadsafe; wrap it with the threadsafe or
+ * concurrent wrappers.
+ */
+#include <stasis/common.h>
+#include <stasis/flags.h>
+#include <stasis/replacementPolicy.h>
+#include <stasis/util/lhtable.h>
+#include <stasis/page.h>
+#include <assert.h>
+
+typedef Page List;
+
+/** Tags stored in the queue table.  Zero is reserved for "not found". */
+enum {
+  TWOQ_A1IN = 1,
+  TWOQ_AM   = 2
+};
+
+/** An eviction that may still be cancelled. */
+typedef struct {
+  pageid_t id;
+  Page * frame;
+  intptr_t queue;
+} stasis_2q_eviction_t;
+
+#define TWOQ_EVICTING_MAX 16
+
+typedef struct stasis_replacement_policy_2q_t {
+  /** FIFO of pages that have been read once. */
+  List a1in;
+  /** LRU of pages that have been read while in A1out. */
+  List am;
+  pageid_t a1in_count;
+  pageid_t a1in_max;
+  /** Maps pageid -> queue tag, for pages that are linked or pinned. */
+  struct LH_ENTRY(table) * queues;
+  /** Ring buffer of recent evictions.  Entries for evictions that went
+      through are never looked up again, and are overwritten in turn. */
+  stasis_2q_eviction_t * evicting;
+  pageid_t evicting_max;
+  pageid_t evicting_next;
+  /** Maps pageid -> (slot in evicting + 1) */
+  struct LH_ENTRY(table) * evicting_index;
+  /** Ring buffer of ids recently evicted from A1in. */
+  pageid_t * a1out;
+  pageid_t a1out_max;
+  pageid_t a1out_next;
+  /** Maps pageid -> (slot in a1out + 1) */
+  struct LH_ENTRY(table) * a1out_index;
+} stasis_replacement_policy_2q_t;
+
+static inline void llInit( List *list ) {
+   memset( list, 0, sizeof( *list ) );
+   list->id = 0xdeadbeef;
+   list->next = list->prev = list;
+}
+static inline void llPush( List *list, Page *p ) {
+  p->next = list;
+  p->prev = list->prev;
+  p->next->prev = p;
+  p->prev->next = p;
+}
+static inline void llRemove( Page *p ) {
+  p->prev->next = p->next;
+  p->next->prev = p->prev;
+  p->prev = NULL;
+  p->next = NULL;
+}
+static inline Page* llHead( List *list ) {
+  return list->next == list ? NULL : list->next;
+}
+
+static intptr_t stasis_2q_queue(stasis_replacement_policy_2q_t *q, Page *p) {
+  return (intptr_t)LH_ENTRY(find)(q->queues, &p->id, sizeof(p->id));
+}
+static void stasis_2q_set_queue(stasis_replacement_policy_2q_t *q, Page *p, intptr_t queue) {
+  LH_ENTRY(insert)(q->queues, &p->id, sizeof(p->id), (void*)queue);
+}
+static void stasis_2q_unlink(stasis_replacement_policy_2q_t *q, Page *p, intptr_t queue) {
+  llRemove(p);
+  if(queue == TWOQ_A1IN) { q->a1in_count--; }
+}
+static void stasis_2q_link(stasis_replacement_policy_2q_t *q, Page *p, intptr_t queue) {
+  if(queue == TWOQ_A1IN) {
+    llPush(&q->a1in, p);
+    q->a1in_count++;
+  } else {
+    llPush(&q->am, p);
+  }
+}
+static void stasis_2q_ghost_push(stasis_replacement_policy_2q_t *q, pageid_t id) {
+  if(id < 0) { return; } // free frames have negative ids; don't remember them.
+  pageid_t slot = q->a1out_next;
+  pageid_t old = q->a1out[slot];
+  if(old != INVALID_PAGE) {
+    intptr_t oldslot = (intptr_t)LH_ENTRY(find)(q->a1out_index, &old, sizeof(old));
+    if(oldslot == slot + 1) {
+      LH_ENTRY(remove)(q->a1out_index, &old, sizeof(old));
+    }
+  }
+  q->a1out[slot] = id;
+  LH_ENTRY(insert)(q->a1out_index, &id, sizeof(id), (void*)(intptr_t)(slot + 1));
+  q->a1out_next = (slot + 1) % q->a1out_max;
+}
+/** @return true iff id was in A1out.  Removes id from A1out. */
+static int stasis_2q_ghost_take(stasis_replacement_policy_2q_t *q, pageid_t id) {
+  intptr_t slot = (intptr_t)LH_ENTRY(remove)(q->a1out_index, &id, sizeof(id));
+  if(slot) {
+    q->a1out[slot-1] = INVALID_PAGE;
+    return 1;
+  }
+  return 0;
+}
+static void stasis_2q_evicting_push(stasis_replacement_policy_2q_t *q, Page *p, intptr_t queue) {
+  if(p->id < 0) { return; }
+  pageid_t slot = q->evicting_next;
+  pageid_t old = q->evicting[slot].id;
+  if(old != INVALID_PAGE) {
+    intptr_t oldslot = (intptr_t)LH_ENTRY(find)(q->evicting_index, &old, sizeof(old));
+    if(oldslot == slot + 1) {
+      LH_ENTRY(remove)(q->evicting_index, &old, sizeof(old));
+    }
+  }
+  q->evicting[slot].id = p->id;
+  q->evicting[slot].frame = p;
+  q->evicting[slot].queue = queue;
+  LH_ENTRY(insert)(q->evicting_index, &p->id, sizeof(p->id), (void*)(intptr_t)(slot + 1));
+  q->evicting_next = (slot + 1) % q->evicting_max;
+}
+/**
+ * @return the queue p was evicted from, if p is a victim that is being
+ * handed back with its old id, or zero otherwise.  Forgets p's eviction.
+ */
+static intptr_t stasis_2q_evicting_take(stasis_replacement_policy_2q_t *q, Page *p) {
+  intptr_t slot = (intptr_t)LH_ENTRY(remove)(q->evicting_index, &p->id, sizeof(p->id));
+  if(!slot) { return 0; }
+  stasis_2q_eviction_t * e = &q->evicting[slot-1];
+  e->id = INVALID_PAGE;
+  // Another frame means the eviction went through, and the page was re-read.
+  return e->frame == p ? e->queue : 0;
+}
+/**
+ * Pick the next victim without removing it.  Evict from A1in while it
+ * is over its share of the pool; otherwise, evict the LRU page of Am.
+ */
+static Page* stasis_2q_victim(stasis_replacement_policy_2q_t *q) {
+  Page * ret = NULL;
+  if(q->a1in_count > q->a1in_max) {
+    ret = llHead(&q->a1in);
+  }
+  if(!ret) { ret = llHead(&q->am); }
+  if(!ret) { ret = llHead(&q->a1in); }
+  return ret;
+}
+
+static void stasis_replacement_policy_2q_hit(struct replacementPolicy * r, Page *p) {
+  stasis_replacement_policy_2q_t *q = r->impl;
+  if(p->prev == NULL) {
+    // ignore attempts to hit pages not in the policy
+    return;
+  }
+  // Hits on A1in pages are usually correlated references; leave them be.
+  if(stasis_2q_queue(q, p) == TWOQ_AM) {
+    llRemove(p);
+    llPush(&q->am, p);
+  }
+}
+static Page* stasis_replacement_policy_2q_getStale(struct replacementPolicy *r) {
+  stasis_replacement_policy_2q_t *q = r->impl;
+  return stasis_2q_victim(q);
+}
+static Page* stasis_replacement_policy_2q_remove(struct replacementPolicy* r, Page *p) {
+  stasis_replacement_policy_2q_t *q = r->impl;
+  Page *ret = NULL;
+
+  if(!p->pinCount) {
+    if(p->next) {
+      stasis_2q_unlink(q, p, stasis_2q_queue(q, p));
+    } else {
+      assert(p->dirty);
+    }
+    ret = p;
+  }
+  p->pinCount++;
+
+  return ret;
+}
+static Page* stasis_replacement_policy_2q_getStaleAndRemove(struct replacementPolicy *r) {
+  stasis_replacement_policy_2q_t *q = r->impl;
+  Page *ret = stasis_2q_victim(q);
+  if(ret) {
+    assert(!ret->pinCount);
+    intptr_t queue = (intptr_t)LH_ENTRY(remove)(q->queues, &ret->id, sizeof(ret->id));
+    stasis_2q_unlink(q, ret, queue);
+    if(queue == TWOQ_A1IN) {
+      stasis_2q_ghost_push(q, ret->id);
+    }
+    // Remember where the page came from, in case the eviction is cancelled.
+    stasis_2q_evicting_push(q, ret, queue);
+    ret->pinCount++;
+  }
+  return ret;
+}
+static void stasis_replacement_policy_2q_insert(struct replacementPolicy *r, Page *p) {
+  stasis_replacement_policy_2q_t *q = r->impl;
+  p->pinCount--;
+  assert(p->pinCount >= 0);
+  if(p->pinCount) { return; }
+
+  intptr_t queue = stasis_2q_queue(q, p);
+  if(!queue) {
+    queue = stasis_2q_evicting_take(q, p);
+    if(queue == TWOQ_A1IN) {
+      // The eviction was cancelled; undo the ghost_push().
+      stasis_2q_ghost_take(q, p->id);
+    } else if(!queue) {
+      queue = stasis_2q_ghost_take(q, p->id) ? TWOQ_AM : TWOQ_A1IN;
+    }
+    stasis_2q_set_queue(q, p, queue);
+  }
+  if(stasis_buffer_manager_hint_writes_are_sequential &&
+     !stasis_buffer_manager_debug_stress_latching && p->dirty) {
+    // See lruFast.c; the writeback thread will remove and reinsert the
+    // page once it is clean.
+    return;
+  }
+  stasis_2q_link(q, p, queue);
+}
+static void stasis_replacement_policy_2q_deinit(struct replacementPolicy * r) {
+  stasis_replacement_policy_2q_t *q = r->impl;
+  LH_ENTRY(destroy)(q->evicting_index);
+  free(q->evicting);
+  LH_ENTRY(destroy)(q->queues);
+  LH_ENTRY(destroy)(q->a1out_index);
+  free(q->a1out);
+  free(q);
+  free(r);
+}
+replacementPolicy * stasis_replacement_policy_2q_init(pageid_t page_count) {
+  replacementPolicy * ret = stasis_alloc(replacementPolicy);
+  ret->init = NULL;
+  ret->deinit = stasis_replacement_policy_2q_deinit;
+  ret->hit = stasis_replacement_policy_2q_hit;
+  ret->getStale = stasis_replacement_policy_2q_getStale;
+  ret->remove = stasis_replacement_policy_2q_remove;
+  ret->getStaleAndRemove = stasis_replacement_policy_2q_getStaleAndRemove;
+  ret->insert = stasis_replacement_policy_2q_insert;
+
+  stasis_replacement_policy_2q_t * q = stasis_alloc(stasis_replacement_policy_2q_t);
+  llInit(&q->a1in);
+  llInit(&q->am);
+  q->a1in_count = 0;
+  // Kin and Kout, from the paper's recommended settings.
+  q->a1in_max = page_count / 4;
+  q->a1out_max = page_count / 2;
+  if(q->a1out_max < 1) { q->a1out_max = 1; }
+  q->queues = LH_ENTRY(create)(page_count > 10 ? page_count : 10);
+  q->a1out = stasis_malloc(q->a1out_max, pageid_t);
+  for(pageid_t i = 0; i < q->a1out_max; i++) {
+    q->a1out[i] = INVALID_PAGE;
+  }
+  q->a1out_next = 0;
+  q->a1out_index = LH_ENTRY(create)(q->a1out_max > 10 ? q->a1out_max : 10);
+  // The buffer managers cancel evictions before they start another one,
+  // so this only needs to outlast the evictions that other threads start
+  // in the meantime.  Keep it short, so that an entry left behind by an
+  // eviction that went through is gone before the frame comes back.
+  q->evicting_max = TWOQ_EVICTING_MAX;
+  q->evicting = stasis_malloc(q->evicting_max, stasis_2q_eviction_t);
+  for(pageid_t i = 0; i < q->evicting_max; i++) {
+    q->evicting[i].id = INVALID_PAGE;
+  }
+  q->evicting_next = 0;
+  q->evicting_index = LH_ENTRY(create)(q->evicting_max);
+  ret->impl = q;
+  return ret;
+}
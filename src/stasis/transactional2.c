@@ -85,6 +85,17 @@ int Tinit(void) {
   assert(stasis_log_file != NULL);
 
   stasis_buffer_manager = stasis_buffer_manager_factory(stasis_log_file, stasis_dirty_page_table);
+  if(stasis_buffer_manager == NULL) {
+    fprintf(stderr, "Tinit(): Could not open the page file\n");
+    stasis_log_group_force_t * group_force = stasis_log_file->group_force;
+    stasis_log_file->close(stasis_log_file);
+    if(group_force) { stasis_log_group_force_deinit(group_force); }
+    stasis_page_deinit();
+    stasis_transaction_table_deinit(stasis_transaction_table);
+    stasis_dirty_page_table_deinit(stasis_dirty_page_table);
+    stasis_initted = 0;
+    return LLADD_IO_ERROR;
+  }
 
   stasis_dirty_page_table_set_buffer_manager(stasis_dirty_page_table, stasis_buffer_manager); // xxx circular dependency.
   pageOperationsInit(stasis_log_file);
@@ -99,6 +110,9 @@ int Tinit(void) {
   setupLockManagerCallbacksNil();
 
   stasis_recovery_initiate(stasis_log_file, stasis_transaction_table, stasis_alloc);
+  if(stasis_buffer_manager->restoreHotSet) {
+    stasis_buffer_manager->restoreHotSet(stasis_buffer_manager);
+  }
   stasis_truncation = stasis_truncation_init(stasis_dirty_page_table, stasis_transaction_table,
                                              stasis_buffer_manager, stasis_log_file);
   if(stasis_truncation_automatic) {
@@ -143,7 +157,7 @@ void TupdateWithPage(int xid, pageid_t page, Page *p, const void * dat, size_t d
   }
 
   // TODO: Add support for finer-grained write latches?
-  if(p) writelock(p->rwlatch,0);
+  if(p) stasis_page_writelock(p);
 
   LogEntry * e = stasis_log_write_update(stasis_log_file, xact, page, p, op, (const byte*)dat, datlen);
 
@@ -193,7 +207,7 @@ void TupdateWithPage(int xid, pageid_t page, Page *p, const void * dat, size_t d
 
   // The entry has been applied.  We can now safely unlatch the page.
 
-  if(p) unlock(p->rwlatch);
+  if(p) stasis_page_writeunlock(p);
 }
 
 void Tupdate(int xid, pageid_t page, const void * dat, size_t datlen, int op) {
@@ -223,9 +237,9 @@ void TreorderableUpdate(int xid, void * hp, pageid_t page,
   stasis_log_reordering_handle_append(h, p, op, (const byte*)dat, datlen, sizeofLogEntry(0, e));
 
   e->LSN = 0;
-  writelock(p->rwlatch,0);
+  stasis_page_writelock(p);
   stasis_operation_do(e, p);
-  unlock(p->rwlatch);
+  stasis_page_writeunlock(p);
   pthread_mutex_unlock(&h->mut);
   // page will be released by the log handle...
   //stasis_log_file->write_entry_done(stasis_log_file, e);
@@ -295,14 +309,20 @@ void Tread(int xid, recordid rid, void * dat) {
   Page * p;
   p = loadPage(xid, rid.page);
 
+  if(!stasis_record_read_optimistic(xid, p, rid, (byte*)dat)) {
+    releasePage(p);
+    return;
+  }
   releasePage( TreadWithPage(xid, rid, p, dat) );
 }
 
 void TreadRaw(int xid, recordid rid, void * dat) {
   Page * p = loadPage(xid, rid.page);
-  readlock(p->rwlatch,0);
-  stasis_record_read(xid, p, rid, (byte*)dat);
-  unlock(p->rwlatch);
+  if(stasis_record_read_optimistic(xid, p, rid, (byte*)dat)) {
+    readlock(p->rwlatch,0);
+    stasis_record_read(xid, p, rid, (byte*)dat);
+    unlock(p->rwlatch);
+  }
   releasePage(p);
 }
 
@@ -448,6 +468,9 @@ int TdurabilityLevel(void) {
 void TtruncateLog(void) {
   stasis_truncation_truncate(stasis_truncation, 1);
 }
+int Tcheckpoint(void) {
+  return stasis_truncation_checkpoint(stasis_truncation);
+}
 typedef struct {
   lsn_t prev_lsn;
   lsn_t compensated_lsn;
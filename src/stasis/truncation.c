@@ -1,8 +1,11 @@
 #include <stasis/transactional.h>
 #include <stasis/truncation.h>
 #include <stasis/bufferManager.h>
+#include <stasis/io/handle.h>
 #include <stdio.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 struct stasis_truncation_t {
   char initialized;
@@ -14,6 +17,10 @@ struct stasis_truncation_t {
   stasis_transaction_table_t * transaction_table;
   stasis_buffer_manager_t * buffer_manager;
   stasis_log_t * log;
+  /** Serializes checkpoints; protects checkpoint_end. */
+  pthread_mutex_t checkpoint_mutex;
+  /** The end of the log when the last checkpoint was written. */
+  lsn_t checkpoint_end;
 };
 
 #ifdef LONG_TEST
@@ -36,6 +43,8 @@ stasis_truncation_t * stasis_truncation_init(stasis_dirty_page_table_t * dpt, st
   ret->transaction_table = tbl;
   ret->buffer_manager = buffer_manager;
   ret->log = log;
+  pthread_mutex_init(&ret->checkpoint_mutex, 0);
+  ret->checkpoint_end = INVALID_LSN;
   return ret;
 }
 
@@ -53,11 +62,16 @@ void stasis_truncation_deinit(stasis_truncation_t * trunc) {
   trunc->automaticallyTruncating = 0;
   pthread_mutex_destroy(&trunc->shutdown_mutex);
   pthread_cond_destroy(&trunc->shutdown_cond);
+  pthread_mutex_destroy(&trunc->checkpoint_mutex);
   free(trunc);
 }
 
 static void* stasis_truncation_thread_worker(void* truncp) {
   stasis_truncation_t * trunc = (stasis_truncation_t*)truncp;
+  // Background truncation flushes pages as writeback.  Forced truncations run in the caller's class.
+  stasis_handle_qos_set_class(STASIS_IO_CLASS_WRITEBACK);
+  struct timeval last_checkpoint;
+  gettimeofday(&last_checkpoint, 0);
   pthread_mutex_lock(&trunc->shutdown_mutex);
   while(trunc->initialized) {
     if(trunc->log->first_unstable_lsn(trunc->log, LOG_FORCE_WAL) - trunc->log->truncation_point(trunc->log)
@@ -69,6 +83,17 @@ static void* stasis_truncation_thread_worker(void* truncp) {
     int timeret = gettimeofday(&now, 0);
     assert(0 == timeret);
 
+    if(stasis_checkpoint_interval > 0
+       && now.tv_sec - last_checkpoint.tv_sec >= stasis_checkpoint_interval) {
+      pthread_mutex_lock(&trunc->checkpoint_mutex);
+      lsn_t checkpoint_end = trunc->checkpoint_end;
+      pthread_mutex_unlock(&trunc->checkpoint_mutex);
+      if(trunc->log->next_available_lsn(trunc->log) != checkpoint_end) {
+        stasis_truncation_checkpoint(trunc);
+      }
+      last_checkpoint = now;
+    }
+
     timeout.tv_sec = now.tv_sec;
     timeout.tv_nsec = now.tv_usec;
     timeout.tv_sec += TRUNCATE_INTERVAL;
@@ -86,6 +111,124 @@ void stasis_truncation_thread_start(stasis_truncation_t* trunc) {
 }
 
 
+char * stasis_truncation_checkpoint_file_name(void) {
+  if(stasis_checkpoint_file_name) { return strdup(stasis_checkpoint_file_name); }
+  const char * base;
+  const char * suffix;
+  if(stasis_log_type == LOG_TO_DIR) {
+    base = stasis_log_dir_name;
+    suffix = "/.checkpoint";  // the log ignores dot files in its directory
+  } else if(stasis_log_type == LOG_TO_FILE) {
+    base = stasis_log_file_name;
+    suffix = ".checkpoint";
+  } else {
+    return NULL;
+  }
+  size_t len = strlen(base) + strlen(suffix) + 1;
+  char * ret = stasis_malloc(len, char);
+  snprintf(ret, len, "%s%s", base, suffix);
+  return ret;
+}
+
+/**
+ * Sync the directory that contains name, so that a rename() into it is
+ * durable.
+ */
+static int stasis_truncation_sync_parent_dir(const char * name) {
+  const char * slash = strrchr(name, '/');
+  char * dir = slash ? strndup(name, slash == name ? 1 : slash - name) : strdup(".");
+  int fd = open(dir, O_RDONLY);
+  int ok = fd != -1 && !fsync(fd);
+  if(fd != -1) { ok = !close(fd) && ok; }
+  free(dir);
+  return ok;
+}
+
+/**
+ * Atomically replace the checkpoint file with lsn.  The file is synced
+ * before it is renamed, and its directory is synced afterwards, so a
+ * crash leaves either the old or new LSN.
+ */
+static int stasis_truncation_save_checkpoint_lsn(const char * name, lsn_t lsn) {
+  size_t len = strlen(name);
+  char *tmpname = stasis_malloc(len + 2, char);
+  snprintf(tmpname, len + 2, "%s~", name);
+  int ok = 0;
+  FILE *f = fopen(tmpname, "w");
+  if(f) {
+    ok = (fwrite(&lsn, sizeof(lsn), 1, f) == 1)
+      && !fflush(f)
+      && !fsync(fileno(f));
+    ok = !fclose(f) && ok;
+    ok = ok && !rename(tmpname, name);
+    ok = ok && stasis_truncation_sync_parent_dir(name);
+  }
+  if(!ok) {
+    perror("Could not save checkpoint lsn");
+    remove(tmpname);
+  }
+  free(tmpname);
+  return ok;
+}
+
+int stasis_truncation_checkpoint(stasis_truncation_t* trunc) {
+  char * name = stasis_truncation_checkpoint_file_name();
+  if(!name) { return 0; }
+  stasis_log_t * log = trunc->log;
+  pthread_mutex_lock(&trunc->checkpoint_mutex);
+
+  // Entries before begin_lsn have been applied to their pages, and to
+  // their transactions' table entries, so the snapshots below reflect them.
+  lsn_t begin_lsn = log->first_pending_lsn(log);
+
+  pageid_t * pages;
+  lsn_t * page_rec_lsns;
+  pageid_t page_count = stasis_dirty_page_table_snapshot(trunc->dirty_pages, &pages, &page_rec_lsns);
+
+  int active_count;
+  int * active = stasis_transaction_table_list_active(trunc->transaction_table, &active_count);
+  CheckpointTransaction * xacts = stasis_malloc(active_count + 1, CheckpointTransaction);
+  int64_t xact_count = 0;
+  for(int i = 0; i < active_count; i++) {
+    stasis_transaction_table_entry_t * l = stasis_transaction_table_get(trunc->transaction_table, active[i]);
+    if(!l) { continue; } // It committed while we were looking.
+    xacts[xact_count].xid = active[i];
+    xacts[xact_count].prev_lsn = l->prevLSN;
+    xacts[xact_count].rec_lsn = l->recLSN;
+    xact_count++;
+  }
+  free(active);
+
+  // Pages that were cleaned before the snapshot may still be in the page
+  // file's write buffers.  Recovery will not redo them, so sync them now.
+  trunc->buffer_manager->forcePages(trunc->buffer_manager, 0);
+
+  LogEntry * e = allocCheckpointLogEntry(log, begin_lsn, page_count, xact_count);
+  CheckpointDirtyPage * cp_pages = (CheckpointDirtyPage*)getCheckpointDirtyPages(e);
+  for(pageid_t i = 0; i < page_count; i++) {
+    cp_pages[i].page = pages[i];
+    cp_pages[i].rec_lsn = page_rec_lsns[i];
+  }
+  memcpy((CheckpointTransaction*)getCheckpointTransactions(e), xacts, xact_count * sizeof(CheckpointTransaction));
+  free(pages);
+  free(page_rec_lsns);
+  free(xacts);
+
+  log->write_entry(log, e);
+  lsn_t lsn = e->LSN;
+  log->write_entry_done(log, e);
+  trunc->checkpoint_end = log->next_available_lsn(log);
+
+  // The checkpoint file must never point past the durable end of the log.
+  stasis_log_force(log, lsn, LOG_FORCE_WAL);
+  DEBUG("Checkpoint at lsn %lld: begin %lld, %lld dirty pages, %lld transactions\n",
+        (long long)lsn, (long long)begin_lsn, (long long)page_count, (long long)xact_count);
+  int ret = stasis_truncation_save_checkpoint_lsn(name, lsn);
+  pthread_mutex_unlock(&trunc->checkpoint_mutex);
+  free(name);
+  return ret;
+}
+
 int stasis_truncation_truncate(stasis_truncation_t* trunc, int force) {
 
   // *_minRecLSN() used to return the same value as flushed if
@@ -124,9 +267,24 @@ int stasis_truncation_truncate(stasis_truncation_t* trunc, int force) {
       if(force || flushed - log_trunc > 2 * TARGET_LOG_SIZE) {
         DEBUG("Flushing dirty buffers: rec_lsn = %lld log_trunc = %lld flushed = %lld\n", rec_lsn, log_trunc, flushed);
         applied_lsn  = trunc->log->first_pending_lsn(trunc->log);
-        if(EAGAIN == stasis_dirty_page_table_flush(trunc->dirty_pages)) {
-          applied_lsn  = trunc->log->first_pending_lsn(trunc->log);
-          stasis_dirty_page_table_flush(trunc->dirty_pages); // can ignore ret val, since some other thread successfully initiated + completed a flush since our first call.
+        if(force) {
+          if(EAGAIN == stasis_dirty_page_table_flush(trunc->dirty_pages)) {
+            applied_lsn  = trunc->log->first_pending_lsn(trunc->log);
+            stasis_dirty_page_table_flush(trunc->dirty_pages); // can ignore ret val, since some other thread successfully initiated + completed a flush since our first call.
+          }
+        } else {
+          // The transactions and the log bound the truncation point anyway,
+          // so only write back the pages that hold it back further.
+          lsn_t target = xact_rec_lsn < flushed_lsn ? xact_rec_lsn : flushed_lsn;
+          target = target < applied_lsn ? target : applied_lsn;
+          stasis_dirty_page_table_flush_with_target(trunc->dirty_pages, target);
+#ifdef DEBUGGING
+          stasis_dirty_page_table_flush_progress_t progress;
+          stasis_dirty_page_table_flush_progress(trunc->dirty_pages, &progress);
+          DEBUG("Flushed %lld of %lld pages below lsn %lld in %d passes; minRecLSN is now %lld\n",
+                (long long)progress.written, (long long)progress.pages, (long long)progress.target_lsn,
+                progress.passes, (long long)progress.min_rec_lsn);
+#endif
         }
 
         page_rec_lsn = stasis_dirty_page_table_minRecLSN(trunc->dirty_pages);
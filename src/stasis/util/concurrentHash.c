@@ -1,7 +1,7 @@
 /**
   concurrenthash.c
 
-  @file implementation of a concurrent, fixed-size hashtable
+  @file implementation of a concurrent, resizable hashtable
 
 
 ============================
@@ -16,8 +16,7 @@ for a discussion of this data structure's API, and non-standard concurrency
 primitives.
 
 This concurrent hash table implementation completely avoids the need for
-global latches, but is incapable of resizing itself at runtime.  It is based
-upon three ideas:
+global latches.  It is based upon three ideas:
 
  - Islands, which we use to implement the NEAR primitive from navigational
    databases of lore.
@@ -340,6 +339,53 @@ conservative because it caps the utilization of hash at 25% instead of
 50% minus one element. This is OK as it is relatively cheap and
 decreases the average size of hash collision chains.
 
+Resizing
+========
+
+Everything above describes a single, fixed-size array of buckets.  To allow
+the hashtable to grow and shrink at runtime, the table is split into a fixed
+number of independent segments, each of which is an array of buckets that
+behaves exactly as described above.  The low bits of a key's hash code pick
+its segment, and the remaining bits pick its bucket within the segment.
+Islands, wraparound and crabbing never cross segment boundaries, so the
+arguments above apply to each segment independently.
+
+Resizing must not add a latch to the lookup path, so it piggybacks on the
+bucket latches that operations already obtain.  A segment's buckets are
+stored in a list of chunks; the first holds the minimum number of buckets,
+and each subsequent chunk doubles the size of the segment.  Chunks are
+allocated the first time the segment grows into them, and are not freed
+until the hashtable is deinitialized, so any bucket index that was ever
+valid names a bucket (and latch) that still exists.
+
+A resize latches every bucket in the segment's current range, rehashes the
+segment in place (shrinking leaves the upper chunks empty, and growing
+clears and then fills them), then publishes the new size and releases the
+bucket latches.  Since the resize holds every bucket latch, an operation
+that holds any bucket latch in the segment excludes resizes of that segment,
+and crabbing proceeds exactly as before.  Operations read the segment's size
+without latching it, latch the bucket it leads them to, and then re-read the
+size.  If it changed, the operation raced with a resize; it releases the
+latch and starts over.  Otherwise, no resize can begin until the operation
+releases its latches, and the table is consistent with the size it read,
+since resizes publish the new size after rehashing the segment.
+
+Resizing a segment therefore never blocks lookups against other segments,
+and only briefly blocks lookups against the segment being resized.  The
+resize obtains its bucket latches with trylock, and backs off if another
+thread holds one, so resizes never wait for a thread that holds bucket
+latches and is blocked on something else (such as a page latch in the buffer
+manager).
+
+Segments are resized opportunistically: after an operation releases its
+last bucket latch, it checks whether the segment is above 25% or below 6.25%
+utilization and, if so, attempts to resize it.  If a segment manages to reach
+37.5% utilization anyway, inserts into that segment retry the resize until
+it succeeds, preserving the 50% invariant that the rest of the
+implementation relies upon.  (It is safe for them to wait, since callers
+are not allowed to hold bucket latches when they start an operation.)
+Segments never shrink below the size that was passed into hashtable_init().
+
 History:
 ========
 
@@ -351,13 +397,16 @@ History:
 -r1429 30 Sep 2010  Added fsck logic.  (To no avail)
 -r1475 14 Feb 2011  Slava found the mod bug, and wrote version 1 of the extensive
                     documentation above.  I expanded it into v2, and committed it.
+-      18 Oct 2026  Split the table into independently resizable segments.
  */
 #define _XOPEN_SOURCE 600
 #include <config.h>
 #include <stasis/util/concurrentHash.h>
 #include <stasis/util/hashFunctions.h>
+#include <stasis/util/latches.h>
 #include <assert.h>
 #include <stdio.h>
+#include <sched.h>
 
 //#define STASIS_HASHTABLE_FSCK_THREAD
 
@@ -367,17 +416,39 @@ struct bucket_t {
   void * val;
 };
 
+/** The log base 2 of the number of segments in each hashtable. */
+#define HASHTABLE_SEGMENT_BITS 6
+#define HASHTABLE_SEGMENT_COUNT (1 << HASHTABLE_SEGMENT_BITS)
+/** The smallest number of buckets in a segment; must be a power of two. */
+#define HASHTABLE_MIN_SEGMENT_SIZE 16
+/** Chunk k > 0 holds minbuckets << (k-1) buckets, so this is plenty. */
+#define HASHTABLE_MAX_CHUNKS 48
+
+struct hashtable_segment_t {
+  /** Never freed while the hashtable is open; see "Resizing", above. */
+  bucket_t * chunks[HASHTABLE_MAX_CHUNKS];
+  int chunk_count;
+  /** Number of buckets in chunk 0; we never shrink below this. */
+  pageid_t minbuckets;
+  int minbits;
+  /** Read without latches; only changes while every bucket is latched. */
+  volatile pageid_t maxbucketid;
+  /** Number of non-null buckets, plus the number of in-progress inserts. */
+  pageid_t count;
+  /** Serializes resizes of this segment. */
+  pthread_mutex_t resize_mut;
+};
+
 struct hashtable_t {
-  bucket_t* buckets;
-  pageid_t maxbucketid;
+  hashtable_segment_t segments[HASHTABLE_SEGMENT_COUNT];
 #ifdef STASIS_HASHTABLE_FSCK_THREAD
   int is_open;
   pthread_t fsck_thread;
 #endif
 };
 
-static inline pageid_t hashtable_wrap(hashtable_t *ht, pageid_t p) {
-  return p & ht->maxbucketid;
+static inline pageid_t hashtable_wrap(pageid_t maxbucketid, pageid_t p) {
+  return p & maxbucketid;
 }
 static inline pageid_t hash6432shift(pageid_t key)
 {
@@ -408,32 +479,161 @@ static inline pageid_t hash6432shift(pageid_t key)
   //return key * 13;
 #endif
 }
-static inline pageid_t hashtable_func(hashtable_t *ht, pageid_t key) {
-  return hashtable_wrap(ht, hash6432shift(key));
+static inline hashtable_segment_t * hashtable_segment(hashtable_t *ht, pageid_t hash) {
+  return &ht->segments[hash & (HASHTABLE_SEGMENT_COUNT-1)];
+}
+static inline pageid_t hashtable_func(pageid_t maxbucketid, pageid_t key) {
+  return hashtable_wrap(maxbucketid, hash6432shift(key) >> HASHTABLE_SEGMENT_BITS);
+}
+static inline bucket_t * hashtable_bucket(hashtable_segment_t *seg, pageid_t idx) {
+  pageid_t hi = idx >> seg->minbits;
+  if(!hi) { return &seg->chunks[0][idx]; }
+  int k = 64 - __builtin_clzll((unsigned long long)hi);  // hi is in [2^(k-1), 2^k)
+  return &seg->chunks[k][idx - (seg->minbuckets << (k-1))];
 }
 
 #ifdef STASIS_HASHTABLE_FSCK_THREAD
 void * hashtable_fsck_worker(void * htp);
 #endif
 
+static bucket_t * hashtable_alloc_buckets(pageid_t count) {
+  bucket_t * buckets = stasis_calloc(count, bucket_t);
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  for(pageid_t i = 0; i < count; i++) {
+    buckets[i].key = -1;
+    pthread_mutex_init(&(buckets[i].mut), &attr);
+  }
+  pthread_mutexattr_destroy(&attr);
+  return buckets;
+}
+static void hashtable_free_buckets(bucket_t * buckets, pageid_t count) {
+  for(pageid_t i = 0; i < count; i++) {
+    pthread_mutex_destroy(&buckets[i].mut);
+  }
+  free(buckets);
+}
+static inline pageid_t hashtable_chunk_size(hashtable_segment_t *seg, int k) {
+  return k ? seg->minbuckets << (k-1) : seg->minbuckets;
+}
+static inline int hashtable_segment_overfull(hashtable_segment_t *seg, pageid_t count) {
+  // 37.5% utilization; see "Resizing", above.
+  return count * 8 > (seg->maxbucketid+1) * 3;
+}
+static inline int hashtable_segment_needs_resize(hashtable_segment_t *seg) {
+  pageid_t buckets = seg->maxbucketid+1;
+  pageid_t count = seg->count;
+  return count * 4 > buckets
+      || (buckets > seg->minbuckets && count * 16 < buckets);
+}
+/**
+ * Latch every bucket in [0, size), or none of them.
+ *
+ * @return 1 on success, 0 if another thread holds one of the latches.
+ */
+static int hashtable_segment_trylatch(hashtable_segment_t *seg, pageid_t size) {
+  for(pageid_t i = 0; i < size; i++) {
+    if(pthread_mutex_trylock(&hashtable_bucket(seg, i)->mut)) {
+      while(i--) { pthread_mutex_unlock(&hashtable_bucket(seg, i)->mut); }
+      return 0;
+    }
+  }
+  return 1;
+}
+/**
+ * Rehash a segment so that it is between 6.25% and 25% full.
+ *
+ * @param block If false, give up instead of waiting for concurrent operations
+ *              to release their bucket latches.
+ */
+static void hashtable_segment_resize(hashtable_segment_t *seg, int block) {
+  if(block) {
+    pthread_mutex_lock(&seg->resize_mut);
+  } else if(pthread_mutex_trylock(&seg->resize_mut)) {
+    return;
+  }
+  pageid_t oldsize = seg->maxbucketid+1;
+  while(!hashtable_segment_trylatch(seg, oldsize)) {
+    if(!block) {
+      pthread_mutex_unlock(&seg->resize_mut);
+      return;
+    }
+    sched_yield();
+  }
+  // Now that the segment is latched, its count can only go up, and only
+  // while inserts wait to reserve a bucket.  Leave them some slack.
+  pageid_t count = seg->count + 1;
+  pageid_t newsize = oldsize;
+  while(count * 4 > newsize) { newsize *= 2; }
+  while(newsize > seg->minbuckets && count * 16 < newsize) { newsize /= 2; }
+  if(newsize != oldsize) {
+    pageid_t n = 0;
+    pageid_t *keys = stasis_malloc(oldsize, pageid_t);
+    void **vals = stasis_malloc(oldsize, void*);
+    for(pageid_t i = 0; i < oldsize; i++) {
+      bucket_t *b = hashtable_bucket(seg, i);
+      if(b->val) {
+        keys[n] = b->key;
+        vals[n] = b->val;
+        n++;
+        b->key = -1;
+        b->val = NULL;
+      }
+    }
+    while(seg->chunk_count < HASHTABLE_MAX_CHUNKS
+        && (seg->minbuckets << (seg->chunk_count-1)) < newsize) {
+      seg->chunks[seg->chunk_count] = hashtable_alloc_buckets(hashtable_chunk_size(seg, seg->chunk_count));
+      seg->chunk_count++;
+    }
+    // Buckets in [oldsize, newsize) are unreachable until we publish newsize,
+    // and were cleared when the segment last shrank (or were just allocated).
+    pageid_t newmax = newsize - 1;
+    for(pageid_t i = 0; i < n; i++) {
+      pageid_t idx = hashtable_func(newmax, keys[i]);
+      while(hashtable_bucket(seg, idx)->val) { idx = hashtable_wrap(newmax, idx+1); }
+      hashtable_bucket(seg, idx)->key = keys[i];
+      hashtable_bucket(seg, idx)->val = vals[i];
+    }
+    free(keys);
+    free(vals);
+    __sync_synchronize();
+    seg->maxbucketid = newmax;
+  }
+  for(pageid_t i = 0; i < oldsize; i++) {
+    pthread_mutex_unlock(&hashtable_bucket(seg, i)->mut);
+  }
+  pthread_mutex_unlock(&seg->resize_mut);
+}
+/** Called once an operation has released its last bucket latch. */
+static inline void hashtable_release(hashtable_segment_t *seg) {
+  if(hashtable_segment_needs_resize(seg)) {
+    hashtable_segment_resize(seg, 0);
+  }
+}
+
 hashtable_t * hashtable_init(pageid_t size) {
   pageid_t newsize = 1;
+  int bits = 0;
   for(int i = 0; size; i++) {
     size /= 2;
     newsize *= 2;
   }
+  newsize /= HASHTABLE_SEGMENT_COUNT;
+  if(newsize < HASHTABLE_MIN_SEGMENT_SIZE) { newsize = HASHTABLE_MIN_SEGMENT_SIZE; }
+  while(((pageid_t)1 << bits) < newsize) { bits++; }
+
   hashtable_t *ht = stasis_alloc(hashtable_t);
 
-  ht->maxbucketid = (newsize) - 1;
-  ht->buckets = stasis_calloc(ht->maxbucketid+1, bucket_t);
-  for(int i = 0; i <= ht->maxbucketid; i++) {
-    ht->buckets[i].key = -1;
-  }
-  pthread_mutexattr_t attr;
-  pthread_mutexattr_init(&attr);
-  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-  for(pageid_t i = 0; i <= ht->maxbucketid; i++) {
-    pthread_mutex_init(&(ht->buckets[i].mut), &attr);
+  for(int i = 0; i < HASHTABLE_SEGMENT_COUNT; i++) {
+    hashtable_segment_t * seg = &ht->segments[i];
+    pthread_mutex_init(&seg->resize_mut, 0);
+    seg->maxbucketid = newsize - 1;
+    seg->minbuckets = newsize;
+    seg->minbits = bits;
+    seg->count = 0;
+    seg->chunks[0] = hashtable_alloc_buckets(newsize);
+    seg->chunk_count = 1;
   }
 #ifdef STASIS_HASHTABLE_FSCK_THREAD
   ht->is_open = 1;
@@ -446,51 +646,75 @@ void hashtable_deinit(hashtable_t * ht) {
   ht->is_open = 0;
   pthread_join(ht->fsck_thread, 0);
 #endif
-  for(pageid_t i = 0; i <= ht->maxbucketid; i++) {
-    pthread_mutex_destroy(&ht->buckets[i].mut);
+  for(int i = 0; i < HASHTABLE_SEGMENT_COUNT; i++) {
+    hashtable_segment_t * seg = &ht->segments[i];
+    for(int k = 0; k < seg->chunk_count; k++) {
+      hashtable_free_buckets(seg->chunks[k], hashtable_chunk_size(seg, k));
+    }
+    pthread_mutex_destroy(&seg->resize_mut);
   }
-  free(ht->buckets);
   free(ht);
 }
 
 int hashtable_debug_number_of_key_copies(hashtable_t *ht, pageid_t pageid) {
   int count = 0;
-  for(int i = 0; i <= ht->maxbucketid; i++) {
-    if(ht->buckets[i].key == pageid) { count ++; }
+  for(int s = 0; s < HASHTABLE_SEGMENT_COUNT; s++) {
+    hashtable_segment_t * seg = &ht->segments[s];
+    pthread_mutex_lock(&seg->resize_mut);
+    for(pageid_t i = 0; i <= seg->maxbucketid; i++) {
+      if(hashtable_bucket(seg, i)->key == pageid) { count ++; }
+    }
+    pthread_mutex_unlock(&seg->resize_mut);
   }
   if(count > 0) { fprintf(stderr, "%d copies of key %lld in hashtable!", count, (unsigned long long) pageid); }
   return count;
 }
 
-void hashtable_fsck(hashtable_t *ht) {
-  pthread_mutex_lock(&ht->buckets[0].mut);
-  for(int i = 1; i <= ht->maxbucketid; i++) {
-    pthread_mutex_lock(&ht->buckets[i].mut);
-    if(ht->buckets[i].key != -1) {
-      pageid_t this_hash_code = hashtable_func(ht, ht->buckets[i].key);
+pageid_t hashtable_debug_bucket_count(hashtable_t *ht) {
+  pageid_t count = 0;
+  for(int s = 0; s < HASHTABLE_SEGMENT_COUNT; s++) {
+    count += ht->segments[s].maxbucketid+1;
+  }
+  return count;
+}
+
+static void hashtable_segment_fsck(hashtable_segment_t *seg) {
+  // Holding bucket 0 excludes resizes, so maxbucketid is stable after this.
+  pthread_mutex_lock(&hashtable_bucket(seg, 0)->mut);
+  pageid_t maxbucketid = seg->maxbucketid;
+  for(pageid_t i = 1; i <= maxbucketid; i++) {
+    bucket_t *b = hashtable_bucket(seg, i), *prev = hashtable_bucket(seg, i-1);
+    pthread_mutex_lock(&b->mut);
+    if(b->key != -1) {
+      pageid_t this_hash_code = hashtable_func(maxbucketid, b->key);
       if(this_hash_code != i) {
-        assert(ht->buckets[i-1].key != -1);
-        assert(ht->buckets[i-1].val != 0);
-        assert(this_hash_code < i || (this_hash_code > i + (ht->maxbucketid/2)));
+        assert(prev->key != -1);
+        assert(prev->val != 0);
+        assert(this_hash_code < i || (this_hash_code > i + (maxbucketid/2)));
       }
     } else {
-      assert(ht->buckets[i].val == NULL);
+      assert(b->val == NULL);
     }
-    pthread_mutex_unlock(&ht->buckets[i-1].mut);
+    if(i > 1) { pthread_mutex_unlock(&prev->mut); }
   }
-  pthread_mutex_lock(&ht->buckets[0].mut);
-  if(ht->buckets[0].key != -1) {
-    pageid_t this_hash_code = hashtable_func(ht, ht->buckets[0].key);
+  bucket_t *first = hashtable_bucket(seg, 0), *last = hashtable_bucket(seg, maxbucketid);
+  if(first->key != -1) {
+    pageid_t this_hash_code = hashtable_func(maxbucketid, first->key);
     if(this_hash_code != 0) {
-      assert(ht->buckets[ht->maxbucketid].key != -1);
-      assert(ht->buckets[ht->maxbucketid].val != 0);
-      assert(this_hash_code < 0 || (this_hash_code > 0 + (ht->maxbucketid/2)));
+      assert(last->key != -1);
+      assert(last->val != 0);
+      assert(this_hash_code < 0 || (this_hash_code > 0 + (maxbucketid/2)));
     }
   } else {
-    assert(ht->buckets[ht->maxbucketid].val == NULL);
+    assert(first->val == NULL);
+  }
+  if(maxbucketid > 0) { pthread_mutex_unlock(&last->mut); }
+  pthread_mutex_unlock(&first->mut);
+}
+void hashtable_fsck(hashtable_t *ht) {
+  for(int s = 0; s < HASHTABLE_SEGMENT_COUNT; s++) {
+    hashtable_segment_fsck(&ht->segments[s]);
   }
-  pthread_mutex_unlock(&ht->buckets[ht->maxbucketid].mut);
-  pthread_mutex_unlock(&ht->buckets[0].mut);
 }
 typedef enum {
   LOOKUP,
@@ -501,10 +725,27 @@ typedef enum {
 static inline void * hashtable_begin_op(hashtable_mode mode, hashtable_t *ht, pageid_t p, void *val, hashtable_bucket_handle_t *h) {
   static int warned = 0;
   assert(p != -1);
-  pageid_t idx = hashtable_func(ht, p);
+  hashtable_segment_t *seg = hashtable_segment(ht, hash6432shift(p));
+  if(mode == INSERT || mode == TRYINSERT) {
+    // Reserve a bucket for the new key.  Otherwise, concurrent inserts could
+    // push the segment past 50% utilization before anyone resized it.
+    while(hashtable_segment_overfull(seg, FETCH_AND_ADD(&seg->count, 1) + 1)) {
+      FETCH_AND_ADD(&seg->count, -1);
+      // Opportunistic resizing fell behind; wait for the segment to quiesce.
+      hashtable_segment_resize(seg, 1);
+    }
+  }
+  pageid_t maxbucketid, idx;
+  bucket_t *b1, *b2 = NULL;
+  while(1) {
+    maxbucketid = seg->maxbucketid;
+    idx = hashtable_func(maxbucketid, p);
+    b1 = hashtable_bucket(seg, idx);
+    pthread_mutex_lock(&b1->mut); // start crabbing
+    if(seg->maxbucketid == maxbucketid) { break; }
+    pthread_mutex_unlock(&b1->mut); // raced with a resize; see "Resizing", above.
+  }
   void * ret;
-  bucket_t *b1 = &ht->buckets[idx], *b2 = NULL;
-  pthread_mutex_lock(&b1->mut); // start crabbing
 
   int num_incrs = 0;
 
@@ -515,17 +756,21 @@ static inline void * hashtable_begin_op(hashtable_mode mode, hashtable_t *ht, pa
       warned = 1;
       printf("The hashtable is seeing lots of collisions.  Increase its size?\n");
     }
-    assert(num_incrs < (ht->maxbucketid/4));
+    assert(num_incrs < (maxbucketid/2));
     num_incrs++;
     if(b1->key == p) { assert(b1->val); ret = b1->val; break; }
     if(b1->val == NULL) { assert(b1->key == -1); ret = NULL; break; }
-    idx = hashtable_wrap(ht, idx+1);
+    idx = hashtable_wrap(maxbucketid, idx+1);
     b2 = b1;
-    b1 = &ht->buckets[idx];
+    b1 = hashtable_bucket(seg, idx);
     pthread_mutex_lock(&b1->mut);
     pthread_mutex_unlock(&b2->mut);
   }
+  if((mode == INSERT || mode == TRYINSERT) && ret) {
+    FETCH_AND_ADD(&seg->count, -1); // the key exists, so we did not need the bucket we reserved.
+  }
   h->b1 = b1; // at this point, b1 is latched.
+  h->seg = seg;
   h->key = p;
   h->idx = idx;
   h->ret = ret;
@@ -547,17 +792,21 @@ void * hashtable_fsck_worker(void * htp) {
 
 
 void hashtable_end_op(hashtable_mode mode, hashtable_t *ht, void *val, hashtable_bucket_handle_t *h) {
+  hashtable_segment_t * seg = h->seg;
   pageid_t idx = h->idx;
+  // Holding b1 excludes resizes, so maxbucketid is the size begin_op used.
+  pageid_t maxbucketid = seg->maxbucketid;
   bucket_t * b1 = h->b1;
   bucket_t * b2 = NULL;
   if(mode == INSERT || (mode == TRYINSERT && h->ret == NULL)) {
     b1->key = h->key;
     b1->val = val;
   } else if(mode == REMOVE && h->ret != NULL)  {
+    FETCH_AND_ADD(&seg->count, -1);
     pageid_t idx2 = idx;
-    idx = hashtable_wrap(ht, idx+1);
+    idx = hashtable_wrap(maxbucketid, idx+1);
     b2 = b1;
-    b1 = &ht->buckets[idx];
+    b1 = hashtable_bucket(seg, idx);
     pthread_mutex_lock(&b1->mut);
     while(1) {
       // Loop invariants: b2 needs to be overwritten.
@@ -575,17 +824,17 @@ void hashtable_end_op(hashtable_mode mode, hashtable_t *ht, void *val, hashtable
       } else {
         // Case 2: b1 belongs "after" b2
 
-        pageid_t newidx = hashtable_func(ht, b1->key);
+        pageid_t newidx = hashtable_func(maxbucketid, b1->key);
 
         // If newidx is past idx2, lookup will never find b1->key in position
         // idx2. Taking wraparound into account, and noticing that we never
         // have more than maxbucketid/4 elements in hash table, the following
         // expression detects if newidx is past idx2:
-        if(((idx2 - newidx) & ht->maxbucketid) > ht->maxbucketid/2) {
+        if(((idx2 - newidx) & maxbucketid) > maxbucketid/2) {
           // skip this b1.
   //        printf("s\n"); fflush(0);
-          idx = hashtable_wrap(ht, idx+1);
-          bucket_t * b0 = &ht->buckets[idx];
+          idx = hashtable_wrap(maxbucketid, idx+1);
+          bucket_t * b0 = hashtable_bucket(seg, idx);
           // Here we have to hold three buckets momentarily.  If we released b1 before latching its successor, then
           // b1 could be deleted by another thread, and the successor could be compacted before we latched it.
           pthread_mutex_lock(&b0->mut);
@@ -594,15 +843,15 @@ void hashtable_end_op(hashtable_mode mode, hashtable_t *ht, void *val, hashtable
         } else {
           // Case 3: we can compact b1 into b2's slot.
 
-//        printf("c %lld %lld %lld  %lld\n", startidx, idx2, newidx, ht->maxbucketid); fflush(0);
+//        printf("c %lld %lld %lld  %lld\n", startidx, idx2, newidx, maxbucketid); fflush(0);
           b2->key = b1->key;
           b2->val = b1->val;
           pthread_mutex_unlock(&b2->mut);
           // now we need to overwrite b1, so it is the new b2.
           idx2 = idx;
-          idx = hashtable_wrap(ht, idx+1);
+          idx = hashtable_wrap(maxbucketid, idx+1);
           b2 = b1;
-          b1 = &ht->buckets[idx];
+          b1 = hashtable_bucket(seg, idx);
           pthread_mutex_lock(&b1->mut);
         }
       }
@@ -615,6 +864,7 @@ static inline void * hashtable_op(hashtable_mode mode, hashtable_t *ht, pageid_t
   hashtable_bucket_handle_t h;
   void * ret = hashtable_begin_op(mode, ht, p, val, &h);
   hashtable_end_op(mode, ht, val, &h);
+  hashtable_release(h.seg);
   return ret;
 }
 static inline void * hashtable_op_lock(hashtable_mode mode, hashtable_t *ht, pageid_t p, void *val, hashtable_bucket_handle_t *h) {
@@ -639,6 +889,7 @@ void * hashtable_test_and_set(hashtable_t *ht, pageid_t p, void * val) {
   } else {
     hashtable_end_op(INSERT, ht, val, &h);
   }
+  hashtable_release(h.seg);
   return ret;
 }
 void * hashtable_lookup(hashtable_t *ht, pageid_t p) {
@@ -661,6 +912,7 @@ void * hashtable_lookup_lock(hashtable_t *ht, pageid_t p, hashtable_bucket_handl
 }
 void hashtable_unlock(hashtable_bucket_handle_t *h) {
   pthread_mutex_unlock(&h->b1->mut);
+  hashtable_release(h->seg);
 }
 
 void * hashtable_remove_begin(hashtable_t *ht, pageid_t p, hashtable_bucket_handle_t *h) {
@@ -669,8 +921,10 @@ void * hashtable_remove_begin(hashtable_t *ht, pageid_t p, hashtable_bucket_hand
 void hashtable_remove_finish(hashtable_t *ht, hashtable_bucket_handle_t *h) {
  // when begin_remove_lock returns, it leaves the remove half done.  we then call this to decide if the remove should happen.  Other than hashtable_unlock, this is the only method you can safely call while holding a latch.
   hashtable_end_op(REMOVE, ht, NULL, h);
+  hashtable_release(h->seg);
 }
 void hashtable_remove_cancel(hashtable_t *ht, hashtable_bucket_handle_t *h) {
  // when begin_remove_lock returns, it leaves the remove half done.  we then call this to decide if the remove should happen.  Other than hashtable_unlock, this is the only method you can safely call while holding a latch.
   hashtable_end_op(LOOKUP, ht, NULL, h);  // hack
+  hashtable_release(h->seg);
 }
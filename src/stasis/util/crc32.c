@@ -54,3 +54,128 @@ uint32_t stasis_crc32(const void *buffer, unsigned int count, uint32_t crc)
 	}
 	return crc;
 }
+
+// CRC32C.  The table and SSE4.2 kernels below are not part of the file
+// above; they compute the same thing in different ways.
+
+#define CRC32C_POLYNOMIAL 0x82F63B78
+/** Bytes per stream in crc32c_hw's three way interleaved loop. */
+#define CRC32C_STRIPE 256
+
+static uint32_t crc32c_table[8][256];
+/** crc32c_shift[k][v] advances the crc (v << 8k) past CRC32C_STRIPE zero bytes. */
+static uint32_t crc32c_shift[4][256];
+static uint32_t (*crc32c_impl)(const unsigned char *p, size_t count, uint32_t crc);
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_byte(uint32_t crc, unsigned char c) {
+	return crc32c_table[0][(crc ^ c) & 0xff] ^ (crc >> 8);
+}
+static uint32_t crc32c_sw(const unsigned char *p, size_t count, uint32_t crc) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	while (count && ((uintptr_t)p & 7)) {
+		crc = crc32c_byte(crc, *p++);
+		count--;
+	}
+	while (count >= 8) {
+		uint64_t w;
+		memcpy(&w, p, sizeof(w));
+		w ^= crc;
+		crc = crc32c_table[7][w & 0xff] ^ crc32c_table[6][(w >> 8) & 0xff]
+		    ^ crc32c_table[5][(w >> 16) & 0xff] ^ crc32c_table[4][(w >> 24) & 0xff]
+		    ^ crc32c_table[3][(w >> 32) & 0xff] ^ crc32c_table[2][(w >> 40) & 0xff]
+		    ^ crc32c_table[1][(w >> 48) & 0xff] ^ crc32c_table[0][w >> 56];
+		p += 8;
+		count -= 8;
+	}
+#endif
+	while (count--) {
+		crc = crc32c_byte(crc, *p++);
+	}
+	return crc;
+}
+static uint32_t crc32c_shift_stripe(uint32_t crc) {
+	return crc32c_shift[0][crc & 0xff] ^ crc32c_shift[1][(crc >> 8) & 0xff]
+	     ^ crc32c_shift[2][(crc >> 16) & 0xff] ^ crc32c_shift[3][crc >> 24];
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+/**
+   The crc32 instruction has a latency of three cycles, but can start
+   once per cycle, so this checksums three stripes at once, and then
+   merges the results with crc32c_shift.
+*/
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(const unsigned char *p, size_t count, uint32_t crc) {
+	uint64_t c0 = crc;
+	while (count && ((uintptr_t)p & 7)) {
+		c0 = _mm_crc32_u8((uint32_t)c0, *p++);
+		count--;
+	}
+	while (count >= 3 * CRC32C_STRIPE) {
+		uint64_t c1 = 0, c2 = 0;
+		for (int i = 0; i < CRC32C_STRIPE; i += 8) {
+			uint64_t w0, w1, w2;
+			memcpy(&w0, p + i, 8);
+			memcpy(&w1, p + i + CRC32C_STRIPE, 8);
+			memcpy(&w2, p + i + 2 * CRC32C_STRIPE, 8);
+			c0 = _mm_crc32_u64(c0, w0);
+			c1 = _mm_crc32_u64(c1, w1);
+			c2 = _mm_crc32_u64(c2, w2);
+		}
+		c0 = crc32c_shift_stripe((uint32_t)c0) ^ (uint32_t)c1;
+		c0 = crc32c_shift_stripe((uint32_t)c0) ^ (uint32_t)c2;
+		p += 3 * CRC32C_STRIPE;
+		count -= 3 * CRC32C_STRIPE;
+	}
+	while (count >= 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		c0 = _mm_crc32_u64(c0, w);
+		p += 8;
+		count -= 8;
+	}
+	while (count--) {
+		c0 = _mm_crc32_u8((uint32_t)c0, *p++);
+	}
+	return (uint32_t)c0;
+}
+#endif
+
+static void crc32c_init(void) {
+	for (int i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int j = 0; j < 8; j++) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+		}
+		crc32c_table[0][i] = crc;
+	}
+	for (int i = 0; i < 256; i++) {
+		for (int k = 1; k < 8; k++) {
+			uint32_t prev = crc32c_table[k-1][i];
+			crc32c_table[k][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xff];
+		}
+	}
+	for (int k = 0; k < 4; k++) {
+		for (int v = 0; v < 256; v++) {
+			uint32_t crc = (uint32_t)v << (8 * k);
+			for (int i = 0; i < CRC32C_STRIPE; i++) {
+				crc = crc32c_byte(crc, 0);
+			}
+			crc32c_shift[k][v] = crc;
+		}
+	}
+	crc32c_impl = crc32c_sw;
+#if defined(__x86_64__) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		crc32c_impl = crc32c_hw;
+	}
+#endif
+}
+
+uint32_t stasis_crc32c(const void *buffer, size_t count, uint32_t crc) {
+	pthread_once(&crc32c_once, crc32c_init);
+	return crc32c_impl((const unsigned char *)buffer, count, crc);
+}
@@ -98,6 +98,21 @@ Page * loadUninitializedPage(int xid, pageid_t pageid);
 
 Page * loadPageForOperation(int xid, pageid_t pageid, int op);
 
+/**
+ * Pin a batch of pages.  This is equivalent to calling loadPage() on
+ * each entry of pageids, but lets the buffer manager amortize its
+ * bookkeeping, and read pages that are not in cache with as few
+ * requests as possible.
+ *
+ * @param pageids The pages to load.  Duplicates are allowed, and are
+ *                pinned once per occurrence.
+ * @param count The number of entries in pageids.  This should be small
+ *              relative to the size of the buffer pool.
+ * @param pages An array of count pointers.  pages[i] will be set to
+ *              the pinned copy of pageids[i].
+ */
+void   loadPages(int xid, const pageid_t * pageids, int count, Page ** pages);
+
 void   prefetchPages(pageid_t pageid, pageid_t count);
 int    preallocatePages(pageid_t pageid, pageid_t count);
 /**
@@ -112,6 +127,24 @@ Page * getCachedPage(int xid, const pageid_t pageid);
    in memory.  releasePage releases this lock.
 */
 void releasePage(Page *p);
+/**
+   Release each page in an array of pages, such as the one produced by
+   loadPages().
+*/
+void releasePages(Page ** pages, int count);
+/**
+   Flag a page that many threads pin at once, such as a hash table
+   header or the root of a tree.  Buffer managers may keep hot pages in
+   memory, and pin them without updating shared state.
+
+   The caller must not have the page pinned.  Writing back a hot page
+   waits until no thread has it pinned.
+
+   @param hot 1 to flag the page, 0 to clear the flag.
+   @return 0 on success, ENOSPC if too many pages are hot, or ENOTSUP
+           if the buffer manager does not distinguish hot pages.
+*/
+int setPageHot(pageid_t pageid, int hot);
 /**
  * Switch the buffer manager into / out of redo mode.  Redo mode forces loadUnintializedPage() to behave like loadPage().
  */
@@ -124,6 +157,8 @@ struct stasis_buffer_manager_t {
   stasis_buffer_manager_handle_t* (*openHandleImpl)(stasis_buffer_manager_t*, int is_sequential);
   int    (*closeHandleImpl)(stasis_buffer_manager_t*, stasis_buffer_manager_handle_t*);
   Page * (*loadPageImpl)(stasis_buffer_manager_t*, stasis_buffer_manager_handle_t* h, int xid, pageid_t pageid, pagetype_t type);
+  /** Optional.  If this is NULL, loadPages() calls loadPageImpl once per page. */
+  void   (*loadPagesImpl)(stasis_buffer_manager_t*, stasis_buffer_manager_handle_t* h, int xid, const pageid_t * pageids, int count, Page ** pages);
   Page * (*loadUninitPageImpl)(stasis_buffer_manager_t*, int xid, pageid_t pageid);
   void   (*prefetchPages)(stasis_buffer_manager_t*, pageid_t pageid, pageid_t count);
   int    (*preallocatePages)(stasis_buffer_manager_t*, pageid_t pageid, pageid_t count);
@@ -153,6 +188,16 @@ struct stasis_buffer_manager_t {
    *  FORCE mode transactions.
    */
   int    (*tryToWriteBackPage)(stasis_buffer_manager_t*, pageid_t p);
+  /**
+   *  Optional.  Equivalent to calling tryToWriteBackPage() on each page in
+   *  pageids, but allows the buffer manager to combine writes of adjacent
+   *  pages.  If this is NULL, callers fall back to tryToWriteBackPage().
+   *
+   *  @param pageids The pages to write back, usually sorted by page id.
+   *  @return the number of pages that could not be written back because
+   *          tryToWriteBackPage() would have returned EBUSY.
+   */
+  int    (*tryToWriteBackPages)(stasis_buffer_manager_t*, const pageid_t * pageids, int count);
   /**
       Force any written back pages to disk.
 
@@ -186,6 +231,14 @@ struct stasis_buffer_manager_t {
   */
   void   (*forcePageRange)(struct stasis_buffer_manager_t*, stasis_buffer_manager_handle_t *h, pageid_t start, pageid_t stop);
   void   (*stasis_buffer_manager_simulate_crash)(struct stasis_buffer_manager_t*);
+  /**
+   *  Optional.  Called by Tinit() once recovery is complete.  Buffer
+   *  managers that save the ids of their cached pages when they are
+   *  closed may begin reloading them here.  This must not block.
+   */
+  void   (*restoreHotSet)(struct stasis_buffer_manager_t*);
+  /** Optional.  @see setPageHot() */
+  int    (*setPageHotImpl)(struct stasis_buffer_manager_t*, pageid_t pageid, int hot);
   /**
    * Write out any dirty pages.  Assumes that there are no running transactions
    */
@@ -0,0 +1,76 @@
+#ifndef STASIS_COMPRESSED_TIER_H
+#define STASIS_COMPRESSED_TIER_H
+#include <stasis/common.h>
+BEGIN_C_DECLS
+/**
+   @file
+
+   An in-memory pool of compressed, clean pages.  The buffer manager puts
+   clean pages here as it evicts them, and checks the pool before reading
+   a page from disk.  Pages leave the pool when they are read back, so a
+   page is never in the buffer pool and the compressed tier at once.
+
+   Pages are compressed with a byte oriented LZ77 variant that is fast
+   enough to beat a disk read by several orders of magnitude.  Pages that
+   do not compress to less than 3/4 of their size are not admitted.  When
+   the pool is full, the oldest pages are dropped.
+*/
+typedef struct stasis_compressed_tier_t stasis_compressed_tier_t;
+
+typedef struct {
+  /** Calls to get() that found the page. */
+  uint64_t hits;
+  /** Calls to get() that did not find the page. */
+  uint64_t misses;
+  /** Pages that were compressed and admitted by put(). */
+  uint64_t insertions;
+  /** Pages that put() did not admit, because they did not compress well. */
+  uint64_t rejections;
+  /** Pages that were dropped to make room for newer ones. */
+  uint64_t evictions;
+  /** Number of pages in the pool. */
+  pageid_t pages;
+  /** Compressed bytes in the pool. */
+  uint64_t bytes;
+  /** The pool's capacity, in compressed bytes. */
+  uint64_t capacity;
+} stasis_compressed_tier_stats_t;
+
+/**
+   @param capacity The number of bytes of compressed pages that the tier
+                   may hold.
+*/
+stasis_compressed_tier_t * stasis_compressed_tier_open(uint64_t capacity);
+void stasis_compressed_tier_close(stasis_compressed_tier_t * t);
+/**
+   Compress a copy of a clean page, replacing any copy that is already in
+   the tier.
+
+   @return 1 if the page was admitted, 0 otherwise.
+*/
+int stasis_compressed_tier_put(stasis_compressed_tier_t * t, pageid_t pageid, const byte * buf);
+/**
+   If the tier holds pageid, decompress it into buf (which must be
+   PAGE_SIZE bytes long), and remove it from the tier.
+
+   @return 1 if the page was found, 0 otherwise.
+*/
+int stasis_compressed_tier_get(stasis_compressed_tier_t * t, pageid_t pageid, byte * buf);
+/** Drop pageid from the tier, if it is there. */
+void stasis_compressed_tier_invalidate(stasis_compressed_tier_t * t, pageid_t pageid);
+void stasis_compressed_tier_stats(stasis_compressed_tier_t * t, stasis_compressed_tier_stats_t * stats);
+
+/**
+   Compress len bytes of in into out.
+
+   @return the compressed length, or 0 if it would be longer than out_len.
+*/
+size_t stasis_compressed_tier_compress(const byte * in, size_t len, byte * out, size_t out_len);
+/**
+   Decompress in, which must expand to exactly out_len bytes.
+
+   @return 0 on success, or -1 if in is corrupt.
+*/
+int stasis_compressed_tier_decompress(const byte * in, size_t len, byte * out, size_t out_len);
+END_C_DECLS
+#endif // STASIS_COMPRESSED_TIER_H
@@ -8,8 +8,31 @@
 #ifndef CONCURRENTBUFFERMANAGER_H_
 #define CONCURRENTBUFFERMANAGER_H_
 #include <stasis/bufferManager.h>
+#include <stasis/replacementPolicy.h>
+#include <stasis/bufferManager/compressedTier.h>
 BEGIN_C_DECLS
 stasis_buffer_manager_t* stasis_buffer_manager_concurrent_hash_factory(stasis_log_t *log, stasis_dirty_page_table_t *dpt);
 stasis_buffer_manager_t* stasis_buffer_manager_concurrent_hash_open(stasis_page_handle_t * h, stasis_log_t * log, stasis_dirty_page_table_t * dpt);
+/**
+ * Copy the statistics for one of the buffer pool's NUMA partitions into
+ * stats.
+ *
+ * @return the number of partitions, or zero if the pool is not partitioned.
+ * @see stasis_buffer_pool_numa_nodes
+ */
+int stasis_buffer_manager_concurrent_hash_numa_stats(stasis_buffer_manager_t *bm, int node, stasis_replacement_policy_numa_stats_t *stats);
+/**
+ * Copy the compressed tier's hit, miss and occupancy counters into stats.
+ *
+ * @return 1, or zero (and leave stats alone) if there is no compressed tier.
+ * @see stasis_buffer_manager_compressed_tier_size
+ */
+int stasis_buffer_manager_concurrent_hash_compressed_tier_stats(stasis_buffer_manager_t *bm, stasis_compressed_tier_stats_t *stats);
+/**
+ * @return the STASIS_BUFFER_POOL_HUGE_PAGES_* mode that the buffer pool is
+ *         using.
+ * @see stasis_buffer_pool_huge_pages
+ */
+int stasis_buffer_manager_concurrent_hash_huge_pages(stasis_buffer_manager_t *bm);
 END_C_DECLS
 #endif /* CONCURRENTBUFFERMANAGER_H_ */
@@ -0,0 +1,19 @@
+#ifndef STASIS_MMAP_READ_ONLY_H
+#define STASIS_MMAP_READ_ONLY_H
+#include <stasis/bufferManager.h>
+BEGIN_C_DECLS
+/**
+   Open a buffer manager that maps filename into memory, and serves pages
+   directly out of the mapping.  The page file must not be modified while
+   the buffer manager is open; the buffer manager refuses all writes.
+
+   @return the buffer manager, or NULL if the file could not be mapped.
+*/
+stasis_buffer_manager_t* stasis_buffer_manager_mmap_read_only_open(const char * filename);
+/**
+   Open stasis_store_file_name with stasis_buffer_manager_mmap_read_only_open().
+   This is suitable for use as stasis_buffer_manager_factory.
+*/
+stasis_buffer_manager_t* stasis_buffer_manager_mmap_read_only_factory(stasis_log_t * log, stasis_dirty_page_table_t *dpt);
+END_C_DECLS
+#endif // STASIS_MMAP_READ_ONLY_H
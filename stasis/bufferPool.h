@@ -66,5 +66,36 @@ Page* stasis_buffer_pool_malloc_page(stasis_buffer_pool_t* pool);
 */
 void  stasis_buffer_pool_free_page(stasis_buffer_pool_t* pool, Page * p, pageid_t id);
 Page * stasis_buffer_pool_get_underlying_array(stasis_buffer_pool_t *ret);
+/**
+    The frames in the underlying array are split into runs of
+    stasis_buffer_pool_frames_per_node() frames, one per NUMA node.  The
+    memory for each run is allocated from the run's node, if that node
+    exists.
+
+    @see stasis_buffer_pool_numa_nodes
+*/
+int stasis_buffer_pool_node_count(stasis_buffer_pool_t *ret);
+pageid_t stasis_buffer_pool_frames_per_node(stasis_buffer_pool_t *ret);
+/** @return the NUMA node that frame p was allocated from. */
+int stasis_buffer_pool_page_node(stasis_buffer_pool_t *ret, Page *p);
+/**
+    @return the STASIS_BUFFER_POOL_HUGE_PAGES_* mode that the frames were
+            actually allocated with.  This can be less than the mode that
+            stasis_buffer_pool_huge_pages asked for, if that mode is not
+            available.
+
+    @see stasis_buffer_pool_huge_pages
+*/
+int stasis_buffer_pool_huge_pages_mode(stasis_buffer_pool_t *ret);
+/**
+    Allocate a PAGE_SIZE aligned buffer, suitable for I/O against file
+    handles that were opened with O_DIRECT.  Buffer pool frames are
+    allocated with this function.
+
+    @return the buffer, or NULL on failure.  Free it with
+            stasis_buffer_pool_free_aligned().
+*/
+void * stasis_buffer_pool_alloc_aligned(size_t len);
+void stasis_buffer_pool_free_aligned(void * buf);
 #endif // STASIS_BUFFER_POOL_H
 
@@ -88,6 +88,14 @@ terms specified in this license.
 #define STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU 1
 #define STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU 2
 #define STASIS_REPLACEMENT_POLICY_CLOCK 3
+#define STASIS_REPLACEMENT_POLICY_CONCURRENT_2Q 4
+
+#define STASIS_NUMA_PLACEMENT_LOCAL 1
+#define STASIS_NUMA_PLACEMENT_HASH  2
+
+#define STASIS_BUFFER_POOL_HUGE_PAGES_DISABLED    1
+#define STASIS_BUFFER_POOL_HUGE_PAGES_TRANSPARENT 2
+#define STASIS_BUFFER_POOL_HUGE_PAGES_EXPLICIT    3
 
 #define MAX_TRANSACTIONS 1000
 
@@ -209,6 +217,14 @@ static const short SLOT_TYPE_LENGTHS[] = { -1, -1, sizeof(blob_record_t), -1};
 #define CLRLOG 7
 
 #define XPREPARE 8
+/**
+    A fuzzy checkpoint.  It is written outside of any transaction, and
+    records the dirty page table and transaction table, so that
+    recovery can skip the parts of the log that precede them.
+
+    @see CheckpointLogEntry
+*/
+#define CHECKPOINTLOG 9
 
 /* Page types */
 #define UNKNOWN_TYPE_PAGE (-1)
@@ -29,8 +29,104 @@ int  stasis_dirty_page_table_is_dirty(stasis_dirty_page_table_t * dirtyPages, Pa
 pageid_t stasis_dirty_page_table_dirty_count(stasis_dirty_page_table_t * dirtyPages);
 
 int  stasis_dirty_page_table_flush(stasis_dirty_page_table_t * dirtyPages);
+/**
+  Write back the pages whose recLSN is below targetLsn, so that the log
+  can be truncated up to it.  (If targetLsn is LSN_T_MAX, this is
+  stasis_dirty_page_table_flush().)
+
+  The pages are collected, sorted by page id, and written in batches of
+  stasis_dirty_page_table_flush_quantum pages, so that adjacent pages are
+  coalesced, and the writes reach the device in order.  Pinned pages are
+  retried until minRecLSN reaches targetLsn.
+
+  @see stasis_dirty_page_table_flush_progress()
+*/
 int  stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyPages, lsn_t targetLsn);
 lsn_t stasis_dirty_page_table_minRecLSN(stasis_dirty_page_table_t* dirtyPages);
+/**
+  Copy the ids and recLSNs of the dirty pages, in no particular order.
+  Shards are copied one at a time, so this is a fuzzy snapshot; pages
+  dirtied by log entries older than the caller's first_pending_lsn()
+  are guaranteed to be included (unless they are cleaned first).
+
+  @param pages Set to a malloc()ed array of page ids.
+  @param recLSNs Set to a malloc()ed array of the corresponding recLSNs.
+  @return the number of pages in the arrays.
+*/
+pageid_t stasis_dirty_page_table_snapshot(stasis_dirty_page_table_t * dirtyPages, pageid_t ** pages, lsn_t ** recLSNs);
+
+/** Progress of an LSN targeted flush, such as the ones log truncation issues. */
+typedef struct {
+  /** The target of the most recent flush_with_target() call, or zero if there has not been one. */
+  lsn_t target_lsn;
+  /** The number of sweeps over the pages below the target.  More than one means that some were pinned. */
+  int passes;
+  /** Pages below the target when the current sweep started. */
+  pageid_t pages;
+  /** Pages that the current sweep has written back. */
+  pageid_t written;
+  /** Pages that the current sweep skipped because they were pinned. */
+  pageid_t busy;
+  /** Set once the flush has returned. */
+  int done;
+  /** The dirty page table's minRecLSN when the progress was sampled. */
+  lsn_t min_rec_lsn;
+} stasis_dirty_page_table_flush_progress_t;
+/**
+  Report the progress of the most recent (or in progress) LSN targeted
+  flush.  If several threads issue targeted flushes at once, this reports
+  on the one that started last.
+*/
+void stasis_dirty_page_table_flush_progress(stasis_dirty_page_table_t * dirtyPages, stasis_dirty_page_table_flush_progress_t * progress);
+
+/** The writeback thresholds that are currently in effect. */
+typedef struct {
+  pageid_t soft_limit;
+  pageid_t low_water_mark;
+  pageid_t hard_limit;
+  pageid_t flush_quantum;
+  /** Measured writeback bandwidth, in pages per second; zero if unknown. */
+  pageid_t write_bandwidth;
+} stasis_dirty_page_table_limits_t;
+/**
+  Report the writeback thresholds that buffer managers should use.
+
+  These are the values of stasis_dirty_page_count_soft_limit and friends,
+  unless stasis_dirty_page_table_adaptive_limits is set, in which case the
+  soft limit, low water mark and flush quantum are scaled down to match
+  the bandwidth that writeback has measured.  The hard limit is never
+  adjusted, since it bounds the memory used by dirty pages.
+*/
+void stasis_dirty_page_table_get_limits(stasis_dirty_page_table_t * dirtyPages, stasis_dirty_page_table_limits_t * limits);
+/**
+  Tell the adaptive limit controller that writeback as a whole wrote pages
+  pages in seconds seconds.  The dirty page table combines the pages that
+  all of its concurrent flushes write into one sample every 100ms of busy
+  time, and calls this with it; buffer managers that write back pages on
+  their own may call it too.
+*/
+void stasis_dirty_page_table_observe_writeback(stasis_dirty_page_table_t * dirtyPages, pageid_t pages, double seconds);
+/**
+  Perform an elevator sweep over one partition of the dirty page table.
+
+  The page id space is divided into stripes of stripe_size pages, and stripe
+  s belongs to partition (s % partition_count).  Since the partitions are
+  disjoint, several writeback threads can sweep the table concurrently
+  without competing for the same pages.  Each call issues its own
+  asyncForcePages() after every stasis_dirty_page_table_flush_quantum
+  pages.
+
+  If partition_count is one, this is equivalent to
+  stasis_dirty_page_table_flush().
+
+  @param dirtyPages The dirty page table.
+  @param partition The partition to be written back; 0 <= partition < partition_count.
+  @param partition_count The total number of partitions.
+  @param stripe_size The number of contiguous pages assigned to a partition at a time.
+
+  @return 0 (as with stasis_dirty_page_table_flush(), pages that are pinned are skipped).
+*/
+int  stasis_dirty_page_table_flush_partition(stasis_dirty_page_table_t * dirtyPages, int partition, int partition_count, pageid_t stripe_size);
 
 /**
   This method returns a (mostly) contiguous range of the dirty page table for writeback.
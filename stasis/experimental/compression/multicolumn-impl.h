@@ -63,7 +63,7 @@ Multicolumn<TUPLE>::Multicolumn(Page * p) :
 
   bytes_left_ = *exceptions_offset_ptr() - first_free;
 
-  assert(*stasis_page_type_ptr(p) == (Multicolumn<TUPLE>::plugin_id()));
+  assert(p->pageType == (Multicolumn<TUPLE>::plugin_id()));
 }
 
 template <class TUPLE>
@@ -234,6 +234,7 @@ static const page_impl multicolumn_impl = {
   0,  // multicolumnLoaded,
   0,  // multicolumnFlushed
   0,  // multicolumnCleanup
+  0,  // multicolumnReadOptimistic
 };
 
 // XXX implement plugin_id().  Currently, it treats all instantiations of the
@@ -248,7 +249,7 @@ Multicolumn<TUPLE>::plugin_id(void) {
 template <class TUPLE>
 void multicolumnLoaded(Page *p) {
   p->LSN = *stasis_page_lsn_ptr(p);
-  assert(*stasis_page_type_ptr(p) == Multicolumn<TUPLE>::plugin_id());
+  assert(p->pageType == Multicolumn<TUPLE>::plugin_id());
   p->impl = new Multicolumn<TUPLE>(p);
 }
 
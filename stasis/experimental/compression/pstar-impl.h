@@ -89,6 +89,7 @@ static const page_impl pstar_impl = {
   0,  // pStarLoaded,
   0,  // pStarFlushed
   0,  // pStarCleanup
+  0,  // pStarReadOptimistic
 };
 
 /**
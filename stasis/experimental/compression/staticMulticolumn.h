@@ -560,7 +560,7 @@ class StaticMulticolumn {
 
       bytes_left_ = *exceptions_offset_ptr() - first_free;
 
-      assert(*stasis_page_type_ptr(p) == (plugin_id()));
+      assert(p->pageType == (plugin_id()));
     }
 
   /**
@@ -665,6 +665,7 @@ static const page_impl static_multicolumn_impl = {
   0,  // multicolumnLoaded,
   0,  // multicolumnFlushed
   0,  // multicolumnCleanup
+  0,  // multicolumnReadOptimistic
 };
 
 template <int N, class TUPLE,
@@ -87,7 +87,7 @@ namespace rose {
     pageCount++;
 
     Page *p = loadPage(xid, next_page);
-    writelock(p->rwlatch,0);
+    stasis_page_writelock(p);
     stasis_page_cleanup(p);
     typename PAGELAYOUT::FMT * mc = PAGELAYOUT::initPage(p, &**begin);
 
@@ -98,12 +98,12 @@ namespace rose {
       if(ret == rose::NOSPACE) {
 	stasis_dirty_page_table_set_dirty((stasis_dirty_page_table_t*)stasis_runtime_dirty_page_table(), p);
 	mc->pack();
-        unlock(p->rwlatch);
+        stasis_page_writeunlock(p);
 	releasePage(p);
 	next_page = pageAlloc(xid,pageAllocState);
 	TlsmAppendPage(xid,tree,(*i).toByteArray(),pageAlloc,pageAllocState,next_page);
 	p = loadPage(xid, next_page);
-        writelock(p->rwlatch,0);
+        stasis_page_writelock(p);
 	mc = PAGELAYOUT::initPage(p, &*i);
 	pageCount++;
 	ret = mc->append(xid, *i);
@@ -113,7 +113,7 @@ namespace rose {
     }
     stasis_dirty_page_table_set_dirty((stasis_dirty_page_table_t*)stasis_runtime_dirty_page_table(), p);
     mc->pack();
-    unlock(p->rwlatch);
+    stasis_page_writeunlock(p);
     releasePage(p);
     return pageCount;
   }
@@ -53,6 +53,43 @@ extern pageid_t stasis_dirty_page_count_hard_limit;
  * by writeback are released at least this often.
  */
 extern pageid_t stasis_dirty_page_table_flush_quantum;
+/**
+ * If true, the dirty page table measures writeback bandwidth, and lowers
+ * the soft limit, low water mark and flush quantum (but never raises them
+ * above the values configured above) when the device is too slow to keep
+ * up with them.  This starts writeback earlier when the disk slows down,
+ * leaving more room below stasis_dirty_page_count_hard_limit, so writers
+ * are less likely to stall.
+ *
+ * Bandwidth is measured as the rate at which asyncForcePages() accepts
+ * pages, which overstates the device while the operating system has room
+ * to buffer writes, so this is off by default.
+ *
+ * @see stasis_dirty_page_table_get_limits()
+ */
+extern int stasis_dirty_page_table_adaptive_limits;
+/**
+ * With adaptive limits, writeback starts once there are more dirty pages
+ * than the device can write in this many milliseconds.
+ */
+extern int stasis_dirty_page_table_adaptive_backlog_ms;
+/**
+ * With adaptive limits, the flush quantum is the number of pages that the
+ * device can write in this many milliseconds.
+ */
+extern int stasis_dirty_page_table_adaptive_quantum_ms;
+/**
+ * The number of shards in the dirty page table.  Each shard has its own
+ * mutex, so threads that dirty pages in different shards do not contend
+ * with each other.  Read when the dirty page table is created.
+ */
+extern int stasis_dirty_page_table_shard_count;
+/**
+ * The dirty page table assigns page ids to shards in stripes of this many
+ * contiguous pages, so that runs of adjacent dirty pages (which writeback
+ * coalesces) usually live in a single shard.
+ */
+extern pageid_t stasis_dirty_page_table_shard_stripe_size;
 
 /**
    If this is true, then the only thread that will perform writeback is the
@@ -95,7 +132,7 @@ extern stasis_handle_t* (*stasis_handle_factory)();
    This factory is invoked by the default stasis_handle_factory, and takes
    additional file system parameters as arguments.
 
-   Valid options: stasis_handle_open_file(), stasis_handle_open_pfile(), and stasis_handle_non_blocking_factory.
+   Valid options: stasis_handle_open_file(), stasis_handle_open_pfile(), stasis_handle_open_uring(), and stasis_handle_non_blocking_factory.
  */
 extern stasis_handle_t* (*stasis_handle_file_factory)(const char* filename, int open_mode, int creat_perms);
 /**
@@ -105,6 +142,35 @@ extern stasis_handle_t* (*stasis_handle_file_factory)(const char* filename, int
  */
 extern uint32_t stasis_handle_raid0_stripe_size;
 extern char ** stasis_handle_raid0_filenames;
+/**
+ * The cache file used by stasis_handle_cache_factory().  It should live on
+ * a faster device than stasis_store_file_name.
+ */
+extern const char * stasis_handle_cache_file_name;
+/**
+ * The size of the cache file used by stasis_handle_cache_factory(), in bytes.
+ */
+extern lsn_t stasis_handle_cache_size;
+/**
+ * If true, stasis_handle_cache_factory() opens the cache in write-back mode.
+ * Otherwise, writes go to both the cache file and the page file.
+ */
+extern int stasis_handle_cache_write_back;
+/**
+ * The number of requests that qos handles (and log forces) may have in
+ * flight at once.
+ */
+extern int stasis_handle_qos_queue_depth;
+/**
+ * The rate, in bytes per second, at which qos handles issue dirty page
+ * writeback.  Zero means unlimited.
+ */
+extern double stasis_handle_qos_writeback_rate;
+/**
+ * The rate, in bytes per second, at which qos handles issue readahead and
+ * other speculative reads.  Zero means unlimited.
+ */
+extern double stasis_handle_qos_prefetch_rate;
 /**
    The factory that non_blocking handles will use for slow handles.  (Only
    used if stasis_buffer_manager_io_handle_default_factory is set to
@@ -119,6 +185,21 @@ extern stasis_handle_t* (*stasis_non_blocking_handle_file_factory)(const char* f
    defining STASIS_BUFFER_MANAGER_IO_HANDLE_FLAGS.
 */
 extern int stasis_buffer_manager_io_handle_flags;
+/**
+   If true, the page file is opened with O_DIRECT, so that pages are cached
+   by the buffer manager but not by the kernel.  (If the file system does
+   not support O_DIRECT, Stasis prints a warning and uses buffered I/O.)
+   Buffer pool frames, and the buffers the page handle uses internally, are
+   always PAGE_SIZE aligned, which satisfies the alignment requirements of
+   devices with block sizes of up to PAGE_SIZE.
+*/
+extern int stasis_buffer_manager_direct_io;
+/**
+   The largest number of adjacent dirty pages that the page handle will
+   combine into a single write during writeback.  One disables write
+   coalescing.
+*/
+extern pageid_t stasis_buffer_manager_write_coalesce_pages;
 /**
    How should stasis grow the page file?  Valid options are:
 
@@ -132,7 +213,9 @@ extern int stasis_buffer_manager_preallocate_mode;
    The default replacement policy.
 
    Valid values are STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU,
-   STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU and STASIS_REPLACEMENT_POLICY_CLOCK
+   STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU, STASIS_REPLACEMENT_POLICY_CLOCK
+   and STASIS_REPLACEMENT_POLICY_CONCURRENT_2Q.  2Q resists cache
+   pollution from large sequential scans.
  */
 extern int stasis_replacement_policy;
 /**
@@ -171,6 +254,21 @@ extern int stasis_suppress_unclean_shutdown_warnings;
    truncates the log.
  */
 extern int stasis_truncation_automatic;
+/**
+   How often, in seconds, the truncation thread writes a fuzzy
+   checkpoint, so that recovery can skip the log entries that it
+   covers.  Checkpoints are only written if the log has grown since
+   the last one.  Zero disables periodic checkpoints.
+ */
+extern int stasis_checkpoint_interval;
+/**
+   The LSN of the most recent checkpoint is stored in this file.  If
+   this is NULL (the default), the file is stored with the log, as
+   ".checkpoint" in stasis_log_dir_name, or as stasis_log_file_name
+   with ".checkpoint" appended, so that it is removed along with the
+   log.  In-memory logs do not store checkpoints.
+ */
+extern const char * stasis_checkpoint_file_name;
 
 /**
     This is the log implementation that is being used.
@@ -207,6 +305,110 @@ extern const char * stasis_store_file_2_name;
  * which currently causes the pages to be read synchronously.
  */
 extern int stasis_buffer_manager_hash_prefetch_count;
+/**
+ * Number of writeback threads the concurrent buffer manager will create at
+ * startup.  Each thread owns a disjoint set of page id stripes in the dirty
+ * page table, and performs its own elevator sweep over them.
+ *
+ * @see stasis_dirty_page_table_flush_partition()
+ */
+extern int stasis_buffer_manager_concurrent_hash_writeback_count;
+/**
+ * The number of contiguous pages that are assigned to a single writeback
+ * thread at a time.  This should be large enough for each thread to produce
+ * long sequential writes.  (Only used if
+ * stasis_buffer_manager_concurrent_hash_writeback_count is greater than one.)
+ */
+extern pageid_t stasis_buffer_manager_concurrent_hash_writeback_stripe_size;
+/**
+ * Number of read-ahead threads the concurrent buffer manager will create
+ * the first time it reads ahead (or prefetchPages() is called).  Zero
+ * disables read-ahead (and prefetchPages()).
+ */
+extern int stasis_buffer_manager_concurrent_hash_readahead_count;
+/**
+ * How far ahead of a sequential scan the concurrent buffer manager will
+ * read.  Scans are detected per buffer manager handle, and, for loads that
+ * do not go through a handle, per thread; handles that were opened with
+ * is_sequential set are treated as sequential from their first page.
+ */
+extern pageid_t stasis_buffer_manager_concurrent_hash_readahead_pages;
+/**
+ * When the concurrent buffer manager is closed cleanly, it writes the ids of
+ * the pages in its cache to this file, in reverse eviction order.  The next
+ * time it starts up, it reloads the first of those pages in the background
+ * once recovery completes.  The file is not tied to the page file; it should
+ * be removed along with it.  NULL (the default) disables this.
+ */
+extern const char * stasis_buffer_manager_hot_set_file_name;
+/**
+ * The number of partitions that the buffer pool is split into.  Each
+ * partition's frames are allocated from (and evicted in favor of threads
+ * running on) the NUMA node with the same number.  Zero, the default,
+ * creates one partition per NUMA node; one disables partitioning.
+ */
+extern int stasis_buffer_pool_numa_nodes;
+/**
+ * When the buffer pool is partitioned, decides which partition a page is
+ * loaded into.  STASIS_NUMA_PLACEMENT_LOCAL (the default) uses the
+ * partition of the thread that loads the page, and
+ * STASIS_NUMA_PLACEMENT_HASH spreads pages over the partitions by page id.
+ * Either way, eviction falls back on other partitions when the preferred
+ * one has nothing to evict.
+ */
+extern int stasis_buffer_manager_numa_placement;
+/**
+ * How the buffer pool's frames should be backed by huge pages, to cut the
+ * number of TLB misses with large caches.
+ *
+ * STASIS_BUFFER_POOL_HUGE_PAGES_DISABLED uses ordinary pages.
+ * STASIS_BUFFER_POOL_HUGE_PAGES_TRANSPARENT (the default) marks the pool
+ * with madvise(MADV_HUGEPAGE); whether transparent huge pages are used
+ * is then up to the kernel's THP settings.
+ * STASIS_BUFFER_POOL_HUGE_PAGES_EXPLICIT maps the pool with MAP_HUGETLB,
+ * which requires pages to have been reserved with vm.nr_hugepages.
+ *
+ * Unavailable modes fall back on the next mode down, with a warning.
+ * stasis_buffer_pool_huge_pages_mode() reports the mode that is in use.
+ */
+extern int stasis_buffer_pool_huge_pages;
+/**
+ * The number of pages' worth of memory that the concurrent buffer manager
+ * may use to keep compressed copies of clean pages that it evicts.  Loads
+ * check the compressed pages before reading from disk.  Zero (the
+ * default) disables the compressed tier.
+ *
+ * @see stasis_buffer_manager_concurrent_hash_compressed_tier_stats()
+ */
+extern pageid_t stasis_buffer_manager_compressed_tier_size;
+/**
+ * If true, Tread() and TreadRaw() copy records out of pinned pages
+ * without latching them, and validate Page.version afterward.  They
+ * fall back on readlock() when a writer interferes.
+ *
+ * @see stasis_record_read_optimistic()
+ */
+extern int stasis_page_optimistic_reads;
+/**
+ * If true, page handles store a checksum in each page's header as it is
+ * written, and verify it as the page is read back.  Pages that fail
+ * verification abort the process.  The checksum lives in the unused
+ * high bits of the page type, so turning this on or off does not change
+ * the page file format; pages gain checksums as they are written.
+ * Defaults to false.
+ *
+ * @see stasis_page_checksum_update()
+ */
+extern int stasis_page_checksums;
+/**
+ * If non-zero, the page handle runs a low priority thread that reads
+ * the page file in the background, and reports pages that fail their
+ * checksums before anything needs them.  The thread reads at most this
+ * many pages per second.  Zero (the default) disables the scrubber.
+ *
+ * @see stasis_page_scrubber_open()
+ */
+extern pageid_t stasis_page_scrubber_pages_per_second;
 
 extern const char * stasis_log_dir_name;
 extern const char * stasis_log_chunk_name;
@@ -225,7 +427,9 @@ extern lsn_t stasis_log_file_pool_chunk_min_size;
  */
 extern const int    stasis_log_file_pool_lsn_chars;
 /**
-   Number of bytes that stasis' log may buffer before writeback.
+   Number of bytes that stasis' log may buffer before writeback.  The
+   file log keeps two buffers of this size, so that appends can continue
+   while the other one is written.
  */
 extern lsn_t stasis_log_file_write_buffer_size;
 /**
@@ -1,6 +1,7 @@
 #ifndef IO_HANDLE_H
 #define IO_HANDLE_H
 #include <stasis/common.h>
+#include <sys/uio.h>
 
 BEGIN_C_DECLS
 
@@ -199,6 +200,23 @@ typedef struct stasis_handle_t {
   int (*async_force)(struct stasis_handle_t * h);
   int (*force_range)(struct stasis_handle_t * h, lsn_t start, lsn_t stop);
   int (*fallocate)(struct stasis_handle_t * h, lsn_t off, lsn_t len);
+  /**
+     Optional (may be NULL).  Offer the handle a copy of a region that
+     the caller is about to discard from memory, and that is unchanged
+     since it was last read or written.  Caching handles may keep the
+     copy, so that later reads of the region are cheaper.  The contents
+     of the handle are not affected.  Buffer managers call this on their
+     miss paths, so it should drop the copy rather than wait for I/O.
+  */
+  int (*admit)(struct stasis_handle_t * h, lsn_t off, const byte * dat, lsn_t len);
+  /**
+     Optional (may be NULL).  Write iovcnt buffers, back to back, starting
+     at off, as though they were a single buffer passed to write().
+     Handles that implement this issue a single request (such as
+     pwritev()) where they can, so callers can gather runs of adjacent
+     pages without copying them.
+  */
+  int (*writev)(struct stasis_handle_t * h, lsn_t off, const struct iovec * iov, int iovcnt);
   /**
      The handle's error flag; this passes errors to the caller when
      they can't be returned directly.
@@ -267,6 +285,21 @@ stasis_handle_t * stasis_handle(open_file)
 */
 stasis_handle_t * stasis_handle(open_pfile)
      (const char * path, int flags, int perm);
+/**
+   Open a handle that is backed by a file, and performs I/O via Linux's
+   io_uring interface.  Concurrent requests from different threads are
+   submitted to the kernel in batches.  Buffers handed out by
+   write_buffer() and read_buffer() are registered with the kernel when
+   possible.
+
+   Falls back to open_pfile() if io_uring is unavailable.
+
+   @param path The name of the file to be opened.
+   @param flags Flags to be passed to open(). (eg O_CREAT)
+   @param perm The file permissions to be passed to open()
+*/
+stasis_handle_t * stasis_handle(open_uring)
+     (const char * path, int flags, int perm);
 /**
    Given a factory for creating "fast" and "slow" handles, provide a
    handle that never makes callers wait for write requests to
@@ -343,9 +376,136 @@ stasis_handle_t * stasis_handle(open_raid1)(stasis_handle_t *a, stasis_handle_t
  * @param stripe_size The raid 0 stripe size.  Must be a multiple of PAGE_SIZE.
  */
 stasis_handle_t * stasis_handle(open_raid0)(int handle_count, stasis_handle_t **h, uint32_t stripe_size);
+/**
+   Open a handle that caches blocks of a slow handle (such as a disk array)
+   in a bounded cache file on a fast handle (such as an SSD).
+
+   Blocks are PAGE_SIZE bytes, and are cached when they are written in
+   their entirety, or passed to admit().  Reads of other blocks go to the
+   slow handle.  The cache's directory is kept in the cache file, so the
+   cache stays warm across restarts, and survives crashes: after a crash,
+   every cached block holds a version that is at least as new as the one
+   that was current at the last force().
+
+   The new handle takes ownership of slow and fast, and closes them when
+   it is closed.  close() writes dirty blocks back, so the slow handle can
+   be used on its own after the cache handle has been closed cleanly.
+
+   @param slow The handle that holds the data.
+   @param fast The handle that backs the cache file.
+   @param cache_size The size of the cache file, in bytes.  A few pages
+                     are used for the cache's metadata.
+   @param write_back If zero, writes go to both handles (write-through).
+                     Otherwise, writes to cached blocks only go to the cache
+                     file until the blocks are evicted from it.
+*/
+stasis_handle_t * stasis_handle(open_cache)(stasis_handle_t * slow, stasis_handle_t * fast,
+                                            lsn_t cache_size, int write_back);
+/**
+   Open stasis_store_file_name, cached in stasis_handle_cache_file_name.
+
+   @see stasis_handle_cache_size, stasis_handle_cache_write_back
+*/
+stasis_handle_t * stasis_handle_cache_factory();
+
+/**
+   I/O priority classes, most urgent first.  Each thread has a current
+   class, which qos handles use to schedule the thread's requests.
+   Classes are only tracked per thread; in particular, buffer manager
+   handles do not carry one, so page loads are issued under the class of
+   the thread that loads the page.
+*/
+typedef enum {
+  /** Log forces.  Commits wait for these. */
+  STASIS_IO_CLASS_LOG = 0,
+  /** Page misses that a caller is waiting for.  This is the default. */
+  STASIS_IO_CLASS_FOREGROUND,
+  /** Speculative reads (readahead, hot set preloading). */
+  STASIS_IO_CLASS_PREFETCH,
+  /** Dirty page writeback. */
+  STASIS_IO_CLASS_WRITEBACK,
+  STASIS_IO_CLASS_COUNT
+} stasis_io_class_t;
+
+typedef struct {
+  uint64_t requests;
+  uint64_t bytes;
+  /** The number of requests that had to wait before being issued. */
+  uint64_t delayed;
+  double wait_seconds;
+} stasis_handle_qos_stats_t;
+
+/**
+   Set the calling thread's I/O class.
+
+   @return the thread's previous class, so that callers can restore it.
+*/
+stasis_io_class_t stasis_handle_qos_set_class(stasis_io_class_t cls);
+stasis_io_class_t stasis_handle_qos_get_class(void);
+/**
+   Report I/O that does not go through a qos handle (such as log forces)
+   to the scheduler, so that qos handles can schedule around it.  Blocks
+   until the request may be issued; requests in STASIS_IO_CLASS_LOG never
+   block.  Each call must be matched by a call to stasis_handle_qos_end().
+*/
+void stasis_handle_qos_begin(stasis_io_class_t cls, lsn_t bytes);
+void stasis_handle_qos_end(stasis_io_class_t cls);
+/**
+   Wait until the scheduler admits a request of up to bytes in the calling
+   thread's class.  Requests the thread then issues through qos handles
+   are charged to the reservation, and do not wait, so threads can reserve
+   before they latch pages, instead of waiting while holding latches.
+   Each call must be matched by a call to stasis_handle_qos_release().
+   This is a no-op while no qos handles are open.
+*/
+void stasis_handle_qos_reserve(lsn_t bytes);
+/**
+   End the calling thread's reservation.  bytes is the number of bytes
+   that the thread actually issued; the rest are returned to its class.
+*/
+void stasis_handle_qos_release(lsn_t bytes);
+/**
+   Limit a class to bytes_per_second.  Zero removes the limit.  This
+   overrides stasis_handle_qos_prefetch_rate and
+   stasis_handle_qos_writeback_rate.
+*/
+void stasis_handle_qos_set_rate(stasis_io_class_t cls, double bytes_per_second);
+void stasis_handle_qos_stats(stasis_io_class_t cls, stasis_handle_qos_stats_t * stats);
+/**
+   Schedule h's requests by the I/O class of the calling thread.
+
+   All qos handles share one scheduler.  Requests wait while a request of
+   a more urgent class is waiting, or stasis_handle_qos_queue_depth
+   requests are in flight.  Prefetch and writeback requests are issued
+   one at a time while log forces or foreground requests are in flight,
+   and are subject to per-class token buckets.
+
+   The new handle takes ownership of h.
+*/
+stasis_handle_t * stasis_handle(open_qos)(stasis_handle_t * h);
+/**
+   Open stasis_store_file_name behind a qos handle.
+
+   @see stasis_handle_qos_queue_depth, stasis_handle_qos_writeback_rate
+*/
+stasis_handle_t * stasis_handle_qos_factory();
 stasis_handle_t * stasis_handle_raid1_factory();
 stasis_handle_t * stasis_handle_raid0_factory();
 
+/**
+ * @return the flags that should be passed to open() for the page file
+ * named filename.  This adds O_DIRECT to stasis_buffer_manager_io_handle_flags
+ * if stasis_buffer_manager_direct_io is set and filename's file system
+ * supports it.
+ */
+int stasis_handle_page_file_flags(const char * filename);
+/**
+ * Advance an iovec array past bytes bytes that have been transferred, so
+ * that implementations of writev() can resume after a short write.
+ * Entries that were fully transferred are skipped, and a partially
+ * transferred entry is trimmed in place.
+ */
+void stasis_handle_iovec_consume(struct iovec ** iov, int * iovcnt, size_t bytes);
 /**
  * Open a Stasis file handle using default arguments.
  */
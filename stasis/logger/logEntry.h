@@ -80,6 +80,29 @@ struct __raw_log_entry {
   unsigned int type;
 };
 
+/**
+   The payload of a CHECKPOINTLOG entry.  It is followed by page_count
+   CheckpointDirtyPage and then xact_count CheckpointTransaction
+   structs.
+*/
+typedef struct CheckpointLogEntry {
+  /** Every entry before this LSN is reflected in the tables below. */
+  lsn_t begin_lsn;
+  pageid_t page_count;
+  int64_t xact_count;
+} CheckpointLogEntry;
+
+typedef struct CheckpointDirtyPage {
+  pageid_t page;
+  lsn_t rec_lsn;
+} CheckpointDirtyPage;
+
+typedef struct CheckpointTransaction {
+  int64_t xid;
+  lsn_t prev_lsn;
+  lsn_t rec_lsn;
+} CheckpointTransaction;
+
 struct LogEntry {
   lsn_t LSN;
   lsn_t prevLSN;
@@ -98,6 +121,11 @@ LogEntry * mallocScratchCommonLogEntry(lsn_t lsn, lsn_t prevLSN, int xid, unsign
 LogEntry * allocCommonLogEntry(stasis_log_t *log, lsn_t prevLSN, int xid, unsigned int type);
 
 LogEntry * allocPrepareLogEntry(stasis_log_t *log, lsn_t prevLSN, int xid, lsn_t recLSN);
+/**
+   Allocate a checkpoint log entry with room for page_count dirty pages
+   and xact_count transactions.  The caller fills them in.
+*/
+LogEntry * allocCheckpointLogEntry(stasis_log_t *log, lsn_t begin_lsn, pageid_t page_count, int64_t xact_count);
 /**
    Allocate a log entry associated with an operation implemention.  This
    is usually called inside of Tupdate().
@@ -140,6 +168,16 @@ static inline const LogEntry * getCLRCompensated(const CLRLogEntry * e) {
 
 lsn_t getPrepareRecLSN(const LogEntry *e);
 
+static inline const CheckpointLogEntry * getCheckpoint(const LogEntry * e) {
+  return (const CheckpointLogEntry*)(((const struct __raw_log_entry*)e)+1);
+}
+static inline const CheckpointDirtyPage * getCheckpointDirtyPages(const LogEntry * e) {
+  return (const CheckpointDirtyPage*)(getCheckpoint(e)+1);
+}
+static inline const CheckpointTransaction * getCheckpointTransactions(const LogEntry * e) {
+  return (const CheckpointTransaction*)(getCheckpointDirtyPages(e) + getCheckpoint(e)->page_count);
+}
+
 END_C_DECLS
 
 #endif /* __LOGENTRY_H */
@@ -114,6 +114,17 @@ struct Page_s {
 
   rwl * rwlatch;
 
+  /**
+      Seqlock style version counter for optimistic readers.  It is odd
+      while a thread holds rwlatch for writing, and is incremented
+      again before the write latch is released.  Threads that take
+      the write latch must use stasis_page_writelock() and
+      stasis_page_writeunlock() so that the version stays in sync.
+
+      @see stasis_record_read_optimistic()
+  */
+  uint64_t version;
+
   /**
       Since the bufferManager re-uses page structs, this lock is used
       to ensure that the page is in one of two consistent states,
@@ -154,6 +165,42 @@ struct Page_s {
 };
 /*@}*/
 
+/**
+   Obtain a write latch on a page, and mark it as being modified, so
+   that concurrent optimistic readers will retry.
+
+   @see Page.version
+*/
+static inline void stasis_page_writelock(Page * p) {
+  writelock(p->rwlatch, 0);
+  __atomic_store_n(&p->version, p->version + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+/**
+   Release a write latch obtained with stasis_page_writelock().
+*/
+static inline void stasis_page_writeunlock(Page * p) {
+  __atomic_store_n(&p->version, p->version + 1, __ATOMIC_RELEASE);
+  unlock(p->rwlatch);
+}
+/**
+   Start an optimistic read of a page.
+
+   @return the page's version, or an odd number if a writer holds the
+           page's latch.
+*/
+static inline uint64_t stasis_page_read_begin_optimistic(Page * p) {
+  return __atomic_load_n(&p->version, __ATOMIC_ACQUIRE);
+}
+/**
+   @return non-zero if nothing was written to the page (under a write
+           latch) since stasis_page_read_begin_optimistic() returned version.
+*/
+static inline int stasis_page_read_validate_optimistic(Page * p, uint64_t version) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return !(version & 1) && __atomic_load_n(&p->version, __ATOMIC_RELAXED) == version;
+}
+
 /**
    @defgroup PAGE_HEADER Default page header
 
@@ -281,6 +328,24 @@ void stasis_record_write(int xid, Page * page, recordid rid, const byte *dat);
  * @return 0 on success, Stasis error code on failure
  */
 int stasis_record_read(int xid, Page * page, recordid rid, byte *dat);
+/**
+ * Read a record without latching the page.  The record is copied
+ * into dat, and then p->version is checked to make sure that no
+ * thread held the page's write latch while the copy was made.  This
+ * never writes to the Page struct, so it does not bounce the latch's
+ * cache line between cores.
+ *
+ * Record writes that happen under a read latch (see Page.rwlatch) are
+ * not excluded, just as they are not excluded by readlock().
+ *
+ * @param p a pinned page.  The caller must not hold rwlatch.
+ * @return 0 if the record was read.  Non-zero if the page was
+ *         modified during the read, the page type or record does not
+ *         support optimistic reads, or stasis_page_optimistic_reads is
+ *         off.  In that case, dat is garbage, and the caller should
+ *         latch the page and call stasis_record_read().
+ */
+int stasis_record_read_optimistic(int xid, Page * p, recordid rid, byte *dat);
 
 const byte * stasis_record_read_begin(int xid, Page * p, recordid rid);
 byte * stasis_record_write_begin(int xid, Page * p, recordid rid);
@@ -301,9 +366,43 @@ int stasis_record_freespace(int xid, Page * p);
 void stasis_record_compact(Page * p);
 void stasis_record_compact_slotids(int xid, Page * p);
 void stasis_uninitialized_page_loaded(int xid, Page * p);
+/**
+   Return the page type stored in a page's type word.  The rest of the
+   word holds the page's checksum.
+
+   @see stasis_page_checksum_update
+*/
+static inline pagetype_t stasis_page_type_from_word(int word) {
+  return (pagetype_t)((uint32_t)word & 0xff);
+}
 void stasis_page_loaded(Page * p, pagetype_t type);
 void stasis_page_flushed(Page * p);
 void stasis_page_cleanup(Page * p);
+/**
+   Store a checksum of p's contents and id in its header.  Page types
+   fit in the low byte of the page's type word, so the checksum (a
+   CRC32C, folded to 24 bits) goes in the rest of the word, and the page
+   layout does not change.  Pages written without a checksum have zeros
+   there, which is what stores created before checksums existed contain.
+
+   This does nothing if stasis_page_checksums is false, or if p's type
+   has no header.  Page handles call it after stasis_page_flushed(),
+   which rewrites the whole type word of every page, immediately before
+   writing p to disk.
+*/
+void stasis_page_checksum_update(Page * p);
+/**
+   Verify the checksum of a page image that was just read from disk.
+   Pages without a checksum (zeroed pages, pages written with
+   stasis_page_checksums turned off, and pages whose type has no header)
+   always pass.
+
+   @param buf PAGE_SIZE bytes read from page pageid.
+   @param type The expected page type, or UNKNOWN_TYPE_PAGE to use the
+               type stored in buf.  Headerless types are never checked.
+   @return 0 if the page looks intact, or 1 if the checksum does not match.
+*/
+int stasis_page_checksum_check(const byte * buf, pageid_t pageid, pagetype_t type);
 /**
    @todo XXX stasis_record_dereference should be dispatched via page_impl[]
 */
@@ -631,6 +730,22 @@ typedef struct page_impl {
       should be released.
    */
   void (*pageCleanup)(Page * p);
+
+  // -------- Optional methods
+
+  /**
+      Copy a record into buf without latching the page.  The page may
+      be modified concurrently, so implementations must not trust
+      anything they read from the page (and must not assert on it).
+      They should bounds check everything, and refuse to copy more
+      than rid.size bytes.
+
+      @return 0 on success, non-zero if the record cannot be read this
+              way.  The caller validates Page.version afterward.
+
+      @see stasis_record_read_optimistic()
+  */
+  int (*recordReadOptimistic)(int xid, Page *p, recordid rid, byte *buf);
 } page_impl;
 
 /**
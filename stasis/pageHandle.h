@@ -2,6 +2,7 @@
 #define STASIS_PAGEHANDLE_H
 
 typedef struct stasis_page_handle_t stasis_page_handle_t;
+typedef struct stasis_page_scrubber_t stasis_page_scrubber_t;
 
 #include <stasis/page.h>
 #include <stasis/io/handle.h>
@@ -34,6 +35,17 @@ struct stasis_page_handle_t {
    *
    */
   void (*write)(struct stasis_page_handle_t* ph, Page * dat);
+  /**
+   * Write back a batch of pages.  This has the same semantics as calling
+   * write() on each page, but runs of adjacent dirty pages (of up to
+   * stasis_buffer_manager_write_coalesce_pages pages) are written with a
+   * single request to the underlying handle.
+   *
+   * @param pages An array of pages, usually sorted by id; only adjacent
+   * entries are merged.  The caller must have exclusive access to each
+   * of them.
+   */
+  void (*write_pages)(struct stasis_page_handle_t* ph, Page ** pages, int count);
 
   /**
      Read a page from disk. This bypasses the cache, and should only be
@@ -50,12 +62,36 @@ struct stasis_page_handle_t {
      @see bufferManager.c for the implementation of read_page.
   */
   void (*read)(struct stasis_page_handle_t* ph, Page * ret, pagetype_t type);
+  /**
+     Read a batch of pages from disk.  This has the same semantics as
+     calling read() on each page, but pages with consecutive ids are
+     read with a single request to the underlying handle.
+
+     @param pages An array of page structs, with ids set correctly and
+     sorted in ascending order.
+  */
+  void (*read_pages)(struct stasis_page_handle_t* ph, Page ** pages, int count, pagetype_t type);
   /**
      This function is a performance hint.  It tells the page handle to
      bring the page range into cache.  The hope is that this hint can be passed
      directly to the OS.
    */
   void  (*prefetch_range)(struct stasis_page_handle_t* ph, pageid_t pageid, pageid_t count);
+  /**
+     @return the number of pages in the page file.  Pages at or past this
+     point have never been written, so there is no point in prefetching them.
+   */
+  pageid_t (*page_count)(struct stasis_page_handle_t* ph);
+  /**
+     Optional (may be NULL).  This is a performance hint, called by buffer
+     managers just before they drop a clean page from memory.  Page handles
+     that are backed by a caching stasis_handle_t pass the page's contents
+     to the handle's admit() method, so that the page can be read back
+     without going to the page file.
+
+     @param p A clean page.  The caller must have exclusive access to it.
+  */
+  void  (*evict)(struct stasis_page_handle_t* ph, Page * p);
   /**
      Force the page file to disk.  Pages that have had pageWrite()
      called on them are guaranteed to be on disk after this returns.
@@ -92,6 +128,12 @@ struct stasis_page_handle_t {
      If this is non-null, stasis_page_handle will keep the dirty page table up-to-date.
    */
   stasis_dirty_page_table_t * dirtyPages;
+  /**
+     The background scrubber that this page handle started, or NULL.
+     Handles returned by dup() never have one.
+     @see stasis_page_scrubber_pages_per_second
+   */
+  stasis_page_scrubber_t * scrubber;
   /**
    * Pointer to implementation-specific state.
    */
@@ -110,4 +152,33 @@ stasis_page_handle_t * stasis_page_handle_open(struct stasis_handle_t * handle,
                                                stasis_log_t * log, stasis_dirty_page_table_t * dirtyPages);
 
 stasis_page_handle_t* stasis_page_handle_default_factory(stasis_log_t *log, stasis_dirty_page_table_t *dpt);
+
+typedef struct {
+  /** Number of times the scrubber has reached the end of the page file. */
+  uint64_t passes;
+  /** Pages read and verified so far. */
+  pageid_t checked;
+  /** Number of times that a page failed verification.  Corrupt pages fail once per pass. */
+  pageid_t corrupt;
+  /** The most recent page that failed verification, or INVALID_PAGE. */
+  pageid_t last_corrupt;
+} stasis_page_scrubber_stats_t;
+
+/**
+  Start a thread that repeatedly reads the page file from start to end,
+  and verifies each page's checksum with stasis_page_checksum_check().
+  This finds corruption in cold pages, which might not otherwise be read
+  for a long time.  The thread runs at the lowest CPU priority, and
+  reads at most pages_per_second pages per second.
+
+  Pages that fail verification are read again, in case they were being
+  written at the time.  Pages that still fail are reported on stderr,
+  and counted in the scrubber's statistics, but are not repaired.
+
+  @param handle The handle to read from.  The scrubber closes it.
+ */
+stasis_page_scrubber_t * stasis_page_scrubber_open(struct stasis_handle_t * handle, pageid_t pages_per_second);
+void stasis_page_scrubber_stats(stasis_page_scrubber_t * s, stasis_page_scrubber_stats_t * stats);
+/** Stop the scrubber, and close its handle. */
+void stasis_page_scrubber_close(stasis_page_scrubber_t * s);
 #endif //STASIS_PAGEHANDLE_H
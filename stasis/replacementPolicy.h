@@ -11,6 +11,8 @@
     For now, Stasis uses plain-old LRU.  DB-MIN would be an interesting
     extension.
 */
+#ifndef STASIS_REPLACEMENT_POLICY_H
+#define STASIS_REPLACEMENT_POLICY_H
 
 #include <stasis/common.h>
 BEGIN_C_DECLS
@@ -50,5 +52,41 @@ replacementPolicy * lruFastInit();
 replacementPolicy* replacementPolicyThreadsafeWrapperInit(replacementPolicy* rp);
 replacementPolicy* replacementPolicyConcurrentWrapperInit(replacementPolicy** rp, int count);
 replacementPolicy* replacementPolicyClockInit(Page * pageArray, int page_count);
+/**
+ * Scan resistant 2Q replacement.  page_count is the number of pages
+ * this policy instance is responsible for; it sizes the FIFO that new
+ * pages are admitted to, and the queue of recently evicted page ids.
+ */
+replacementPolicy* stasis_replacement_policy_2q_init(pageid_t page_count);
+
+typedef struct {
+  /** The number of frames that belong to the node. */
+  pageid_t frames;
+  /** Frames taken from the node by threads that prefer it. */
+  uint64_t local_evictions;
+  /** Frames taken from the node by threads that prefer some other node. */
+  uint64_t remote_evictions;
+} stasis_replacement_policy_numa_stats_t;
+
+/**
+   Partition a replacement policy by NUMA node.
+
+   @param rp One threadsafe replacement policy per node.
+   @param frames The buffer pool's frames.  Frame i belongs to node
+                 i / frames_per_node.
+ */
+replacementPolicy* stasis_replacement_policy_numa_init(replacementPolicy** rp, int node_count, Page * frames, pageid_t frames_per_node, pageid_t frame_count);
+/**
+   Make the calling thread's getStaleAndRemove() calls look in node first.
+   Pass -1 to go back to preferring the node that the thread is running on.
+ */
+void stasis_replacement_policy_numa_prefer_node(replacementPolicy* rp, int node);
+/**
+   Copy node's statistics into stats, if node is valid.
+
+   @return the number of nodes.
+ */
+int stasis_replacement_policy_numa_stats(replacementPolicy* rp, int node, stasis_replacement_policy_numa_stats_t *stats);
 
 END_C_DECLS
+#endif // STASIS_REPLACEMENT_POLICY_H
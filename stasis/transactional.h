@@ -579,7 +579,8 @@ BEGIN_C_DECLS
  * Initialize Stasis.  This opens the pagefile and log, initializes
  * subcomponents, and runs recovery.
  *
- * @return 0 on success
+ * @return 0 on success, or LLADD_IO_ERROR if the page file could not be
+ *         opened.  Stasis is not initialized if Tinit() fails.
  */
 int Tinit(void);
 
@@ -800,6 +801,14 @@ int TdurabilityLevel(void);
  * transactions can prevent it from completely emptying the log).
  */
 void TtruncateLog(void);
+/**
+ * Write a fuzzy checkpoint.  Recovery starts from the most recent
+ * checkpoint, instead of the beginning of the log, and does not redo
+ * updates to pages that the checkpoint shows were already written back.
+ *
+ * @return 1 if the checkpoint was written, 0 otherwise.
+ */
+int Tcheckpoint(void);
 /**
  * Default log factory.
  */
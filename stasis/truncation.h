@@ -71,9 +71,24 @@ stasis_truncation_t * stasis_truncation_init(stasis_dirty_page_table_t * dpt, st
 void stasis_truncation_deinit(stasis_truncation_t * trunc);
 
 /**
-   Spawn a periodic, demand-based log truncation thread.
+   Spawn a periodic, demand-based log truncation thread.  It also
+   writes a checkpoint every stasis_checkpoint_interval seconds.
 */
 void stasis_truncation_thread_start(stasis_truncation_t* trunc);
+/**
+   Write a fuzzy checkpoint, and record its LSN in
+   stasis_truncation_checkpoint_file_name().  This does not block
+   transactions, but it does sync the page file.
+
+   @return 1 if the checkpoint was recorded, 0 otherwise.
+*/
+int stasis_truncation_checkpoint(stasis_truncation_t* trunc);
+/**
+   @return the name of the file that records the LSN of the most recent
+   checkpoint (see stasis_checkpoint_file_name), or NULL if the log
+   does not support checkpoints.  The caller must free() it.
+*/
+char * stasis_truncation_checkpoint_file_name(void);
 /**
    Initiate a round of log truncation.
 */
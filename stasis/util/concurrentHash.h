@@ -1,7 +1,7 @@
 /**
  * concurrentHash.h
  *
- * @file A concurrent, fixed-size hashtable that allows users to obtain latches
+ * @file A concurrent, resizable hashtable that allows users to obtain latches
  *       on its keys.
  *
  * Operations against this hashtable proceed in two phases.  In the first phase,
@@ -19,6 +19,14 @@
  * It would be trivial to implement an insert_begin, _finish, and _remove, but
  * the need for such things has never come up.  (See hashtable_test_and_set instead)
  *
+ * The hashtable grows and shrinks as keys are inserted and removed.  The size
+ * passed into hashtable_init() is the smallest size the hashtable will shrink
+ * to, so callers no longer need to size it for the worst case.  Resizing is
+ * performed a small portion of the table at a time, and does not add a latch
+ * to lookups.  It is skipped while any bucket latch in that portion of the
+ * table is held, which is another reason not to hold bucket latches for long.
+ * Memory is not returned to the allocator until hashtable_deinit().
+ *
  *  Created on: Oct 15, 2009
  *      Author: sears
  */
@@ -31,9 +39,11 @@ BEGIN_C_DECLS
 
 typedef struct hashtable_t hashtable_t;
 typedef struct bucket_t bucket_t;
+typedef struct hashtable_segment_t hashtable_segment_t;
 
 typedef struct hashtable_bucket_handle_t {
   bucket_t * b1;
+  hashtable_segment_t * seg;
   pageid_t key;
   pageid_t idx;
   void * ret;
@@ -63,6 +73,10 @@ void hashtable_unlock(hashtable_bucket_handle_t *h);
  * @return -0 if key not found, 1 if the key exists, >1 if the hashtable is corrupt, and the key appears multiple times..
  */
 int hashtable_debug_number_of_key_copies(hashtable_t *ht, pageid_t pageied);
+/**
+ * @return the number of buckets currently allocated by the hashtable.
+ */
+pageid_t hashtable_debug_bucket_count(hashtable_t *ht);
 
 END_C_DECLS
 
@@ -21,6 +21,17 @@
 BEGIN_C_DECLS
 
 uint32_t stasis_crc32(const void *buffer, unsigned int count, uint32_t crc);
+/**
+   Compute a CRC32C (Castagnoli) checksum.  This is the polynomial that
+   SSE4.2's crc32 instruction implements; it is used when the CPU
+   supports it, and a slicing-by-8 table implementation is used
+   otherwise.
+
+   Usage is the same as stasis_crc32(): start with crc = -1, and pass the
+   result of each call into the next one.  Inverting the final result
+   gives the standard CRC32C value.
+*/
+uint32_t stasis_crc32c(const void *buffer, size_t count, uint32_t crc);
 
 END_C_DECLS
 #endif // STASIS_CRC32_H
@@ -11,6 +11,7 @@
 
 void setup (void) {
   remove("logfile.txt");
+  remove("logfile.txt.checkpoint");
   remove("storefile.txt");
   system("rm -rf stasis_log");
 }
@@ -6,6 +6,7 @@
 #include <stasis/bufferManager.h>
 #include <stasis/bufferManager/bufferHash.h>
 #include <stasis/bufferManager/concurrentBufferManager.h>
+#include <stasis/bufferManager/mmapReadOnly.h>
 #include <stasis/bufferManager/legacy/legacyBufferManager.h>
 #include <stasis/util/random.h>
 #include <sched.h>
@@ -104,6 +105,34 @@ void * workerThread(void * p) {
 
   return NULL;
 }
+#define BATCH_SIZE 8
+/** Like workerThread, but pins pages in batches using loadPages() */
+void * workerThreadBatched(void * arg) {
+  pageid_t pageids[BATCH_SIZE];
+  int ks[BATCH_SIZE];
+  Page * pages[BATCH_SIZE];
+
+  for(int i = 0 ; i < READS_PER_THREAD / BATCH_SIZE; i++) {
+    for(int b = 0; b < BATCH_SIZE; b++) {
+      // Every so often, ask for the same page twice.
+      ks[b] = (b && !(i % 5)) ? ks[b-1]
+        : (int) (((double)NUM_PAGES)*rand()/(RAND_MAX+1.0));
+      pageids[b] = PAGE_MULT * (ks[b]+1);
+    }
+    loadPages(-1, pageids, BATCH_SIZE, pages);
+    for(int b = 0; b < BATCH_SIZE; b++) {
+      recordid rid = { pageids[b], 0, sizeof(int) };
+      int j;
+      assert(pages[b]->id == pageids[b]);
+      readlock(pages[b]->rwlatch,0);
+      stasis_record_read(1, pages[b], rid, (byte*)&j);
+      unlock(pages[b]->rwlatch);
+      assert(ks[b] == j);
+    }
+    releasePages(pages, BATCH_SIZE);
+  }
+  return NULL;
+}
 static pthread_mutex_t ralloc_mutex;
 void * workerThreadWriting(void * q) {
 
@@ -239,6 +268,672 @@ START_TEST(pageLoadTest) {
   Tdeinit();
 } END_TEST
 
+/**
+    @test
+
+    Like pageLoadTest, but the readers use loadPages().
+*/
+START_TEST(pageBatchLoadTest) {
+  pthread_t workers[THREAD_COUNT];
+
+  Tinit();
+
+  initializePages();
+
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&workers[i], NULL, workerThreadBatched, NULL);
+  }
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  Tdeinit();
+} END_TEST
+
+#define RUN_START  10
+#define RUN_LENGTH 64
+
+/** Write the value i to slot 0 of page start+i, for each i in [0, count). */
+static void initializeRun(pageid_t start, int count) {
+  for(int i = 0; i < count; i++) {
+    recordid rid = { start + i, 0, sizeof(int) };
+    Page * p = loadPage(-1, rid.page);
+    writelock(p->rwlatch,0);
+    stasis_page_slotted_initialize_page(p);
+    stasis_record_alloc_done(-1, p, rid);
+    stasis_record_write(-1, p, rid, (byte*)&i);
+    stasis_page_lsn_write(-1, p, 0);
+    unlock(p->rwlatch);
+    releasePage(p);
+  }
+}
+/**
+    @test
+
+    Write a run of adjacent pages, restart so that the cache is empty,
+    and then read them back with loadPages(), with a few of the pages
+    already pinned, and some duplicates in the request.
+*/
+START_TEST(pageBatchAdjacentTest) {
+  Tinit();
+  initializeRun(RUN_START, RUN_LENGTH);
+  Tdeinit();
+
+  Tinit();
+  Page * cached[2];
+  cached[0] = loadPage(-1, RUN_START + 3);
+  cached[1] = loadPage(-1, RUN_START + 40);
+
+  pageid_t pageids[RUN_LENGTH + 2];
+  Page * pages[RUN_LENGTH + 2];
+  // Request the run backwards; loadPages should sort the misses.
+  for(int i = 0; i < RUN_LENGTH; i++) {
+    pageids[i] = RUN_START + RUN_LENGTH - 1 - i;
+  }
+  pageids[RUN_LENGTH] = RUN_START + 7;
+  pageids[RUN_LENGTH + 1] = RUN_START + 40;
+
+  loadPages(-1, pageids, RUN_LENGTH + 2, pages);
+  for(int i = 0; i < RUN_LENGTH + 2; i++) {
+    recordid rid = { pageids[i], 0, sizeof(int) };
+    int j;
+    assert(pages[i]->id == pageids[i]);
+    readlock(pages[i]->rwlatch,0);
+    stasis_record_read(-1, pages[i], rid, (byte*)&j);
+    unlock(pages[i]->rwlatch);
+    assert(j == pageids[i] - RUN_START);
+  }
+  assert(pages[RUN_LENGTH] == pages[RUN_LENGTH - 1 - 7]);
+  assert(pages[RUN_LENGTH + 1] == cached[1]);
+  releasePages(pages, RUN_LENGTH + 2);
+  releasePages(cached, 2);
+  Tdeinit();
+} END_TEST
+
+#define SCAN_LENGTH 1000
+
+/**
+    Scan pages [RUN_START, RUN_START+SCAN_LENGTH) through a buffer manager
+    handle, or, if h is NULL, with loadPage().  After a few pages, read-ahead
+    should bring pages that we have not asked for yet into cache.
+
+    loadPage() scans also load each page twice, and load an unrelated page
+    every few pages, the way region and iterator code does.
+*/
+static void readAheadScanImpl(stasis_buffer_manager_handle_t * h) {
+  stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+  for(int i = 0; i < SCAN_LENGTH; i++) {
+    recordid rid = { RUN_START + i, 0, sizeof(int) };
+    Page * p;
+    if(h) {
+      p = bm->loadPageImpl(bm, h, -1, rid.page, UNKNOWN_TYPE_PAGE);
+    } else {
+      releasePage(loadPage(-1, rid.page));
+      if(!(i % 4)) { releasePage(loadPage(-1, RUN_START - 1)); }
+      p = loadPage(-1, rid.page);
+    }
+    int j;
+    readlock(p->rwlatch,0);
+    stasis_record_read(-1, p, rid, (byte*)&j);
+    unlock(p->rwlatch);
+    assert(j == i);
+    releasePage(p);
+    if(i == 3) {
+      // Read-ahead is asynchronous; give it up to ten seconds.
+      pageid_t ahead = RUN_START + 4 + stasis_buffer_manager_concurrent_hash_readahead_pages / 2;
+      Page * q = NULL;
+      for(int k = 0; k < 1000 && !q; k++) {
+        q = getCachedPage(-1, ahead);
+        if(!q) { usleep(10000); }
+      }
+      assert(q);
+      releasePage(q);
+    }
+  }
+}
+static void readAheadScan(int is_sequential) {
+  stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+  stasis_buffer_manager_handle_t * h = bm->openHandleImpl(bm, is_sequential);
+  assert(h);
+  readAheadScanImpl(h);
+  bm->closeHandleImpl(bm, h);
+}
+/**
+    @test
+
+    Check that the concurrent buffer manager reads ahead of sequential
+    scans, both for handles that were opened with the sequential hint,
+    and for handles that were not, and for loadPage() calls, which do not
+    go through a handle.
+*/
+START_TEST(sequentialReadAheadTest) {
+  int old_readahead_count = stasis_buffer_manager_concurrent_hash_readahead_count;
+  stasis_buffer_manager_concurrent_hash_readahead_count = 1;
+  Tinit();
+  initializeRun(RUN_START, SCAN_LENGTH);
+  Tdeinit();
+
+  Tinit();
+  readAheadScan(1);
+  Tdeinit();
+
+  Tinit();
+  readAheadScan(0);
+  Tdeinit();
+
+  Tinit();
+  readAheadScanImpl(NULL);
+  Tdeinit();
+  stasis_buffer_manager_concurrent_hash_readahead_count = old_readahead_count;
+} END_TEST
+
+/**
+    @test
+
+    Check that the pages that were cached at shutdown are brought back
+    into cache in the background the next time Stasis starts.
+*/
+START_TEST(hotSetTest) {
+  stasis_buffer_manager_hot_set_file_name = "hotset.txt";
+  remove(stasis_buffer_manager_hot_set_file_name);
+  Tinit();
+  initializeRun(RUN_START, RUN_LENGTH);
+  Tdeinit();
+
+  FILE * f = fopen(stasis_buffer_manager_hot_set_file_name, "r");
+  assert(f);
+  pageid_t count;
+  assert(1 == fread(&count, sizeof(count), 1, f));
+  assert(count >= RUN_LENGTH);
+  fclose(f);
+
+  Tinit();
+  for(int i = 0; i < RUN_LENGTH; i++) {
+    Page * p = NULL;
+    // The hot set is reloaded asynchronously; give it up to ten seconds.
+    for(int k = 0; k < 1000 && !p; k++) {
+      p = getCachedPage(-1, RUN_START + i);
+      if(!p) { usleep(10000); }
+    }
+    assert(p);
+    releasePage(p);
+  }
+  Tdeinit();
+  remove(stasis_buffer_manager_hot_set_file_name);
+  stasis_buffer_manager_hot_set_file_name = NULL;
+} END_TEST
+
+/**
+    @test
+
+    Write a run of adjacent pages with the page file opened with O_DIRECT,
+    so that writeback coalesces them into large, aligned writes.  Then
+    restart and read them back (also with O_DIRECT), once through
+    read-ahead, and once at random.
+*/
+START_TEST(directIOTest) {
+  int old_direct_io = stasis_buffer_manager_direct_io;
+  int old_readahead_count = stasis_buffer_manager_concurrent_hash_readahead_count;
+  stasis_buffer_manager_direct_io = 1;
+  stasis_buffer_manager_concurrent_hash_readahead_count = 1;
+
+  Tinit();
+  initializeRun(RUN_START, SCAN_LENGTH);
+  Tdeinit();
+
+  Tinit();
+  readAheadScan(1);
+  for(int i = 0; i < SCAN_LENGTH; i++) {
+    recordid rid = { RUN_START + stasis_util_random64(SCAN_LENGTH), 0, sizeof(int) };
+    Page * p = loadPage(-1, rid.page);
+    int j;
+    readlock(p->rwlatch,0);
+    stasis_record_read(-1, p, rid, (byte*)&j);
+    unlock(p->rwlatch);
+    assert(j == rid.page - RUN_START);
+    releasePage(p);
+  }
+  Tdeinit();
+
+  stasis_buffer_manager_direct_io = old_direct_io;
+  stasis_buffer_manager_concurrent_hash_readahead_count = old_readahead_count;
+} END_TEST
+
+/**
+    @test
+
+    Put the page file behind a write-back cache handle, with a buffer pool
+    that is too small to hold the run, so that clean pages are admitted to
+    the cache file as they are evicted.  Then restart, and read the run
+    back at random, with a crash in between.
+*/
+START_TEST(pageCacheHandleTest) {
+  stasis_handle_t* (*old_factory)() = stasis_handle_factory;
+  pageid_t old_size = stasis_buffer_manager_size;
+  stasis_handle_factory = stasis_handle_cache_factory;
+  stasis_handle_cache_size = 128 * PAGE_SIZE;
+  stasis_handle_cache_write_back = 1;
+  stasis_buffer_manager_size = 100;
+  remove(stasis_handle_cache_file_name);
+
+  Tinit();
+  initializeRun(RUN_START, SCAN_LENGTH);
+  Tdeinit();
+
+  for(int crash = 0; crash < 2; crash++) {
+    Tinit();
+    for(int i = 0; i < SCAN_LENGTH; i++) {
+      recordid rid = { RUN_START + stasis_util_random64(SCAN_LENGTH), 0, sizeof(int) };
+      Page * p = loadPage(-1, rid.page);
+      int j;
+      readlock(p->rwlatch,0);
+      stasis_record_read(-1, p, rid, (byte*)&j);
+      unlock(p->rwlatch);
+      assert(j == rid.page - RUN_START);
+      releasePage(p);
+    }
+    if(crash) {
+      TuncleanShutdown();
+    } else {
+      Tdeinit();
+    }
+  }
+  int old_readahead_count = stasis_buffer_manager_concurrent_hash_readahead_count;
+  stasis_buffer_manager_concurrent_hash_readahead_count = 1;
+  Tinit();
+  readAheadScan(0);
+  Tdeinit();
+  stasis_buffer_manager_concurrent_hash_readahead_count = old_readahead_count;
+
+  remove(stasis_handle_cache_file_name);
+  stasis_handle_cache_write_back = 0;
+  stasis_buffer_manager_size = old_size;
+  stasis_handle_factory = old_factory;
+} END_TEST
+
+/**
+    @test
+
+    Round trip zeroed, partly filled and random pages through the
+    compressed tier, and check that it stays within its capacity.
+*/
+START_TEST(compressedTierTest) {
+  byte * page = stasis_malloc(PAGE_SIZE, byte);
+  byte * buf = stasis_malloc(PAGE_SIZE, byte);
+  stasis_compressed_tier_stats_t stats;
+
+  stasis_compressed_tier_t * t = stasis_compressed_tier_open(100 * PAGE_SIZE);
+  memset(page, 0, PAGE_SIZE);
+  assert(stasis_compressed_tier_put(t, 1, page));
+  stasis_compressed_tier_stats(t, &stats);
+  assert(stats.insertions == 1 && stats.pages == 1);
+  assert(stats.bytes < PAGE_SIZE / 16);
+  memset(buf, 1, PAGE_SIZE);
+  assert(stasis_compressed_tier_get(t, 1, buf));
+  assert(!memcmp(page, buf, PAGE_SIZE));
+  // Pages leave the tier when they are read.
+  assert(!stasis_compressed_tier_get(t, 1, buf));
+
+  // A header, a few records at the end of the page, and free space.
+  for(int i = 0; i < 64; i++) { page[i] = (byte)stasis_util_random64(256); }
+  for(int i = PAGE_SIZE - 512; i < PAGE_SIZE; i++) { page[i] = (byte)(i % 7 ? (uint64_t)i : stasis_util_random64(256)); }
+  assert(stasis_compressed_tier_put(t, 2, page));
+  assert(stasis_compressed_tier_get(t, 2, buf));
+  assert(!memcmp(page, buf, PAGE_SIZE));
+
+  for(int i = 0; i < PAGE_SIZE; i++) { page[i] = (byte)stasis_util_random64(256); }
+  assert(!stasis_compressed_tier_put(t, 3, page));
+  assert(!stasis_compressed_tier_get(t, 3, buf));
+  stasis_compressed_tier_stats(t, &stats);
+  assert(stats.hits == 2 && stats.misses == 2 && stats.rejections == 1);
+  assert(stats.pages == 0 && stats.bytes == 0);
+  stasis_compressed_tier_close(t);
+
+  // Each of these pages compresses to a bit more than a quarter page.
+  t = stasis_compressed_tier_open(2 * PAGE_SIZE);
+  for(pageid_t i = 0; i < 10; i++) {
+    memset(page, 0, PAGE_SIZE);
+    for(int j = 0; j < PAGE_SIZE / 4; j++) { page[j] = (byte)stasis_util_random64(256); }
+    *(pageid_t*)page = i;
+    assert(stasis_compressed_tier_put(t, i, page));
+  }
+  stasis_compressed_tier_stats(t, &stats);
+  assert(stats.evictions > 0);
+  assert(stats.pages == 10 - (pageid_t)stats.evictions);
+  assert(stats.bytes <= stats.capacity);
+  assert(!stasis_compressed_tier_get(t, 0, buf));
+  assert(stasis_compressed_tier_get(t, 9, buf));
+  assert(!memcmp(page, buf, PAGE_SIZE));
+  stasis_compressed_tier_invalidate(t, 8);
+  assert(!stasis_compressed_tier_get(t, 8, buf));
+  stasis_compressed_tier_close(t);
+
+  // Short inputs, output buffers that are too small, and corrupt input.
+  byte small[64];
+  byte out[64];
+  memcpy(small, "abc", 3);
+  size_t len = stasis_compressed_tier_compress(small, 3, buf, PAGE_SIZE);
+  assert(len && !stasis_compressed_tier_decompress(buf, len, out, 3));
+  assert(!memcmp(small, out, 3));
+  memset(page, 0, PAGE_SIZE);
+  assert(!stasis_compressed_tier_compress(page, PAGE_SIZE, buf, 8));
+  len = stasis_compressed_tier_compress(page, PAGE_SIZE, buf, PAGE_SIZE);
+  assert(len);
+  assert(stasis_compressed_tier_decompress(buf, len - 1, page, PAGE_SIZE));
+  assert(stasis_compressed_tier_decompress(buf, len, page, PAGE_SIZE - 1));
+
+  free(buf);
+  free(page);
+} END_TEST
+
+/**
+    @test
+
+    Read and then overwrite a run of pages that does not fit in the buffer
+    pool, so that clean pages go to the compressed tier as they are
+    evicted, and dirty ones invalidate their compressed copies.
+*/
+START_TEST(compressedTierBufferManagerTest) {
+  pageid_t old_size = stasis_buffer_manager_size;
+  stasis_buffer_manager_compressed_tier_size = SCAN_LENGTH;
+  stasis_buffer_manager_size = 100;
+
+  Tinit();
+  initializeRun(RUN_START, SCAN_LENGTH);
+  for(int pass = 0; pass < 3; pass++) {
+    for(int i = 0; i < SCAN_LENGTH; i++) {
+      recordid rid = { RUN_START + (pass == 1 ? i : (pageid_t)stasis_util_random64(SCAN_LENGTH)), 0, sizeof(int) };
+      Page * p = loadPage(-1, rid.page);
+      int j;
+      writelock(p->rwlatch,0);
+      stasis_record_read(-1, p, rid, (byte*)&j);
+      assert(j == rid.page - RUN_START + (pass == 2 ? SCAN_LENGTH : 0));
+      if(pass == 1) {
+        // Overwrite each page, so that the third pass fails if it sees stale copies.
+        j += SCAN_LENGTH;
+        stasis_record_write(-1, p, rid, (byte*)&j);
+        stasis_page_lsn_write(-1, p, 0);
+      }
+      unlock(p->rwlatch);
+      releasePage(p);
+    }
+  }
+  stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+  pageid_t pageids[16];
+  Page * pages[16];
+  for(int i = 0; i < 16; i++) { pageids[i] = RUN_START + i * 2; }
+  bm->loadPagesImpl(bm, NULL, -1, pageids, 16, pages);
+  for(int i = 0; i < 16; i++) {
+    recordid rid = { pageids[i], 0, sizeof(int) };
+    int j;
+    readlock(pages[i]->rwlatch,0);
+    stasis_record_read(-1, pages[i], rid, (byte*)&j);
+    unlock(pages[i]->rwlatch);
+    assert(j == i * 2 + SCAN_LENGTH);
+    releasePage(pages[i]);
+  }
+
+  stasis_compressed_tier_stats_t stats;
+  assert(stasis_buffer_manager_concurrent_hash_compressed_tier_stats(bm, &stats));
+  printf("compressed tier: %lld hits, %lld misses, %lld pages, %lld bytes\n",
+         (long long)stats.hits, (long long)stats.misses, (long long)stats.pages, (long long)stats.bytes);
+  assert(stats.hits > 0);
+  assert(stats.insertions > 0 && !stats.rejections);
+  assert(stats.bytes <= stats.capacity);
+  Tdeinit();
+
+  stasis_buffer_manager_compressed_tier_size = 0;
+  stasis_buffer_manager_size = old_size;
+} END_TEST
+
+/**
+    @test
+
+    Write a run of pages with the default buffer manager, then reopen the
+    page file with the read only, mmap based buffer manager, and check
+    that pages are served directly out of the mapping, and that Tinit()
+    fails cleanly if the page file is missing.
+*/
+START_TEST(mmapReadOnlyTest) {
+  stasis_buffer_manager_t* (*old_factory)(stasis_log_t*, stasis_dirty_page_table_t*)
+    = stasis_buffer_manager_factory;
+
+  Tinit();
+  initializeRun(RUN_START, SCAN_LENGTH);
+  Tdeinit();
+
+  stasis_buffer_manager_factory = stasis_buffer_manager_mmap_read_only_factory;
+  Tinit();
+  readAheadScan(1);
+  readAheadScan(0);
+  Page * first = loadPage(-1, RUN_START);
+  for(int i = 0; i < SCAN_LENGTH; i++) {
+    recordid rid = { RUN_START + stasis_util_random64(SCAN_LENGTH), 0, sizeof(int) };
+    Page * p = loadPage(-1, rid.page);
+    int j;
+    assert(p == loadPage(-1, rid.page));
+    // Zero copy; pages are laid out just as they are in the file.
+    assert(p->memAddr == first->memAddr + (rid.page - RUN_START) * PAGE_SIZE);
+    readlock(p->rwlatch,0);
+    stasis_record_read(-1, p, rid, (byte*)&j);
+    unlock(p->rwlatch);
+    assert(j == rid.page - RUN_START);
+    releasePage(p);
+    releasePage(p);
+  }
+  releasePage(first);
+  Tdeinit();
+
+  // Without a page file, Tinit() should fail cleanly, and leave Stasis
+  // in a state where it can be initialized again.
+  const char * old_store_file_name = stasis_store_file_name;
+  stasis_store_file_name = "missing.txt";
+  remove(stasis_store_file_name);
+  assert(LLADD_IO_ERROR == Tinit());
+  stasis_store_file_name = old_store_file_name;
+  assert(0 == Tinit());
+  Tdeinit();
+
+  stasis_buffer_manager_factory = old_factory;
+} END_TEST
+
+/**
+    @test
+
+    Like pageLoadTest, but spreads writeback across several writeback
+    threads, each responsible for a different set of page id stripes.
+    This checks that the workload's reads and writes see consistent
+    pages, and that Tdeinit() stops all of the threads.  That each
+    thread only writes back its own stripes is checked by
+    dirtyPageTable_shardTest.
+*/
+START_TEST(parallelWritebackTest) {
+  int old_count = stasis_buffer_manager_concurrent_hash_writeback_count;
+  pageid_t old_stripe_size = stasis_buffer_manager_concurrent_hash_writeback_stripe_size;
+  stasis_buffer_manager_concurrent_hash_writeback_count = 4;
+  stasis_buffer_manager_concurrent_hash_writeback_stripe_size = 16;
+
+  pthread_t workers[THREAD_COUNT];
+  int i;
+
+  Tinit();
+
+  initializePages();
+
+  for(i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&workers[i], NULL, workerThread, NULL);
+  }
+  for(i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  Tdeinit();
+
+  stasis_buffer_manager_concurrent_hash_writeback_count = old_count;
+  stasis_buffer_manager_concurrent_hash_writeback_stripe_size = old_stripe_size;
+} END_TEST
+
+/**
+    @test
+
+    Split the buffer pool into two NUMA partitions (even if the machine
+    only has one node), run the pageLoadTest workload with each of the
+    placement policies, and check the per-partition statistics.
+*/
+START_TEST(numaPartitionTest) {
+  int old_nodes = stasis_buffer_pool_numa_nodes;
+  int old_placement = stasis_buffer_manager_numa_placement;
+  stasis_buffer_pool_numa_nodes = 2;
+
+  int placements[] = { STASIS_NUMA_PLACEMENT_LOCAL, STASIS_NUMA_PLACEMENT_HASH };
+  for(int k = 0; k < 2; k++) {
+    stasis_buffer_manager_numa_placement = placements[k];
+    pthread_t workers[THREAD_COUNT];
+
+    Tinit();
+
+    initializePages();
+
+    for(int i = 0; i < THREAD_COUNT; i++) {
+      pthread_create(&workers[i], NULL, workerThread, NULL);
+    }
+    for(int i = 0; i < THREAD_COUNT; i++) {
+      pthread_join(workers[i], NULL);
+    }
+
+    stasis_replacement_policy_numa_stats_t stats[2];
+    assert(2 == stasis_buffer_manager_concurrent_hash_numa_stats(stasis_runtime_buffer_manager(), 0, &stats[0]));
+    assert(2 == stasis_buffer_manager_concurrent_hash_numa_stats(stasis_runtime_buffer_manager(), 1, &stats[1]));
+    assert(stats[0].frames + stats[1].frames == stasis_buffer_manager_size);
+    assert(stats[0].local_evictions + stats[1].local_evictions > 0);
+    if(placements[k] == STASIS_NUMA_PLACEMENT_HASH) {
+      // Half of the pages hash to each partition.
+      assert(stats[0].local_evictions > 0);
+      assert(stats[1].local_evictions > 0);
+    }
+
+    Tdeinit();
+  }
+
+  stasis_buffer_pool_numa_nodes = old_nodes;
+  stasis_buffer_manager_numa_placement = old_placement;
+} END_TEST
+
+/**
+    @test
+
+    Allocate the buffer pool with each of the huge page modes.  Modes that
+    this machine does not support should fall back on lesser modes.
+*/
+START_TEST(hugePageTest) {
+  int old_huge_pages = stasis_buffer_pool_huge_pages;
+  int old_readahead_count = stasis_buffer_manager_concurrent_hash_readahead_count;
+  stasis_buffer_manager_concurrent_hash_readahead_count = 1;
+  int modes[] = { STASIS_BUFFER_POOL_HUGE_PAGES_DISABLED,
+                  STASIS_BUFFER_POOL_HUGE_PAGES_TRANSPARENT,
+                  STASIS_BUFFER_POOL_HUGE_PAGES_EXPLICIT };
+  for(int k = 0; k < 3; k++) {
+    stasis_buffer_pool_huge_pages = modes[k];
+    Tinit();
+    int mode = stasis_buffer_manager_concurrent_hash_huge_pages(stasis_runtime_buffer_manager());
+    printf("requested huge page mode %d, got %d\n", modes[k], mode);
+    assert(mode >= STASIS_BUFFER_POOL_HUGE_PAGES_DISABLED && mode <= modes[k]);
+    initializeRun(RUN_START, SCAN_LENGTH);
+    Tdeinit();
+
+    Tinit();
+    readAheadScan(0);
+    Tdeinit();
+  }
+  stasis_buffer_pool_huge_pages = old_huge_pages;
+  stasis_buffer_manager_concurrent_hash_readahead_count = old_readahead_count;
+} END_TEST
+
+#define HOT_PAGE_PINS 100000
+static recordid hotRid;
+static volatile int hotPageDone;
+
+static void * hotPagePinner(void * arg) {
+  for(int i = 0; i < HOT_PAGE_PINS; i++) {
+    Page * p = loadPage(-1, hotRid.page);
+    assert(p->id == hotRid.page);
+    if(i % 2) {
+      // Pinning a page twice must not deadlock with a waiting writeback.
+      Page * q = loadPage(-1, hotRid.page);
+      assert(q == p);
+      releasePage(q);
+    }
+    releasePage(p);
+  }
+  return NULL;
+}
+static void * hotPageWriteBack(void * arg) {
+  stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+  while(!hotPageDone) {
+    // Forced writeback waits for the pins to drain, instead of giving up.
+    assert(!bm->writeBackPage(bm, hotRid.page));
+    bm->tryToWriteBackPage(bm, hotRid.page);
+  }
+  return NULL;
+}
+/**
+    @test
+
+    Pin and update a hot page from many threads while it is being
+    written back, then make sure the updates survived.
+*/
+START_TEST(hotPageTest) {
+  pthread_t workers[THREAD_COUNT];
+  pthread_t writeback;
+  Tinit();
+  int xid = Tbegin();
+  hotRid = Talloc(xid, sizeof(int));
+  int val = 0;
+  Tset(xid, hotRid, &val);
+
+  assert(!setPageHot(hotRid.page, 1));
+  assert(!setPageHot(hotRid.page, 1));
+
+  hotPageDone = 0;
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&workers[i], NULL, hotPagePinner, NULL);
+  }
+  pthread_create(&writeback, NULL, hotPageWriteBack, NULL);
+  for(val = 1; val <= 1000; val++) {
+    Tset(xid, hotRid, &val);
+  }
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  hotPageDone = 1;
+  pthread_join(writeback, NULL);
+
+  Tread(xid, hotRid, &val);
+  assert(val == 1000);
+
+  // The table of hot pages is small; it should fill up.
+  int ret = 0;
+  pageid_t i;
+  for(i = 0; !ret; i++) {
+    ret = setPageHot(hotRid.page + 1 + i, 1);
+  }
+  assert(ret == ENOSPC);
+  for(pageid_t j = 0; j < i; j++) {
+    assert(!setPageHot(hotRid.page + 1 + j, 0));
+  }
+  assert(!setPageHot(hotRid.page, 0));
+
+  Tcommit(xid);
+  Tdeinit();
+
+  Tinit();
+  xid = Tbegin();
+  Tread(xid, hotRid, &val);
+  assert(val == 1000);
+  Tcommit(xid);
+  Tdeinit();
+} END_TEST
+
 START_TEST(pageSingleThreadWriterTest) {
   int i = 100;
 
@@ -360,9 +1055,22 @@ static void stalePinTestImpl(stasis_buffer_manager_t * (*fact)(stasis_log_t*, st
   stasis_buffer_manager_factory = old_fact;
 }
 START_TEST(prefetchTest) {
+  int old_readahead_count = stasis_buffer_manager_concurrent_hash_readahead_count;
+  stasis_buffer_manager_concurrent_hash_readahead_count = 0;
+  Tinit();
+  prefetchPages(100, 100);
+  Tdeinit();
+
+  // With read-ahead enabled, prefetching past the end of the page file
+  // should not bring any pages into cache.
+  stasis_buffer_manager_concurrent_hash_readahead_count = 1;
   Tinit();
   prefetchPages(100, 100);
+  usleep(100000);
+  Page * p = getCachedPage(-1, 150);
+  assert(!p);
   Tdeinit();
+  stasis_buffer_manager_concurrent_hash_readahead_count = old_readahead_count;
 } END_TEST
 START_TEST(stalePinTest) {
   stalePinTestImpl(stasis_buffer_manager_hash_factory);
@@ -370,6 +1078,55 @@ START_TEST(stalePinTest) {
 START_TEST(stalePinTestConcurrentBufferManager) {
   stalePinTestImpl(stasis_buffer_manager_concurrent_hash_factory);
 } END_TEST
+#define SCAN_POOL_SIZE 200
+#define SCAN_HOT_PAGES 8
+static void loadRun(pageid_t start, int count) {
+  for(int i = 0; i < count; i++) {
+    releasePage(loadPage(-1, start + i));
+  }
+}
+/**
+    Under 2Q, pages that are re-read after they leave the cache belong to
+    the hot set, and a one-pass scan of more pages than the pool holds
+    should not push them out.
+*/
+static void scanResistanceTestImpl(stasis_buffer_manager_t * (*fact)(stasis_log_t*, stasis_dirty_page_table_t*)) {
+  stasis_buffer_manager_t * (*old_fact)(stasis_log_t*, stasis_dirty_page_table_t*) = stasis_buffer_manager_factory;
+  int old_policy = stasis_replacement_policy;
+  pageid_t old_size = stasis_buffer_manager_size;
+  stasis_buffer_manager_factory = fact;
+  stasis_replacement_policy = STASIS_REPLACEMENT_POLICY_CONCURRENT_2Q;
+  stasis_buffer_manager_size = SCAN_POOL_SIZE;
+
+  pageid_t hot = RUN_START;
+  pageid_t filler = hot + SCAN_HOT_PAGES;
+  pageid_t scan = filler + SCAN_POOL_SIZE;
+
+  Tinit();
+  loadRun(hot, SCAN_HOT_PAGES);
+  // Push the hot set out of the pool, and then re-read it.
+  loadRun(filler, SCAN_POOL_SIZE);
+  loadRun(hot, SCAN_HOT_PAGES);
+
+  loadRun(scan, 3 * SCAN_POOL_SIZE);
+
+  for(int i = 0; i < SCAN_HOT_PAGES; i++) {
+    Page * p = getCachedPage(-1, hot + i);
+    assert(p);
+    releasePage(p);
+  }
+  Tdeinit();
+
+  stasis_buffer_manager_factory = old_fact;
+  stasis_replacement_policy = old_policy;
+  stasis_buffer_manager_size = old_size;
+}
+START_TEST(scanResistanceTest) {
+  scanResistanceTestImpl(stasis_buffer_manager_hash_factory);
+} END_TEST
+START_TEST(scanResistanceTestConcurrentBufferManager) {
+  scanResistanceTestImpl(stasis_buffer_manager_concurrent_hash_factory);
+} END_TEST
 //START_TEST(stalePinTestDeprecatedBufferManager) {
 //  stalePinTestImpl(stasis_buffer_manager_deprecated_factory);
 //} END_TEST
@@ -393,9 +1150,24 @@ Suite * check_suite(void) {
   tcase_add_test(tc, pageLoadTest);
 #ifndef DBUG_TEST
   tcase_add_test(tc, pageThreadedWritersTest);
+  tcase_add_test(tc, parallelWritebackTest);
+  tcase_add_test(tc, numaPartitionTest);
+  tcase_add_test(tc, hugePageTest);
+  tcase_add_test(tc, hotPageTest);
+  tcase_add_test(tc, pageBatchLoadTest);
+  tcase_add_test(tc, pageBatchAdjacentTest);
+  tcase_add_test(tc, sequentialReadAheadTest);
+  tcase_add_test(tc, hotSetTest);
+  tcase_add_test(tc, directIOTest);
+  tcase_add_test(tc, mmapReadOnlyTest);
+  tcase_add_test(tc, pageCacheHandleTest);
+  tcase_add_test(tc, compressedTierTest);
+  tcase_add_test(tc, compressedTierBufferManagerTest);
   tcase_add_test(tc, pageBlindRandomTest);
   tcase_add_test(tc, stalePinTestConcurrentBufferManager);
   tcase_add_test(tc, pageBlindThreadTest);
+  tcase_add_test(tc, scanResistanceTest);
+  tcase_add_test(tc, scanResistanceTestConcurrentBufferManager);
 #endif
   /* --------------------------------------------- */
 
@@ -174,6 +174,49 @@ START_TEST(concurrentHashTest) {
   hashtable_deinit(ht);
 } END_TEST
 
+START_TEST(resizeHashTest) {
+  ht = hashtable_init(1);
+  pageid_t min_buckets = hashtable_debug_bucket_count(ht);
+  pageid_t *data = stasis_malloc(NUM_ENTRIES, pageid_t);
+  for(pageid_t i = 0; i < NUM_ENTRIES; i++) {
+    data[i] = i;
+    assert(NULL == hashtable_insert(ht, i, &data[i]));
+  }
+  pageid_t grown_buckets = hashtable_debug_bucket_count(ht);
+  assert(grown_buckets >= NUM_ENTRIES * 2);
+  for(pageid_t i = 0; i < NUM_ENTRIES; i++) {
+    assert(&data[i] == hashtable_lookup(ht, i));
+  }
+  for(pageid_t i = 0; i < NUM_ENTRIES; i++) {
+    assert(&data[i] == hashtable_remove(ht, i));
+  }
+  assert(hashtable_debug_bucket_count(ht) < grown_buckets);
+  assert(hashtable_debug_bucket_count(ht) >= min_buckets);
+  free(data);
+  hashtable_deinit(ht);
+} END_TEST
+
+/**
+ * Like concurrentHashTest, but the hashtable starts out small, and is resized
+ * in race with the workers.
+ */
+START_TEST(concurrentResizeHashTest) {
+  ht = hashtable_init(1);
+  pthread_t workers[NUM_THREADS];
+  for(int i = 0 ; i < NUM_THREADS; i++) {
+    pageid_t *data = stasis_malloc(THREAD_ENTRIES, pageid_t);
+
+    for(int j = 1; j <= THREAD_ENTRIES; j++) {
+      data[j-1] = -1 * (i + (j * NUM_THREADS));
+    }
+    pthread_create(&workers[i], 0, worker, data);
+  }
+  for(int i = 0 ; i < NUM_THREADS; i++) {
+    pthread_join(workers[i],0);
+  }
+  hashtable_deinit(ht);
+} END_TEST
+
 Suite * check_suite(void) {
   Suite *s = suite_create("lhtable");
   /* Begin a new test */
@@ -188,6 +231,8 @@ Suite * check_suite(void) {
 #ifndef DBUG_TEST // TODO should run exactly one of these two tests under dbug.  Need good way to choose which one.
   tcase_add_test(tc, wraparoundHashTest);
   tcase_add_test(tc, concurrentHashTest);
+  tcase_add_test(tc, resizeHashTest);
+  tcase_add_test(tc, concurrentResizeHashTest);
 #endif
 
   /* --------------------------------------------- */
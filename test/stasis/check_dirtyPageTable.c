@@ -136,6 +136,220 @@ START_TEST(dirtyPageTable_threadTest) {
   Tdeinit();
 } END_TEST
 
+START_TEST(dirtyPageTable_adaptiveLimitsTest) {
+  stasis_buffer_manager_factory = stasis_buffer_manager_mem_array_factory;
+  stasis_dirty_page_table_adaptive_limits = 1;
+  Tinit();
+  stasis_dirty_page_table_t * dpt = (stasis_dirty_page_table_t *)stasis_runtime_dirty_page_table();
+  stasis_dirty_page_table_limits_t limits;
+
+  // Before writeback is measured, the configured limits are in effect.
+  stasis_dirty_page_table_observe_writeback(dpt, 0, 1.0);
+  stasis_dirty_page_table_get_limits(dpt, &limits);
+  assert(limits.write_bandwidth == 0);
+  assert(limits.soft_limit == stasis_dirty_page_count_soft_limit);
+  assert(limits.low_water_mark == stasis_dirty_page_low_water_mark);
+  assert(limits.hard_limit == stasis_dirty_page_count_hard_limit);
+  assert(limits.flush_quantum == stasis_dirty_page_table_flush_quantum);
+
+  // A very slow device: the limits shrink, but stay within their bounds.
+  stasis_dirty_page_table_observe_writeback(dpt, 100, 1.0);
+  stasis_dirty_page_table_get_limits(dpt, &limits);
+  assert(limits.write_bandwidth == 100);
+  assert(limits.soft_limit == stasis_dirty_page_count_soft_limit / 8);
+  assert(limits.low_water_mark == limits.soft_limit * stasis_dirty_page_low_water_mark
+                                  / stasis_dirty_page_count_soft_limit);
+  assert(limits.hard_limit == stasis_dirty_page_count_hard_limit);
+  assert(limits.flush_quantum == 16);
+
+  // A moderately slow device: the soft limit is one second of writeback.
+  pageid_t bw = stasis_dirty_page_count_soft_limit / 2;
+  for(int i = 0; i < 100; i++) {
+    stasis_dirty_page_table_observe_writeback(dpt, bw, 1.0);
+  }
+  stasis_dirty_page_table_get_limits(dpt, &limits);
+  assert(limits.soft_limit > bw - 2 && limits.soft_limit <= bw);
+  assert(limits.low_water_mark < limits.soft_limit);
+  assert(limits.flush_quantum > bw / 10 - 2 && limits.flush_quantum <= bw / 10);
+
+  // The device speeds up: the limits converge back to the configured values.
+  for(int i = 0; i < 100; i++) {
+    stasis_dirty_page_table_observe_writeback(dpt, 1000000, 0.001);
+  }
+  stasis_dirty_page_table_get_limits(dpt, &limits);
+  assert(limits.soft_limit == stasis_dirty_page_count_soft_limit);
+  assert(limits.low_water_mark == stasis_dirty_page_low_water_mark);
+  assert(limits.flush_quantum == stasis_dirty_page_table_flush_quantum);
+
+  // Turning the controller off restores the configured limits immediately.
+  stasis_dirty_page_table_observe_writeback(dpt, 100, 1.0);
+  stasis_dirty_page_table_adaptive_limits = 0;
+  stasis_dirty_page_table_get_limits(dpt, &limits);
+  assert(limits.write_bandwidth == 0);
+  assert(limits.soft_limit == stasis_dirty_page_count_soft_limit);
+  stasis_dirty_page_table_adaptive_limits = 1;
+
+  // Writeback still works with adaptive limits in effect.
+  for(pageid_t i = 0; i < NUM_PAGES; i++) {
+    Page * p = loadPage(-1, i);
+    writelock(p->rwlatch, 0);
+    stasis_dirty_page_table_set_dirty(dpt, p);
+    unlock(p->rwlatch);
+    releasePage(p);
+  }
+  stasis_dirty_page_table_flush(dpt);
+  assert(stasis_dirty_page_table_dirty_count(dpt) == 0);
+  Tdeinit();
+  stasis_dirty_page_table_adaptive_limits = 0;
+} END_TEST
+
+/** A stub buffer manager whose writeback simply cleans stubPages, and logs the order of the writes. */
+static Page stubPages[NUM_PAGES];
+static pageid_t stubWrites[NUM_PAGES];
+static int stubWriteCount;
+static int stubWriteBack(stasis_buffer_manager_t * bm, pageid_t p) {
+  stasis_dirty_page_table_set_clean((stasis_dirty_page_table_t*)bm->impl, &stubPages[p]);
+  if(stubWriteCount < NUM_PAGES) { stubWrites[stubWriteCount++] = p; }
+  return 0;
+}
+static void stubForce(stasis_buffer_manager_t * bm, stasis_buffer_manager_handle_t * h) { }
+static void stubOpen(stasis_buffer_manager_t * bm, stasis_dirty_page_table_t * dpt) {
+  memset(bm, 0, sizeof(*bm));
+  bm->writeBackPage = stubWriteBack;
+  bm->tryToWriteBackPage = stubWriteBack;
+  bm->asyncForcePages = stubForce;
+  bm->impl = dpt;
+  stasis_dirty_page_table_set_buffer_manager(dpt, bm);
+  memset(stubPages, 0, sizeof(stubPages));
+  for(pageid_t i = 0; i < NUM_PAGES; i++) { stubPages[i].id = i; }
+  stubWriteCount = 0;
+}
+
+START_TEST(dirtyPageTable_shardTest) {
+  int oldShards = stasis_dirty_page_table_shard_count;
+  pageid_t oldStripe = stasis_dirty_page_table_shard_stripe_size;
+  stasis_dirty_page_table_shard_count = 4;
+  stasis_dirty_page_table_shard_stripe_size = 8;
+  stasis_dirty_page_table_t * dpt = stasis_dirty_page_table_init();
+  stasis_dirty_page_table_shard_count = oldShards;
+  stasis_dirty_page_table_shard_stripe_size = oldStripe;
+
+  stasis_buffer_manager_t bm;
+  stubOpen(&bm, dpt);
+  assert(stasis_dirty_page_table_minRecLSN(dpt) == LSN_T_MAX);
+
+  // Dirty the pages in a scrambled order, so that recLSNs do not follow
+  // page ids, and the pages span several stripes of every shard.
+  for(pageid_t i = 0; i < NUM_PAGES; i++) {
+    Page * p = &stubPages[(i * 37) % NUM_PAGES];
+    p->LSN = 1000 + i;
+    stasis_dirty_page_table_set_dirty(dpt, p);
+  }
+  assert(stasis_dirty_page_table_dirty_count(dpt) == NUM_PAGES);
+  assert(stasis_dirty_page_table_minRecLSN(dpt) == 1000);
+
+  // Flush candidates are merged across shards into contiguous ranges.
+  pageid_t starts[NUM_PAGES], ends[NUM_PAGES];
+  int n = stasis_dirty_page_table_get_flush_candidates(dpt, 0, 0, NUM_PAGES, starts, ends);
+  assert(n == 1);
+  assert(starts[0] == 0 && ends[0] == NUM_PAGES);
+  n = stasis_dirty_page_table_get_flush_candidates(dpt, 5, 30, NUM_PAGES, starts, ends);
+  assert(n == 1);
+  assert(starts[0] == 5 && ends[0] == 30);
+  n = stasis_dirty_page_table_get_flush_candidates(dpt, 5, 0, 20, starts, ends);
+  assert(n == 1);
+  assert(starts[0] == 5 && ends[0] == 25);
+
+  // Cleaning the oldest page advances minRecLSN.
+  stasis_dirty_page_table_set_clean(dpt, &stubPages[0]);
+  assert(stasis_dirty_page_table_minRecLSN(dpt) == 1001);
+  n = stasis_dirty_page_table_get_flush_candidates(dpt, 0, 0, NUM_PAGES, starts, ends);
+  assert(n == 1);
+  assert(starts[0] == 1 && ends[0] == NUM_PAGES);
+
+  // LSN targeted writeback only writes the pages that hold back truncation.
+  stasis_dirty_page_table_flush_with_target(dpt, 1050);
+  assert(stasis_dirty_page_table_minRecLSN(dpt) == 1050);
+  assert(stasis_dirty_page_table_dirty_count(dpt) == NUM_PAGES - 50);
+  for(pageid_t i = 0; i < NUM_PAGES; i++) {
+    Page * p = &stubPages[(i * 37) % NUM_PAGES];
+    assert(stasis_dirty_page_table_is_dirty(dpt, p) == (i >= 50));
+  }
+
+  // Partitioned writeback sees every shard, and only writes its own stripes.
+  int * wasDirty = stasis_malloc(NUM_PAGES, int);
+  for(pageid_t i = 0; i < NUM_PAGES; i++) {
+    wasDirty[i] = stasis_dirty_page_table_is_dirty(dpt, &stubPages[i]);
+  }
+  stasis_dirty_page_table_flush_partition(dpt, 0, 3, 5);
+  for(pageid_t i = 0; i < NUM_PAGES; i++) {
+    if((i / 5) % 3 == 0) {
+      assert(!stasis_dirty_page_table_is_dirty(dpt, &stubPages[i]));
+    } else {
+      assert(stasis_dirty_page_table_is_dirty(dpt, &stubPages[i]) == wasDirty[i]);
+    }
+  }
+  free(wasDirty);
+  stasis_dirty_page_table_flush_partition(dpt, 1, 3, 5);
+  stasis_dirty_page_table_flush_partition(dpt, 2, 3, 5);
+  assert(stasis_dirty_page_table_dirty_count(dpt) == 0);
+  assert(stasis_dirty_page_table_minRecLSN(dpt) == LSN_T_MAX);
+
+  // So does a full, page ordered sweep.
+  for(pageid_t i = 0; i < NUM_PAGES; i++) {
+    stasis_dirty_page_table_set_dirty(dpt, &stubPages[i]);
+  }
+  stasis_dirty_page_table_flush(dpt);
+  assert(stasis_dirty_page_table_dirty_count(dpt) == 0);
+  stasis_dirty_page_table_deinit(dpt);
+} END_TEST
+
+START_TEST(dirtyPageTable_targetedFlushTest) {
+  stasis_dirty_page_table_t * dpt = stasis_dirty_page_table_init();
+  stasis_buffer_manager_t bm;
+  stubOpen(&bm, dpt);
+
+  stasis_dirty_page_table_flush_progress_t progress;
+  stasis_dirty_page_table_flush_progress(dpt, &progress);
+  assert(progress.target_lsn == 0);
+  assert(progress.min_rec_lsn == LSN_T_MAX);
+
+  // recLSNs run backwards through the page file.
+  for(pageid_t i = 0; i < NUM_PAGES; i++) {
+    stubPages[i].LSN = 1000 + NUM_PAGES - i;
+    stasis_dirty_page_table_set_dirty(dpt, &stubPages[i]);
+  }
+  const lsn_t target = 1000 + NUM_PAGES / 2 + 1;
+  stasis_dirty_page_table_flush_with_target(dpt, target);
+
+  // Exactly the pages below the target were written, in page order.
+  assert(stubWriteCount == NUM_PAGES / 2);
+  for(int i = 0; i < stubWriteCount; i++) {
+    assert(stubWrites[i] == NUM_PAGES / 2 + i);
+  }
+  assert(stasis_dirty_page_table_minRecLSN(dpt) == target);
+
+  stasis_dirty_page_table_flush_progress(dpt, &progress);
+  assert(progress.target_lsn == target);
+  assert(progress.passes == 1);
+  assert(progress.pages == NUM_PAGES / 2);
+  assert(progress.written == NUM_PAGES / 2);
+  assert(progress.busy == 0);
+  assert(progress.done);
+  assert(progress.min_rec_lsn == target);
+
+  // A target that nothing is below is a no-op.
+  stubWriteCount = 0;
+  stasis_dirty_page_table_flush_with_target(dpt, 1000);
+  assert(stubWriteCount == 0);
+  stasis_dirty_page_table_flush_progress(dpt, &progress);
+  assert(progress.target_lsn == 1000 && progress.pages == 0 && progress.done);
+
+  stasis_dirty_page_table_flush(dpt);
+  assert(stasis_dirty_page_table_dirty_count(dpt) == 0);
+  stasis_dirty_page_table_deinit(dpt);
+} END_TEST
+
 Suite * check_suite(void) {
   Suite *s = suite_create("allocationPolicy");
   /* Begin a new test */
@@ -145,6 +359,9 @@ Suite * check_suite(void) {
   /* Sub tests are added, one per line, here */
   tcase_add_test(tc, dirtyPageTable_randomTest);
   tcase_add_test(tc, dirtyPageTable_threadTest);
+  tcase_add_test(tc, dirtyPageTable_adaptiveLimitsTest);
+  tcase_add_test(tc, dirtyPageTable_shardTest);
+  tcase_add_test(tc, dirtyPageTable_targetedFlushTest);
 
   /* --------------------------------------------- */
 
@@ -53,6 +53,7 @@ terms specified in this license.
 #include <assert.h>
 #include <sys/time.h>
 #include <time.h>
+#include <sched.h>
 
 #define LOG_NAME   "check_filePool.log"
 
@@ -126,6 +127,76 @@ START_TEST(filePoolDirTest){
   log->close(log);
 } END_TEST
 
+#define GROUP_THREADS 16
+#define GROUP_ENTRIES 500
+
+static stasis_log_t * group_log;
+
+static void * filePoolGroupWorker(void * arg) {
+  intptr_t id = (intptr_t)arg;
+  for(int i = 0; i < GROUP_ENTRIES; i++) {
+    // Vary the entry size, so that entries in a group have different lengths.
+    LogEntry * e = group_log->reserve_entry(group_log, sizeof(struct __raw_log_entry) + sizeof(UpdateLogEntry) + (i % 7) * 8);
+    e->type = UPDATELOG;
+    e->xid = id;
+    e->prevLSN = i;
+    e->update.arg_size = (i % 7) * 8;
+    e->update.page = INVALID_PAGE;
+    memset(stasis_log_entry_update_args_ptr(e), id, e->update.arg_size);
+    // The entry has not been written yet, so truncation must not pass it.
+    if(!(i % 13)) { sched_yield(); }
+    assert(group_log->first_pending_lsn(group_log) <= e->LSN);
+    group_log->write_entry(group_log, e);
+    group_log->write_entry_done(group_log, e);
+    if(!(i % 50)) { group_log->force_tail(group_log, LOG_FORCE_COMMIT); }
+  }
+  return 0;
+}
+/**
+   @test
+   Check that entries reserved concurrently (and so grouped) land at
+   distinct LSNs, and are intact after the log is reopened.
+*/
+START_TEST(filePoolGroupTest) {
+  group_log = stasis_log_file_pool_open(stasis_log_dir_name,
+                                        stasis_log_file_mode,
+                                        stasis_log_file_permissions);
+  pthread_t workers[GROUP_THREADS];
+  for(intptr_t i = 0; i < GROUP_THREADS; i++) {
+    pthread_create(&workers[i], 0, filePoolGroupWorker, (void*)i);
+  }
+  for(int i = 0; i < GROUP_THREADS; i++) {
+    pthread_join(workers[i], 0);
+  }
+  group_log->close(group_log);
+
+  group_log = stasis_log_file_pool_open(stasis_log_dir_name,
+                                        stasis_log_file_mode,
+                                        stasis_log_file_permissions);
+  int next[GROUP_THREADS];
+  memset(next, 0, sizeof(next));
+  lsn_t l = group_log->truncation_point(group_log);
+  const LogEntry * e;
+  while((e = group_log->read_entry(group_log, l))) {
+    if(e->type == UPDATELOG) {
+      assert(e->xid >= 0 && e->xid < GROUP_THREADS);
+      // Each thread's entries are in the log in the order it wrote them.
+      assert(e->prevLSN == next[e->xid]);
+      next[e->xid]++;
+      assert(e->update.arg_size == (e->prevLSN % 7) * 8);
+      const byte * arg = stasis_log_entry_update_args_cptr(e);
+      for(unsigned int j = 0; j < e->update.arg_size; j++) {
+        assert(arg[j] == (byte)e->xid);
+      }
+    }
+    l = group_log->next_entry(group_log, e);
+    group_log->read_entry_done(group_log, e);
+  }
+  for(int i = 0; i < GROUP_THREADS; i++) {
+    assert(next[i] == GROUP_ENTRIES);
+  }
+  group_log->close(group_log);
+} END_TEST
 
 Suite * check_suite(void) {
   Suite *s = suite_create("filePool");
@@ -135,6 +206,7 @@ Suite * check_suite(void) {
   /* Sub tests are added, one per line, here */
 
   tcase_add_test(tc, filePoolDirTest);
+  tcase_add_test(tc, filePoolGroupTest);
 
   /* --------------------------------------------- */
 
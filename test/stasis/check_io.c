@@ -81,6 +81,35 @@ void handle_smoketest(stasis_handle_t * h) {
 }
 
 
+void handle_writevtest(stasis_handle_t * h) {
+  if(!h->writev) { return; }
+  byte a[100], b[PAGE_SIZE], c[3];
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  memset(c, 'c', sizeof(c));
+  struct iovec iov[3] = { { a, sizeof(a) }, { b, sizeof(b) }, { c, sizeof(c) } };
+  const lsn_t off = 3 * PAGE_SIZE + 7;
+  assert(!h->writev(h, off, iov, 3));
+  // writev() must not modify the caller's iovecs.
+  assert(iov[0].iov_base == a && iov[0].iov_len == sizeof(a));
+
+  byte buf[sizeof(a) + sizeof(b) + sizeof(c)];
+  assert(!h->read(h, off, buf, sizeof(buf)));
+  assert(!memcmp(buf, a, sizeof(a)));
+  assert(!memcmp(buf + sizeof(a), b, sizeof(b)));
+  assert(!memcmp(buf + sizeof(a) + sizeof(b), c, sizeof(c)));
+  assert(h->end_position(h) >= off + (lsn_t)sizeof(buf));
+
+  // Resuming after a short write.
+  struct iovec * v = iov;
+  int cnt = 3;
+  stasis_handle_iovec_consume(&v, &cnt, sizeof(a) + 10);
+  assert(cnt == 2 && v == &iov[1]);
+  assert(v->iov_base == b + 10 && v->iov_len == sizeof(b) - 10);
+  stasis_handle_iovec_consume(&v, &cnt, sizeof(b) - 10 + sizeof(c));
+  assert(cnt == 0);
+}
+
 typedef struct {
   int * values;
   int count;
@@ -262,6 +291,7 @@ START_TEST(io_memoryTest) {
   h = stasis_handle(open_memory)();
   //  h = stasis_handle(open_debug)(h);
   handle_smoketest(h);
+  handle_writevtest(h);
   h->close(h);
   h = stasis_handle(open_memory)();
   //  h = stasis_handle(open_debug)(h);
@@ -279,6 +309,7 @@ START_TEST(io_fileTest) {
   h = stasis_handle(open_file)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
   //  h = stasis_handle(open_debug)(h);
   handle_smoketest(h);
+  handle_writevtest(h);
   h->close(h);
 
   remove("logfile.txt");
@@ -305,6 +336,7 @@ START_TEST(io_pfileTest) {
   h = stasis_handle(open_pfile)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
   //  h = stasis_handle(open_debug)(h);
   handle_smoketest(h);
+  handle_writevtest(h);
   h->close(h);
 
   remove("logfile.txt");
@@ -324,6 +356,31 @@ START_TEST(io_pfileTest) {
 
 } END_TEST
 
+START_TEST(io_uringTest) {
+  printf("io_uringTest\n"); fflush(stdout);
+
+  stasis_handle_t * h;
+  h = stasis_handle(open_uring)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
+  handle_smoketest(h);
+  handle_writevtest(h);
+  h->close(h);
+
+  remove("logfile.txt");
+
+  h = stasis_handle(open_uring)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
+  handle_sequentialtest(h);
+  h->close(h);
+
+  remove("logfile.txt");
+
+  h = stasis_handle(open_uring)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
+  handle_concurrencytest(h);
+  h->close(h);
+
+  remove("logfile.txt");
+
+} END_TEST
+
 START_TEST(io_raid1pfileTest) {
   printf("io_raid1pfileTest\n"); fflush(stdout);
 
@@ -368,6 +425,278 @@ START_TEST(io_raid1pfileTest) {
   remove(B);
 
 } END_TEST
+static void cache_fill_block(byte * buf, pageid_t block, int version) {
+  for(int i = 0; i < PAGE_SIZE / (int)sizeof(int); i++) {
+    ((int*)buf)[i] = (int)block * 1000 + version;
+  }
+}
+static int cache_check_block(stasis_handle_t * h, pageid_t block, int version) {
+  byte buf[PAGE_SIZE], expected[PAGE_SIZE];
+  cache_fill_block(expected, block, version);
+  int ret = h->read(h, block * PAGE_SIZE, buf, PAGE_SIZE);
+  return !ret && !memcmp(buf, expected, PAGE_SIZE);
+}
+static void cache_copy_file(const char * from, const char * to) {
+  stasis_handle_t * a = stasis_handle(open_pfile)(from, O_RDWR, FILE_PERM);
+  stasis_handle_t * b = stasis_handle(open_pfile)(to, O_CREAT | O_TRUNC | O_RDWR, FILE_PERM);
+  lsn_t len = a->end_position(a);
+  byte * buf = stasis_malloc(len ? len : 1, byte);
+  assert(!a->read(a, 0, buf, len));
+  assert(!b->write(b, 0, buf, len));
+  free(buf);
+  a->close(a);
+  b->close(b);
+}
+#define CACHE_TEST_SIZE (64 * PAGE_SIZE)
+/**
+   @test
+   Run the generic handle tests against the cache handle, in both modes.
+*/
+START_TEST(io_cacheTest) {
+  printf("io_cacheTest\n"); fflush(stdout);
+  const char * A = "vol1.txt";
+  const char * B = "vol2.txt";
+  for(int write_back = 0; write_back < 2; write_back++) {
+    void (*tests[3])(stasis_handle_t*) = { handle_smoketest, handle_sequentialtest, handle_concurrencytest };
+    for(int t = 0; t < 3; t++) {
+      remove(A);
+      remove(B);
+      stasis_handle_t * h = stasis_handle_open_cache(stasis_handle(open_pfile)(A, O_CREAT | O_RDWR, FILE_PERM),
+                                                     stasis_handle(open_pfile)(B, O_CREAT | O_RDWR, FILE_PERM),
+                                                     CACHE_TEST_SIZE, write_back);
+      assert(!h->error);
+      tests[t](h);
+      h->close(h);
+    }
+  }
+  remove(A);
+  remove(B);
+} END_TEST
+/**
+   @test
+   Check that qos handles behave like the handles they wrap.
+*/
+START_TEST(io_qosTest) {
+  printf("io_qosTest\n"); fflush(stdout);
+  stasis_handle_t * h = stasis_handle(open_qos)(stasis_handle(open_memory)());
+  handle_smoketest(h);
+  handle_writevtest(h);
+  h->close(h);
+  h = stasis_handle(open_qos)(stasis_handle(open_memory)());
+  handle_sequentialtest(h);
+  h->close(h);
+  h = stasis_handle(open_qos)(stasis_handle(open_memory)());
+  handle_concurrencytest(h);
+  h->close(h);
+} END_TEST
+
+typedef struct {
+  stasis_handle_t * h;
+  int pages;
+} qos_writeback_arg;
+
+static void * qos_writeback_worker(void * argp) {
+  qos_writeback_arg * arg = argp;
+  byte buf[PAGE_SIZE];
+  memset(buf, 1, PAGE_SIZE);
+  stasis_handle_qos_set_class(STASIS_IO_CLASS_WRITEBACK);
+  for(int i = 0; i < arg->pages; i++) {
+    arg->h->write(arg->h, i * PAGE_SIZE, buf, PAGE_SIZE);
+  }
+  return 0;
+}
+/**
+   @test
+   Check that rate limited writeback waits for tokens, and that foreground
+   reads do not wait for it.
+*/
+START_TEST(io_qosPriorityTest) {
+  printf("io_qosPriorityTest\n"); fflush(stdout);
+  assert(stasis_handle_qos_get_class() == STASIS_IO_CLASS_FOREGROUND);
+  assert(stasis_handle_qos_set_class(STASIS_IO_CLASS_PREFETCH) == STASIS_IO_CLASS_FOREGROUND);
+  assert(stasis_handle_qos_set_class(STASIS_IO_CLASS_FOREGROUND) == STASIS_IO_CLASS_PREFETCH);
+
+  stasis_handle_qos_stats_t fg_before, fg_after, wb_before, wb_after;
+  stasis_handle_qos_stats(STASIS_IO_CLASS_FOREGROUND, &fg_before);
+  stasis_handle_qos_stats(STASIS_IO_CLASS_WRITEBACK, &wb_before);
+
+  // The bucket holds 16 pages; the rest trickle out over about a second.
+  stasis_handle_qos_set_rate(STASIS_IO_CLASS_WRITEBACK, 16 * PAGE_SIZE);
+  stasis_handle_t * h = stasis_handle(open_qos)(stasis_handle(open_memory)());
+  qos_writeback_arg arg = { h, 32 };
+  pthread_t wb;
+  pthread_create(&wb, 0, qos_writeback_worker, &arg);
+  byte buf[PAGE_SIZE];
+  int reads = 0;
+  void * ret;
+  while(1) {
+    h->read(h, 0, buf, PAGE_SIZE);
+    reads++;
+    stasis_handle_qos_stats(STASIS_IO_CLASS_WRITEBACK, &wb_after);
+    if(wb_after.requests - wb_before.requests == (uint64_t)arg.pages) { break; }
+    usleep(10000);
+  }
+  pthread_join(wb, &ret);
+  stasis_handle_qos_stats(STASIS_IO_CLASS_FOREGROUND, &fg_after);
+  stasis_handle_qos_stats(STASIS_IO_CLASS_WRITEBACK, &wb_after);
+  stasis_handle_qos_set_rate(STASIS_IO_CLASS_WRITEBACK, 0);
+  h->close(h);
+
+  assert(fg_after.requests - fg_before.requests == (uint64_t)reads);
+  assert(fg_after.delayed == fg_before.delayed);
+  assert(wb_after.bytes - wb_before.bytes == (uint64_t)arg.pages * PAGE_SIZE);
+  assert(wb_after.delayed > wb_before.delayed);
+  assert(wb_after.wait_seconds - wb_before.wait_seconds > 0.5);
+} END_TEST
+/**
+   @test
+   Check that requests issued under a reservation are charged to it, and
+   that unused bytes are returned.
+*/
+START_TEST(io_qosReserveTest) {
+  printf("io_qosReserveTest\n"); fflush(stdout);
+  stasis_handle_qos_set_class(STASIS_IO_CLASS_WRITEBACK);
+  stasis_handle_qos_stats_t before, after;
+  byte buf[PAGE_SIZE];
+  memset(buf, 1, PAGE_SIZE);
+
+  // Without any qos handles, reservations are no-ops.
+  stasis_handle_qos_stats(STASIS_IO_CLASS_WRITEBACK, &before);
+  stasis_handle_qos_reserve(4 * PAGE_SIZE);
+  stasis_handle_qos_release(0);
+  stasis_handle_qos_stats(STASIS_IO_CLASS_WRITEBACK, &after);
+  assert(after.requests == before.requests);
+
+  stasis_handle_t * h = stasis_handle(open_qos)(stasis_handle(open_memory)());
+  stasis_handle_qos_stats(STASIS_IO_CLASS_WRITEBACK, &before);
+  stasis_handle_qos_reserve(4 * PAGE_SIZE);
+  for(int i = 0; i < 2; i++) {
+    h->write(h, i * PAGE_SIZE, buf, PAGE_SIZE);
+  }
+  stasis_handle_qos_release(2 * PAGE_SIZE);
+  stasis_handle_qos_stats(STASIS_IO_CLASS_WRITEBACK, &after);
+  assert(after.requests - before.requests == 1);
+  assert(after.bytes - before.bytes == 2 * PAGE_SIZE);
+
+  // The reservation is over; requests are scheduled one at a time again.
+  h->write(h, 0, buf, PAGE_SIZE);
+  stasis_handle_qos_stats(STASIS_IO_CLASS_WRITEBACK, &after);
+  assert(after.requests - before.requests == 2);
+  h->close(h);
+  stasis_handle_qos_set_class(STASIS_IO_CLASS_FOREGROUND);
+} END_TEST
+/**
+   @test
+   Check that the cache serves admitted blocks, evicts blocks that do not
+   fit, stays warm across restarts and recovers dirty blocks after a crash.
+*/
+START_TEST(io_cacheRecoveryTest) {
+  printf("io_cacheRecoveryTest\n"); fflush(stdout);
+  const char * A = "vol1.txt";
+  const char * B = "vol2.txt";
+  const char * A2 = "vol1.crash";
+  const char * B2 = "vol2.crash";
+  remove(A); remove(B); remove(A2); remove(B2);
+  byte buf[PAGE_SIZE];
+
+  // Write-through: admitted blocks are read from the cache file, even
+  // after a restart.  (We write the slow handle behind the cache's back
+  // to tell where reads come from.)
+  stasis_handle_t * slow = stasis_handle(open_pfile)(A, O_CREAT | O_RDWR, FILE_PERM);
+  stasis_handle_t * h = stasis_handle_open_cache(slow, stasis_handle(open_pfile)(B, O_CREAT | O_RDWR, FILE_PERM),
+                                                 CACHE_TEST_SIZE, 0);
+  assert(!h->error);
+  for(pageid_t i = 0; i < 8; i++) {
+    cache_fill_block(buf, i, 1);
+    assert(!h->write(h, i * PAGE_SIZE, buf, PAGE_SIZE));
+  }
+  cache_fill_block(buf, 8, 1);
+  assert(!slow->write(slow, 8 * PAGE_SIZE, buf, PAGE_SIZE));
+  assert(!h->admit(h, 8 * PAGE_SIZE, buf, PAGE_SIZE));
+  // admit() queues the block; force() waits for the queue to drain.
+  assert(!h->force(h));
+  cache_fill_block(buf, 8, 2);
+  assert(!slow->write(slow, 8 * PAGE_SIZE, buf, PAGE_SIZE));
+  assert(cache_check_block(h, 8, 1));
+  for(pageid_t i = 0; i < 8; i++) {
+    assert(cache_check_block(h, i, 1));
+    assert(cache_check_block(slow, i, 1));
+  }
+  // A write that races with a queued admission wins.
+  cache_fill_block(buf, 9, 1);
+  assert(!slow->write(slow, 9 * PAGE_SIZE, buf, PAGE_SIZE));
+  assert(!h->admit(h, 9 * PAGE_SIZE, buf, PAGE_SIZE));
+  cache_fill_block(buf, 9, 2);
+  assert(!h->write(h, 9 * PAGE_SIZE, buf, PAGE_SIZE));
+  assert(!h->force(h));
+  assert(cache_check_block(h, 9, 2));
+  h->close(h);
+
+  slow = stasis_handle(open_pfile)(A, O_CREAT | O_RDWR, FILE_PERM);
+  h = stasis_handle_open_cache(slow, stasis_handle(open_pfile)(B, O_CREAT | O_RDWR, FILE_PERM),
+                               CACHE_TEST_SIZE, 0);
+  assert(!h->error);
+  assert(cache_check_block(h, 8, 1));
+  h->close(h);
+  remove(A); remove(B);
+
+  // Write-back: dirty blocks stay in the cache file until they are evicted.
+  slow = stasis_handle(open_pfile)(A, O_CREAT | O_RDWR, FILE_PERM);
+  h = stasis_handle_open_cache(slow, stasis_handle(open_pfile)(B, O_CREAT | O_RDWR, FILE_PERM),
+                               CACHE_TEST_SIZE, 1);
+  assert(!h->error);
+  for(pageid_t i = 0; i < 32; i++) {
+    cache_fill_block(buf, i, 1);
+    assert(!h->write(h, i * PAGE_SIZE, buf, PAGE_SIZE));
+  }
+  assert(slow->end_position(slow) == 0);
+  assert(h->end_position(h) == 32 * PAGE_SIZE);
+  assert(!h->force(h));
+
+  // Take a crash image, then keep going.
+  cache_copy_file(A, A2);
+  cache_copy_file(B, B2);
+  for(pageid_t i = 0; i < 8; i++) {
+    cache_fill_block(buf, i, 2);
+    assert(!h->write(h, i * PAGE_SIZE, buf, PAGE_SIZE));
+  }
+  // More blocks than the cache can hold; dirty blocks are written back as they are evicted.
+  for(pageid_t i = 32; i < 256; i++) {
+    cache_fill_block(buf, i, 1);
+    assert(!h->write(h, i * PAGE_SIZE, buf, PAGE_SIZE));
+  }
+  assert(slow->end_position(slow) > 0);
+  for(pageid_t i = 0; i < 256; i++) {
+    assert(cache_check_block(h, i, i < 8 ? 2 : 1));
+  }
+  h->close(h);
+
+  // A clean shutdown leaves the slow handle up to date.
+  slow = stasis_handle(open_pfile)(A, O_RDWR, FILE_PERM);
+  for(pageid_t i = 0; i < 256; i++) {
+    assert(cache_check_block(slow, i, i < 8 ? 2 : 1));
+  }
+  slow->close(slow);
+
+  // Recover from the crash image.  Nothing had been written to the slow
+  // handle, so all of the data comes from the cache directory.
+  slow = stasis_handle(open_pfile)(A2, O_RDWR, FILE_PERM);
+  h = stasis_handle_open_cache(slow, stasis_handle(open_pfile)(B2, O_RDWR, FILE_PERM),
+                               CACHE_TEST_SIZE, 1);
+  assert(!h->error);
+  assert(h->end_position(h) == 32 * PAGE_SIZE);
+  for(pageid_t i = 0; i < 32; i++) {
+    assert(cache_check_block(h, i, 1));
+  }
+  h->close(h);
+  slow = stasis_handle(open_pfile)(A2, O_RDWR, FILE_PERM);
+  for(pageid_t i = 0; i < 32; i++) {
+    assert(cache_check_block(slow, i, 1));
+  }
+  slow->close(slow);
+
+  remove(A); remove(B); remove(A2); remove(B2);
+} END_TEST
 START_TEST(io_raid0pfileTest) {
   printf("io_raid0pfileTest\n"); fflush(stdout);
   uint32_t stripe_size = PAGE_SIZE;
@@ -539,8 +868,14 @@ Suite * check_suite(void) {
   tcase_add_test(tc, io_memoryTest);
   tcase_add_test(tc, io_fileTest);
   tcase_add_test(tc, io_pfileTest);
+  tcase_add_test(tc, io_uringTest);
   tcase_add_test(tc, io_raid1pfileTest);
   tcase_add_test(tc, io_raid0pfileTest);
+  tcase_add_test(tc, io_cacheTest);
+  tcase_add_test(tc, io_cacheRecoveryTest);
+  tcase_add_test(tc, io_qosTest);
+  tcase_add_test(tc, io_qosPriorityTest);
+  tcase_add_test(tc, io_qosReserveTest);
   //tcase_add_test(tc, io_nonBlockingTest_file);
   //tcase_add_test(tc, io_nonBlockingTest_pfile);
   /* --------------------------------------------- */
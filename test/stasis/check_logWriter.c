@@ -452,6 +452,58 @@ START_TEST(loggerMemCheckThreaded) {
   loggerCheckThreaded(LOG_TO_MEMORY);
 } END_TEST
 
+#define FORCE_THREAD_COUNT 20
+#define FORCE_ENTRIES_PER_THREAD 200
+
+static void * force_worker_thread(void * arg) {
+  int key = *(int*)arg;
+  stasis_log_t * log = stasis_log();
+  lsn_t * lsns = stasis_malloc(FORCE_ENTRIES_PER_THREAD, lsn_t);
+  for(int i = 0; i < FORCE_ENTRIES_PER_THREAD; i++) {
+    LogEntry * le = allocCommonLogEntry(log, -1, key * FORCE_ENTRIES_PER_THREAD + i, XCOMMIT);
+    log->write_entry(log, le);
+    lsns[i] = le->LSN;
+    log->write_entry_done(log, le);
+    stasis_log_force(log, lsns[i], (i & 1) ? LOG_FORCE_WAL : LOG_FORCE_COMMIT);
+    assert(log->first_unstable_lsn(log, (i & 1) ? LOG_FORCE_WAL : LOG_FORCE_COMMIT) > lsns[i]);
+    sched_yield();
+  }
+  for(int i = 0; i < FORCE_ENTRIES_PER_THREAD; i++) {
+    const LogEntry * e = log->read_entry(log, lsns[i]);
+    assert(e);
+    assert(e->xid == key * FORCE_ENTRIES_PER_THREAD + i);
+    log->read_entry_done(log, e);
+  }
+  free(lsns);
+  return 0;
+}
+/**
+   Many threads append and force at once, with a tail buffer smaller
+   than a log entry, so that appends wait for the flusher to swap
+   buffers, and entries straddle them.
+*/
+START_TEST(loggerConcurrentForceTest) {
+  stasis_log_type = LOG_TO_FILE;
+  lsn_t old_buffer_size = stasis_log_file_write_buffer_size;
+  stasis_log_file_write_buffer_size = 16;
+  stasis_log_safe_writes_delete(stasis_log_file_name);
+
+  pthread_t workers[FORCE_THREAD_COUNT];
+  int keys[FORCE_THREAD_COUNT];
+
+  Tinit();
+  for(int i = 0; i < FORCE_THREAD_COUNT; i++) {
+    keys[i] = i;
+    pthread_create(&workers[i], NULL, force_worker_thread, &keys[i]);
+  }
+  for(int i = 0; i < FORCE_THREAD_COUNT; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  Tdeinit();
+
+  stasis_log_file_write_buffer_size = old_buffer_size;
+} END_TEST
+
 void reopenLogWorkload(int truncating) {
   stasis_operation_table_init();
   stasis_truncation_automatic = 0;
@@ -630,6 +682,7 @@ Suite * check_suite(void) {
   if(stasis_log_type != LOG_TO_MEMORY) {
     tcase_add_test(tc, loggerReopenTest);
     tcase_add_test(tc, loggerTruncateReopenTest);
+    tcase_add_test(tc, loggerConcurrentForceTest);
   }
 
   /* --------------------------------------------- */
@@ -55,6 +55,8 @@ terms specified in this license.
 #include <stasis/transactional.h>
 #include <stasis/util/latches.h>
 #include <stasis/util/random.h>
+#include <stasis/util/crc32.h>
+#include <stasis/pageHandle.h>
 
 #include <sched.h>
 #include <assert.h>
@@ -564,6 +566,211 @@ START_TEST(fixedPageThreadTest) {
   pthread_mutex_destroy(&random_mutex);
 } END_TEST
 
+#define OPTIMISTIC_RECORD_SIZE 64
+static volatile int optimistic_done;
+
+static void* optimistic_reader_thread(void * arg_ptr) {
+  Page * p = (Page*)arg_ptr;
+  recordid rid = { p->id, 0, OPTIMISTIC_RECORD_SIZE };
+  byte buf[OPTIMISTIC_RECORD_SIZE];
+  while(!optimistic_done) {
+    if(!stasis_record_read_optimistic(-1, p, rid, buf)) {
+      // The writer fills the record with one value at a time; a torn
+      // read would contain two different values.
+      for(int i = 1; i < OPTIMISTIC_RECORD_SIZE; i++) {
+        assert(buf[i] == buf[0]);
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+    @test Check that optimistic reads fail while the page is write
+    latched, and that they never return a partially written record.
+*/
+START_TEST(pageOptimisticReadTest) {
+  pthread_t workers[THREAD_COUNT];
+  Tinit();
+  Page * p = loadPage(-1, 2);
+  memset(p->memAddr, 0, PAGE_SIZE);
+  stasis_page_slotted_initialize_page(p);
+  p->LSN = 0;
+  *stasis_page_lsn_ptr(p) = p->LSN;
+
+  stasis_page_writelock(p);
+  recordid rid = stasis_record_alloc_begin(-1, p, OPTIMISTIC_RECORD_SIZE);
+  stasis_record_alloc_done(-1, p, rid);
+  byte val[OPTIMISTIC_RECORD_SIZE];
+  memset(val, 42, OPTIMISTIC_RECORD_SIZE);
+  stasis_record_write(-1, p, rid, val);
+
+  byte buf[OPTIMISTIC_RECORD_SIZE];
+  assert(stasis_record_read_optimistic(-1, p, rid, buf));
+  stasis_page_writeunlock(p);
+
+  memset(buf, 0, OPTIMISTIC_RECORD_SIZE);
+  assert(!stasis_record_read_optimistic(-1, p, rid, buf));
+  assert(!memcmp(buf, val, OPTIMISTIC_RECORD_SIZE));
+
+  recordid bad = rid;
+  bad.slot = 10;
+  assert(stasis_record_read_optimistic(-1, p, bad, buf));
+  bad = rid;
+  bad.size = OPTIMISTIC_RECORD_SIZE + 1;
+  assert(stasis_record_read_optimistic(-1, p, bad, buf));
+
+  stasis_page_optimistic_reads = 0;
+  assert(stasis_record_read_optimistic(-1, p, rid, buf));
+  stasis_page_optimistic_reads = 1;
+
+  optimistic_done = 0;
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&workers[i], NULL, optimistic_reader_thread, p);
+  }
+  for(int i = 0; i < 10000; i++) {
+    stasis_page_writelock(p);
+    byte * b = stasis_record_write_begin(-1, p, rid);
+    for(int j = 0; j < OPTIMISTIC_RECORD_SIZE; j++) {
+      b[j] = (byte)i;
+      if(j == OPTIMISTIC_RECORD_SIZE / 2 && !(i % 100)) { sched_yield(); }
+    }
+    stasis_record_write_done(-1, p, rid, b);
+    stasis_page_writeunlock(p);
+  }
+  optimistic_done = 1;
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  assert(!stasis_record_read_optimistic(-1, p, rid, buf));
+  assert(buf[0] == (byte)9999);
+
+  p->LSN = 0;
+  *stasis_page_lsn_ptr(p) = p->LSN;
+  releasePage(p);
+  Tdeinit();
+} END_TEST
+
+/** Bit at a time CRC32C, to check stasis_crc32c() against. */
+static uint32_t reference_crc32c(const byte * buf, size_t len, uint32_t crc) {
+  for(size_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for(int j = 0; j < 8; j++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+/**
+    @test Check stasis_crc32c() against a reference implementation, then
+    check that page checksums catch corruption and misdirected writes.
+*/
+START_TEST(pageChecksumTest) {
+  assert(~stasis_crc32c("123456789", 9, (uint32_t)-1) == 0xE3069283);
+  byte * buf = stasis_malloc(4 * PAGE_SIZE, byte);
+  for(int i = 0; i < 4 * PAGE_SIZE; i++) { buf[i] = (byte)stasis_util_random64(256); }
+  for(int i = 0; i < 200; i++) {
+    size_t off = stasis_util_random64(8);
+    size_t len = stasis_util_random64(3 * PAGE_SIZE);
+    size_t split = len ? stasis_util_random64(len) : 0;
+    uint32_t crc = stasis_crc32c(buf + off, split, (uint32_t)-1);
+    crc = stasis_crc32c(buf + off + split, len - split, crc);
+    assert(crc == reference_crc32c(buf + off, len, (uint32_t)-1));
+  }
+
+  stasis_page_checksums = 1;
+  Tinit();
+  Page * p = loadPage(-1, 3);
+  writelock(p->rwlatch, 0);
+  stasis_page_slotted_initialize_page(p);
+  recordid rid = stasis_record_alloc_begin(-1, p, sizeof(int));
+  stasis_record_alloc_done(-1, p, rid);
+  int val = 42;
+  stasis_record_write(-1, p, rid, (byte*)&val);
+  stasis_page_flushed(p);
+  stasis_page_checksum_update(p);
+  // The checksum shares the type word with the page type.
+  assert((uint32_t)*stasis_page_type_cptr(p) >> 8);
+  assert(stasis_page_type_from_word(*stasis_page_type_cptr(p)) == SLOTTED_PAGE);
+  memcpy(buf, p->memAddr, PAGE_SIZE);
+  assert(!stasis_page_checksum_check(buf, 3, UNKNOWN_TYPE_PAGE));
+  assert(!stasis_page_checksum_check(buf, 3, SLOTTED_PAGE));
+  // The page id is part of the checksum.
+  assert(stasis_page_checksum_check(buf, 4, UNKNOWN_TYPE_PAGE));
+  buf[100] ^= 1;
+  assert(stasis_page_checksum_check(buf, 3, UNKNOWN_TYPE_PAGE));
+  // Callers that know the page has no header never check it.
+  assert(!stasis_page_checksum_check(buf, 3, SEGMENT_PAGE));
+  stasis_page_checksums = 0;
+  assert(!stasis_page_checksum_check(buf, 3, UNKNOWN_TYPE_PAGE));
+  // Pages written with checksums off look like pages from older stores.
+  stasis_page_flushed(p);
+  stasis_page_checksum_update(p);
+  assert(*stasis_page_type_cptr(p) == SLOTTED_PAGE);
+  stasis_page_checksums = 1;
+  memcpy(buf, p->memAddr, PAGE_SIZE);
+  buf[100] ^= 1;
+  assert(!stasis_page_checksum_check(buf, 3, UNKNOWN_TYPE_PAGE));
+  memset(buf, 0, PAGE_SIZE);
+  assert(!stasis_page_checksum_check(buf, 3, UNKNOWN_TYPE_PAGE));
+  unlock(p->rwlatch);
+  releasePage(p);
+  Tdeinit();
+  free(buf);
+  stasis_page_checksums = 0;
+} END_TEST
+
+#define SCRUB_PAGES 20
+/**
+    @test Write some pages, corrupt one of them behind Stasis' back, and
+    check that the scrubber finds it.
+*/
+START_TEST(pageScrubberTest) {
+  stasis_page_checksums = 1;
+  stasis_page_scrubber_pages_per_second = 100000;
+  Tinit();
+  for(int i = 1; i <= SCRUB_PAGES; i++) {
+    Page * p = loadPage(-1, i);
+    writelock(p->rwlatch, 0);
+    stasis_page_slotted_initialize_page(p);
+    recordid rid = stasis_record_alloc_begin(-1, p, sizeof(int));
+    stasis_record_alloc_done(-1, p, rid);
+    stasis_record_write(-1, p, rid, (byte*)&i);
+    stasis_page_lsn_write(-1, p, 0);
+    unlock(p->rwlatch);
+    releasePage(p);
+  }
+  Tdeinit();
+  stasis_page_scrubber_pages_per_second = 0;
+
+  stasis_handle_t * h = stasis_handle_open_file(stasis_store_file_name, O_RDWR, FILE_PERM);
+  byte * buf = stasis_malloc(PAGE_SIZE, byte);
+  assert(!h->read(h, 5 * PAGE_SIZE, buf, PAGE_SIZE));
+  buf[100] ^= 1;
+  assert(!h->write(h, 5 * PAGE_SIZE, buf, PAGE_SIZE));
+  free(buf);
+
+  // Checksums are only checked for registered page types, so bring
+  // Stasis back up, without reloading the corrupt page.
+  Tinit();
+
+  stasis_page_scrubber_t * s = stasis_page_scrubber_open(h, 100000);
+  stasis_page_scrubber_stats_t stats;
+  stasis_page_scrubber_stats(s, &stats);
+  for(int i = 0; i < 1000 && !stats.passes; i++) {
+    usleep(10000);
+    stasis_page_scrubber_stats(s, &stats);
+  }
+  stasis_page_scrubber_close(s);
+  assert(stats.passes);
+  assert(stats.checked >= SCRUB_PAGES);
+  // Page 5 fails once per pass.
+  assert(stats.corrupt >= 1 && stats.corrupt <= (pageid_t)stats.passes + 1);
+  assert(stats.last_corrupt == 5);
+  Tdeinit();
+  stasis_page_checksums = 0;
+} END_TEST
 
 START_TEST(pageCheckSlotTypeTest) {
 	Tinit();
@@ -730,6 +937,9 @@ Suite * check_suite(void) {
   tcase_add_test(tc, pageNoThreadTest);
   tcase_add_test(tc, pageThreadTest);
   tcase_add_test(tc, fixedPageThreadTest);
+  tcase_add_test(tc, pageOptimisticReadTest);
+  tcase_add_test(tc, pageChecksumTest);
+  tcase_add_test(tc, pageScrubberTest);
   tcase_add_test(tc, latchFreeThreadTest);
 
   /* --------------------------------------------- */
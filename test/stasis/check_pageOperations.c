@@ -122,7 +122,7 @@ START_TEST(pageOpCheckRecovery) {
   memset(p.memAddr, 3, USABLE_SIZE_OF_PAGE);
   TpageSetRange(xid, pageid3, 0, p.memAddr, USABLE_SIZE_OF_PAGE);
 
-  byte newAddr[USABLE_SIZE_OF_PAGE];
+  byte newAddr[PAGE_SIZE]; // TpageGet() copies the whole page, header included.
 
   memset(p.memAddr, 1, USABLE_SIZE_OF_PAGE);
   TpageGet(xid, pageid1, newAddr);
@@ -506,6 +506,74 @@ START_TEST (recovery_multiple_xacts) {
   Tdeinit();
 } END_TEST
 
+/**
+   @test
+
+   Crash after a checkpoint that was taken while a transaction was
+   active and some pages were dirty.  Recovery starts from the
+   checkpoint, so it must still roll back the loser, and redo the
+   committed updates to pages that were not written back.
+*/
+START_TEST (recovery_checkpoint) {
+  int xid, loser;
+  recordid rids[10];
+  int j, k;
+
+  Tinit();
+  xid = Tbegin();
+  for(int i = 0; i < 10; i++) {
+    rids[i] = Talloc(xid, sizeof(int));
+    Tset(xid, rids[i], &i);
+  }
+  Tcommit(xid);
+
+  loser = Tbegin();
+  Tincrement(loser, rids[0]);
+  // Write back everything so far; the checkpoint will say so.
+  stasis_dirty_page_table_flush((stasis_dirty_page_table_t*)stasis_runtime_dirty_page_table());
+
+  xid = Tbegin();
+  k = 100;
+  Tset(xid, rids[1], &k);
+  Tcommit(xid);
+  Tincrement(loser, rids[2]);
+
+  assert(Tcheckpoint());
+
+  xid = Tbegin();
+  k = 200;
+  Tset(xid, rids[3], &k);
+  Tcommit(xid);
+  Tincrement(loser, rids[4]);
+
+  TuncleanShutdown();
+  Tinit();
+
+  xid = Tbegin();
+  for(int i = 0; i < 10; i++) {
+    Tread(xid, rids[i], &j);
+    assert(j == (i == 1 ? 100 : (i == 3 ? 200 : i)));
+  }
+  Tcommit(xid);
+  Tdeinit();
+
+  // A checkpoint file that does not point at a checkpoint is ignored.
+  char * name = stasis_truncation_checkpoint_file_name();
+  FILE * f = fopen(name, "w");
+  free(name);
+  lsn_t bogus = LSN_T_MAX - 1;
+  assert(1 == fwrite(&bogus, sizeof(bogus), 1, f));
+  fclose(f);
+
+  Tinit();
+  xid = Tbegin();
+  for(int i = 0; i < 10; i++) {
+    Tread(xid, rids[i], &j);
+    assert(j == (i == 1 ? 100 : (i == 3 ? 200 : i)));
+  }
+  Tcommit(xid);
+  Tdeinit();
+} END_TEST
 
 /**
   Add suite declarations here
@@ -529,6 +597,7 @@ Suite * check_suite(void) {
     tcase_add_test(tc, recovery_clr);
     tcase_add_test(tc, recovery_crash);
     tcase_add_test(tc, recovery_multiple_xacts);
+    tcase_add_test(tc, recovery_checkpoint);
 
     tcase_add_test(tc, recovery_softCommit);
   }
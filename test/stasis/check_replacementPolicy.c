@@ -186,6 +186,14 @@ START_TEST(replacementPolicyClockRandomTest) {
   lru->deinit(lru);
   randomTeardown();
 } END_TEST
+START_TEST(replacementPolicy2QRandomTest) {
+  threaded = 0;
+  randomSetup();
+  replacementPolicy * lru = stasis_replacement_policy_2q_init(OBJECT_COUNT);
+  randomTest(lru, SHORT_COUNT);
+  lru->deinit(lru);
+  randomTeardown();
+} END_TEST
 replacementPolicy * worker_lru;
 unsigned long worker_count;
 void * randomTestWorker(void * arg) {
@@ -250,6 +258,202 @@ START_TEST(replacementPolicyClockThreadTest) {
   randomTeardown();
 } END_TEST
 
+START_TEST(replacementPolicyConcurrent2QThreadTest) {
+  int LRU_COUNT = OBJECT_COUNT / 51;
+  replacementPolicy ** lru = stasis_alloca(LRU_COUNT,replacementPolicy*);
+  for(int i = 0; i < LRU_COUNT; i++) {
+    lru[i] = stasis_replacement_policy_2q_init(OBJECT_COUNT / LRU_COUNT);
+  }
+  replacementPolicy * cwLru = replacementPolicyConcurrentWrapperInit(lru, LRU_COUNT);
+  threaded = 1;
+  worker_lru = cwLru;
+  worker_count = SHORT_COUNT / THREAD_COUNT;
+  pthread_t *threads = stasis_alloca(THREAD_COUNT, pthread_t);
+  randomSetup();
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&threads[i], 0, randomTestWorker, 0);
+  }
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(threads[i], 0);
+  }
+
+  cwLru->deinit(cwLru);
+  randomTeardown();
+} END_TEST
+
+static replacementPolicy * numaInit(void) {
+  replacementPolicy * nodes[2];
+  for(int i = 0; i < 2; i++) {
+    nodes[i] = replacementPolicyThreadsafeWrapperInit(lruFastInit());
+  }
+  return stasis_replacement_policy_numa_init(nodes, 2, pages, OBJECT_COUNT / 2, OBJECT_COUNT);
+}
+START_TEST(replacementPolicyNUMAThreadTest) {
+  randomSetup();
+  replacementPolicy * numaLru = numaInit();
+  threaded = 1;
+  worker_lru = numaLru;
+  worker_count = SHORT_COUNT / THREAD_COUNT;
+  pthread_t *threads = stasis_alloca(THREAD_COUNT, pthread_t);
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&threads[i], 0, randomTestWorker, 0);
+  }
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(threads[i], 0);
+  }
+
+  numaLru->deinit(numaLru);
+  randomTeardown();
+} END_TEST
+/**
+   A thread that prefers node 1 should drain node 1 before it takes
+   pages from node 0.
+*/
+START_TEST(replacementPolicyNUMAPreferenceTest) {
+  randomSetup();
+  replacementPolicy * rp = numaInit();
+  for(int i = 0; i < OBJECT_COUNT; i++) {
+    rp->insert(rp, &pages[i]);
+  }
+  stasis_replacement_policy_numa_prefer_node(rp, 1);
+  for(int i = 0; i < OBJECT_COUNT; i++) {
+    Page * p = rp->getStaleAndRemove(rp);
+    assert(p);
+    if(i < OBJECT_COUNT / 2) {
+      assert(p->id >= OBJECT_COUNT / 2);
+    } else {
+      assert(p->id < OBJECT_COUNT / 2);
+    }
+  }
+  assert(!rp->getStaleAndRemove(rp));
+  stasis_replacement_policy_numa_prefer_node(rp, -1);
+
+  stasis_replacement_policy_numa_stats_t stats;
+  assert(2 == stasis_replacement_policy_numa_stats(rp, 0, &stats));
+  assert(stats.frames == OBJECT_COUNT / 2);
+  assert(stats.local_evictions == 0);
+  assert(stats.remote_evictions == OBJECT_COUNT / 2);
+  assert(2 == stasis_replacement_policy_numa_stats(rp, 1, &stats));
+  assert(stats.local_evictions == OBJECT_COUNT / 2);
+  assert(stats.remote_evictions == 0);
+
+  rp->deinit(rp);
+  randomTeardown();
+} END_TEST
+
+#define SCAN_CACHE_SIZE 16
+#define SCAN_HOT_COUNT  4
+#define SCAN_LENGTH     1000
+
+/** Mimic the buffer manager: pin and unpin id, reusing a victim's frame if necessary. */
+static void scanAccess(replacementPolicy *rp, Page *frames, Page **resident,
+                       int *residentCount, int id) {
+  Page *p = resident[id];
+  if(p) {
+    assert(p == rp->remove(rp, p));
+  } else {
+    if(*residentCount == SCAN_CACHE_SIZE) {
+      p = rp->getStaleAndRemove(rp);
+      assert(p);
+      resident[p->id] = NULL;
+    } else {
+      p = &frames[(*residentCount)++];
+      p->pinCount = 1;
+    }
+    p->id = id;
+    resident[id] = p;
+  }
+  rp->insert(rp, p);
+}
+/**
+   Load a hot set twice, so that it is admitted to 2Q's main queue, then
+   run a long sequential scan.  The scan should only displace other scan
+   pages.
+*/
+START_TEST(replacementPolicy2QScanResistanceTest) {
+  int page_count = SCAN_HOT_COUNT + 2 * SCAN_CACHE_SIZE + SCAN_LENGTH;
+  Page *frames = stasis_calloc(SCAN_CACHE_SIZE, Page);
+  Page **resident = stasis_calloc(page_count, Page*);
+  int residentCount = 0;
+  replacementPolicy *rp = stasis_replacement_policy_2q_init(SCAN_CACHE_SIZE);
+  int next = SCAN_HOT_COUNT;
+  for(int i = 0; i < SCAN_HOT_COUNT; i++) {
+    scanAccess(rp, frames, resident, &residentCount, i);
+  }
+  // Push the hot set out of the cache once.
+  for(int i = 0; i < SCAN_CACHE_SIZE; i++) {
+    scanAccess(rp, frames, resident, &residentCount, next++);
+  }
+  for(int i = 0; i < SCAN_HOT_COUNT; i++) {
+    assert(!resident[i]);
+    scanAccess(rp, frames, resident, &residentCount, i);
+  }
+  while(next < page_count) {
+    scanAccess(rp, frames, resident, &residentCount, next++);
+  }
+  for(int i = 0; i < SCAN_HOT_COUNT; i++) {
+    assert(resident[i]);
+  }
+  rp->deinit(rp);
+  free(resident);
+  free(frames);
+} END_TEST
+
+/**
+   Cancel an eviction from A1in.  The page should go back to A1in, not be
+   promoted to Am, so the pages leave in FIFO order.
+*/
+START_TEST(replacementPolicy2QCancelledEvictionTest) {
+  Page cancelPages[6];
+  memset(cancelPages, 0, sizeof(cancelPages));
+  replacementPolicy *rp = stasis_replacement_policy_2q_init(8);
+  for(int i = 0; i < 6; i++) {
+    cancelPages[i].id = i;
+    cancelPages[i].pinCount = 1;
+    rp->insert(rp, &cancelPages[i]);
+  }
+  Page *victim = rp->getStaleAndRemove(rp);
+  assert(victim == &cancelPages[0]);
+  rp->insert(rp, victim);
+  for(int i = 1; i <= 6; i++) {
+    victim = rp->getStaleAndRemove(rp);
+    assert(victim == &cancelPages[i % 6]);
+  }
+  assert(!rp->getStaleAndRemove(rp));
+  rp->deinit(rp);
+} END_TEST
+
+/**
+   Evict a page, and reuse its frame for another page.  The new page is
+   not a cancelled eviction, and the old page is promoted to Am when it is
+   re-read into a different frame.
+*/
+START_TEST(replacementPolicy2QRetaggedFrameTest) {
+  Page retagPages[7];
+  memset(retagPages, 0, sizeof(retagPages));
+  replacementPolicy *rp = stasis_replacement_policy_2q_init(8);
+  for(int i = 0; i < 6; i++) {
+    retagPages[i].id = i;
+    retagPages[i].pinCount = 1;
+    rp->insert(rp, &retagPages[i]);
+  }
+  Page *victim = rp->getStaleAndRemove(rp);
+  assert(victim == &retagPages[0]);
+  victim->id = 100;
+  rp->insert(rp, victim);
+  retagPages[6].id = 0;
+  retagPages[6].pinCount = 1;
+  rp->insert(rp, &retagPages[6]);
+  // A1in holds 1-5 and 100; it is over its share of the pool until 1-4
+  // are gone.  Then page 0 is the only page in Am.
+  for(int i = 1; i <= 4; i++) {
+    victim = rp->getStaleAndRemove(rp);
+    assert(victim == &retagPages[i]);
+  }
+  victim = rp->getStaleAndRemove(rp);
+  assert(victim == &retagPages[6]);
+  rp->deinit(rp);
+} END_TEST
 
 START_TEST(replacementPolicyEmptyFastLRUTest) {
   randomSetup();
@@ -278,6 +482,13 @@ START_TEST(replacementPolicyEmptyConcurrentTest) {
   rp->deinit(rp);
   randomTeardown();
 } END_TEST
+START_TEST(replacementPolicyEmpty2QTest) {
+  randomSetup();
+  replacementPolicy *rp  = stasis_replacement_policy_2q_init(OBJECT_COUNT);
+  fillThenEmptyTest(rp);
+  rp->deinit(rp);
+  randomTeardown();
+} END_TEST
 START_TEST(replacementPolicyEmptyClockTest) {
   randomSetup();
   replacementPolicy *rp  = replacementPolicyClockInit(pages, OBJECT_COUNT);
@@ -295,14 +506,22 @@ Suite * check_suite(void) {
   tcase_add_test(tc, replacementPolicyEmptyThreadsafeTest);
   tcase_add_test(tc, replacementPolicyEmptyConcurrentTest);
   tcase_add_test(tc, replacementPolicyEmptyClockTest);
+  tcase_add_test(tc, replacementPolicyEmpty2QTest);
+  tcase_add_test(tc, replacementPolicy2QScanResistanceTest);
+  tcase_add_test(tc, replacementPolicy2QCancelledEvictionTest);
+  tcase_add_test(tc, replacementPolicy2QRetaggedFrameTest);
   tcase_add_test(tc, replacementPolicyLRURandomTest);
   tcase_add_test(tc, replacementPolicyLRUFastRandomTest);
   tcase_add_test(tc, replacementPolicyThreadsafeRandomTest);
   tcase_add_test(tc, replacementPolicyConcurrentRandomTest);
   tcase_add_test(tc, replacementPolicyClockRandomTest);
+  tcase_add_test(tc, replacementPolicy2QRandomTest);
   tcase_add_test(tc, replacementPolicyThreadsafeThreadTest);
   tcase_add_test(tc, replacementPolicyConcurrentThreadTest);
   tcase_add_test(tc, replacementPolicyClockThreadTest);
+  tcase_add_test(tc, replacementPolicyConcurrent2QThreadTest);
+  tcase_add_test(tc, replacementPolicyNUMAPreferenceTest);
+  tcase_add_test(tc, replacementPolicyNUMAThreadTest);
 
 
   /* --------------------------------------------- */
@@ -44,6 +44,13 @@ static char * logEntryToString(const LogEntry * le) {
 
     }
     break;
+  case CHECKPOINTLOG:
+    {
+      const CheckpointLogEntry * cp = getCheckpoint(le);
+      err = asprintf(&ret, "CHKPT\tlsn=%9lld\tbegin=%9lld\tdirty=%lld\txacts=%lld\n", le->LSN,
+               cp->begin_lsn, (long long)cp->page_count, (long long)cp->xact_count);
+    }
+    break;
   case XEND:
     {
       err = asprintf(&ret, "END  \tlsn=%9lld\tprevlsn=%9lld\txid=%4d\n", le->LSN, le->prevLSN, le->xid);